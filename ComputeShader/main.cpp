@@ -22,118 +22,289 @@
 #include <array>
 #include <optional>
 #include <set>
-#include <random>
+#include <string>
+#include <ctime>
+
+#include "benchmark.h"
+#include "device_allocator.h"
+#include "frame_graph.h"
+#include "frame_pacing.h"
+#include "gpu_profiler.h"
+#include "offscreen_targets.h"
+#include "pipeline_cache.h"
+#include "pipeline_registry.h"
+#include "pipeline_reloader.h"
+#include "shader_reloader.h"
+#include "staging_ring.h"
+#include "vulkan_bootstrap.h"
 
 constexpr uint32_t width = 800;
 constexpr uint32_t height = 600;
 
-constexpr uint32_t particle_count = 8192;
+// Written on exit and validated against the device and driver on the next launch.
+const std::string pipeline_cache_path = "pipeline.cache";
 
-constexpr int max_frames_in_flight = 2;
+// Runs the simulation on a dedicated compute family when the device has one, one frame ahead of
+// the frame that draws it, so the dispatch overlaps the raster work instead of preceding it.
+constexpr bool ASYNC_COMPUTE = true;
 
-const std::vector<const char*> validation_layers = {
-    "VK_LAYER_KHRONOS_validation"
-};
+// Size of the particle pool and how long particles live. The pool is allocated at this size and
+// the emission rate keeps it about full; everything else is decided on the GPU.
+struct ParticleSettings {
+    static constexpr uint32_t max_pool_size = 1u << 24;
 
-const std::vector<const char*> device_extensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
-};
+    uint32_t max_particles = 1u << 20;
+    float mean_lifetime = 4.0f;
 
-#ifdef NDEBUG
-const bool enableValidationLayers = false;
-#else
-const bool enable_validation_layers = true;
-#endif
+    // Invocations per workgroup of the particle passes, a specialization constant of their shaders.
+    uint32_t workgroup_size = 256;
 
-VkResult create_debug_utils_messenger_ext(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* create_info, const VkAllocationCallbacks* allocator, VkDebugUtilsMessengerEXT* debug_messenger) {
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        return func(instance, create_info, allocator, debug_messenger);
-    }
-    else {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    // Particles closer than this flock and collide. Sets the cell size of the neighbor grid.
+    float interaction_radius = 0.02f;
+
+    // Throws unless count is between 1 and max_pool_size; option names where count came from.
+    static void validate_max_particles(uint32_t count, const std::string& option) {
+        if (count < 1 || count > max_pool_size) {
+            throw std::runtime_error("particles: " + option + " must be between 1 and " + std::to_string(max_pool_size));
+        }
     }
-}
 
-void destroy_debug_utils_messenger_ext(VkInstance instance, VkDebugUtilsMessengerEXT debug_messenger, const VkAllocationCallbacks* allocator) {
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        func(instance, debug_messenger, allocator);
+    // --max-particles=N, --particle-workgroup-size=N
+    static ParticleSettings from_command_line(int argc, char** argv) {
+        ParticleSettings settings;
+
+        auto parse_count = [](const std::string& argument, const std::string& prefix, unsigned long min, unsigned long max) {
+            unsigned long count = 0;
+            try {
+                count = std::stoul(argument.substr(prefix.size()));
+            }
+            catch (const std::exception&) {
+                count = 0;
+            }
+
+            if (count < min || count > max) {
+                throw std::runtime_error("particles: " + prefix.substr(0, prefix.size() - 1) + " must be between " +
+                    std::to_string(min) + " and " + std::to_string(max));
+            }
+            return static_cast<uint32_t>(count);
+        };
+
+        for (int i = 1; i < argc; i++) {
+            std::string argument = argv[i];
+
+            if (argument.rfind("--max-particles=", 0) == 0) {
+                settings.max_particles = parse_count(argument, "--max-particles=", 1, max_pool_size);
+            }
+            else if (argument.rfind("--particle-workgroup-size=", 0) == 0) {
+                settings.workgroup_size = parse_count(argument, "--particle-workgroup-size=", 32, 1024);
+                if ((settings.workgroup_size & (settings.workgroup_size - 1)) != 0) {
+                    throw std::runtime_error("particles: --particle-workgroup-size must be a power of two");
+                }
+            }
+        }
+
+        return settings;
     }
-}
+};
 
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphics_and_compute_family;
     std::optional<uint32_t> present_family;
 
+    // A transfer-only family if the device has one, the graphics family otherwise.
+    std::optional<uint32_t> transfer_family;
+
+    // A compute family without graphics if async compute is on and the device has one, the
+    // graphics family otherwise.
+    std::optional<uint32_t> compute_family;
+
     bool is_complete() {
         return graphics_and_compute_family.has_value() && present_family.has_value();
     }
 };
 
-struct SwapChainSupportDetails {
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> present_modes;
-};
-
 struct UniformBufferObject {
     float delta_time = 1.0f;
+    float delta_seconds = 0.0f;
+    float mean_lifetime = 0.0f;
+    uint32_t emit_count = 0;
+    uint32_t max_particles = 0;
+    uint32_t seed = 0;
+    float interaction_radius = 0.0f;
+    float cell_size = 0.0f;
+    uint32_t grid_dim = 0;
 };
 
+// Particles live in fixed slots of a pool, stored as separate streams, one buffer and vertex
+// binding each. Motion and life are rewritten by every update and double as the ring of states;
+// the color is written once when a particle is emitted. The alive list of each state holds the
+// slots in use and doubles as the index buffer of the draw.
 struct Particle {
-    glm::vec2 position;
-    glm::vec2 velocity;
-    glm::vec4 color;
+    struct Motion {
+        glm::vec2 position;
+        glm::vec2 velocity;
+    };
+    using Life = float;
+
+    // RGBA8.
+    using Color = uint32_t;
 
-    static VkVertexInputBindingDescription get_binding_description() {
-        VkVertexInputBindingDescription binding_description{};
-        binding_description.binding = 0;
-        binding_description.stride = sizeof(Particle);
-        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static constexpr uint32_t motion_binding = 0;
+    static constexpr uint32_t life_binding = 1;
+    static constexpr uint32_t color_binding = 2;
 
-        return binding_description;
+    static std::array<VkVertexInputBindingDescription, 3> get_binding_descriptions() {
+        std::array<VkVertexInputBindingDescription, 3> binding_descriptions{};
+
+        binding_descriptions[0].binding = motion_binding;
+        binding_descriptions[0].stride = sizeof(Motion);
+        binding_descriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        binding_descriptions[1].binding = life_binding;
+        binding_descriptions[1].stride = sizeof(Life);
+        binding_descriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        binding_descriptions[2].binding = color_binding;
+        binding_descriptions[2].stride = sizeof(Color);
+        binding_descriptions[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return binding_descriptions;
     }
 
-    static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions() {
-        std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+    static std::array<VkVertexInputAttributeDescription, 3> get_attribute_descriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attribute_descriptions{};
 
-        attribute_descriptions[0].binding = 0;
+        attribute_descriptions[0].binding = motion_binding;
         attribute_descriptions[0].location = 0;
         attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-        attribute_descriptions[0].offset = offsetof(Particle, position);
+        attribute_descriptions[0].offset = offsetof(Motion, position);
 
-        attribute_descriptions[1].binding = 0;
+        attribute_descriptions[1].binding = life_binding;
         attribute_descriptions[1].location = 1;
-        attribute_descriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attribute_descriptions[1].offset = offsetof(Particle, color);
+        attribute_descriptions[1].format = VK_FORMAT_R32_SFLOAT;
+        attribute_descriptions[1].offset = 0;
+
+        attribute_descriptions[2].binding = color_binding;
+        attribute_descriptions[2].location = 2;
+        attribute_descriptions[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attribute_descriptions[2].offset = 0;
 
         return attribute_descriptions;
     }
 };
 
+// Mirrors ParticleCounts in shaders/particle_common.glsl: the indirect arguments of the next
+// update and of the draw, followed by the number of live particles. Written only by the GPU.
+struct ParticleCounts {
+    VkDispatchIndirectCommand dispatch;
+    VkDrawIndexedIndirectCommand draw;
+    uint32_t alive_count;
+};
+
+// Header of the free slot stack, followed by max_particles slots.
+struct ParticlePoolHeader {
+    int32_t free_count;
+    uint32_t high_water;
+};
+
+// Header of a retired slot list, followed by max_particles slots. The dispatch recycles them.
+struct RetiredSlotsHeader {
+    VkDispatchIndirectCommand dispatch;
+    uint32_t count;
+};
+
+// The GlslShader items of ComputeShader.vcxproj; keep the two in step.
+std::vector<ShaderReloader::Source> shader_sources() {
+    return {
+        { "shaders/particle_hash.comp", "shaders/particle_hash.comp.spv", {} },
+        { "shaders/particle_scan.comp", "shaders/particle_scan.comp.spv", {} },
+        { "shaders/particle_scatter.comp", "shaders/particle_scatter.comp.spv", {} },
+        { "shaders/particle_system.comp", "shaders/particle_system.comp.spv", {} },
+        { "shaders/particle_recycle.comp", "shaders/particle_recycle.comp.spv", {} },
+        { "shaders/particle_emit.comp", "shaders/particle_emit.comp.spv", {} },
+        { "shaders/particle_args.comp", "shaders/particle_args.comp.spv", {} },
+        { "shaders/particle_system.frag", "shaders/particle_system.frag.spv", {} },
+        { "shaders/particle_system.vert", "shaders/particle_system.vert.spv", {} },
+    };
+}
+
 class ComputeShaderApplication {
 public:
-    void run() {
+    void run(const FramePacing& pacing, const ParticleSettings& particles, const ShaderReloadSettings& shader_reload,
+        const GpuProfilerOptions& profiling) {
+        this->pacing = pacing;
+        frames_in_flight = pacing.frames_in_flight;
+        this->particles = particles;
+        this->profiling = profiling;
+
         init_window();
         init_vulkan();
+        if (shader_reload.enabled) {
+            shader_reloader.init(shader_sources());
+        }
         main_loop();
         cleanup();
     }
 
+    // Offscreen, without a window; see BenchmarkSettings. The simulation steps a fixed 60 Hz
+    // frame time so every run emits and moves the same particles.
+    BenchmarkRun run_benchmark(const FramePacing& pacing, const ParticleSettings& particles, const GpuProfilerOptions& profiling,
+        const BenchmarkSettings& settings) {
+        this->pacing = pacing;
+        frames_in_flight = pacing.frames_in_flight;
+        this->particles = particles;
+        this->profiling = profiling;
+        headless = true;
+
+        init_vulkan();
+
+        BenchmarkRun run;
+        run.config = { { "frames_in_flight", frames_in_flight }, { "max_particles", particles.max_particles },
+            { "async_compute", async_compute ? 1u : 0u }, { "width", width }, { "height", height } };
+        run_benchmark_frames(settings, logical_device, gpu_profiler, startup, run, [this](float frame_delta_ms) {
+            last_frame_time = frame_delta_ms;
+            draw_frame();
+        });
+        run.startup_ms = startup.phases();
+        run.add_gpu_scopes(gpu_profiler);
+        run.add_allocator_stats(allocator.stats());
+        run.memory_bytes.emplace_back("offscreen", offscreen_targets.memory_bytes());
+
+        cleanup();
+        return run;
+    }
+
 private:
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;
+
+    // No window, surface or swap chain; frames go to offscreen_targets and are never presented.
+    bool headless = false;
+    OffscreenTargets offscreen_targets;
+    PhaseTimer startup;
+
+    FramePacing pacing;
+    uint32_t frames_in_flight = 2;
+    ParticleSettings particles;
+    GpuProfilerOptions profiling;
+    PresentWaiter present_waiter;
 
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debug_messenger;
+    VulkanInstance instance;
     VkSurfaceKHR surface;
 
     VkPhysicalDevice physical_device = VK_NULL_HANDLE;
     VkDevice logical_device;
+    DeviceAllocator allocator;
+    StagingRing uploader;
+    PipelineCache pipeline_cache;
+    PipelineRegistry pipelines;
+    ShaderReloader shader_reloader;
+    PipelineReloader pipeline_reloader;
+    GpuProfiler gpu_profiler;
 
     VkQueue graphics_queue;
     VkQueue compute_queue;
     VkQueue present_queue;
+    VkQueue transfer_queue;
 
     VkSwapchainKHR swap_chain;
     std::vector<VkImage> swap_chain_images;
@@ -144,19 +315,83 @@ private:
 
     VkRenderPass render_pass;
     VkPipelineLayout pipeline_layout;
-    VkPipeline graphics_pipeline;
+    PipelineHandle graphics_pipeline_handle;
+    VkPipeline graphics_pipeline = VK_NULL_HANDLE;
 
     VkDescriptorSetLayout compute_descriptor_set_layout;
     VkPipelineLayout compute_pipeline_layout;
-    VkPipeline compute_pipeline;
+    PipelineHandle compute_pipeline_handle;
+    PipelineHandle recycle_pipeline_handle;
+    PipelineHandle hash_pipeline_handle;
+    PipelineHandle scan_pipeline_handle;
+    PipelineHandle scatter_pipeline_handle;
+    PipelineHandle emit_pipeline_handle;
+    PipelineHandle args_pipeline_handle;
+    VkPipeline compute_pipeline = VK_NULL_HANDLE;
+    VkPipeline recycle_pipeline = VK_NULL_HANDLE;
+    VkPipeline hash_pipeline = VK_NULL_HANDLE;
+    VkPipeline scan_pipeline = VK_NULL_HANDLE;
+    VkPipeline scatter_pipeline = VK_NULL_HANDLE;
+    VkPipeline emit_pipeline = VK_NULL_HANDLE;
+    VkPipeline args_pipeline = VK_NULL_HANDLE;
 
     VkCommandPool command_pool;
-
-    std::vector<VkBuffer> shader_storage_buffers;
-    std::vector<VkDeviceMemory> shader_storage_buffers_memory;
+    VkCommandPool compute_command_pool;
+
+    // Set when the simulation runs on its own queue family; the particle buffers then change
+    // owners between the two queues every frame.
+    bool async_compute = false;
+    uint32_t graphics_family = 0;
+    uint32_t compute_family = 0;
+
+    // Everything one update writes: the changing streams, the alive list and its counts, which
+    // change owners in async mode, and the slots that died, which stay on the compute queue.
+    struct ParticleState {
+        VkBuffer motion = VK_NULL_HANDLE;
+        Allocation motion_allocation;
+        VkBuffer life = VK_NULL_HANDLE;
+        Allocation life_allocation;
+        VkBuffer alive = VK_NULL_HANDLE;
+        Allocation alive_allocation;
+        VkBuffer counts = VK_NULL_HANDLE;
+        Allocation counts_allocation;
+        VkBuffer retired = VK_NULL_HANDLE;
+        Allocation retired_allocation;
+    };
+
+    // Ring of particle states. Dispatch f reads state f - 1 and writes state f, so even a single
+    // frame in flight needs two. In async mode the frame f draws state f - 2 while dispatch f
+    // runs, which takes a ring of at least three.
+    uint32_t particle_buffer_count = 0;
+    std::vector<ParticleState> particle_states;
+
+    // Written by emission only, read by the draw. Shared by both queues: a slot is only reused
+    // once no frame in flight can draw it (see record_compute_command_buffer).
+    VkBuffer particle_color_buffer;
+    Allocation particle_color_allocation;
+
+    // Free slot stack, compute queue only.
+    VkBuffer particle_pool_buffer;
+    Allocation particle_pool_allocation;
+
+    // Neighbor grid, rebuilt by every update before it runs; compute queue only. Cells are at
+    // least the interaction radius wide over the [-1, 1] window.
+    uint32_t grid_dim = 0;
+    VkBuffer cell_count_buffer;
+    Allocation cell_count_allocation;
+    VkBuffer cell_start_buffer;
+    Allocation cell_start_allocation;
+    VkBuffer particle_cell_buffer;
+    Allocation particle_cell_allocation;
+    VkBuffer sorted_motion_buffer;
+    Allocation sorted_motion_allocation;
+
+    // Fraction of a particle carried over to the next frame's emission.
+    float emission_budget = 0.0f;
+    uint32_t launch_seed = 0;
 
     std::vector<VkBuffer> uniform_buffers;
-    std::vector<VkDeviceMemory> uniform_buffers_memory;
+    std::vector<Allocation> uniform_buffer_allocations;
     std::vector<void*> uniform_buffers_mapped;
 
     VkDescriptorPool descriptor_pool;
@@ -165,11 +400,13 @@ private:
     std::vector<VkCommandBuffer> command_buffers;
     std::vector<VkCommandBuffer> compute_command_buffers;
 
+    // Binary semaphores only remain for acquire and present; everything else is ordered by the
+    // frame graph's timelines.
     std::vector<VkSemaphore> image_available_semaphores;
     std::vector<VkSemaphore> render_finished_semaphores;
-    std::vector<VkSemaphore> compute_finished_semaphores;
-    std::vector<VkFence> in_flight_fences;
-    std::vector<VkFence> compute_in_flight_fences;
+    FrameGraph frame_graph;
+    uint32_t compute_pass = 0;
+    uint32_t graphics_pass = 0;
     uint32_t current_frame = 0;
 
     float last_frame_time = 0.0f;
@@ -177,6 +414,7 @@ private:
     bool framebuffer_resized = false;
 
     double last_time = 0.0f;
+    double last_title_time = 0.0;
 
     void init_window() {
         glfwInit();
@@ -196,39 +434,77 @@ private:
     }
 
     void init_vulkan() {
+        startup.begin("instance");
         create_instance();
-        setup_debug_messenger();
-        create_surface();
-        pick_physical_device();
+        if (!headless) {
+            surface = create_surface(instance.handle(), window, glfwCreateWindowSurface);
+        }
+        startup.begin("device");
+        physical_device = pick_physical_device(instance.handle(), [this](VkPhysicalDevice device) { return is_device_suitable(device); });
         create_logical_device();
+        startup.begin("swap_chain");
         create_swap_chain();
         create_image_views();
         create_render_pass();
+        startup.begin("pipelines");
         create_compute_descriptor_set_layout();
         create_graphics_pipeline();
         create_compute_pipeline();
+        startup.begin("resources");
         create_framebuffers();
         create_command_pool();
         create_shader_storage_buffers();
+
+        // The compute queue is not ordered with the upload's destination (graphics) queue, so the
+        // first dispatch must not be submitted before the initial particles are there.
+        uint64_t particle_upload = uploader.submit();
+        if (async_compute) {
+            uploader.wait(particle_upload);
+        }
         create_uniform_buffers();
         create_descriptor_pool();
         create_compute_descriptor_sets();
+        // The pipelines have been compiling on the registry threads while the resources were created.
+        graphics_pipeline = graphics_pipeline_handle.get();
+        compute_pipeline = compute_pipeline_handle.get();
+        recycle_pipeline = recycle_pipeline_handle.get();
+        hash_pipeline = hash_pipeline_handle.get();
+        scan_pipeline = scan_pipeline_handle.get();
+        scatter_pipeline = scatter_pipeline_handle.get();
+        emit_pipeline = emit_pipeline_handle.get();
+        args_pipeline = args_pipeline_handle.get();
         create_command_buffers();
         create_compute_command_buffers();
         create_sync_objects();
+        startup.end();
+
+        allocator.print_stats(log());
+    }
+
+    // Headless runs keep stdout for the benchmark report.
+    std::ostream& log() {
+        return headless ? std::cerr : std::cout;
     }
 
     void main_loop() {
         while (!glfwWindowShouldClose(window)) {
+            // In low-latency mode input is only sampled once the previous frame is on screen.
+            present_waiter.wait_for_last_present();
             glfwPollEvents();
             draw_frame();
             // We want to animate the particle system using the last frames time to get smooth, frame-rate independent animation
             double current_time = glfwGetTime();
             last_frame_time = (current_time - last_time) * 1000.0;
             last_time = current_time;
+
+            if (current_time - last_title_time >= 1.0) {
+                glfwSetWindowTitle(window, ("Vulkan | " + gpu_profiler.summary()).c_str());
+                last_title_time = current_time;
+            }
         }
 
         vkDeviceWaitIdle(logical_device);
+        std::cout << gpu_profiler.report();
     }
 
     void cleanup_swap_chain() {
@@ -240,56 +516,72 @@ private:
             vkDestroyImageView(logical_device, image_view, nullptr);
         }
 
+        if (headless) {
+            offscreen_targets.cleanup();
+            return;
+        }
+
         vkDestroySwapchainKHR(logical_device, swap_chain, nullptr);
     }
 
     void cleanup() {
         cleanup_swap_chain();
 
-        vkDestroyPipeline(logical_device, graphics_pipeline, nullptr);
+        shader_reloader.cleanup();
+        pipeline_reloader.cleanup();
+        pipelines.cleanup();
         vkDestroyPipelineLayout(logical_device, pipeline_layout, nullptr);
-
-        vkDestroyPipeline(logical_device, compute_pipeline, nullptr);
         vkDestroyPipelineLayout(logical_device, compute_pipeline_layout, nullptr);
 
         vkDestroyRenderPass(logical_device, render_pass, nullptr);
 
-        for (size_t i = 0; i < max_frames_in_flight; i++) {
-            vkDestroyBuffer(logical_device, uniform_buffers[i], nullptr);
-            vkFreeMemory(logical_device, uniform_buffers_memory[i], nullptr);
+        for (size_t i = 0; i < particle_buffer_count; i++) {
+            allocator.destroy_buffer(uniform_buffers[i], uniform_buffer_allocations[i]);
         }
 
         vkDestroyDescriptorPool(logical_device, descriptor_pool, nullptr);
 
         vkDestroyDescriptorSetLayout(logical_device, compute_descriptor_set_layout, nullptr);
 
-        for (size_t i = 0; i < max_frames_in_flight; i++) {
-            vkDestroyBuffer(logical_device, shader_storage_buffers[i], nullptr);
-            vkFreeMemory(logical_device, shader_storage_buffers_memory[i], nullptr);
-        }
-
-        for (size_t i = 0; i < max_frames_in_flight; i++) {
+        for (auto& state : particle_states) {
+            allocator.destroy_buffer(state.motion, state.motion_allocation);
+            allocator.destroy_buffer(state.life, state.life_allocation);
+            allocator.destroy_buffer(state.alive, state.alive_allocation);
+            allocator.destroy_buffer(state.counts, state.counts_allocation);
+            allocator.destroy_buffer(state.retired, state.retired_allocation);
+        }
+        allocator.destroy_buffer(particle_color_buffer, particle_color_allocation);
+        allocator.destroy_buffer(particle_pool_buffer, particle_pool_allocation);
+        allocator.destroy_buffer(cell_count_buffer, cell_count_allocation);
+        allocator.destroy_buffer(cell_start_buffer, cell_start_allocation);
+        allocator.destroy_buffer(particle_cell_buffer, particle_cell_allocation);
+        allocator.destroy_buffer(sorted_motion_buffer, sorted_motion_allocation);
+
+        for (size_t i = 0; i < frames_in_flight; i++) {
             vkDestroySemaphore(logical_device, render_finished_semaphores[i], nullptr);
             vkDestroySemaphore(logical_device, image_available_semaphores[i], nullptr);
-            vkDestroySemaphore(logical_device, compute_finished_semaphores[i], nullptr);
-            vkDestroyFence(logical_device, in_flight_fences[i], nullptr);
-            vkDestroyFence(logical_device, compute_in_flight_fences[i], nullptr);
         }
+        frame_graph.cleanup();
 
+        vkDestroyCommandPool(logical_device, compute_command_pool, nullptr);
         vkDestroyCommandPool(logical_device, command_pool, nullptr);
 
+        uploader.cleanup();
+        gpu_profiler.cleanup();
+        allocator.cleanup();
+        pipeline_cache.cleanup();
         vkDestroyDevice(logical_device, nullptr);
 
-        if (enable_validation_layers) {
-            destroy_debug_utils_messenger_ext(instance, debug_messenger, nullptr);
+        if (!headless) {
+            vkDestroySurfaceKHR(instance.handle(), surface, nullptr);
         }
+        instance.cleanup();
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
+        if (!headless) {
+            glfwDestroyWindow(window);
 
-        glfwDestroyWindow(window);
-
-        glfwTerminate();
+            glfwTerminate();
+        }
     }
 
     void recreate_swap_chain() {
@@ -302,6 +594,7 @@ private:
 
         vkDeviceWaitIdle(logical_device);
 
+        present_waiter.reset();
         cleanup_swap_chain();
 
         create_swap_chain();
@@ -310,90 +603,7 @@ private:
     }
 
     void create_instance() {
-        if (enable_validation_layers && !check_validation_layer_support()) {
-            throw std::runtime_error("vk: validation layers requested, but not available");
-        }
-
-        VkApplicationInfo app_info{};
-        app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        app_info.pApplicationName = "Compute Shader Particle SYstem";
-        app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.pEngineName = "No Engine";
-        app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.apiVersion = VK_API_VERSION_1_0;
-
-        VkInstanceCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        create_info.pApplicationInfo = &app_info;
-
-        auto extensions = get_required_extensions();
-        create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        create_info.ppEnabledExtensionNames = extensions.data();
-
-        VkDebugUtilsMessengerCreateInfoEXT debug_create_info{};
-        if (enable_validation_layers) {
-            create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-            create_info.ppEnabledLayerNames = validation_layers.data();
-
-            populate_debug_messenger_create_info(debug_create_info);
-            create_info.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debug_create_info;
-        }
-        else {
-            create_info.enabledLayerCount = 0;
-            create_info.pNext = nullptr;
-        }
-
-        if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("vk: ailed to create instance");
-        }
-    }
-
-    void populate_debug_messenger_create_info(VkDebugUtilsMessengerCreateInfoEXT& create_info) {
-        create_info = {};
-        create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        create_info.pfnUserCallback = debug_callback;
-    }
-
-    void setup_debug_messenger() {
-        if (!enable_validation_layers) return;
-
-        VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        populate_debug_messenger_create_info(createInfo);
-
-        if (create_debug_utils_messenger_ext(instance, &createInfo, nullptr, &debug_messenger) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to set up debug messenger");
-        }
-    }
-
-    void create_surface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create window surface");
-        }
-    }
-
-    void pick_physical_device() {
-        uint32_t device_count = 0;
-        vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
-
-        if (device_count == 0) {
-            throw std::runtime_error("vk: failed to find GPUs with Vulkan support");
-        }
-
-        std::vector<VkPhysicalDevice> devices(device_count);
-        vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
-
-        for (const auto& device : devices) {
-            if (is_device_suitable(device)) {
-                physical_device = device;
-                break;
-            }
-        }
-
-        if (physical_device == VK_NULL_HANDLE) {
-            throw std::runtime_error("vk: failed to find a suitable GPU");
-        }
+        instance.init("ComputeShader", VK_API_VERSION_1_2, required_instance_extensions(headless, glfwGetRequiredInstanceExtensions));
     }
 
     void create_logical_device() {
@@ -402,7 +612,9 @@ private:
         std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
         std::set<uint32_t> unique_queue_families = {
             indices.graphics_and_compute_family.value(),
-            indices.present_family.value() };
+            indices.present_family.value(),
+            indices.transfer_family.value(),
+            indices.compute_family.value() };
 
         float queue_priority = 1.0f;
         for (uint32_t queue_family : unique_queue_families) {
@@ -416,20 +628,36 @@ private:
 
         VkPhysicalDeviceFeatures device_features{};
 
+        bool use_pipeline_statistics = profiling.pipeline_statistics && GpuProfiler::supports_pipeline_statistics(physical_device);
+        device_features.pipelineStatisticsQuery = use_pipeline_statistics ? VK_TRUE : VK_FALSE;
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features{};
+        timeline_semaphore_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timeline_semaphore_features.timelineSemaphore = VK_TRUE;
+
         VkDeviceCreateInfo create_info{};
         create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        create_info.pNext = &timeline_semaphore_features;
 
         create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
         create_info.pQueueCreateInfos = queue_create_infos.data();
 
         create_info.pEnabledFeatures = &device_features;
 
-        create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-        create_info.ppEnabledExtensionNames = device_extensions.data();
+        std::vector<const char*> enabled_extensions = required_device_extensions(headless);
+        bool use_present_wait = !headless && pacing.low_latency && PresentWaiter::is_supported(physical_device);
+        if (use_present_wait) {
+            const auto& present_wait_extensions = PresentWaiter::device_extensions();
+            enabled_extensions.insert(enabled_extensions.end(), present_wait_extensions.begin(), present_wait_extensions.end());
+            create_info.pNext = present_waiter.device_create_next(create_info.pNext);
+        }
+
+        create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions.size());
+        create_info.ppEnabledExtensionNames = enabled_extensions.data();
 
-        if (enable_validation_layers) {
-            create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-            create_info.ppEnabledLayerNames = validation_layers.data();
+        if (instance.is_validation_enabled()) {
+            create_info.enabledLayerCount = static_cast<uint32_t>(VulkanInstance::validation_layers().size());
+            create_info.ppEnabledLayerNames = VulkanInstance::validation_layers().data();
         }
         else {
             create_info.enabledLayerCount = 0;
@@ -440,21 +668,43 @@ private:
         }
 
         vkGetDeviceQueue(logical_device, indices.graphics_and_compute_family.value(), 0, &graphics_queue);
-        vkGetDeviceQueue(logical_device, indices.graphics_and_compute_family.value(), 0, &compute_queue);
+        vkGetDeviceQueue(logical_device, indices.compute_family.value(), 0, &compute_queue);
         vkGetDeviceQueue(logical_device, indices.present_family.value(), 0, &present_queue);
+        vkGetDeviceQueue(logical_device, indices.transfer_family.value(), 0, &transfer_queue);
+
+        graphics_family = indices.graphics_and_compute_family.value();
+        compute_family = indices.compute_family.value();
+        async_compute = compute_family != graphics_family;
+        particle_buffer_count = std::max(frames_in_flight, async_compute ? 3u : 2u);
+        log() << "Particle simulation on " << (async_compute ? "an async compute" : "the graphics") << " queue" << std::endl;
+
+        present_waiter.init(logical_device, use_present_wait);
+        allocator.init(physical_device, logical_device);
+        pipeline_cache.init(physical_device, logical_device, pipeline_cache_path);
+        pipelines.init(logical_device, pipeline_cache.handle());
+        pipeline_reloader.init(pipelines, shader_reloader);
+        gpu_profiler.init(physical_device, logical_device, frames_in_flight, profiling.csv_path, use_pipeline_statistics);
+        uploader.init(logical_device, allocator,
+            transfer_queue, indices.transfer_family.value(),
+            graphics_queue, indices.graphics_and_compute_family.value());
+        uploader.set_profiler(&gpu_profiler);
     }
 
     void create_swap_chain() {
-        SwapChainSupportDetails swap_chain_support = query_swap_chain_support(physical_device);
+        if (headless) {
+            VkExtent2D extent = { width, height };
+            create_offscreen_swap_chain(offscreen_targets, physical_device, logical_device, extent, frames_in_flight,
+                swap_chain_images, swap_chain_image_format, swap_chain_extent);
+            return;
+        }
+
+        SwapChainSupportDetails swap_chain_support = query_swap_chain_support(physical_device, surface);
 
         VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
         VkPresentModeKHR present_mode = choose_swap_present_mode(swap_chain_support.present_modes);
-        VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities);
+        VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities, framebuffer_extent());
 
-        uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
-        if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount) {
-            image_count = swap_chain_support.capabilities.maxImageCount;
-        }
+        uint32_t image_count = choose_swap_image_count(swap_chain_support.capabilities);
 
         VkSwapchainCreateInfoKHR create_info{};
         create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -530,7 +780,7 @@ private:
         color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        color_attachment.finalLayout = presentable_layout(headless);
 
         VkAttachmentReference color_attachment_ref{};
         color_attachment_ref.attachment = 0;
@@ -563,29 +813,23 @@ private:
         }
     }
 
+    // 0: parameters, then the input and output state: motion (1, 2), life (3, 4), alive list (5, 6)
+    // and counts (7, 8). 9: colors, 10: free slot stack, 11: retired slots to recycle, 12: retired
+    // slots of this update. 13-16: neighbor grid (cell counts, cell starts, particle cells,
+    // motion in cell order).
     void create_compute_descriptor_set_layout() {
-        std::array<VkDescriptorSetLayoutBinding, 3> layout_bindings{};
-        layout_bindings[0].binding = 0;
-        layout_bindings[0].descriptorCount = 1;
-        layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        layout_bindings[0].pImmutableSamplers = nullptr;
-        layout_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-        layout_bindings[1].binding = 1;
-        layout_bindings[1].descriptorCount = 1;
-        layout_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        layout_bindings[1].pImmutableSamplers = nullptr;
-        layout_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-        layout_bindings[2].binding = 2;
-        layout_bindings[2].descriptorCount = 1;
-        layout_bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        layout_bindings[2].pImmutableSamplers = nullptr;
-        layout_bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        std::array<VkDescriptorSetLayoutBinding, 17> layout_bindings{};
+        for (uint32_t i = 0; i < layout_bindings.size(); i++) {
+            layout_bindings[i].binding = i;
+            layout_bindings[i].descriptorCount = 1;
+            layout_bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            layout_bindings[i].pImmutableSamplers = nullptr;
+            layout_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
 
         VkDescriptorSetLayoutCreateInfo layout_info{};
         layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layout_info.bindingCount = 3;
+        layout_info.bindingCount = static_cast<uint32_t>(layout_bindings.size());
         layout_info.pBindings = layout_bindings.data();
 
         if (vkCreateDescriptorSetLayout(logical_device, &layout_info, nullptr, &compute_descriptor_set_layout) != VK_SUCCESS) {
@@ -594,92 +838,6 @@ private:
     }
 
     void create_graphics_pipeline() {
-        auto vert_shader_code = read_file("shaders/particle_system.vert.spv");
-        auto frag_shader_code = read_file("shaders/particle_system.frag.spv");
-
-        VkShaderModule vert_shader_module = create_shader_module(vert_shader_code);
-        VkShaderModule frag_shader_module = create_shader_module(frag_shader_code);
-
-        VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
-        vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vert_shader_stage_info.module = vert_shader_module;
-        vert_shader_stage_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
-        frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        frag_shader_stage_info.module = frag_shader_module;
-        frag_shader_stage_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_stage_info, frag_shader_stage_info };
-
-        VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-        vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-        auto binding_description = Particle::get_binding_description();
-        auto attribute_descriptions = Particle::get_attribute_descriptions();
-
-        vertex_input_info.vertexBindingDescriptionCount = 1;
-        vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
-        vertex_input_info.pVertexBindingDescriptions = &binding_description;
-        vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
-
-        VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-        input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
-        input_assembly.primitiveRestartEnable = VK_FALSE;
-
-        VkPipelineViewportStateCreateInfo viewport_state{};
-        viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewport_state.viewportCount = 1;
-        viewport_state.scissorCount = 1;
-
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-        VkPipelineColorBlendAttachmentState color_blend_attachment{};
-        color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        color_blend_attachment.blendEnable = VK_TRUE;
-        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-        color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-        color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-
-        VkPipelineColorBlendStateCreateInfo color_blending{};
-        color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        color_blending.logicOpEnable = VK_FALSE;
-        color_blending.logicOp = VK_LOGIC_OP_COPY;
-        color_blending.attachmentCount = 1;
-        color_blending.pAttachments = &color_blend_attachment;
-        color_blending.blendConstants[0] = 0.0f;
-        color_blending.blendConstants[1] = 0.0f;
-        color_blending.blendConstants[2] = 0.0f;
-        color_blending.blendConstants[3] = 0.0f;
-
-        std::vector<VkDynamicState> dynamic_states = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-        };
-        VkPipelineDynamicStateCreateInfo dynamic_state{};
-        dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
-        dynamic_state.pDynamicStates = dynamic_states.data();
-
         VkPipelineLayoutCreateInfo pipeline_layout_info{};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipeline_layout_info.setLayoutCount = 0;
@@ -689,40 +847,46 @@ private:
             throw std::runtime_error("vk: failed to create pipeline layout");
         }
 
-        VkGraphicsPipelineCreateInfo pipeline_info{};
-        pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipeline_info.stageCount = 2;
-        pipeline_info.pStages = shader_stages;
-        pipeline_info.pVertexInputState = &vertex_input_info;
-        pipeline_info.pInputAssemblyState = &input_assembly;
-        pipeline_info.pViewportState = &viewport_state;
-        pipeline_info.pRasterizationState = &rasterizer;
-        pipeline_info.pMultisampleState = &multisampling;
-        pipeline_info.pColorBlendState = &color_blending;
-        pipeline_info.pDynamicState = &dynamic_state;
-        pipeline_info.layout = pipeline_layout;
-        pipeline_info.renderPass = render_pass;
-        pipeline_info.subpass = 0;
-        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-
-        if (vkCreateGraphicsPipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create graphics pipeline");
-        }
-
-        vkDestroyShaderModule(logical_device, frag_shader_module, nullptr);
-        vkDestroyShaderModule(logical_device, vert_shader_module, nullptr);
+        GraphicsPipelineDesc desc{};
+        desc.vertex_shader.path = "shaders/particle_system.vert.spv";
+        desc.fragment_shader.path = "shaders/particle_system.frag.spv";
+
+        auto binding_descriptions = Particle::get_binding_descriptions();
+        auto attribute_descriptions = Particle::get_attribute_descriptions();
+        desc.vertex_bindings.assign(binding_descriptions.begin(), binding_descriptions.end());
+        desc.vertex_attributes.assign(attribute_descriptions.begin(), attribute_descriptions.end());
+
+        desc.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+        desc.cull_mode = VK_CULL_MODE_BACK_BIT;
+        desc.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        desc.alpha_blend = true;
+        desc.layout = pipeline_layout;
+        desc.render_pass = render_pass;
+        desc.subpass = 0;
+
+        graphics_pipeline_handle = pipelines.request(desc);
+        pipeline_reloader.track(graphics_pipeline_handle, graphics_pipeline, desc);
     }
 
+    // Recycle, update, emission and argument passes share one layout and descriptor set, and the
+    // workgroup size as specialization constant 0.
     void create_compute_pipeline() {
-        auto compute_shader_code = read_file("shaders/particle_system.comp.spv");
-
-        VkShaderModule compute_shader_module = create_shader_module(compute_shader_code);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (particles.workgroup_size > properties.limits.maxComputeWorkGroupSize[0] ||
+            particles.workgroup_size > properties.limits.maxComputeWorkGroupInvocations) {
+            throw std::runtime_error("vk: particle workgroup size " + std::to_string(particles.workgroup_size) +
+                " exceeds the device limit of " + std::to_string(std::min(properties.limits.maxComputeWorkGroupSize[0],
+                    properties.limits.maxComputeWorkGroupInvocations)));
+        }
 
-        VkPipelineShaderStageCreateInfo compute_shader_stage_info{};
-        compute_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        compute_shader_stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-        compute_shader_stage_info.module = compute_shader_module;
-        compute_shader_stage_info.pName = "main";
+        // Every pass over the pool is a 1-D dispatch of one invocation per particle.
+        uint32_t max_group_count = (particles.max_particles + particles.workgroup_size - 1) / particles.workgroup_size;
+        if (max_group_count > properties.limits.maxComputeWorkGroupCount[0]) {
+            throw std::runtime_error("vk: " + std::to_string(particles.max_particles) + " particles in workgroups of " +
+                std::to_string(particles.workgroup_size) + " need " + std::to_string(max_group_count) +
+                " workgroups, more than the device limit of " + std::to_string(properties.limits.maxComputeWorkGroupCount[0]));
+        }
 
         VkPipelineLayoutCreateInfo pipeline_layout_info{};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -733,16 +897,31 @@ private:
             throw std::runtime_error("vk: failed to create compute pipeline layout");
         }
 
-        VkComputePipelineCreateInfo pipeline_info{};
-        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-        pipeline_info.layout = compute_pipeline_layout;
-        pipeline_info.stage = compute_shader_stage_info;
+        request_compute_pipeline("shaders/particle_system.comp.spv", compute_pipeline_handle, compute_pipeline);
+        request_compute_pipeline("shaders/particle_recycle.comp.spv", recycle_pipeline_handle, recycle_pipeline);
+        request_compute_pipeline("shaders/particle_hash.comp.spv", hash_pipeline_handle, hash_pipeline);
+        request_compute_pipeline("shaders/particle_scan.comp.spv", scan_pipeline_handle, scan_pipeline);
+        request_compute_pipeline("shaders/particle_scatter.comp.spv", scatter_pipeline_handle, scatter_pipeline);
+        request_compute_pipeline("shaders/particle_emit.comp.spv", emit_pipeline_handle, emit_pipeline);
+        request_compute_pipeline("shaders/particle_args.comp.spv", args_pipeline_handle, args_pipeline);
+    }
 
-        if (vkCreateComputePipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &compute_pipeline) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create compute pipeline");
-        }
+    void request_compute_pipeline(const std::string& path, PipelineHandle& handle, VkPipeline& pipeline) {
+        ComputePipelineDesc desc{};
+        desc.shader.path = path;
+        desc.layout = compute_pipeline_layout;
 
-        vkDestroyShaderModule(logical_device, compute_shader_module, nullptr);
+        VkSpecializationMapEntry workgroup_size_entry{};
+        workgroup_size_entry.constantID = 0;
+        workgroup_size_entry.offset = 0;
+        workgroup_size_entry.size = sizeof(uint32_t);
+        desc.shader.specialization_entries.push_back(workgroup_size_entry);
+
+        const uint8_t* workgroup_size_bytes = reinterpret_cast<const uint8_t*>(&particles.workgroup_size);
+        desc.shader.specialization_data.assign(workgroup_size_bytes, workgroup_size_bytes + sizeof(uint32_t));
+
+        handle = pipelines.request(desc);
+        pipeline_reloader.track(handle, pipeline, desc);
     }
 
     void create_framebuffers() {
@@ -779,88 +958,196 @@ private:
         if (vkCreateCommandPool(logical_device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to create graphics command pool");
         }
+
+        pool_info.queueFamilyIndex = queue_family_indices.compute_family.value();
+
+        if (vkCreateCommandPool(logical_device, &pool_info, nullptr, &compute_command_pool) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create compute command pool");
+        }
     }
 
     void create_shader_storage_buffers() {
-        // Initialize particles.
-        std::default_random_engine rnd_engine((unsigned)time(nullptr));
-        std::uniform_real_distribution<float> rnd_dist(0.0f, 1.0f);
-
-        // Initial particle positions on a circle.
-        std::vector<Particle> particles(particle_count);
-        for (auto& particle : particles) {
-            float r = 0.25f * sqrt(rnd_dist(rnd_engine));
-            float theta = rnd_dist(rnd_engine) * 2.0f * 3.14159265358979323846f;
-            float x = r * cos(theta) * height / width;
-            float y = r * sin(theta);
-
-            particle.position = glm::vec2(x, y);
-            particle.velocity = glm::normalize(glm::vec2(x, y)) * 0.00025f;
-            particle.color = glm::vec4(rnd_dist(rnd_engine), rnd_dist(rnd_engine), rnd_dist(rnd_engine), 1.0f);
-        }
-
-        VkDeviceSize buffer_size = sizeof(Particle) * particle_count;
-
-        // Create a staging buffer used to upload data to the GPU.
-        VkBuffer staging_buffer;
-        VkDeviceMemory staging_buffer_memory;
-        create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            staging_buffer, staging_buffer_memory);
-
-        void* data;
-        vkMapMemory(logical_device, staging_buffer_memory, 0, buffer_size, 0, &data);
-        memcpy(data, particles.data(), (size_t)buffer_size);
-        vkUnmapMemory(logical_device, staging_buffer_memory);
-
-        shader_storage_buffers.resize(max_frames_in_flight);
-        shader_storage_buffers_memory.resize(max_frames_in_flight);
-
-        // Copy initial particle data to all storage buffers.
-        for (size_t i = 0; i < max_frames_in_flight; i++) {
-            create_buffer(buffer_size,
-                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        launch_seed = static_cast<uint32_t>(time(nullptr));
+
+        // The pool starts empty, with every slot above the high water mark; particles are emitted
+        // on the GPU. Only the headers need initial values.
+        ParticleCounts empty_counts{};
+        empty_counts.dispatch = { 0, 1, 1 };
+        empty_counts.draw = { 0, 1, 0, 0, 0 };
+        empty_counts.alive_count = 0;
+
+        RetiredSlotsHeader empty_retired{};
+        empty_retired.dispatch = { 0, 1, 1 };
+        empty_retired.count = 0;
+
+        ParticlePoolHeader empty_pool{};
+        empty_pool.free_count = 0;
+        empty_pool.high_water = 0;
+
+        VkDeviceSize slot_list_size = sizeof(uint32_t) * particles.max_particles;
+
+        particle_states.resize(particle_buffer_count);
+        for (auto& state : particle_states) {
+            allocator.create_buffer(sizeof(Particle::Motion) * particles.max_particles,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                state.motion, state.motion_allocation);
+
+            allocator.create_buffer(sizeof(Particle::Life) * particles.max_particles,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                state.life, state.life_allocation);
+
+            allocator.create_buffer(slot_list_size,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                state.alive, state.alive_allocation);
+
+            allocator.create_buffer(sizeof(ParticleCounts),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                state.counts, state.counts_allocation);
+            uploader.upload_buffer(state.counts, 0, &empty_counts, sizeof(empty_counts));
+
+            allocator.create_buffer(sizeof(RetiredSlotsHeader) + slot_list_size,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                shader_storage_buffers[i], shader_storage_buffers_memory[i]);
-            copy_buffer(staging_buffer, shader_storage_buffers[i], buffer_size);
+                state.retired, state.retired_allocation);
+            uploader.upload_buffer(state.retired, 0, &empty_retired, sizeof(empty_retired));
+        }
+
+        allocator.create_buffer(sizeof(Particle::Color) * particles.max_particles,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            { graphics_family, compute_family },
+            particle_color_buffer, particle_color_allocation);
+
+        allocator.create_buffer(sizeof(ParticlePoolHeader) + slot_list_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            particle_pool_buffer, particle_pool_allocation);
+        uploader.upload_buffer(particle_pool_buffer, 0, &empty_pool, sizeof(empty_pool));
+
+        grid_dim = std::clamp(static_cast<uint32_t>(2.0f / particles.interaction_radius), 1u, 1024u);
+        VkDeviceSize cell_count = static_cast<VkDeviceSize>(grid_dim) * grid_dim;
+
+        allocator.create_buffer(sizeof(uint32_t) * cell_count,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            cell_count_buffer, cell_count_allocation);
+
+        allocator.create_buffer(sizeof(uint32_t) * (cell_count + 1),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            cell_start_buffer, cell_start_allocation);
+
+        allocator.create_buffer(sizeof(uint32_t) * 2 * particles.max_particles,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            particle_cell_buffer, particle_cell_allocation);
+
+        allocator.create_buffer(sizeof(Particle::Motion) * particles.max_particles,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            sorted_motion_buffer, sorted_motion_allocation);
+
+        // The uploads land on the graphics family; hand every state over to the simulation, which
+        // writes each of them first, and the compute-only buffers for good. Dispatch 0 acquires
+        // its input and the compute-only buffers as well.
+        if (async_compute) {
+            VkCommandBuffer command_buffer = uploader.destination_command_buffer();
+            for (size_t i = 0; i < particle_buffer_count; i++) {
+                transfer_particle_state(command_buffer, static_cast<uint32_t>(i), graphics_family, compute_family,
+                    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+            }
+            transfer_compute_buffers(command_buffer, graphics_family, compute_family,
+                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+        }
+    }
+
+    // One half of a queue family ownership transfer of a particle state (the buffers the draw
+    // reads): the release when recorded on the src family, the acquire when recorded on the dst
+    // family. Both halves must match.
+    void transfer_particle_state(VkCommandBuffer command_buffer, uint32_t index, uint32_t src_family, uint32_t dst_family,
+        VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+        const ParticleState& state = particle_states[index];
+        transfer_buffers(command_buffer, { state.motion, state.life, state.alive, state.counts },
+            src_family, dst_family, src_stage, src_access, dst_stage, dst_access);
+    }
+
+    // The free slot stack and the retired lists, which move to the compute queue once.
+    void transfer_compute_buffers(VkCommandBuffer command_buffer, uint32_t src_family, uint32_t dst_family,
+        VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+        std::vector<VkBuffer> buffers = { particle_pool_buffer };
+        for (const auto& state : particle_states) {
+            buffers.push_back(state.retired);
         }
+        transfer_buffers(command_buffer, buffers, src_family, dst_family, src_stage, src_access, dst_stage, dst_access);
+    }
 
-        vkDestroyBuffer(logical_device, staging_buffer, nullptr);
-        vkFreeMemory(logical_device, staging_buffer_memory, nullptr);
+    void transfer_buffers(VkCommandBuffer command_buffer, const std::vector<VkBuffer>& buffers, uint32_t src_family, uint32_t dst_family,
+        VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+        std::vector<VkBufferMemoryBarrier> barriers(buffers.size());
+        for (size_t i = 0; i < buffers.size(); i++) {
+            barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barriers[i].srcAccessMask = src_access;
+            barriers[i].dstAccessMask = dst_access;
+            barriers[i].srcQueueFamilyIndex = src_family;
+            barriers[i].dstQueueFamilyIndex = dst_family;
+            barriers[i].buffer = buffers[i];
+            barriers[i].offset = 0;
+            barriers[i].size = VK_WHOLE_SIZE;
+        }
+
+        vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0,
+            0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+    }
+
+    void record_memory_barrier(VkCommandBuffer command_buffer,
+        VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+
+        vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
     }
 
     void create_uniform_buffers() {
         VkDeviceSize buffer_size = sizeof(UniformBufferObject);
 
-        uniform_buffers.resize(max_frames_in_flight);
-        uniform_buffers_memory.resize(max_frames_in_flight);
-        uniform_buffers_mapped.resize(max_frames_in_flight);
+        uniform_buffers.resize(particle_buffer_count);
+        uniform_buffer_allocations.resize(particle_buffer_count);
+        uniform_buffers_mapped.resize(particle_buffer_count);
 
-        for (size_t i = 0; i < max_frames_in_flight; i++) {
-            create_buffer(buffer_size,
+        for (size_t i = 0; i < particle_buffer_count; i++) {
+            allocator.create_buffer(buffer_size,
                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                uniform_buffers[i], uniform_buffers_memory[i]);
-            vkMapMemory(logical_device, uniform_buffers_memory[i], 0, buffer_size, 0, &uniform_buffers_mapped[i]);
+                uniform_buffers[i], uniform_buffer_allocations[i]);
+
+            // Host-visible blocks stay mapped for the allocator's lifetime.
+            uniform_buffers_mapped[i] = uniform_buffer_allocations[i].mapped;
         }
     }
 
     void create_descriptor_pool() {
         std::array<VkDescriptorPoolSize, 2> pool_sizes{};
         pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        pool_sizes[0].descriptorCount = static_cast<uint32_t>(max_frames_in_flight);
+        pool_sizes[0].descriptorCount = particle_buffer_count;
 
         pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        pool_sizes[1].descriptorCount = static_cast<uint32_t>(max_frames_in_flight) * 2;
+        pool_sizes[1].descriptorCount = particle_buffer_count * 16;
 
         VkDescriptorPoolCreateInfo pool_info{};
         pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         pool_info.poolSizeCount = 2;
         pool_info.pPoolSizes = pool_sizes.data();
-        pool_info.maxSets = static_cast<uint32_t>(max_frames_in_flight);
+        pool_info.maxSets = particle_buffer_count;
 
         if (vkCreateDescriptorPool(logical_device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to create descriptor pool");
@@ -868,138 +1155,63 @@ private:
     }
 
     void create_compute_descriptor_sets() {
-        std::vector<VkDescriptorSetLayout> layouts(max_frames_in_flight, compute_descriptor_set_layout);
+        std::vector<VkDescriptorSetLayout> layouts(particle_buffer_count, compute_descriptor_set_layout);
         VkDescriptorSetAllocateInfo alloc_info{};
         alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         alloc_info.descriptorPool = descriptor_pool;
-        alloc_info.descriptorSetCount = static_cast<uint32_t>(max_frames_in_flight);
+        alloc_info.descriptorSetCount = particle_buffer_count;
         alloc_info.pSetLayouts = layouts.data();
 
-        compute_descriptor_sets.resize(max_frames_in_flight);
+        compute_descriptor_sets.resize(particle_buffer_count);
         if (vkAllocateDescriptorSets(logical_device, &alloc_info, compute_descriptor_sets.data()) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to allocate descriptor sets");
         }
 
-        for (size_t i = 0; i < max_frames_in_flight; i++) {
-            VkDescriptorBufferInfo uniform_buffer_info{};
-            uniform_buffer_info.buffer = uniform_buffers[i];
-            uniform_buffer_info.offset = 0;
-            uniform_buffer_info.range = sizeof(UniformBufferObject);
-
-            std::array<VkWriteDescriptorSet, 3> descriptor_writes{};
-            descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_writes[0].dstSet = compute_descriptor_sets[i];
-            descriptor_writes[0].dstBinding = 0;
-            descriptor_writes[0].dstArrayElement = 0;
-            descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptor_writes[0].descriptorCount = 1;
-            descriptor_writes[0].pBufferInfo = &uniform_buffer_info;
-
-            VkDescriptorBufferInfo storage_buffer_info_last_frame{};
-            storage_buffer_info_last_frame.buffer = shader_storage_buffers[(i - 1) % max_frames_in_flight]; // 0->1, 1->0.
-            storage_buffer_info_last_frame.offset = 0;
-            storage_buffer_info_last_frame.range = sizeof(Particle) * particle_count;
-
-            descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_writes[1].dstSet = compute_descriptor_sets[i];
-            descriptor_writes[1].dstBinding = 1;
-            descriptor_writes[1].dstArrayElement = 0;
-            descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            descriptor_writes[1].descriptorCount = 1;
-            descriptor_writes[1].pBufferInfo = &storage_buffer_info_last_frame;
-
-            VkDescriptorBufferInfo storage_buffer_info_current_frame{};
-            storage_buffer_info_current_frame.buffer = shader_storage_buffers[i];
-            storage_buffer_info_current_frame.offset = 0;
-            storage_buffer_info_current_frame.range = sizeof(Particle) * particle_count;
-
-            descriptor_writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_writes[2].dstSet = compute_descriptor_sets[i];
-            descriptor_writes[2].dstBinding = 2;
-            descriptor_writes[2].dstArrayElement = 0;
-            descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-            descriptor_writes[2].descriptorCount = 1;
-            descriptor_writes[2].pBufferInfo = &storage_buffer_info_current_frame;
-
-            vkUpdateDescriptorSets(logical_device, 3, descriptor_writes.data(), 0, nullptr);
-        }
-    }
-
-    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-        VkBuffer& buffer, VkDeviceMemory& buffer_memory) {
-        VkBufferCreateInfo buffer_info{};
-        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        buffer_info.size = size;
-        buffer_info.usage = usage;
-        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        if (vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create buffer");
-        }
-
-        VkMemoryRequirements mem_requirements;
-        vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
-
-        VkMemoryAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = mem_requirements.size;
-        alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to allocate buffer memory");
-        }
-
-        vkBindBufferMemory(logical_device, buffer, buffer_memory, 0);
-    }
-
-    void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
-        VkCommandBufferAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        alloc_info.commandPool = command_pool;
-        alloc_info.commandBufferCount = 1;
-
-        VkCommandBuffer command_buffer;
-        vkAllocateCommandBuffers(logical_device, &alloc_info, &command_buffer);
-
-        VkCommandBufferBeginInfo begin_info{};
-        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-        vkBeginCommandBuffer(command_buffer, &begin_info);
-
-        VkBufferCopy copy_region{};
-        copy_region.size = size;
-        vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
-
-        vkEndCommandBuffer(command_buffer);
-
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffer;
-
-        vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphics_queue);
-
-        vkFreeCommandBuffers(logical_device, command_pool, 1, &command_buffer);
-    }
-
-    uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties mem_properties;
-        vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
-
-        for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-            if ((type_filter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
+        for (size_t i = 0; i < particle_buffer_count; i++) {
+            const ParticleState& input = particle_states[(i + particle_buffer_count - 1) % particle_buffer_count]; // The previous frame's state.
+            const ParticleState& output = particle_states[i];
+
+            // Slots retired particle_buffer_count - 1 updates ago, the oldest list in the ring.
+            const ParticleState& recycled = particle_states[(i + 1) % particle_buffer_count];
+
+            VkDeviceSize slot_list_size = sizeof(uint32_t) * particles.max_particles;
+
+            std::array<VkDescriptorBufferInfo, 17> buffer_infos{};
+            buffer_infos[0] = { uniform_buffers[i], 0, sizeof(UniformBufferObject) };
+            buffer_infos[1] = { input.motion, 0, VK_WHOLE_SIZE };
+            buffer_infos[2] = { output.motion, 0, VK_WHOLE_SIZE };
+            buffer_infos[3] = { input.life, 0, VK_WHOLE_SIZE };
+            buffer_infos[4] = { output.life, 0, VK_WHOLE_SIZE };
+            buffer_infos[5] = { input.alive, 0, slot_list_size };
+            buffer_infos[6] = { output.alive, 0, slot_list_size };
+            buffer_infos[7] = { input.counts, 0, sizeof(ParticleCounts) };
+            buffer_infos[8] = { output.counts, 0, sizeof(ParticleCounts) };
+            buffer_infos[9] = { particle_color_buffer, 0, VK_WHOLE_SIZE };
+            buffer_infos[10] = { particle_pool_buffer, 0, VK_WHOLE_SIZE };
+            buffer_infos[11] = { recycled.retired, 0, VK_WHOLE_SIZE };
+            buffer_infos[12] = { output.retired, 0, VK_WHOLE_SIZE };
+            buffer_infos[13] = { cell_count_buffer, 0, VK_WHOLE_SIZE };
+            buffer_infos[14] = { cell_start_buffer, 0, VK_WHOLE_SIZE };
+            buffer_infos[15] = { particle_cell_buffer, 0, VK_WHOLE_SIZE };
+            buffer_infos[16] = { sorted_motion_buffer, 0, VK_WHOLE_SIZE };
+
+            std::array<VkWriteDescriptorSet, 17> descriptor_writes{};
+            for (uint32_t binding = 0; binding < descriptor_writes.size(); binding++) {
+                descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptor_writes[binding].dstSet = compute_descriptor_sets[i];
+                descriptor_writes[binding].dstBinding = binding;
+                descriptor_writes[binding].dstArrayElement = 0;
+                descriptor_writes[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptor_writes[binding].descriptorCount = 1;
+                descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
             }
-        }
 
-        throw std::runtime_error("vk: failed to find suitable memory type");
+            vkUpdateDescriptorSets(logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+        }
     }
 
     void create_command_buffers() {
-        command_buffers.resize(max_frames_in_flight);
+        command_buffers.resize(frames_in_flight);
 
         VkCommandBufferAllocateInfo alloc_info{};
         alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1013,11 +1225,11 @@ private:
     }
 
     void create_compute_command_buffers() {
-        compute_command_buffers.resize(max_frames_in_flight);
+        compute_command_buffers.resize(frames_in_flight);
 
         VkCommandBufferAllocateInfo alloc_info{};
         alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        alloc_info.commandPool = command_pool;
+        alloc_info.commandPool = compute_command_pool;
         alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
         alloc_info.commandBufferCount = (uint32_t)compute_command_buffers.size();
 
@@ -1026,6 +1238,45 @@ private:
         }
     }
 
+    // Stages that touch a particle state: the count reset, the indirect update and the shaders on
+    // the compute side; the indirect draw and vertex fetch on the graphics side.
+    static constexpr VkPipelineStageFlags simulation_stages =
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    static constexpr VkPipelineStageFlags draw_stages =
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+
+    // The particle state the given frame draws. In async mode it is the one the previous dispatch
+    // read, so frame 0 has nothing to draw yet.
+    std::optional<uint32_t> drawn_particle_buffer(uint64_t frame) const {
+        if (!async_compute) {
+            return static_cast<uint32_t>(frame % particle_buffer_count);
+        }
+        if (frame == 0) {
+            return std::nullopt;
+        }
+        return static_cast<uint32_t>((frame + particle_buffer_count - 2) % particle_buffer_count);
+    }
+
+    // Takes the drawn state over from the compute family; release_drawn_particles() hands it back
+    // for the dispatch that overwrites it.
+    void acquire_drawn_particles(VkCommandBuffer command_buffer, uint64_t frame) {
+        std::optional<uint32_t> drawn = drawn_particle_buffer(frame);
+        if (async_compute && drawn.has_value()) {
+            transfer_particle_state(command_buffer, drawn.value(), compute_family, graphics_family,
+                draw_stages, 0,
+                draw_stages, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        }
+    }
+
+    void release_drawn_particles(VkCommandBuffer command_buffer, uint64_t frame) {
+        std::optional<uint32_t> drawn = drawn_particle_buffer(frame);
+        if (async_compute && drawn.has_value()) {
+            transfer_particle_state(command_buffer, drawn.value(), graphics_family, compute_family,
+                draw_stages, 0,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+        }
+    }
+
     void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index) {
         VkCommandBufferBeginInfo begin_info{};
         begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1034,6 +1285,12 @@ private:
             throw std::runtime_error("vk: failed to begin recording command buffer");
         }
 
+        uint64_t frame = frame_graph.frame();
+        std::optional<uint32_t> drawn = drawn_particle_buffer(frame);
+        acquire_drawn_particles(command_buffer, frame);
+
+        GpuProfiler::Scope render_scope = gpu_profiler.begin(command_buffer, "render", graphics_family);
+
         VkRenderPassBeginInfo render_pass_info{};
         render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         render_pass_info.renderPass = render_pass;
@@ -1063,19 +1320,47 @@ private:
         scissor.extent = swap_chain_extent;
         vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(command_buffer, 0, 1, &shader_storage_buffers[current_frame], offsets);
+        if (drawn.has_value()) {
+            const ParticleState& state = particle_states[drawn.value()];
 
-        vkCmdDraw(command_buffer, particle_count, 1, 0, 0);
+            VkBuffer vertex_buffers[] = { state.motion, state.life, particle_color_buffer };
+            VkDeviceSize offsets[] = { 0, 0, 0 };
+            vkCmdBindVertexBuffers(command_buffer, 0, 3, vertex_buffers, offsets);
+
+            // The alive list picks the slots; its length is whatever the simulation left alive.
+            vkCmdBindIndexBuffer(command_buffer, state.alive, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexedIndirect(command_buffer, state.counts, offsetof(ParticleCounts, draw), 1, sizeof(VkDrawIndexedIndirectCommand));
+        }
 
         vkCmdEndRenderPass(command_buffer);
 
+        gpu_profiler.end(command_buffer, render_scope);
+
+        release_drawn_particles(command_buffer, frame);
+
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to record command buffer");
+        }
+    }
+
+    // Keeps the ownership transfers balanced in a frame whose swap chain image could not be acquired.
+    void record_ownership_command_buffer(VkCommandBuffer command_buffer) {
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to begin recording command buffer");
+        }
+
+        acquire_drawn_particles(command_buffer, frame_graph.frame());
+        release_drawn_particles(command_buffer, frame_graph.frame());
+
         if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to record command buffer");
         }
     }
 
-    void record_compute_command_buffer(VkCommandBuffer command_buffer) {
+    void record_compute_command_buffer(VkCommandBuffer command_buffer, uint32_t emit_count) {
         VkCommandBufferBeginInfo begin_info{};
         begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -1083,12 +1368,105 @@ private:
             throw std::runtime_error("vk: failed to begin recording compute command buffer");
         }
 
-        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline);
+        GpuProfiler::Scope compute_scope = gpu_profiler.begin(command_buffer, "compute", compute_family);
+
+        uint64_t frame = frame_graph.frame();
+        uint32_t output = static_cast<uint32_t>(frame % particle_buffer_count);
+        uint32_t input = static_cast<uint32_t>((frame + particle_buffer_count - 1) % particle_buffer_count);
+
+        // The output was last drawn by the graphics queue (or handed over after the upload). The
+        // input is owned by this queue since the dispatch that wrote it, except for the very first.
+        if (async_compute) {
+            transfer_particle_state(command_buffer, output, graphics_family, compute_family,
+                simulation_stages, 0,
+                simulation_stages, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            if (frame == 0) {
+                transfer_particle_state(command_buffer, input, graphics_family, compute_family,
+                    simulation_stages, 0,
+                    simulation_stages, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+                transfer_compute_buffers(command_buffer, graphics_family, compute_family,
+                    simulation_stages, 0,
+                    simulation_stages, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            }
+        }
 
         vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_layout,
-            0, 1, &compute_descriptor_sets[current_frame], 0, nullptr);
+            0, 1, &compute_descriptor_sets[output], 0, nullptr);
+
+        // Slots die in one update and are reused particle_buffer_count - 1 updates later, when
+        // every frame that could still draw them (and read their color) has finished; the frame
+        // graph dependencies guarantee exactly that. The oldest retired list goes back onto the
+        // free stack first.
+        const ParticleState& recycled = particle_states[(frame + 1) % particle_buffer_count];
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, recycle_pipeline);
+        vkCmdDispatchIndirect(command_buffer, recycled.retired, offsetof(RetiredSlotsHeader, dispatch));
+
+        record_memory_barrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+        // Survivors and new particles are appended to the output alive list, the dead to its
+        // retired list, both from zero. The retired list was recycled by the previous update (or
+        // just now with a ring of one).
+        vkCmdFillBuffer(command_buffer, particle_states[output].counts, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(command_buffer, particle_states[output].retired, 0, sizeof(RetiredSlotsHeader), 0);
+        vkCmdFillBuffer(command_buffer, cell_count_buffer, 0, VK_WHOLE_SIZE, 0);
+        record_memory_barrier(command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+        // Sort the live particles into the neighbor grid: count per cell, prefix sum, scatter.
+        // Hash and scatter run over the input alive list, like the update.
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, hash_pipeline);
+        vkCmdDispatchIndirect(command_buffer, particle_states[input].counts, offsetof(ParticleCounts, dispatch));
+        record_memory_barrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, scan_pipeline);
+        vkCmdDispatch(command_buffer, 1, 1, 1);
+        record_memory_barrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, scatter_pipeline);
+        vkCmdDispatchIndirect(command_buffer, particle_states[input].counts, offsetof(ParticleCounts, dispatch));
+        record_memory_barrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        // Update the live particles against their grid neighbors; the group count was written by
+        // the previous frame.
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline);
+        vkCmdDispatchIndirect(command_buffer, particle_states[input].counts, offsetof(ParticleCounts, dispatch));
+
+        record_memory_barrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
 
-        vkCmdDispatch(command_buffer, particle_count / 256, 1, 1);
+        if (emit_count > 0) {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, emit_pipeline);
+            vkCmdDispatch(command_buffer, (emit_count + particles.workgroup_size - 1) / particles.workgroup_size, 1, 1);
+
+            record_memory_barrier(command_buffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        }
+
+        // Write the arguments of the next update, the draw and the recycling of this update's dead.
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, args_pipeline);
+        vkCmdDispatch(command_buffer, 1, 1, 1);
+
+        // Once read here, the input is final and goes to the graphics queue, which draws it next frame.
+        if (async_compute) {
+            transfer_particle_state(command_buffer, input, compute_family, graphics_family,
+                simulation_stages, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+        }
+
+        gpu_profiler.end(command_buffer, compute_scope);
 
         if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to record compute command buffer");
@@ -1096,69 +1474,117 @@ private:
     }
 
     void create_sync_objects() {
-        image_available_semaphores.resize(max_frames_in_flight);
-        render_finished_semaphores.resize(max_frames_in_flight);
-        compute_finished_semaphores.resize(max_frames_in_flight);
-        in_flight_fences.resize(max_frames_in_flight);
-        compute_in_flight_fences.resize(max_frames_in_flight);
+        image_available_semaphores.resize(frames_in_flight);
+        render_finished_semaphores.resize(frames_in_flight);
 
         VkSemaphoreCreateInfo semaphore_info{};
         semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkFenceCreateInfo fence_info{};
-        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-        for (size_t i = 0; i < max_frames_in_flight; i++) {
+        for (size_t i = 0; i < frames_in_flight; i++) {
             if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(logical_device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
+                vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS) {
                 throw std::runtime_error("vk: failed to create graphics synchronization objects for a frame");
             }
-            if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &compute_finished_semaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(logical_device, &fence_info, nullptr, &compute_in_flight_fences[i]) != VK_SUCCESS) {
-                throw std::runtime_error("vk: failed to create compute synchronization objects for a frame");
-            }
         }
+
+        frame_graph.init(logical_device, frames_in_flight);
+        compute_pass = frame_graph.add_pass("compute", compute_queue);
+        graphics_pass = frame_graph.add_pass("graphics", graphics_queue);
+
+        // The simulation reads the particles and dispatch arguments written by the previous frame.
+        frame_graph.add_dependency(compute_pass, compute_pass, simulation_stages, 1);
+
+        if (async_compute) {
+            // Frame f draws the state dispatch f - 1 released, while dispatch f already runs next to
+            // it. The state dispatch f overwrites was drawn, and released, particle_buffer_count - 2
+            // frames ago.
+            frame_graph.add_dependency(compute_pass, graphics_pass, simulation_stages, particle_buffer_count - 2);
+            frame_graph.add_dependency(graphics_pass, compute_pass, draw_stages, 1);
+        }
+        else {
+            // The dispatch overwrites the buffer the graphics pass drew frames_in_flight frames ago,
+            // and the particles are drawn straight from the storage buffer as vertices.
+            frame_graph.add_dependency(compute_pass, graphics_pass, simulation_stages, frames_in_flight);
+            frame_graph.add_dependency(graphics_pass, compute_pass, draw_stages);
+        }
+    }
+
+    // Emits at the rate that keeps the pool about full; the dispatch for it is the only size the
+    // CPU still decides.
+    uint32_t next_emit_count() {
+        emission_budget += particles.max_particles / particles.mean_lifetime * (last_frame_time / 1000.0f);
+
+        uint32_t emit_count = static_cast<uint32_t>(std::min(emission_budget, static_cast<float>(particles.max_particles)));
+        emission_budget = std::min(emission_budget - emit_count, 1.0f);
+        return emit_count;
     }
 
-    void update_uniform_buffer(uint32_t current_image) {
+    void update_uniform_buffer(uint32_t current_image, uint32_t emit_count) {
         UniformBufferObject ubo{};
         ubo.delta_time = last_frame_time * 2.0f;
+        ubo.delta_seconds = last_frame_time / 1000.0f;
+        ubo.mean_lifetime = particles.mean_lifetime;
+        ubo.emit_count = emit_count;
+        ubo.max_particles = particles.max_particles;
+        ubo.seed = launch_seed ^ static_cast<uint32_t>(frame_graph.frame() * 0x9e3779b9u);
+        ubo.interaction_radius = particles.interaction_radius;
+        ubo.cell_size = 2.0f / grid_dim;
+        ubo.grid_dim = grid_dim;
 
         memcpy(uniform_buffers_mapped[current_image], &ubo, sizeof(ubo));
     }
 
     void draw_frame() {
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        frame_graph.begin_frame();
+        current_frame = frame_graph.frame_slot();
 
-        // Compute submission.
-        vkWaitForFences(logical_device, 1, &compute_in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+        // The previous frame waited for both passes of the frame frames_in_flight before it, so
+        // every frame up to that one has completed.
+        uint64_t frame = frame_graph.frame();
+        uint64_t completed_frames = frame > frames_in_flight ? frame - frames_in_flight : 0;
+        for (const std::string& error : pipeline_reloader.update(frame, completed_frames)) {
+            log() << error << std::endl;
+        }
 
-        update_uniform_buffer(current_frame);
+        // Compute submission. Only waits for the dispatch that last used this slot's uniform
+        // buffer and command buffer.
+        frame_graph.wait_for_slot(compute_pass);
 
-        vkResetFences(logical_device, 1, &compute_in_flight_fences[current_frame]);
+        // The graphics pass of that frame is usually done by now too; if not, its timing is dropped
+        // instead of waiting for it here.
+        gpu_profiler.begin_frame(current_frame);
+
+        uint32_t emit_count = next_emit_count();
+        update_uniform_buffer(static_cast<uint32_t>(frame_graph.frame() % particle_buffer_count), emit_count);
 
         vkResetCommandBuffer(compute_command_buffers[current_frame], /*VkCommandBufferResetFlagBits*/ 0);
-        record_compute_command_buffer(compute_command_buffers[current_frame]);
+        record_compute_command_buffer(compute_command_buffers[current_frame], emit_count);
 
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &compute_command_buffers[current_frame];
-        submit_info.signalSemaphoreCount = 1;
-        submit_info.pSignalSemaphores = &compute_finished_semaphores[current_frame];
-
-        if (vkQueueSubmit(compute_queue, 1, &submit_info, compute_in_flight_fences[current_frame]) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to submit compute command buffer");
-        };
+        frame_graph.submit(compute_pass, compute_command_buffers[current_frame]);
 
         // Graphics submission.
-        vkWaitForFences(logical_device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+        frame_graph.wait_for_slot(graphics_pass);
 
         uint32_t image_index;
+        if (headless) {
+            // Nothing to acquire or present, so no binary semaphores either.
+            image_index = offscreen_targets.next_image();
+            vkResetCommandBuffer(command_buffers[current_frame], /*VkCommandBufferResetFlagBits*/ 0);
+            record_command_buffer(command_buffers[current_frame], image_index);
+            frame_graph.submit(graphics_pass, command_buffers[current_frame]);
+            return;
+        }
+
         VkResult result = vkAcquireNextImageKHR(logical_device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // The graphics pass is skipped this frame; its dependents keep waiting for its last
+            // submission. In async mode it still has to pass this frame's particles back.
+            if (async_compute) {
+                vkResetCommandBuffer(command_buffers[current_frame], /*VkCommandBufferResetFlagBits*/ 0);
+                record_ownership_command_buffer(command_buffers[current_frame]);
+                frame_graph.submit(graphics_pass, command_buffers[current_frame]);
+            }
             recreate_swap_chain();
             return;
         }
@@ -1166,27 +1592,12 @@ private:
             throw std::runtime_error("vk: failed to acquire swap chain image");
         }
 
-        vkResetFences(logical_device, 1, &in_flight_fences[current_frame]);
-
         vkResetCommandBuffer(command_buffers[current_frame], /*VkCommandBufferResetFlagBits*/ 0);
         record_command_buffer(command_buffers[current_frame], image_index);
 
-        VkSemaphore wait_semaphores[] = { compute_finished_semaphores[current_frame], image_available_semaphores[current_frame] };
-        VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        submit_info = {};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-        submit_info.waitSemaphoreCount = 2;
-        submit_info.pWaitSemaphores = wait_semaphores;
-        submit_info.pWaitDstStageMask = wait_stages;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffers[current_frame];
-        submit_info.signalSemaphoreCount = 1;
-        submit_info.pSignalSemaphores = &render_finished_semaphores[current_frame];
-
-        if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to submit draw command buffer");
-        }
+        frame_graph.submit(graphics_pass, command_buffers[current_frame],
+            { { image_available_semaphores[current_frame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } },
+            render_finished_semaphores[current_frame]);
 
         VkPresentInfoKHR present_info{};
         present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1199,6 +1610,7 @@ private:
         present_info.pSwapchains = swap_chains;
 
         present_info.pImageIndices = &image_index;
+        present_info.pNext = present_waiter.next_present(swap_chain, present_info.pNext);
 
         result = vkQueuePresentKHR(present_queue, &present_info);
 
@@ -1209,116 +1621,41 @@ private:
         else if (result != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to present swap chain image");
         }
-
-        current_frame = (current_frame + 1) % max_frames_in_flight;
-    }
-
-    VkShaderModule create_shader_module(const std::vector<char>& code) {
-        VkShaderModuleCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        create_info.codeSize = code.size();
-        create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-        VkShaderModule shader_module;
-        if (vkCreateShaderModule(logical_device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create shader module");
-        }
-
-        return shader_module;
-    }
-
-    VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats) {
-        for (const auto& available_format : available_formats) {
-            if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-                return available_format;
-            }
-        }
-
-        return available_formats[0];
     }
 
     VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes) {
-        for (const auto& available_present_mode : available_present_modes) {
-            if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return available_present_mode;
-            }
-        }
-
-        return VK_PRESENT_MODE_FIFO_KHR;
-    }
-
-    VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities) {
-        if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-            return capabilities.currentExtent;
-        }
-        else {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
-
-            VkExtent2D actual_extent = {
-                static_cast<uint32_t>(width),
-                static_cast<uint32_t>(height)
-            };
-
-            actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-            actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
-
-            return actual_extent;
-        }
-    }
-
-    SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device) {
-        SwapChainSupportDetails details;
-
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-
-        uint32_t format_count;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, nullptr);
-
-        if (format_count != 0) {
-            details.formats.resize(format_count);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, details.formats.data());
-        }
-
-        uint32_t present_mode_count;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, nullptr);
-
-        if (present_mode_count != 0) {
-            details.present_modes.resize(present_mode_count);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, details.present_modes.data());
-        }
-
-        return details;
+        return pacing.choose_present_mode(available_present_modes);
     }
 
     bool is_device_suitable(VkPhysicalDevice device) {
         QueueFamilyIndices indices = find_queue_families(device);
 
-        bool extensions_supported = check_device_extension_support(device);
+        bool extensions_supported = supports_device_extensions(device, required_device_extensions(headless));
 
-        bool swap_chain_adequate = false;
-        if (extensions_supported) {
-            SwapChainSupportDetails swap_chain_support = query_swap_chain_support(device);
-            swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+        bool swap_chain_adequate = headless;
+        if (extensions_supported && !headless) {
+            swap_chain_adequate = query_swap_chain_support(device, surface).is_adequate();
         }
 
-        return indices.is_complete() && extensions_supported && swap_chain_adequate;
+        return indices.is_complete() && extensions_supported && swap_chain_adequate && supports_timeline_semaphores(device);
     }
 
-    bool check_device_extension_support(VkPhysicalDevice device) {
-        uint32_t extension_count;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
-
-        std::vector<VkExtensionProperties> available_extensions(extension_count);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+    bool supports_timeline_semaphores(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
 
-        std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features{};
+        timeline_semaphore_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
 
-        for (const auto& extension : available_extensions) {
-            required_extensions.erase(extension.extensionName);
-        }
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &timeline_semaphore_features;
+        vkGetPhysicalDeviceFeatures2(device, &features);
 
-        return required_extensions.empty();
+        return timeline_semaphore_features.timelineSemaphore;
     }
 
     QueueFamilyIndices find_queue_families(VkPhysicalDevice device) {
@@ -1336,10 +1673,7 @@ private:
                 indices.graphics_and_compute_family = i;
             }
 
-            VkBool32 present_support = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
-
-            if (present_support) {
+            if (supports_present(headless, device, i, queue_family, surface)) {
                 indices.present_family = i;
             }
 
@@ -1350,77 +1684,75 @@ private:
             i++;
         }
 
-        return indices;
-    }
-
-    std::vector<const char*> get_required_extensions() {
-        uint32_t glfw_extension_count = 0;
-        const char** glfw_extensions;
-        glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-
-        std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
-
-        if (enable_validation_layers) {
-            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        // Dedicated transfer families map to the copy engines, which run alongside graphics work.
+        for (uint32_t j = 0; j < queue_family_count; j++) {
+            VkQueueFlags flags = queue_families[j].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                indices.transfer_family = j;
+                break;
+            }
         }
 
-        return extensions;
-    }
-
-    bool check_validation_layer_support() {
-        uint32_t layer_count;
-        vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-
-        std::vector<VkLayerProperties> available_layers(layer_count);
-        vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
-
-        for (const char* layer_name : validation_layers) {
-            bool layer_found = false;
-
-            for (const auto& layer_properties : available_layers) {
-                if (strcmp(layer_name, layer_properties.layerName) == 0) {
-                    layer_found = true;
-                    break;
-                }
-            }
+        if (!indices.transfer_family.has_value()) {
+            indices.transfer_family = indices.graphics_and_compute_family;
+        }
 
-            if (!layer_found) {
-                return false;
+        // Compute-only families feed the async compute engines, which fill the gaps the raster
+        // work leaves on the shader cores.
+        for (uint32_t j = 0; ASYNC_COMPUTE && j < queue_family_count; j++) {
+            VkQueueFlags flags = queue_families[j].queueFlags;
+            if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+                indices.compute_family = j;
+                break;
             }
         }
 
-        return true;
-    }
-
-    static std::vector<char> read_file(const std::string& filename) {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-        if (!file.is_open()) {
-            throw std::runtime_error("failed to open file");
+        if (!indices.compute_family.has_value()) {
+            indices.compute_family = indices.graphics_and_compute_family;
         }
 
-        size_t file_size = (size_t)file.tellg();
-        std::vector<char> buffer(file_size);
-
-        file.seekg(0);
-        file.read(buffer.data(), file_size);
-
-        file.close();
-
-        return buffer;
+        return indices;
     }
 
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
-        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-        return VK_FALSE;
+    VkExtent2D framebuffer_extent() {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
     }
 };
 
-int main() {
-    ComputeShaderApplication app;
-
+int main(int argc, char** argv) {
     try {
-        app.run();
+        FramePacing pacing = FramePacing::from_command_line(argc, argv);
+        ParticleSettings particles = ParticleSettings::from_command_line(argc, argv);
+        GpuProfilerOptions profiling = GpuProfilerOptions::from_command_line(argc, argv);
+        ShaderReloadSettings shader_reload = ShaderReloadSettings::from_command_line(argc, argv);
+        BenchmarkSettings benchmark = BenchmarkSettings::from_command_line(argc, argv);
+
+        if (benchmark.enabled) {
+            // A fresh instance and device per particle count, so every run starts up the same way.
+            std::vector<uint32_t> particle_counts = benchmark.particle_counts;
+            if (particle_counts.empty()) {
+                particle_counts.push_back(particles.max_particles);
+            }
+            for (uint32_t count : particle_counts) {
+                ParticleSettings::validate_max_particles(count, "--benchmark-particles");
+            }
+
+            BenchmarkReport report("ComputeShader");
+            for (uint32_t count : particle_counts) {
+                ParticleSettings run_particles = particles;
+                run_particles.max_particles = count;
+
+                ComputeShaderApplication app;
+                report.add_run(app.run_benchmark(pacing, run_particles, profiling, benchmark));
+            }
+            report.write(benchmark.output_path);
+        }
+        else {
+            ComputeShaderApplication app;
+            app.run(pacing, particles, shader_reload, profiling);
+        }
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
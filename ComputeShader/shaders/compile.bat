@@ -1,4 +0,0 @@
-C:\VulkanSDK\1.3.290.0\Bin\glslc.exe particle_system.comp -o particle_system.comp.spv
-C:\VulkanSDK\1.3.290.0\Bin\glslc.exe particle_system.frag -o particle_system.frag.spv
-C:\VulkanSDK\1.3.290.0\Bin\glslc.exe particle_system.vert -o particle_system.vert.spv
-pause
\ No newline at end of file
@@ -0,0 +1,30 @@
+// Particles live in fixed slots of a pool, stored as separate streams. Motion (position,
+// velocity) and life are rewritten by every update; the color is written once when a particle is
+// emitted. An alive list of slot indices says which slots are in use.
+
+// Indirect arguments and the live count of one particle state. dispatch_* is a
+// VkDispatchIndirectCommand for the next update, index_count.. a VkDrawIndexedIndirectCommand
+// over the alive list.
+struct ParticleCounts {
+    uint dispatch_x;
+    uint dispatch_y;
+    uint dispatch_z;
+    uint index_count;
+    uint instance_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+    uint alive_count;
+};
+
+layout (binding = 0) uniform ParameterUBO {
+    float delta_time;
+    float delta_seconds;
+    float mean_lifetime;
+    uint emit_count;
+    uint max_particles;
+    uint seed;
+    float interaction_radius;
+    float cell_size;
+    uint grid_dim;
+} ubo;
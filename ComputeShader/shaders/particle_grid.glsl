@@ -0,0 +1,30 @@
+// Needs particle_common.glsl included first.
+
+// Uniform grid over the window, cells at least interaction_radius wide. Rebuilt every frame by a
+// counting sort: hash counts the particles per cell, scan turns the counts into cell starts and
+// scatter copies the motion of every live particle into cell order.
+layout(std430, binding = 13) buffer CellCounts {
+   uint cell_counts[];
+};
+
+layout(std430, binding = 14) buffer CellStarts {
+   uint cell_starts[];
+};
+
+// Cell and rank within the cell of every live particle, by alive list index.
+layout(std430, binding = 15) buffer ParticleCells {
+   uvec2 particle_cells[];
+};
+
+layout(std430, binding = 16) buffer SortedMotion {
+   vec4 sorted_motion[];
+};
+
+uvec2 cell_coord(vec2 position) {
+    ivec2 coord = ivec2(floor((position + 1.0) / ubo.cell_size));
+    return uvec2(clamp(coord, ivec2(0), ivec2(int(ubo.grid_dim) - 1)));
+}
+
+uint cell_index(uvec2 coord) {
+    return coord.y * ubo.grid_dim + coord.x;
+}
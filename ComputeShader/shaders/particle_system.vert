@@ -1,12 +1,15 @@
 #version 450
 
+// One vertex binding per particle stream, indexed through the alive list.
 layout(location = 0) in vec2 in_position;
-layout(location = 1) in vec4 in_color;
+layout(location = 1) in float in_life;
+layout(location = 2) in vec4 in_color;
 
 layout(location = 0) out vec3 frag_color;
 
 void main() {
-    gl_PointSize = 14.0;
+    gl_PointSize = 3.0;
     gl_Position = vec4(in_position.xy, 1.0, 1.0);
-    frag_color = in_color.rgb;
+    // Fade out over the last second.
+    frag_color = in_color.rgb * clamp(in_life, 0.0, 1.0);
 }
\ No newline at end of file
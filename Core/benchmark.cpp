@@ -0,0 +1,294 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+uint32_t parse_count(const std::string& argument, const std::string& value, uint32_t min_value) {
+    unsigned long count = 0;
+    try {
+        size_t end = 0;
+        count = std::stoul(value, &end);
+        if (end != value.size()) {
+            count = 0;
+        }
+    }
+    catch (const std::exception&) {
+        count = 0;
+    }
+
+    if (count < min_value || count > UINT32_MAX) {
+        throw std::runtime_error("benchmark: bad value in " + argument);
+    }
+    return static_cast<uint32_t>(count);
+}
+
+std::vector<uint32_t> parse_list(const std::string& argument, const std::string& value) {
+    std::vector<uint32_t> values;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(parse_count(argument, item, 1));
+    }
+
+    if (values.empty()) {
+        throw std::runtime_error("benchmark: " + argument + " needs at least one value");
+    }
+    return values;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    size_t rank = static_cast<size_t>(std::lround(p * (values.size() - 1)));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+std::string quoted(const std::string& text) {
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+}
+
+BenchmarkSettings BenchmarkSettings::from_command_line(int argc, char** argv) {
+    BenchmarkSettings settings;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        std::string value = argument.substr(argument.find('=') + 1);
+
+        if (argument == "--benchmark") {
+            settings.enabled = true;
+        }
+        else if (argument.rfind("--benchmark-frames=", 0) == 0) {
+            settings.frames = parse_count(argument, value, 1);
+        }
+        else if (argument.rfind("--benchmark-warmup=", 0) == 0) {
+            settings.warmup_frames = parse_count(argument, value, 0);
+        }
+        else if (argument.rfind("--benchmark-output=", 0) == 0) {
+            settings.output_path = value;
+        }
+        else if (argument.rfind("--benchmark-particles=", 0) == 0) {
+            settings.particle_counts = parse_list(argument, value);
+        }
+        else if (argument.rfind("--benchmark-msaa=", 0) == 0) {
+            settings.msaa_levels = parse_list(argument, value);
+            for (uint32_t samples : settings.msaa_levels) {
+                // The values of VkSampleCountFlagBits.
+                if ((samples & (samples - 1)) != 0 || samples > 64) {
+                    throw std::runtime_error("benchmark: " + argument + " takes powers of two up to 64");
+                }
+            }
+        }
+    }
+
+    return settings;
+}
+
+void PhaseTimer::begin(const std::string& name) {
+    end();
+    running = name;
+    started = Clock::now();
+    is_running = true;
+}
+
+void PhaseTimer::end() {
+    if (!is_running) {
+        return;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+    finished.emplace_back(running, ms);
+    is_running = false;
+}
+
+double PhaseTimer::total_ms() const {
+    double total = 0.0;
+    for (const auto& phase : finished) {
+        total += phase.second;
+    }
+    return total;
+}
+
+std::string PhaseTimer::summary() const {
+    std::ostringstream text;
+    text.precision(1);
+    text.setf(std::ios::fixed);
+
+    for (const auto& phase : finished) {
+        text << phase.first << " " << phase.second << " ms | ";
+    }
+    text << "total " << total_ms() << " ms";
+
+    for (const auto& phase : background) {
+        text << " | " << phase.first << " " << phase.second << " ms (background)";
+    }
+    return text.str();
+}
+
+void BenchmarkRun::add_gpu_scopes(const GpuProfiler& profiler) {
+    for (const auto& name : profiler.scope_names()) {
+        GpuScope scope;
+        scope.name = name;
+        scope.samples = profiler.sample_count(name);
+        scope.p50 = profiler.percentile(name, 0.5);
+        scope.p95 = profiler.percentile(name, 0.95);
+        scope.p99 = profiler.percentile(name, 0.99);
+        gpu_ms.push_back(scope);
+    }
+}
+
+void BenchmarkRun::add_allocator_stats(const AllocatorStats& stats) {
+    memory_bytes.emplace_back("reserved", stats.reserved_bytes);
+    memory_bytes.emplace_back("used", stats.used_bytes);
+    memory_bytes.emplace_back("requested", stats.requested_bytes);
+}
+
+std::vector<const char*> required_instance_extensions(bool headless, const char** (*window_extensions)(uint32_t* count)) {
+    std::vector<const char*> extensions;
+    if (!headless) {
+        uint32_t count = 0;
+        const char** names = window_extensions(&count);
+        extensions.assign(names, names + count);
+    }
+    return extensions;
+}
+
+const std::vector<const char*>& required_device_extensions(bool headless) {
+    static const std::vector<const char*> no_extensions;
+    static const std::vector<const char*> swap_chain_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    return headless ? no_extensions : swap_chain_extensions;
+}
+
+bool supports_present(bool headless, VkPhysicalDevice physical_device, uint32_t family,
+    const VkQueueFamilyProperties& properties, VkSurfaceKHR surface) {
+    if (headless) {
+        return (properties.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    }
+
+    VkBool32 present_support = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, family, surface, &present_support);
+    return present_support == VK_TRUE;
+}
+
+VkImageLayout presentable_layout(bool headless) {
+    return headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+void create_offscreen_swap_chain(OffscreenTargets& targets, VkPhysicalDevice physical_device, VkDevice logical_device,
+    VkExtent2D extent, uint32_t frames_in_flight, std::vector<VkImage>& images, VkFormat& image_format, VkExtent2D& image_extent) {
+    targets.init(physical_device, logical_device, OffscreenTargets::default_format, extent, frames_in_flight);
+    images = targets.images();
+    image_format = targets.format();
+    image_extent = targets.extent();
+}
+
+void run_benchmark_frames(const BenchmarkSettings& settings, VkDevice logical_device, GpuProfiler& profiler,
+    PhaseTimer& startup, BenchmarkRun& run, const std::function<void(float frame_delta_ms)>& draw_frame,
+    float frame_delta_ms) {
+    profiler.set_window(settings.frames);
+
+    auto last_frame_end = PhaseTimer::Clock::now();
+    for (uint32_t frame = 0; frame < settings.warmup_frames + settings.frames; frame++) {
+        if (frame == 0) {
+            startup.begin("first_frame");
+        }
+        draw_frame(frame_delta_ms);
+        if (frame == 0) {
+            startup.end();
+        }
+
+        auto frame_end = PhaseTimer::Clock::now();
+        if (frame >= settings.warmup_frames) {
+            run.cpu_frame_ms.push_back(std::chrono::duration<double, std::milli>(frame_end - last_frame_end).count());
+        }
+        last_frame_end = frame_end;
+    }
+
+    vkDeviceWaitIdle(logical_device);
+    profiler.flush();
+}
+
+void BenchmarkReport::write(const std::string& path) const {
+    std::ostringstream json;
+    json.precision(4);
+    json.setf(std::ios::fixed);
+
+    json << "{\n  \"sample\": " << quoted(sample) << ",\n  \"runs\": [";
+    for (size_t r = 0; r < runs.size(); r++) {
+        const BenchmarkRun& run = runs[r];
+        json << (r > 0 ? "," : "") << "\n    {\n";
+
+        json << "      \"config\": {";
+        for (size_t i = 0; i < run.config.size(); i++) {
+            json << (i > 0 ? ", " : "") << quoted(run.config[i].first) << ": " << run.config[i].second;
+        }
+        json << "},\n";
+
+        double mean = 0.0;
+        double max = 0.0;
+        for (double ms : run.cpu_frame_ms) {
+            mean += ms;
+            max = std::max(max, ms);
+        }
+        if (!run.cpu_frame_ms.empty()) {
+            mean /= run.cpu_frame_ms.size();
+        }
+
+        json << "      \"frames\": " << run.cpu_frame_ms.size() << ",\n";
+        json << "      \"cpu_frame_ms\": {\"mean\": " << mean
+            << ", \"p50\": " << percentile(run.cpu_frame_ms, 0.5)
+            << ", \"p95\": " << percentile(run.cpu_frame_ms, 0.95)
+            << ", \"p99\": " << percentile(run.cpu_frame_ms, 0.99)
+            << ", \"max\": " << max << "},\n";
+
+        json << "      \"gpu_ms\": {";
+        for (size_t i = 0; i < run.gpu_ms.size(); i++) {
+            const BenchmarkRun::GpuScope& scope = run.gpu_ms[i];
+            json << (i > 0 ? ", " : "") << quoted(scope.name) << ": {\"samples\": " << scope.samples
+                << ", \"p50\": " << scope.p50 << ", \"p95\": " << scope.p95 << ", \"p99\": " << scope.p99 << "}";
+        }
+        json << "},\n";
+
+        json << "      \"startup_ms\": {";
+        for (size_t i = 0; i < run.startup_ms.size(); i++) {
+            json << (i > 0 ? ", " : "") << quoted(run.startup_ms[i].first) << ": " << run.startup_ms[i].second;
+        }
+        json << "},\n";
+
+        json << "      \"memory_bytes\": {";
+        for (size_t i = 0; i < run.memory_bytes.size(); i++) {
+            json << (i > 0 ? ", " : "") << quoted(run.memory_bytes[i].first) << ": " << run.memory_bytes[i].second;
+        }
+        json << "}\n    }";
+    }
+    json << "\n  ]\n}\n";
+
+    if (path.empty()) {
+        std::cout << json.str();
+        return;
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("benchmark: failed to open " + path);
+    }
+    file << json.str();
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "device_allocator.h"
+#include "gpu_profiler.h"
+#include "offscreen_targets.h"
+
+// Fixed-length headless runs for tracking performance across commits, started with --benchmark.
+//
+// A benchmark renders offscreen, without a window, surface or swap chain, for warmup_frames plus
+// frames frames and writes one JSON report covering every configuration of the sweep.
+struct BenchmarkSettings {
+    bool enabled = false;
+    uint32_t frames = 600;
+    uint32_t warmup_frames = 60;
+
+    // Where the JSON goes; stdout when empty.
+    std::string output_path;
+
+    // Sweeps, for the samples they apply to: particle counts for ComputeShader, MSAA sample
+    // counts (powers of two) for ModelLoading. Empty runs the default configuration once.
+    std::vector<uint32_t> particle_counts;
+    std::vector<uint32_t> msaa_levels;
+
+    // Reads --benchmark, --benchmark-frames=N, --benchmark-warmup=N, --benchmark-output=path,
+    // --benchmark-particles=N,N,... and --benchmark-msaa=N,N,...; anything else on the command
+    // line is left alone. Throws on bad values.
+    static BenchmarkSettings from_command_line(int argc, char** argv);
+};
+
+// Wall-clock time of named phases in the order they ran, e.g. the steps of startup.
+//
+// Work timed on other threads alongside the phases, like loaders, is added as background phases.
+// They overlap the others, so total_ms() leaves them out.
+class PhaseTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Ends the running phase, if any, and starts the next one.
+    void begin(const std::string& name);
+    void end();
+
+    void add_background(const std::string& name, double ms) { background.emplace_back(name, ms); }
+
+    const std::vector<std::pair<std::string, double>>& phases() const { return finished; }
+    const std::vector<std::pair<std::string, double>>& background_phases() const { return background; }
+    double total_ms() const;
+
+    // "instance 31.2 ms | device 80.4 ms | total 111.6 ms | load_model 95.0 ms (background)".
+    std::string summary() const;
+
+private:
+    std::vector<std::pair<std::string, double>> finished;
+    std::vector<std::pair<std::string, double>> background;
+    std::string running;
+    Clock::time_point started{};
+    bool is_running = false;
+};
+
+// Results of one configuration.
+struct BenchmarkRun {
+    std::vector<std::pair<std::string, uint64_t>> config;
+    std::vector<std::pair<std::string, double>> startup_ms;
+    std::vector<double> cpu_frame_ms;
+
+    struct GpuScope {
+        std::string name;
+        size_t samples = 0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+    };
+    std::vector<GpuScope> gpu_ms;
+
+    std::vector<std::pair<std::string, uint64_t>> memory_bytes;
+
+    void add_gpu_scopes(const GpuProfiler& profiler);
+    void add_allocator_stats(const AllocatorStats& stats);
+};
+
+// The headless path every sample takes the same way; headless runs have no window, surface or
+// swap chain.
+
+// What the window system needs, none when headless: GLFW is not even initialized without a
+// window, and nothing is presented. window_extensions is glfwGetRequiredInstanceExtensions, passed
+// in so Core does not depend on GLFW.
+std::vector<const char*> required_instance_extensions(bool headless, const char** (*window_extensions)(uint32_t* count));
+
+// VK_KHR_swapchain, none when headless.
+const std::vector<const char*>& required_device_extensions(bool headless);
+
+// Whether family can present to surface. Headless runs never present, so the graphics family
+// stands in.
+bool supports_present(bool headless, VkPhysicalDevice physical_device, uint32_t family,
+    const VkQueueFamilyProperties& properties, VkSurfaceKHR surface);
+
+// Final layout of the image a frame ends on. PRESENT_SRC_KHR needs VK_KHR_swapchain, which
+// headless runs do not enable.
+VkImageLayout presentable_layout(bool headless);
+
+// Offscreen targets of extent, one per frame in flight, in place of the swap chain's images.
+void create_offscreen_swap_chain(OffscreenTargets& targets, VkPhysicalDevice physical_device, VkDevice logical_device,
+    VkExtent2D extent, uint32_t frames_in_flight, std::vector<VkImage>& images, VkFormat& image_format, VkExtent2D& image_extent);
+
+// Draws warmup_frames plus frames frames back to back and adds the CPU time of the measured ones
+// to run; the first frame is timed as startup's "first_frame". draw_frame gets frame_delta_ms as
+// the time since the previous frame, so simulations advance the same amount every frame whatever
+// the machine. The warmup frames are left out of the results; the profiler window only keeps the
+// measured ones.
+void run_benchmark_frames(const BenchmarkSettings& settings, VkDevice logical_device, GpuProfiler& profiler,
+    PhaseTimer& startup, BenchmarkRun& run, const std::function<void(float frame_delta_ms)>& draw_frame,
+    float frame_delta_ms = 1000.0f / 60.0f);
+
+class BenchmarkReport {
+public:
+    explicit BenchmarkReport(const std::string& sample) : sample(sample) {}
+
+    void add_run(BenchmarkRun run) { runs.push_back(std::move(run)); }
+
+    // To path, or stdout when it is empty.
+    void write(const std::string& path) const;
+
+private:
+    std::string sample;
+    std::vector<BenchmarkRun> runs;
+};
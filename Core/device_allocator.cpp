@@ -0,0 +1,369 @@
+#include "device_allocator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+void DeviceAllocator::init(VkPhysicalDevice physical_device, VkDevice logical_device, VkDeviceSize block_size) {
+    if (block_size < min_allocation_size || (block_size & (block_size - 1)) != 0) {
+        throw std::runtime_error("vk: allocator block size must be a power of two");
+    }
+
+    this->physical_device = physical_device;
+    this->logical_device = logical_device;
+    this->block_size = block_size;
+    memory_budget = false;
+
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    max_order = 0;
+    while (size_for_order(max_order) < block_size) {
+        max_order++;
+    }
+
+    pools.clear();
+    pools.resize(memory_properties.memoryTypeCount * 2);
+    counters = {};
+}
+
+void DeviceAllocator::cleanup() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& pool : pools) {
+        for (auto& block : pool.blocks) {
+            vkFreeMemory(logical_device, block->memory, nullptr);
+        }
+    }
+    pools.clear();
+
+    // Dedicated allocations are owned by their resources and must be freed before this point.
+    counters = {};
+}
+
+Allocation DeviceAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Allocation allocation{};
+    allocation.requested_size = requirements.size;
+    allocation.memory_type = find_memory_type(requirements.memoryTypeBits, properties);
+    allocation.pool = allocation.memory_type * 2 + (linear ? 0 : 1);
+
+    VkDeviceSize size = std::max({ requirements.size, requirements.alignment, min_allocation_size });
+    bool lazily_allocated = (memory_properties.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+    if (size <= block_size / 4 && !lazily_allocated) {
+        allocation.order = order_for_size(size);
+
+        Pool& pool = pools[allocation.pool];
+        Block* block = nullptr;
+        VkDeviceSize offset = 0;
+
+        for (auto& candidate : pool.blocks) {
+            if (allocate_from_block(*candidate, allocation.order, offset)) {
+                block = candidate.get();
+                break;
+            }
+        }
+
+        if (block == nullptr) {
+            // The heap may be too small for another whole block (e.g. a 256 MiB BAR heap); fall
+            // through to a dedicated allocation in that case.
+            block = create_block(allocation.pool, allocation.memory_type);
+            if (block != nullptr && !allocate_from_block(*block, allocation.order, offset)) {
+                block = nullptr;
+            }
+        }
+
+        if (block != nullptr) {
+            allocation.memory = block->memory;
+            allocation.offset = offset;
+            allocation.size = size_for_order(allocation.order);
+            allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+
+            counters.allocation_count++;
+            counters.used_bytes += allocation.size;
+            counters.requested_bytes += requirements.size;
+            return allocation;
+        }
+    }
+
+    allocation.memory = allocate_device_memory(requirements.size, allocation.memory_type, &allocation.mapped);
+    if (allocation.memory == VK_NULL_HANDLE) {
+        throw std::runtime_error("vk: failed to allocate device memory");
+    }
+
+    allocation.offset = 0;
+    allocation.size = requirements.size;
+    allocation.dedicated = true;
+
+    counters.allocation_count++;
+    counters.dedicated_count++;
+    counters.reserved_bytes += allocation.size;
+    counters.used_bytes += allocation.size;
+    counters.requested_bytes += requirements.size;
+    return allocation;
+}
+
+void DeviceAllocator::free(Allocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    counters.allocation_count--;
+    counters.used_bytes -= allocation.size;
+
+    if (allocation.dedicated) {
+        vkFreeMemory(logical_device, allocation.memory, nullptr);
+
+        counters.dedicated_count--;
+        counters.reserved_bytes -= allocation.size;
+        counters.requested_bytes -= allocation.requested_size;
+        allocation = {};
+        return;
+    }
+
+    Pool& pool = pools[allocation.pool];
+    auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [&](const std::unique_ptr<Block>& block) {
+        return block->memory == allocation.memory;
+    });
+
+    if (it == pool.blocks.end()) {
+        throw std::runtime_error("vk: freeing an allocation that does not belong to this allocator");
+    }
+
+    free_to_block(**it, allocation.offset, allocation.order);
+
+    // Hand empty blocks back to the driver, but keep one per pool around so a resource that is
+    // recreated every resize does not bounce a whole block in and out.
+    if (pool.blocks.size() > 1 && block_is_empty(**it)) {
+        vkFreeMemory(logical_device, (*it)->memory, nullptr);
+        counters.reserved_bytes -= block_size;
+        pool.blocks.erase(it);
+    }
+
+    counters.requested_bytes -= allocation.requested_size;
+    allocation = {};
+}
+
+void DeviceAllocator::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& allocation) {
+    create_buffer(size, usage, properties, {}, buffer, allocation);
+}
+
+void DeviceAllocator::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+    const std::vector<uint32_t>& queue_families, VkBuffer& buffer, Allocation& allocation) {
+    std::vector<uint32_t> unique_families = queue_families;
+    std::sort(unique_families.begin(), unique_families.end());
+    unique_families.erase(std::unique(unique_families.begin(), unique_families.end()), unique_families.end());
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (unique_families.size() > 1) {
+        buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(unique_families.size());
+        buffer_info.pQueueFamilyIndices = unique_families.data();
+    }
+
+    if (vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create buffer");
+    }
+
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
+
+    allocation = allocate(mem_requirements, properties, true);
+
+    vkBindBufferMemory(logical_device, buffer, allocation.memory, allocation.offset);
+}
+
+void DeviceAllocator::destroy_buffer(VkBuffer buffer, Allocation& allocation) {
+    vkDestroyBuffer(logical_device, buffer, nullptr);
+    free(allocation);
+}
+
+void DeviceAllocator::create_image(const VkImageCreateInfo& image_info, VkMemoryPropertyFlags properties, VkImage& image, Allocation& allocation) {
+    if (vkCreateImage(logical_device, &image_info, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create image");
+    }
+
+    VkMemoryRequirements mem_requirements;
+    vkGetImageMemoryRequirements(logical_device, image, &mem_requirements);
+
+    if ((properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0 && !has_memory_type(mem_requirements.memoryTypeBits, properties)) {
+        properties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    }
+
+    allocation = allocate(mem_requirements, properties, image_info.tiling == VK_IMAGE_TILING_LINEAR);
+
+    vkBindImageMemory(logical_device, image, allocation.memory, allocation.offset);
+}
+
+void DeviceAllocator::destroy_image(VkImage image, Allocation& allocation) {
+    vkDestroyImage(logical_device, image, nullptr);
+    free(allocation);
+}
+
+uint32_t DeviceAllocator::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("vk: failed to find suitable memory type");
+}
+
+bool DeviceAllocator::has_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return true;
+        }
+    }
+    return false;
+}
+
+VkDeviceSize DeviceAllocator::committed_bytes(const Allocation& allocation) const {
+    if (allocation.memory == VK_NULL_HANDLE ||
+        (memory_properties.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) == 0) {
+        return allocation.size;
+    }
+
+    VkDeviceSize committed = 0;
+    vkGetDeviceMemoryCommitment(logical_device, allocation.memory, &committed);
+    return committed;
+}
+
+VkDeviceSize DeviceAllocator::heap_headroom(VkMemoryPropertyFlags properties) const {
+    uint32_t heap = memory_properties.memoryTypes[find_memory_type(~0u, properties)].heapIndex;
+
+    if (!memory_budget) {
+        return memory_properties.memoryHeaps[heap].size / 4;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties2.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(physical_device, &properties2);
+
+    return budget.heapBudget[heap] > budget.heapUsage[heap] ? budget.heapBudget[heap] - budget.heapUsage[heap] : 0;
+}
+
+AllocatorStats DeviceAllocator::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    AllocatorStats result = counters;
+    for (const auto& pool : pools) {
+        result.block_count += static_cast<uint32_t>(pool.blocks.size());
+    }
+
+    return result;
+}
+
+void DeviceAllocator::print_stats(std::ostream& out) const {
+    AllocatorStats s = stats();
+
+    auto mib = [](VkDeviceSize bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+
+    out << std::fixed << std::setprecision(2)
+        << "allocator: " << s.allocation_count << " allocations in "
+        << s.block_count << " blocks + " << s.dedicated_count << " dedicated, "
+        << mib(s.requested_bytes) << " MiB requested, "
+        << mib(s.used_bytes) << " MiB used, "
+        << mib(s.reserved_bytes) << " MiB reserved" << std::endl;
+}
+
+VkDeviceMemory DeviceAllocator::allocate_device_memory(VkDeviceSize size, uint32_t memory_type, void** mapped) {
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &memory) != VK_SUCCESS) {
+        return VK_NULL_HANDLE;
+    }
+
+    *mapped = nullptr;
+    if (memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(logical_device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            vkFreeMemory(logical_device, memory, nullptr);
+            throw std::runtime_error("vk: failed to map device memory");
+        }
+    }
+
+    return memory;
+}
+
+DeviceAllocator::Block* DeviceAllocator::create_block(uint32_t pool_index, uint32_t memory_type) {
+    auto block = std::make_unique<Block>();
+
+    block->memory = allocate_device_memory(block_size, memory_type, &block->mapped);
+    if (block->memory == VK_NULL_HANDLE) {
+        return nullptr;
+    }
+
+    block->free_lists.resize(max_order + 1);
+    block->free_lists[max_order].insert(0);
+
+    counters.reserved_bytes += block_size;
+
+    pools[pool_index].blocks.push_back(std::move(block));
+    return pools[pool_index].blocks.back().get();
+}
+
+bool DeviceAllocator::allocate_from_block(Block& block, uint32_t order, VkDeviceSize& offset) {
+    uint32_t current = order;
+    while (current <= max_order && block.free_lists[current].empty()) {
+        current++;
+    }
+
+    if (current > max_order) {
+        return false;
+    }
+
+    offset = *block.free_lists[current].begin();
+    block.free_lists[current].erase(block.free_lists[current].begin());
+
+    // Split down to the requested order, returning the upper halves to the free lists.
+    while (current > order) {
+        current--;
+        block.free_lists[current].insert(offset + size_for_order(current));
+    }
+
+    return true;
+}
+
+void DeviceAllocator::free_to_block(Block& block, VkDeviceSize offset, uint32_t order) {
+    // Merge with the buddy for as long as it is free too.
+    while (order < max_order) {
+        VkDeviceSize buddy = offset ^ size_for_order(order);
+        if (block.free_lists[order].erase(buddy) == 0) {
+            break;
+        }
+
+        offset = std::min(offset, buddy);
+        order++;
+    }
+
+    block.free_lists[order].insert(offset);
+}
+
+bool DeviceAllocator::block_is_empty(const Block& block) const {
+    return !block.free_lists[max_order].empty();
+}
+
+uint32_t DeviceAllocator::order_for_size(VkDeviceSize size) const {
+    uint32_t order = 0;
+    while (size_for_order(order) < size) {
+        order++;
+    }
+
+    return order;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <vector>
+
+// A piece of device memory handed out by DeviceAllocator. Either a range inside a shared block
+// or a whole VkDeviceMemory of its own (dedicated).
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    VkDeviceSize requested_size = 0;
+
+    // Non-null for host-visible memory. Blocks are mapped once and stay mapped for their lifetime.
+    void* mapped = nullptr;
+
+    uint32_t memory_type = 0;
+    uint32_t pool = 0;
+    uint32_t order = 0;
+    bool dedicated = false;
+};
+
+struct AllocatorStats {
+    uint32_t block_count = 0;
+    uint32_t dedicated_count = 0;
+    uint32_t allocation_count = 0;
+
+    // Bytes held in VkDeviceMemory objects, bytes handed out (rounded to buddy sizes) and bytes
+    // actually asked for by vkGet*MemoryRequirements.
+    VkDeviceSize reserved_bytes = 0;
+    VkDeviceSize used_bytes = 0;
+    VkDeviceSize requested_bytes = 0;
+};
+
+// Sub-allocates device memory out of large blocks so a scene costs a handful of vkAllocateMemory
+// calls instead of one per resource.
+//
+// Blocks are power-of-two sized and split with a buddy scheme, so any alignment up to the rounded
+// allocation size comes for free. Linear (buffers, linear images) and optimal-tiling resources live
+// in separate pools per memory type, which keeps bufferImageGranularity out of the picture.
+// Anything larger than a quarter of a block gets a dedicated allocation, and so does lazily
+// allocated memory, which the driver only commits per VkDeviceMemory.
+class DeviceAllocator {
+public:
+    static constexpr VkDeviceSize default_block_size = 64ull * 1024 * 1024;
+    static constexpr VkDeviceSize min_allocation_size = 256;
+
+    void init(VkPhysicalDevice physical_device, VkDevice logical_device, VkDeviceSize block_size = default_block_size);
+    void cleanup();
+
+    VkPhysicalDevice physical_device_handle() const { return physical_device; }
+
+    Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+    void free(Allocation& allocation);
+
+    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& allocation);
+
+    // Shared between the given queue families without ownership transfers (concurrent sharing)
+    // when they differ; exclusive otherwise.
+    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+        const std::vector<uint32_t>& queue_families, VkBuffer& buffer, Allocation& allocation);
+    void destroy_buffer(VkBuffer buffer, Allocation& allocation);
+
+    // LAZILY_ALLOCATED in properties is a preference: images that have no such memory type get
+    // the other properties alone.
+    void create_image(const VkImageCreateInfo& image_info, VkMemoryPropertyFlags properties, VkImage& image, Allocation& allocation);
+    void destroy_image(VkImage image, Allocation& allocation);
+
+    uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    bool has_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+
+    // What the driver actually committed for lazily allocated memory, the allocation's size otherwise.
+    VkDeviceSize committed_bytes(const Allocation& allocation) const;
+
+    // Call once VK_EXT_memory_budget is enabled on the device.
+    void enable_memory_budget() { memory_budget = true; }
+
+    // Bytes the heap behind the first memory type with these properties can still take: budget
+    // minus usage as VK_EXT_memory_budget reports them, which counts other processes too, or a
+    // quarter of the heap's size without the extension.
+    VkDeviceSize heap_headroom(VkMemoryPropertyFlags properties) const;
+
+    AllocatorStats stats() const;
+    void print_stats(std::ostream& out) const;
+
+private:
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* mapped = nullptr;
+
+        // Free offsets per buddy order, order 0 being min_allocation_size.
+        std::vector<std::set<VkDeviceSize>> free_lists;
+    };
+
+    struct Pool {
+        std::vector<std::unique_ptr<Block>> blocks;
+    };
+
+    VkDeviceMemory allocate_device_memory(VkDeviceSize size, uint32_t memory_type, void** mapped);
+    Block* create_block(uint32_t pool_index, uint32_t memory_type);
+    bool allocate_from_block(Block& block, uint32_t order, VkDeviceSize& offset);
+    void free_to_block(Block& block, VkDeviceSize offset, uint32_t order);
+    bool block_is_empty(const Block& block) const;
+
+    uint32_t order_for_size(VkDeviceSize size) const;
+    VkDeviceSize size_for_order(uint32_t order) const { return min_allocation_size << order; }
+
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    VkDevice logical_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memory_properties{};
+    bool memory_budget = false;
+
+    VkDeviceSize block_size = default_block_size;
+    uint32_t max_order = 0;
+
+    // Two pools per memory type: index * 2 for linear resources, index * 2 + 1 for optimal-tiling images.
+    std::vector<Pool> pools;
+
+    // Everything but block_count, which is derived from the pools.
+    AllocatorStats counters{};
+
+    mutable std::mutex mutex;
+};
@@ -0,0 +1,201 @@
+#include "frame_graph.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void FrameGraph::init(VkDevice logical_device, uint32_t frames_in_flight) {
+    this->logical_device = logical_device;
+    this->frames_in_flight = frames_in_flight;
+    history = frames_in_flight + 1;
+    current_frame = 0;
+    started = false;
+}
+
+void FrameGraph::cleanup() {
+    for (auto& timeline : timelines) {
+        vkDestroySemaphore(logical_device, timeline.semaphore, nullptr);
+    }
+    timelines.clear();
+    passes.clear();
+}
+
+uint32_t FrameGraph::add_pass(const std::string& name, VkQueue queue) {
+    if (started) {
+        throw std::runtime_error("frame graph: passes must be added before the first frame");
+    }
+
+    auto it = std::find_if(timelines.begin(), timelines.end(), [&](const Timeline& timeline) { return timeline.queue == queue; });
+    uint32_t timeline_index = static_cast<uint32_t>(it - timelines.begin());
+
+    if (it == timelines.end()) {
+        VkSemaphoreTypeCreateInfo type_info{};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_info.pNext = &type_info;
+
+        Timeline timeline{};
+        timeline.queue = queue;
+        if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &timeline.semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create timeline semaphore");
+        }
+        timelines.push_back(timeline);
+    }
+
+    Pass pass{};
+    pass.name = name;
+    pass.timeline = timeline_index;
+    passes.push_back(pass);
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void FrameGraph::add_dependency(uint32_t pass, uint32_t dependency, VkPipelineStageFlags wait_stage, uint32_t frame_distance) {
+    if (started) {
+        throw std::runtime_error("frame graph: dependencies must be added before the first frame");
+    }
+    if (frame_distance == 0 && dependency >= pass) {
+        throw std::runtime_error("frame graph: " + passes[pass].name + " depends on " + passes[dependency].name +
+            " in the same frame, which is not submitted before it");
+    }
+
+    passes[pass].dependencies.push_back({ dependency, wait_stage, frame_distance });
+    history = std::max(history, frame_distance + 1);
+}
+
+void FrameGraph::begin_frame() {
+    if (!started) {
+        started = true;
+        current_frame = 0;
+        for (auto& pass : passes) {
+            pass.values.assign(history, 0);
+        }
+        return;
+    }
+
+    // Carry every pass forward, so a pass that is not submitted this frame still reports its
+    // last value.
+    current_frame++;
+    for (auto& pass : passes) {
+        pass.values[current_frame % history] = pass.values[(current_frame - 1) % history];
+    }
+}
+
+uint64_t FrameGraph::value_at(const Pass& pass, uint64_t frame) const {
+    if (frame > current_frame || current_frame - frame >= history) {
+        throw std::runtime_error("frame graph: frame out of the tracked range of " + pass.name);
+    }
+    return pass.values[frame % history];
+}
+
+void FrameGraph::wait_for_pass(uint32_t pass, uint64_t frame) {
+    uint64_t value = value_at(passes[pass], frame);
+    if (value == 0) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timelines[passes[pass].timeline].semaphore;
+    wait_info.pValues = &value;
+
+    if (vkWaitSemaphores(logical_device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to wait for " + passes[pass].name);
+    }
+}
+
+void FrameGraph::wait_for_slot(uint32_t pass) {
+    if (current_frame >= frames_in_flight) {
+        wait_for_pass(pass, current_frame - frames_in_flight);
+    }
+}
+
+void FrameGraph::submit(uint32_t pass_index, VkCommandBuffer command_buffer,
+    const std::vector<BinarySemaphoreWait>& binary_waits, VkSemaphore binary_signal) {
+    Pass& pass = passes[pass_index];
+    Timeline& timeline = timelines[pass.timeline];
+
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<uint64_t> wait_values;
+    std::vector<VkPipelineStageFlags> wait_stages;
+
+    for (const auto& dependency : pass.dependencies) {
+        if (current_frame < dependency.frame_distance) {
+            continue;
+        }
+
+        uint64_t value = value_at(passes[dependency.pass], current_frame - dependency.frame_distance);
+        if (value == 0) {
+            continue;
+        }
+
+        wait_semaphores.push_back(timelines[passes[dependency.pass].timeline].semaphore);
+        wait_values.push_back(value);
+        wait_stages.push_back(dependency.wait_stage);
+    }
+
+    // Values are ignored for binary semaphores but the arrays have to line up.
+    for (const auto& wait : binary_waits) {
+        wait_semaphores.push_back(wait.semaphore);
+        wait_values.push_back(0);
+        wait_stages.push_back(wait.stage);
+    }
+
+    uint64_t signal_value = timeline.last_value + 1;
+    VkSemaphore signal_semaphores[2] = { timeline.semaphore, binary_signal };
+    uint64_t signal_values[2] = { signal_value, 0 };
+    uint32_t signal_count = binary_signal != VK_NULL_HANDLE ? 2 : 1;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+    timeline_info.pWaitSemaphoreValues = wait_values.data();
+    timeline_info.signalSemaphoreValueCount = signal_count;
+    timeline_info.pSignalSemaphoreValues = signal_values;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+    submit_info.pWaitSemaphores = wait_semaphores.data();
+    submit_info.pWaitDstStageMask = wait_stages.data();
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    submit_info.signalSemaphoreCount = signal_count;
+    submit_info.pSignalSemaphores = signal_semaphores;
+
+    if (vkQueueSubmit(timeline.queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to submit " + pass.name);
+    }
+
+    timeline.last_value = signal_value;
+    pass.values[current_frame % history] = signal_value;
+}
+
+void FrameGraph::wait_idle() {
+    std::vector<VkSemaphore> semaphores;
+    std::vector<uint64_t> values;
+    for (const auto& timeline : timelines) {
+        if (timeline.last_value > 0) {
+            semaphores.push_back(timeline.semaphore);
+            values.push_back(timeline.last_value);
+        }
+    }
+
+    if (semaphores.empty()) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+    wait_info.pSemaphores = semaphores.data();
+    wait_info.pValues = values.data();
+
+    if (vkWaitSemaphores(logical_device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to wait for the frame graph");
+    }
+}
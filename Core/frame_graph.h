@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary semaphore attached to a pass submission, for the swap chain edges (acquire and present),
+// which cannot use timeline semaphores.
+struct BinarySemaphoreWait {
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VkPipelineStageFlags stage = 0;
+};
+
+// Per-frame passes and their dependencies, scheduled with one timeline semaphore per queue.
+//
+// Passes are declared once with the queue they run on and the passes they depend on, either in
+// the same frame or a fixed number of frames back. Every submission signals the next value of its
+// queue's timeline, and the GPU waits for exactly the values its dependencies signalled. The CPU
+// never waits on whole frames either: wait_for_slot() blocks only until the one submission whose
+// per-frame resources are about to be reused has finished.
+//
+// A pass that is skipped in a frame keeps the value of its last submission, so dependents still
+// wait for the latest work it did. Requires the timelineSemaphore feature (Vulkan 1.2).
+class FrameGraph {
+public:
+    void init(VkDevice logical_device, uint32_t frames_in_flight);
+    void cleanup();
+
+    // Declaration, before the first frame. Passes on the same VkQueue share a timeline.
+    uint32_t add_pass(const std::string& name, VkQueue queue);
+
+    // pass waits at wait_stage for dependency from frame_distance frames back; 0 means the same
+    // frame, in which case dependency has to be submitted first.
+    void add_dependency(uint32_t pass, uint32_t dependency, VkPipelineStageFlags wait_stage, uint32_t frame_distance = 0);
+
+    // Starts the next frame. The first frame is 0.
+    void begin_frame();
+    uint64_t frame() const { return current_frame; }
+    uint32_t frame_slot() const { return static_cast<uint32_t>(current_frame % frames_in_flight); }
+
+    // Blocks until pass has finished its last submission at or before the given frame.
+    void wait_for_pass(uint32_t pass, uint64_t frame);
+
+    // Blocks until pass no longer uses the resources of the current frame slot, i.e. its work from
+    // frames_in_flight frames ago has finished.
+    void wait_for_slot(uint32_t pass);
+
+    // Submits the pass for the current frame, waiting for its dependencies.
+    void submit(uint32_t pass, VkCommandBuffer command_buffer,
+        const std::vector<BinarySemaphoreWait>& binary_waits = {},
+        VkSemaphore binary_signal = VK_NULL_HANDLE);
+
+    // Blocks until everything submitted through the graph has finished.
+    void wait_idle();
+
+private:
+    struct Timeline {
+        VkQueue queue = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t last_value = 0;
+    };
+
+    struct Dependency {
+        uint32_t pass = 0;
+        VkPipelineStageFlags wait_stage = 0;
+        uint32_t frame_distance = 0;
+    };
+
+    struct Pass {
+        std::string name;
+        uint32_t timeline = 0;
+        std::vector<Dependency> dependencies;
+
+        // Timeline value of the last submission at or before each frame, indexed by frame % history.
+        std::vector<uint64_t> values;
+    };
+
+    uint64_t value_at(const Pass& pass, uint64_t frame) const;
+
+    VkDevice logical_device = VK_NULL_HANDLE;
+    uint32_t frames_in_flight = 0;
+
+    // Frames of values kept per pass; the largest distance any lookup can go back, plus one.
+    uint32_t history = 0;
+
+    std::vector<Timeline> timelines;
+    std::vector<Pass> passes;
+
+    uint64_t current_frame = 0;
+    bool started = false;
+};
@@ -0,0 +1,259 @@
+#include "frame_loop.h"
+
+#include <stdexcept>
+
+#include "benchmark.h"
+#include "vulkan_bootstrap.h"
+
+void FrameLoop::init(const Config& config) {
+    this->config = config;
+    current_frame = 0;
+    framebuffer_resized = false;
+
+    create_swap_chain();
+    create_image_views();
+    create_frame_objects();
+}
+
+void FrameLoop::cleanup() {
+    cleanup_swap_chain();
+
+    for (size_t i = 0; i < in_flight_fences.size(); i++) {
+        vkDestroySemaphore(config.logical_device, render_finished_semaphores[i], nullptr);
+        vkDestroySemaphore(config.logical_device, image_available_semaphores[i], nullptr);
+        vkDestroyFence(config.logical_device, in_flight_fences[i], nullptr);
+    }
+    image_available_semaphores.clear();
+    render_finished_semaphores.clear();
+    in_flight_fences.clear();
+
+    if (!command_buffers.empty()) {
+        vkFreeCommandBuffers(config.logical_device, config.command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
+        command_buffers.clear();
+    }
+}
+
+void FrameLoop::create_swap_chain() {
+    if (is_headless()) {
+        create_offscreen_swap_chain(offscreen_targets, config.physical_device, config.logical_device, config.headless_extent,
+            frames_in_flight(), swap_chain_images, swap_chain_image_format, swap_chain_extent);
+        return;
+    }
+
+    SwapChainSupportDetails swap_chain_support = query_swap_chain_support(config.physical_device, config.surface);
+
+    VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
+    VkPresentModeKHR present_mode = config.pacing.choose_present_mode(swap_chain_support.present_modes);
+    VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities, config.wait_for_framebuffer_extent());
+
+    uint32_t image_count = choose_swap_image_count(swap_chain_support.capabilities);
+
+    VkSwapchainCreateInfoKHR create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    create_info.surface = config.surface;
+
+    create_info.minImageCount = image_count;
+    create_info.imageFormat = surface_format.format;
+    create_info.imageColorSpace = surface_format.colorSpace;
+    create_info.imageExtent = extent;
+    create_info.imageArrayLayers = 1;
+    create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    uint32_t queue_family_indices[] = { config.graphics_family, config.present_family };
+
+    if (config.graphics_family != config.present_family) {
+        create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        create_info.queueFamilyIndexCount = 2;
+        create_info.pQueueFamilyIndices = queue_family_indices;
+    }
+    else {
+        create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    create_info.preTransform = swap_chain_support.capabilities.currentTransform;
+    create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    create_info.presentMode = present_mode;
+    create_info.clipped = VK_TRUE;
+
+    create_info.oldSwapchain = VK_NULL_HANDLE;
+
+    if (vkCreateSwapchainKHR(config.logical_device, &create_info, nullptr, &swap_chain) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create swap chain");
+    }
+
+    vkGetSwapchainImagesKHR(config.logical_device, swap_chain, &image_count, nullptr);
+    swap_chain_images.resize(image_count);
+    vkGetSwapchainImagesKHR(config.logical_device, swap_chain, &image_count, swap_chain_images.data());
+
+    swap_chain_image_format = surface_format.format;
+    swap_chain_extent = extent;
+}
+
+void FrameLoop::create_image_views() {
+    swap_chain_image_views.resize(swap_chain_images.size());
+
+    for (size_t i = 0; i < swap_chain_images.size(); i++) {
+        VkImageViewCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        create_info.image = swap_chain_images[i];
+        create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        create_info.format = swap_chain_image_format;
+        create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        create_info.subresourceRange.baseMipLevel = 0;
+        create_info.subresourceRange.levelCount = 1;
+        create_info.subresourceRange.baseArrayLayer = 0;
+        create_info.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(config.logical_device, &create_info, nullptr, &swap_chain_image_views[i]) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create image views");
+        }
+    }
+}
+
+void FrameLoop::cleanup_swap_chain() {
+    for (auto image_view : swap_chain_image_views) {
+        vkDestroyImageView(config.logical_device, image_view, nullptr);
+    }
+    swap_chain_image_views.clear();
+
+    if (is_headless()) {
+        offscreen_targets.cleanup();
+        return;
+    }
+
+    vkDestroySwapchainKHR(config.logical_device, swap_chain, nullptr);
+    swap_chain = VK_NULL_HANDLE;
+}
+
+void FrameLoop::recreate_swap_chain() {
+    // Blocks while minimized, before anything is torn down.
+    config.wait_for_framebuffer_extent();
+
+    vkDeviceWaitIdle(config.logical_device);
+
+    if (config.present_waiter) {
+        config.present_waiter->reset();
+    }
+    config.destroy_swap_chain_resources();
+    cleanup_swap_chain();
+
+    create_swap_chain();
+    create_image_views();
+    config.create_swap_chain_resources();
+}
+
+void FrameLoop::create_frame_objects() {
+    uint32_t frame_count = frames_in_flight();
+
+    command_buffers.resize(frame_count);
+
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = config.command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = frame_count;
+
+    if (vkAllocateCommandBuffers(config.logical_device, &alloc_info, command_buffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to allocate command buffers");
+    }
+
+    image_available_semaphores.resize(frame_count);
+    render_finished_semaphores.resize(frame_count);
+    in_flight_fences.resize(frame_count);
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (size_t i = 0; i < frame_count; i++) {
+        if (vkCreateSemaphore(config.logical_device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(config.logical_device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
+            vkCreateFence(config.logical_device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create synchronization objects for a frame");
+        }
+    }
+}
+
+void FrameLoop::draw_frame(const RecordFrame& record) {
+    bool headless = is_headless();
+
+    vkWaitForFences(config.logical_device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+    if (config.profiler) {
+        config.profiler->begin_frame(current_frame);
+    }
+
+    uint32_t image_index;
+    VkResult result = headless ? VK_SUCCESS : vkAcquireNextImageKHR(config.logical_device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+    if (headless) {
+        image_index = offscreen_targets.next_image();
+    }
+    else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        recreate_swap_chain();
+        return;
+    }
+    else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        throw std::runtime_error("vk: failed to acquire swap chain image");
+    }
+
+    vkResetFences(config.logical_device, 1, &in_flight_fences[current_frame]);
+
+    vkResetCommandBuffer(command_buffers[current_frame], 0);
+    record(command_buffers[current_frame], current_frame, image_index);
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+    VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame] };
+    VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    submit_info.waitSemaphoreCount = headless ? 0 : 1;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffers[current_frame];
+
+    VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame] };
+    submit_info.signalSemaphoreCount = headless ? 0 : 1;
+    submit_info.pSignalSemaphores = signal_semaphores;
+
+    if (vkQueueSubmit(config.graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to submit draw command buffer");
+    }
+
+    if (headless) {
+        current_frame = (current_frame + 1) % frames_in_flight();
+        return;
+    }
+
+    VkPresentInfoKHR present_info{};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = signal_semaphores;
+
+    VkSwapchainKHR swap_chains[] = { swap_chain };
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = swap_chains;
+    present_info.pImageIndices = &image_index;
+    if (config.present_waiter) {
+        present_info.pNext = config.present_waiter->next_present(swap_chain, present_info.pNext);
+    }
+
+    result = vkQueuePresentKHR(config.present_queue, &present_info);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized) {
+        framebuffer_resized = false;
+        recreate_swap_chain();
+    }
+    else if (result != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to present swap chain image");
+    }
+
+    current_frame = (current_frame + 1) % frames_in_flight();
+}
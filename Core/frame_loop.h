@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "frame_pacing.h"
+#include "gpu_profiler.h"
+#include "offscreen_targets.h"
+
+// The swap chain and the frame loop of a sample that renders each frame with one command buffer
+// on the graphics queue, as Triangle and Rectangle do: the swap chain, or OffscreenTargets standing
+// in for it when headless, its image views, and per frame in flight a command buffer, a fence and
+// the acquire and present semaphores.
+//
+// draw_frame() waits for the slot's fence, acquires an image, lets the sample record the slot's
+// command buffer, submits it and presents. When the swap chain is out of date, suboptimal or the
+// window was resized, the device is drained and the swap chain made again in place; the sample's
+// framebuffers and other attachments of the swap chain's size go and come back through
+// destroy_swap_chain_resources and create_swap_chain_resources around it.
+//
+// Samples with more queues or passes, or that retire swap chains instead of draining the device,
+// keep their own loops.
+class FrameLoop {
+public:
+    struct Config {
+        VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+        VkDevice logical_device = VK_NULL_HANDLE;
+        // VK_NULL_HANDLE when headless.
+        VkSurfaceKHR surface = VK_NULL_HANDLE;
+        uint32_t graphics_family = 0;
+        uint32_t present_family = 0;
+        VkQueue graphics_queue = VK_NULL_HANDLE;
+        VkQueue present_queue = VK_NULL_HANDLE;
+        // The command buffers are allocated from it, so it needs RESET_COMMAND_BUFFER.
+        VkCommandPool command_pool = VK_NULL_HANDLE;
+
+        // Present mode and frames in flight.
+        FramePacing pacing;
+        PresentWaiter* present_waiter = nullptr;
+        // Optional; begin_frame() is called once the slot's fence has signalled.
+        GpuProfiler* profiler = nullptr;
+
+        // Size of the offscreen targets when headless.
+        VkExtent2D headless_extent{};
+        // The window's framebuffer size, waiting for events while it is zero, i.e. minimized.
+        std::function<VkExtent2D()> wait_for_framebuffer_extent;
+
+        // Called with the device idle around recreating the swap chain.
+        std::function<void()> destroy_swap_chain_resources;
+        std::function<void()> create_swap_chain_resources;
+    };
+
+    // Records the frame into command_buffer, which is reset and not begun. frame_slot indexes the
+    // sample's per-frame resources, image_index the swap chain images.
+    using RecordFrame = std::function<void(VkCommandBuffer command_buffer, uint32_t frame_slot, uint32_t image_index)>;
+
+    // Creates the swap chain and its image views and the per-frame objects.
+    void init(const Config& config);
+
+    // After the sample destroyed its swap chain resources, with the device idle.
+    void cleanup();
+
+    bool is_headless() const { return config.surface == VK_NULL_HANDLE; }
+
+    // The swap chain is made again after the next present, e.g. from a framebuffer size callback.
+    void mark_resized() { framebuffer_resized = true; }
+
+    void draw_frame(const RecordFrame& record);
+
+    VkFormat image_format() const { return swap_chain_image_format; }
+    VkExtent2D extent() const { return swap_chain_extent; }
+    const std::vector<VkImageView>& image_views() const { return swap_chain_image_views; }
+    uint32_t frames_in_flight() const { return config.pacing.frames_in_flight; }
+    VkDeviceSize offscreen_memory_bytes() const { return offscreen_targets.memory_bytes(); }
+
+private:
+    void create_swap_chain();
+    void create_image_views();
+    void cleanup_swap_chain();
+    void recreate_swap_chain();
+    void create_frame_objects();
+
+    Config config;
+    OffscreenTargets offscreen_targets;
+
+    VkSwapchainKHR swap_chain = VK_NULL_HANDLE;
+    std::vector<VkImage> swap_chain_images;
+    VkFormat swap_chain_image_format = VK_FORMAT_UNDEFINED;
+    VkExtent2D swap_chain_extent{};
+    std::vector<VkImageView> swap_chain_image_views;
+
+    std::vector<VkCommandBuffer> command_buffers;
+    std::vector<VkSemaphore> image_available_semaphores;
+    std::vector<VkSemaphore> render_finished_semaphores;
+    std::vector<VkFence> in_flight_fences;
+
+    uint32_t current_frame = 0;
+    bool framebuffer_resized = false;
+};
@@ -0,0 +1,193 @@
+#include "frame_pacing.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+struct PresentModeName {
+    const char* name;
+    VkPresentModeKHR mode;
+};
+
+const PresentModeName present_mode_names[] = {
+    { "mailbox", VK_PRESENT_MODE_MAILBOX_KHR },
+    { "immediate", VK_PRESENT_MODE_IMMEDIATE_KHR },
+    { "fifo", VK_PRESENT_MODE_FIFO_KHR },
+    { "fifo-relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR },
+};
+
+bool has_extension(const std::vector<VkExtensionProperties>& extensions, const char* name) {
+    for (const auto& extension : extensions) {
+        if (strcmp(extension.extensionName, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+FramePacing FramePacing::from_command_line(int argc, char** argv) {
+    FramePacing pacing;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+
+        if (argument.rfind("--frames-in-flight=", 0) == 0) {
+            std::string value = argument.substr(strlen("--frames-in-flight="));
+            unsigned long count = 0;
+            try {
+                count = std::stoul(value);
+            }
+            catch (const std::exception&) {
+                count = 0;
+            }
+
+            if (count < 1 || count > max_frames_in_flight) {
+                throw std::runtime_error("frame pacing: --frames-in-flight must be between 1 and " + std::to_string(max_frames_in_flight));
+            }
+            pacing.frames_in_flight = static_cast<uint32_t>(count);
+        }
+        else if (argument.rfind("--present-mode=", 0) == 0) {
+            std::string value = argument.substr(strlen("--present-mode="));
+            bool found = false;
+            for (const auto& entry : present_mode_names) {
+                if (value == entry.name) {
+                    pacing.present_mode = entry.mode;
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                throw std::runtime_error("frame pacing: unknown present mode " + value);
+            }
+        }
+        else if (argument == "--low-latency") {
+            pacing.low_latency = true;
+        }
+    }
+
+    return pacing;
+}
+
+VkPresentModeKHR FramePacing::choose_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes) const {
+    for (const auto& available_present_mode : available_present_modes) {
+        if (available_present_mode == present_mode) {
+            return available_present_mode;
+        }
+    }
+
+    // The only mode every surface has to support.
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+const char* present_mode_name(VkPresentModeKHR present_mode) {
+    for (const auto& entry : present_mode_names) {
+        if (entry.mode == present_mode) {
+            return entry.name;
+        }
+    }
+    return "unknown";
+}
+
+bool PresentWaiter::is_supported(VkPhysicalDevice physical_device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    uint32_t extension_count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, extensions.data());
+
+    for (const char* name : device_extensions()) {
+        if (!has_extension(extensions, name)) {
+            return false;
+        }
+    }
+
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+    present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+    present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    present_id_features.pNext = &present_wait_features;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &present_id_features;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+    return present_id_features.presentId && present_wait_features.presentWait;
+}
+
+const std::vector<const char*>& PresentWaiter::device_extensions() {
+    static const std::vector<const char*> extensions = {
+        VK_KHR_PRESENT_ID_EXTENSION_NAME,
+        VK_KHR_PRESENT_WAIT_EXTENSION_NAME
+    };
+    return extensions;
+}
+
+const void* PresentWaiter::device_create_next(const void* next) {
+    present_wait_features = {};
+    present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    present_wait_features.pNext = const_cast<void*>(next);
+    present_wait_features.presentWait = VK_TRUE;
+
+    present_id_features = {};
+    present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    present_id_features.pNext = &present_wait_features;
+    present_id_features.presentId = VK_TRUE;
+
+    return &present_id_features;
+}
+
+void PresentWaiter::init(VkDevice logical_device, bool enabled) {
+    this->logical_device = logical_device;
+    this->enabled = false;
+
+    if (enabled) {
+        wait_for_present = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(logical_device, "vkWaitForPresentKHR"));
+        this->enabled = wait_for_present != nullptr;
+    }
+}
+
+const void* PresentWaiter::next_present(VkSwapchainKHR swap_chain, const void* next) {
+    if (!enabled) {
+        return next;
+    }
+
+    if (swap_chain != this->swap_chain) {
+        this->swap_chain = swap_chain;
+        last_present_id = 0;
+    }
+
+    last_present_id++;
+
+    present_id = {};
+    present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    present_id.pNext = next;
+    present_id.swapchainCount = 1;
+    present_id.pPresentIds = &last_present_id;
+    return &present_id;
+}
+
+void PresentWaiter::wait_for_last_present() {
+    if (!enabled || last_present_id == 0) {
+        return;
+    }
+
+    // VK_TIMEOUT and VK_ERROR_OUT_OF_DATE_KHR both just mean there is nothing more to wait for;
+    // the frame loop deals with the swap chain itself.
+    wait_for_present(logical_device, swap_chain, last_present_id, wait_timeout);
+}
+
+void PresentWaiter::reset() {
+    swap_chain = VK_NULL_HANDLE;
+    last_present_id = 0;
+}
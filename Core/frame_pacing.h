@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// How the samples pace frames against the display, chosen at startup instead of compiled in.
+//
+// Throughput-oriented setups want several frames in flight and MAILBOX or IMMEDIATE; latency-
+// sensitive ones want FIFO with low_latency, which holds every frame back until the previous one
+// is on screen before input is sampled.
+struct FramePacing {
+    static constexpr uint32_t max_frames_in_flight = 8;
+
+    uint32_t frames_in_flight = 2;
+
+    // Used when the surface supports it, FIFO otherwise.
+    VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+
+    // Waits for the last present with VK_KHR_present_wait before the next frame starts. Ignored
+    // when the device lacks the extension.
+    bool low_latency = false;
+
+    // Reads --frames-in-flight=N, --present-mode=mailbox|immediate|fifo|fifo-relaxed and
+    // --low-latency; anything else on the command line is left alone. Throws on bad values.
+    static FramePacing from_command_line(int argc, char** argv);
+
+    VkPresentModeKHR choose_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes) const;
+};
+
+const char* present_mode_name(VkPresentModeKHR present_mode);
+
+// VK_KHR_present_id and VK_KHR_present_wait, used for FramePacing::low_latency.
+//
+// Every present gets an increasing id, and wait_for_last_present() blocks until the previous one
+// has been displayed. Ids restart with each swap chain, so nothing is waited on right after one
+// was recreated.
+class PresentWaiter {
+public:
+    static constexpr uint64_t wait_timeout = 100'000'000; // 100 ms, so a hidden window cannot hang the loop.
+
+    // Needs a Vulkan 1.1 instance for the feature query.
+    static bool is_supported(VkPhysicalDevice physical_device);
+
+    // Extensions and feature structs to add to device creation when the waiter is used. The
+    // returned chain stays valid as long as this object.
+    static const std::vector<const char*>& device_extensions();
+    const void* device_create_next(const void* next);
+
+    void init(VkDevice logical_device, bool enabled);
+
+    bool is_enabled() const { return enabled; }
+
+    // Returns the VkPresentIdKHR to chain into VkPresentInfoKHR::pNext for this present, or next
+    // unchanged when disabled. The returned pointer is valid until the following call.
+    const void* next_present(VkSwapchainKHR swap_chain, const void* next);
+
+    void wait_for_last_present();
+
+    // Forgets the last present; call before the swap chain it went to is destroyed or retired.
+    void reset();
+
+private:
+    bool enabled = false;
+    VkDevice logical_device = VK_NULL_HANDLE;
+    PFN_vkWaitForPresentKHR wait_for_present = nullptr;
+
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+
+    VkSwapchainKHR swap_chain = VK_NULL_HANDLE;
+    uint64_t last_present_id = 0;
+    VkPresentIdKHR present_id{};
+};
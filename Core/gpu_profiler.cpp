@@ -0,0 +1,388 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Result order follows the bit order.
+const VkQueryPipelineStatisticFlags graphics_statistic_flags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+constexpr uint32_t graphics_statistic_count = 5;
+
+// Queues without graphics may only use the compute counter.
+const VkQueryPipelineStatisticFlags compute_statistic_flags =
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+VkQueryPool create_query_pool(VkDevice logical_device, VkQueryType type, uint32_t count, VkQueryPipelineStatisticFlags statistics) {
+    VkQueryPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = type;
+    pool_info.queryCount = count;
+    pool_info.pipelineStatistics = statistics;
+
+    VkQueryPool query_pool;
+    if (vkCreateQueryPool(logical_device, &pool_info, nullptr, &query_pool) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create profiler query pool");
+    }
+
+    return query_pool;
+}
+
+}
+
+GpuProfilerOptions GpuProfilerOptions::from_command_line(int argc, char** argv) {
+    GpuProfilerOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+
+        if (argument.rfind("--profile-csv=", 0) == 0) {
+            options.csv_path = argument.substr(strlen("--profile-csv="));
+            if (options.csv_path.empty()) {
+                throw std::runtime_error("gpu profiler: --profile-csv needs a path");
+            }
+        }
+        else if (argument == "--pipeline-statistics") {
+            options.pipeline_statistics = true;
+        }
+    }
+
+    return options;
+}
+
+bool GpuProfiler::supports_pipeline_statistics(VkPhysicalDevice physical_device) {
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physical_device, &features);
+    return features.pipelineStatisticsQuery == VK_TRUE;
+}
+
+void GpuProfiler::init(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t frames_in_flight,
+    const std::string& csv_path, bool pipeline_statistics) {
+    this->logical_device = logical_device;
+    this->pipeline_statistics = pipeline_statistics;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    timestamp_period = properties.limits.timestampPeriod;
+
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+    queue_families.resize(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+    slots.resize(frames_in_flight);
+    for (auto& slot : slots) {
+        create_pools(slot);
+    }
+    create_pools(loading);
+
+    if (!csv_path.empty()) {
+        csv.open(csv_path, std::ios::trunc);
+        if (!csv) {
+            throw std::runtime_error("gpu profiler: failed to open " + csv_path);
+        }
+        csv << "frame,scope,gpu_ms,ia_vertices,vs_invocations,clipping_primitives,fs_invocations,cs_invocations\n";
+    }
+
+    current = &loading;
+    current_frame = 0;
+    started = false;
+}
+
+void GpuProfiler::cleanup() {
+    for (auto& slot : slots) {
+        destroy_pools(slot);
+    }
+    slots.clear();
+    destroy_pools(loading);
+    current = nullptr;
+
+    if (csv.is_open()) {
+        csv.close();
+    }
+}
+
+void GpuProfiler::flush() {
+    if (!loading.scopes.empty()) {
+        collect(loading, true);
+        loading.scopes.clear();
+    }
+
+    for (auto& slot : slots) {
+        collect(slot, true);
+        slot.scopes.clear();
+    }
+}
+
+void GpuProfiler::begin_frame(uint32_t frame_slot) {
+    if (started) {
+        current_frame++;
+    }
+    started = true;
+
+    if (!loading.scopes.empty() && collect(loading, false)) {
+        loading.scopes.clear();
+    }
+
+    current = &slots[frame_slot];
+    collect(*current, true);
+    current->scopes.clear();
+    current->frame = current_frame;
+}
+
+GpuProfiler::Scope GpuProfiler::begin(VkCommandBuffer command_buffer, const std::string& name, uint32_t queue_family) {
+    if (current == nullptr || current->scopes.size() >= max_scopes || !supports_timestamps(queue_family)) {
+        return {};
+    }
+
+    Scope scope{};
+    scope.index = static_cast<uint32_t>(current->scopes.size());
+
+    ScopeRecord record{};
+    record.name = name;
+    record.queue_family = queue_family;
+    if (pipeline_statistics) {
+        VkQueueFlags flags = queue_families[queue_family].queueFlags;
+        if (flags & VK_QUEUE_GRAPHICS_BIT) {
+            record.statistics_pool = current->graphics_statistics;
+        }
+        else if (flags & VK_QUEUE_COMPUTE_BIT) {
+            record.statistics_pool = current->compute_statistics;
+        }
+    }
+    current->scopes.push_back(record);
+
+    vkCmdResetQueryPool(command_buffer, current->timestamps, scope.index * 2, 2);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, current->timestamps, scope.index * 2);
+
+    if (record.statistics_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, record.statistics_pool, scope.index, 1);
+        vkCmdBeginQuery(command_buffer, record.statistics_pool, scope.index, 0);
+    }
+
+    return scope;
+}
+
+void GpuProfiler::end(VkCommandBuffer command_buffer, const Scope& scope) {
+    if (!scope.is_valid()) {
+        return;
+    }
+
+    const ScopeRecord& record = current->scopes[scope.index];
+    if (record.statistics_pool != VK_NULL_HANDLE) {
+        vkCmdEndQuery(command_buffer, record.statistics_pool, scope.index);
+    }
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current->timestamps, scope.index * 2 + 1);
+}
+
+void GpuProfiler::create_pools(Slot& slot) {
+    slot.timestamps = create_query_pool(logical_device, VK_QUERY_TYPE_TIMESTAMP, max_scopes * 2, 0);
+    if (pipeline_statistics) {
+        slot.graphics_statistics = create_query_pool(logical_device, VK_QUERY_TYPE_PIPELINE_STATISTICS, max_scopes, graphics_statistic_flags);
+        slot.compute_statistics = create_query_pool(logical_device, VK_QUERY_TYPE_PIPELINE_STATISTICS, max_scopes, compute_statistic_flags);
+    }
+}
+
+void GpuProfiler::destroy_pools(Slot& slot) {
+    vkDestroyQueryPool(logical_device, slot.timestamps, nullptr);
+    if (slot.graphics_statistics != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(logical_device, slot.graphics_statistics, nullptr);
+        vkDestroyQueryPool(logical_device, slot.compute_statistics, nullptr);
+    }
+    slot = {};
+}
+
+bool GpuProfiler::collect(Slot& slot, bool partial) {
+    if (slot.scopes.empty()) {
+        return true;
+    }
+
+    // Value and availability per query. Without WAIT_BIT this never blocks; VK_NOT_READY just
+    // means some of them are not written yet.
+    uint32_t query_count = static_cast<uint32_t>(slot.scopes.size()) * 2;
+    std::vector<uint64_t> timestamps(query_count * 2);
+    VkResult result = vkGetQueryPoolResults(logical_device, slot.timestamps, 0, query_count,
+        timestamps.size() * sizeof(uint64_t), timestamps.data(), 2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY) {
+        throw std::runtime_error("vk: failed to read profiler timestamps");
+    }
+    if (result == VK_NOT_READY && !partial) {
+        return false;
+    }
+
+    bool complete = true;
+    for (size_t i = 0; i < slot.scopes.size(); i++) {
+        const ScopeRecord& record = slot.scopes[i];
+        const uint64_t* begin = &timestamps[i * 4];
+        const uint64_t* end = &timestamps[i * 4 + 2];
+        if (begin[1] == 0 || end[1] == 0) {
+            complete = false;
+            continue;
+        }
+
+        PipelineStatistics statistics{};
+        bool has_statistics = false;
+        if (record.statistics_pool != VK_NULL_HANDLE) {
+            uint32_t index = static_cast<uint32_t>(i);
+            uint64_t values[graphics_statistic_count + 1] = {};
+
+            if (record.statistics_pool == slot.graphics_statistics) {
+                result = vkGetQueryPoolResults(logical_device, record.statistics_pool, index, 1,
+                    sizeof(values), values, sizeof(values),
+                    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+                has_statistics = result == VK_SUCCESS && values[graphics_statistic_count] != 0;
+                statistics.input_assembly_vertices = values[0];
+                statistics.vertex_shader_invocations = values[1];
+                statistics.clipping_primitives = values[2];
+                statistics.fragment_shader_invocations = values[3];
+                statistics.compute_shader_invocations = values[4];
+            }
+            else {
+                result = vkGetQueryPoolResults(logical_device, record.statistics_pool, index, 1,
+                    2 * sizeof(uint64_t), values, 2 * sizeof(uint64_t),
+                    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+                has_statistics = result == VK_SUCCESS && values[1] != 0;
+                statistics.compute_shader_invocations = values[0];
+            }
+        }
+
+        double gpu_ms = ticks_to_ms(record.queue_family, begin[0], end[0]);
+        add(slot.frame, record.name, gpu_ms, has_statistics ? &statistics : nullptr);
+    }
+
+    return complete;
+}
+
+void GpuProfiler::add_sample(const std::string& name, double gpu_ms, const PipelineStatistics* statistics) {
+    add(current_frame, name, gpu_ms, statistics);
+}
+
+void GpuProfiler::add(uint64_t frame, const std::string& name, double gpu_ms, const PipelineStatistics* statistics) {
+    Series& entry = series_for(name);
+    entry.samples.push_back(gpu_ms);
+    if (entry.samples.size() > window) {
+        entry.samples.pop_front();
+    }
+    if (statistics != nullptr) {
+        entry.statistics = *statistics;
+        entry.has_statistics = true;
+    }
+
+    if (!csv.is_open()) {
+        return;
+    }
+
+    csv << frame << ',' << name << ',' << gpu_ms;
+    if (statistics != nullptr) {
+        csv << ',' << statistics->input_assembly_vertices << ',' << statistics->vertex_shader_invocations
+            << ',' << statistics->clipping_primitives << ',' << statistics->fragment_shader_invocations
+            << ',' << statistics->compute_shader_invocations;
+    }
+    else {
+        csv << ",,,,,";
+    }
+    csv << '\n';
+}
+
+bool GpuProfiler::supports_timestamps(uint32_t queue_family) const {
+    return queue_family < queue_families.size() && queue_families[queue_family].timestampValidBits > 0;
+}
+
+double GpuProfiler::ticks_to_ms(uint32_t queue_family, uint64_t begin_ticks, uint64_t end_ticks) const {
+    // Only the valid bits count; the difference wraps around with them.
+    uint32_t valid_bits = queue_families[queue_family].timestampValidBits;
+    uint64_t mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+    uint64_t ticks = (end_ticks - begin_ticks) & mask;
+    return static_cast<double>(ticks) * timestamp_period / 1e6;
+}
+
+double GpuProfiler::percentile(const std::string& name, double p) const {
+    const Series* entry = find_series(name);
+    if (entry == nullptr || entry->samples.empty()) {
+        return 0.0;
+    }
+
+    std::vector<double> sorted(entry->samples.begin(), entry->samples.end());
+    size_t rank = static_cast<size_t>(std::lround(std::clamp(p, 0.0, 1.0) * (sorted.size() - 1)));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+size_t GpuProfiler::sample_count(const std::string& name) const {
+    const Series* entry = find_series(name);
+    return entry != nullptr ? entry->samples.size() : 0;
+}
+
+std::vector<std::string> GpuProfiler::scope_names() const {
+    std::vector<std::string> names;
+    for (const auto& entry : series) {
+        names.push_back(entry.name);
+    }
+    return names;
+}
+
+std::string GpuProfiler::summary() const {
+    std::ostringstream stream;
+    stream.setf(std::ios::fixed);
+    stream.precision(2);
+
+    for (size_t i = 0; i < series.size(); i++) {
+        if (i > 0) {
+            stream << " | ";
+        }
+        stream << series[i].name << ' ' << percentile(series[i].name, 0.5) << " ms";
+    }
+
+    return stream.str();
+}
+
+std::string GpuProfiler::report() const {
+    std::ostringstream stream;
+    stream.setf(std::ios::fixed);
+    stream.precision(3);
+
+    for (const auto& entry : series) {
+        stream << entry.name << ": p50 " << percentile(entry.name, 0.5) << " ms, p95 " << percentile(entry.name, 0.95)
+            << " ms, p99 " << percentile(entry.name, 0.99) << " ms over " << entry.samples.size() << " frames";
+        if (entry.has_statistics) {
+            const PipelineStatistics& statistics = entry.statistics;
+            stream << "; vertices " << statistics.input_assembly_vertices << ", vs " << statistics.vertex_shader_invocations
+                << ", primitives " << statistics.clipping_primitives << ", fs " << statistics.fragment_shader_invocations
+                << ", cs " << statistics.compute_shader_invocations;
+        }
+        stream << '\n';
+    }
+
+    return stream.str();
+}
+
+GpuProfiler::Series& GpuProfiler::series_for(const std::string& name) {
+    for (auto& entry : series) {
+        if (entry.name == name) {
+            return entry;
+        }
+    }
+
+    series.push_back({});
+    series.back().name = name;
+    return series.back();
+}
+
+const GpuProfiler::Series* GpuProfiler::find_series(const std::string& name) const {
+    for (const auto& entry : series) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
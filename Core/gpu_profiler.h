@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// What the profiler records, chosen at startup like FramePacing.
+struct GpuProfilerOptions {
+    // One row per scope and frame: frame, scope, gpu_ms and the pipeline statistics. Empty to
+    // keep the results in memory only.
+    std::string csv_path;
+
+    // Needs the pipelineStatisticsQuery feature; ignored when the device lacks it.
+    bool pipeline_statistics = false;
+
+    // Reads --profile-csv=path and --pipeline-statistics; anything else on the command line is
+    // left alone.
+    static GpuProfilerOptions from_command_line(int argc, char** argv);
+};
+
+struct PipelineStatistics {
+    uint64_t input_assembly_vertices = 0;
+    uint64_t vertex_shader_invocations = 0;
+    uint64_t clipping_primitives = 0;
+    uint64_t fragment_shader_invocations = 0;
+    uint64_t compute_shader_invocations = 0;
+};
+
+// GPU time and pipeline statistics per named scope, measured with queries recorded into the
+// command buffers of every frame in flight.
+//
+// Each frame slot has its own query pools. A scope resets its queries in the command buffer that
+// writes them, so scopes on different queues need no ordering between each other, and the
+// results of a slot are read back when the slot comes around again: begin_frame() is called once
+// the CPU has waited for the frame that last used it, which has finished by then. Nothing ever
+// waits on a query; results that are still unavailable are dropped.
+//
+// Scopes recorded before the first begin_frame(), like mip generation while loading, go into a
+// separate slot that is read once all of them have finished, and count as frame 0.
+//
+// Timings keep a rolling window per scope for percentiles. Work outside the frame slots, like
+// staging batches, measures itself and reports through add_sample(). Not thread-safe.
+class GpuProfiler {
+public:
+    static constexpr uint32_t max_scopes = 16;
+    static constexpr size_t default_window = 240;
+
+    // A scope that could not be started (no timestamps on the queue, out of queries) is invalid
+    // and end() ignores it.
+    struct Scope {
+        uint32_t index = UINT32_MAX;
+        bool is_valid() const { return index != UINT32_MAX; }
+    };
+
+    static bool supports_pipeline_statistics(VkPhysicalDevice physical_device);
+
+    // pipeline_statistics only when the device was created with pipelineStatisticsQuery.
+    void init(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t frames_in_flight,
+        const std::string& csv_path, bool pipeline_statistics);
+    void cleanup();
+
+    // Samples kept per scope for the percentiles.
+    void set_window(size_t samples) { window = samples; }
+
+    // Collects every slot once the device is idle, so the last frames are not missing.
+    void flush();
+
+    // Collects the results of the given slot, then records into it. Call it once the CPU has
+    // waited for the slot's previous frame; scopes of it still running on another queue are dropped.
+    void begin_frame(uint32_t frame_slot);
+
+    // Outside of render passes; end() may be inside one as long as begin() was in the same
+    // command buffer.
+    Scope begin(VkCommandBuffer command_buffer, const std::string& name, uint32_t queue_family);
+    void end(VkCommandBuffer command_buffer, const Scope& scope);
+
+    // GPU time measured elsewhere, attributed to the current frame.
+    void add_sample(const std::string& name, double gpu_ms, const PipelineStatistics* statistics = nullptr);
+
+    bool supports_timestamps(uint32_t queue_family) const;
+    double ticks_to_ms(uint32_t queue_family, uint64_t begin_ticks, uint64_t end_ticks) const;
+
+    // p in [0, 1] over the rolling window; 0 for a scope without samples.
+    double percentile(const std::string& name, double p) const;
+    size_t sample_count(const std::string& name) const;
+
+    // In order of first appearance.
+    std::vector<std::string> scope_names() const;
+
+    // "compute 0.41 ms | render 1.20 ms", the median of every scope, for the window title.
+    std::string summary() const;
+
+    // p50, p95 and p99 of every scope plus its latest statistics, one line each.
+    std::string report() const;
+
+private:
+    struct ScopeRecord {
+        std::string name;
+        uint32_t queue_family = 0;
+        VkQueryPool statistics_pool = VK_NULL_HANDLE;
+    };
+
+    struct Slot {
+        VkQueryPool timestamps = VK_NULL_HANDLE;
+        VkQueryPool graphics_statistics = VK_NULL_HANDLE;
+        VkQueryPool compute_statistics = VK_NULL_HANDLE;
+        std::vector<ScopeRecord> scopes;
+        uint64_t frame = 0;
+    };
+
+    struct Series {
+        std::string name;
+        std::deque<double> samples;
+        PipelineStatistics statistics{};
+        bool has_statistics = false;
+    };
+
+    void create_pools(Slot& slot);
+    void destroy_pools(Slot& slot);
+
+    // Returns false when some results were unavailable. Those are dropped, or with partial false
+    // nothing is taken and the slot is left for a later try.
+    bool collect(Slot& slot, bool partial);
+    void add(uint64_t frame, const std::string& name, double gpu_ms, const PipelineStatistics* statistics);
+    Series& series_for(const std::string& name);
+    const Series* find_series(const std::string& name) const;
+
+    VkDevice logical_device = VK_NULL_HANDLE;
+    bool pipeline_statistics = false;
+    size_t window = default_window;
+
+    float timestamp_period = 1.0f;
+    std::vector<VkQueueFamilyProperties> queue_families;
+
+    std::vector<Slot> slots;
+    Slot loading;
+    Slot* current = nullptr;
+    uint64_t current_frame = 0;
+    bool started = false;
+
+    // In order of first appearance, so the summary keeps its layout from frame to frame.
+    std::vector<Series> series;
+
+    std::ofstream csv;
+};
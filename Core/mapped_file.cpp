@@ -0,0 +1,160 @@
+#include "mapped_file.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(handle, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE file_mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file_mapping == nullptr) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    view = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(file_mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file = handle;
+    mapping = file_mapping;
+    length = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (view != nullptr) {
+        UnmapViewOfFile(view);
+        CloseHandle(mapping);
+        CloseHandle(file);
+    }
+
+    view = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    length = 0;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* address = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    file = fd;
+    view = address;
+    length = static_cast<size_t>(file_stat.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (view != nullptr) {
+        munmap(const_cast<void*>(view), length);
+        ::close(file);
+    }
+
+    view = nullptr;
+    file = -1;
+    length = 0;
+}
+#endif
+
+uint64_t hash_file(const std::string& path) {
+    MappedFile source;
+    if (!source.open(path)) {
+        throw std::runtime_error("failed to open " + path);
+    }
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(source.data());
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < source.size(); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+namespace {
+
+struct FileHashRecord {
+    uint64_t magic;
+    uint64_t size;
+    int64_t write_time;
+    uint64_t hash;
+};
+
+constexpr uint64_t file_hash_magic = 0x31485341484c4946ull; // "FILHASH1"
+
+}
+
+uint64_t hash_file_cached(const std::string& path) {
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(path, error);
+    int64_t write_time = error ? 0 : static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+    if (error) {
+        throw std::runtime_error("failed to open " + path);
+    }
+
+    std::string record_path = path + ".hash";
+    FileHashRecord record{};
+    {
+        std::ifstream in(record_path, std::ios::binary);
+        if (in.read(reinterpret_cast<char*>(&record), sizeof(record)) &&
+            record.magic == file_hash_magic && record.size == size && record.write_time == write_time) {
+            return record.hash;
+        }
+    }
+
+    record.magic = file_hash_magic;
+    record.size = size;
+    record.write_time = write_time;
+    record.hash = hash_file(path);
+
+    // Only saves the next run some work, so failing to write it is not an error.
+    std::ofstream out(record_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    return record.hash;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    // Returns false if the file does not exist or cannot be mapped.
+    bool open(const std::string& path);
+    void close();
+
+    const void* data() const { return view; }
+    size_t size() const { return length; }
+
+private:
+    const void* view = nullptr;
+    size_t length = 0;
+
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int file = -1;
+#endif
+};
+
+// FNV-1a over the contents of a file, used to tell whether baked data is stale.
+uint64_t hash_file(const std::string& path);
+
+// hash_file() remembered in path + ".hash" along with the file's size and modification time, so
+// a file that has not changed since is not read again.
+uint64_t hash_file_cached(const std::string& path);
@@ -0,0 +1,98 @@
+#include "mesh_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static constexpr uint64_t array_alignment = 16;
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool MeshCache::open(const std::string& path, uint64_t source_hash, uint32_t import_flags) {
+    close();
+
+    if (!file.open(path) || file.size() < sizeof(MeshCacheHeader)) {
+        file.close();
+        return false;
+    }
+
+    const char* bytes = static_cast<const char*>(file.data());
+    const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(bytes);
+
+    bool valid = header->magic == magic &&
+        header->version == version &&
+        header->source_hash == source_hash &&
+        header->import_flags == import_flags &&
+        header->vertex_stride > 0 &&
+        (header->index_size == 2 || header->index_size == 4) &&
+        header->vertex_offset + static_cast<uint64_t>(header->vertex_count) * header->vertex_stride <= file.size() &&
+        header->index_offset + static_cast<uint64_t>(header->index_count) * header->index_size <= file.size();
+
+    if (!valid) {
+        file.close();
+        return false;
+    }
+
+    data.vertices = bytes + header->vertex_offset;
+    data.vertex_count = header->vertex_count;
+    data.vertex_stride = header->vertex_stride;
+    data.indices = bytes + header->index_offset;
+    data.index_count = header->index_count;
+    data.index_size = header->index_size;
+    memcpy(data.position_offset, header->position_offset, sizeof(data.position_offset));
+    memcpy(data.position_scale, header->position_scale, sizeof(data.position_scale));
+    memcpy(data.constant_color, header->constant_color, sizeof(data.constant_color));
+    return true;
+}
+
+void MeshCache::close() {
+    file.close();
+    data = {};
+}
+
+void MeshCache::write(const std::string& path, uint64_t source_hash, uint32_t import_flags, const MeshData& mesh) {
+    MeshCacheHeader header{};
+    header.magic = magic;
+    header.version = version;
+    header.source_hash = source_hash;
+    header.import_flags = import_flags;
+    header.vertex_stride = mesh.vertex_stride;
+    header.vertex_count = mesh.vertex_count;
+    header.index_size = mesh.index_size;
+    header.index_count = mesh.index_count;
+    header.vertex_offset = align_up(sizeof(MeshCacheHeader), array_alignment);
+    header.index_offset = align_up(header.vertex_offset + mesh.vertex_bytes(), array_alignment);
+    memcpy(header.position_offset, mesh.position_offset, sizeof(header.position_offset));
+    memcpy(header.position_scale, mesh.position_scale, sizeof(header.position_scale));
+    memcpy(header.constant_color, mesh.constant_color, sizeof(header.constant_color));
+
+    // Written under a temporary name and renamed, so an interrupted run never leaves a truncated
+    // cache behind that passes the header check.
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("mesh cache: failed to write " + path);
+        }
+
+        const char padding[array_alignment] = {};
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(padding, static_cast<std::streamsize>(header.vertex_offset - sizeof(header)));
+        out.write(static_cast<const char*>(mesh.vertices), static_cast<std::streamsize>(mesh.vertex_bytes()));
+        out.write(padding, static_cast<std::streamsize>(header.index_offset - header.vertex_offset - mesh.vertex_bytes()));
+        out.write(static_cast<const char*>(mesh.indices), static_cast<std::streamsize>(mesh.index_bytes()));
+
+        if (!out) {
+            throw std::runtime_error("mesh cache: failed to write " + path);
+        }
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("mesh cache: failed to write " + path);
+    }
+}
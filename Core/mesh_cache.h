@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "mapped_file.h"
+
+// Vertex and index arrays exactly as they go into the GPU buffers.
+struct MeshData {
+    const void* vertices = nullptr;
+    uint32_t vertex_count = 0;
+    uint32_t vertex_stride = 0;
+
+    const void* indices = nullptr;
+    uint32_t index_count = 0;
+    uint32_t index_size = 0;
+
+    // Quantized positions decode as offset + scale * stored value; identity for float positions.
+    float position_offset[3] = { 0.0f, 0.0f, 0.0f };
+    float position_scale[3] = { 1.0f, 1.0f, 1.0f };
+
+    // Value of attributes that are the same for every vertex and were left out of the vertex array.
+    float constant_color[3] = { 1.0f, 1.0f, 1.0f };
+
+    size_t vertex_bytes() const { return static_cast<size_t>(vertex_count) * vertex_stride; }
+    size_t index_bytes() const { return static_cast<size_t>(index_count) * index_size; }
+};
+
+// Binary mesh file written after a model has been imported once, so later runs can map it and copy
+// the arrays straight into staging memory instead of parsing and deduplicating the source again.
+//
+// Layout: MeshCacheHeader, vertex array, index array, each array starting 16-byte aligned. The
+// header records a hash of the source file and the importer settings it was built with, and the
+// cache is ignored when either no longer matches or the format version changed. The vertex layout
+// is up to the importer; callers tell layouts apart by vertex_stride.
+class MeshCache {
+public:
+    static constexpr uint32_t magic = 0x4853454d; // "MESH"
+    // Bumped whenever importers change what they store, so stale caches are rebuilt.
+    static constexpr uint32_t version = 3;
+
+    // Maps the cache and validates it against the source hash and the importer settings.
+    bool open(const std::string& path, uint64_t source_hash, uint32_t import_flags);
+    void close();
+
+    const MeshData& mesh() const { return data; }
+
+    static void write(const std::string& path, uint64_t source_hash, uint32_t import_flags, const MeshData& mesh);
+
+private:
+    MappedFile file;
+    MeshData data{};
+};
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t import_flags;
+    uint32_t vertex_stride;
+    uint32_t vertex_count;
+    uint32_t index_size;
+    uint32_t index_count;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    float position_offset[3];
+    float position_scale[3];
+    float constant_color[3];
+};
@@ -0,0 +1,382 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Modelled LRU cache size; larger than any real FIFO so the order works well across hardware.
+static constexpr uint32_t modelled_cache_size = 32;
+
+static float vertex_score(int32_t cache_position, uint32_t remaining_triangles) {
+    if (remaining_triangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        // The last triangle's vertices get a fixed score so the next triangle does not simply
+        // reuse its most recent edge, which strips badly.
+        if (cache_position < 3) {
+            score = 0.75f;
+        }
+        else {
+            float scale = 1.0f / (modelled_cache_size - 3);
+            score = std::pow(1.0f - (cache_position - 3) * scale, 1.5f);
+        }
+    }
+
+    // Favour vertices with few triangles left to get rid of lone triangles early.
+    score += 2.0f / std::sqrt(static_cast<float>(remaining_triangles));
+    return score;
+}
+
+void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Triangles using each vertex; the first `remaining[v]` entries of its range are not emitted yet.
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (size_t i = 0; i < index_count; i++) {
+        remaining[indices[i]]++;
+    }
+
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+
+    std::vector<uint32_t> adjacency(index_count);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < index_count; i++) {
+            adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<int32_t> cache_position(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        vertex_scores[v] = vertex_score(-1, remaining[v]);
+    }
+
+    std::vector<float> triangle_scores(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++) {
+        triangle_scores[t] = vertex_scores[indices[t * 3 + 0]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> output;
+    output.reserve(index_count);
+
+    uint32_t cache[modelled_cache_size + 3];
+    uint32_t cache_count = 0;
+
+    size_t scan = 0;
+    int64_t best = -1;
+
+    for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left; start over at the first unused triangle.
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = static_cast<int64_t>(scan);
+        }
+
+        size_t triangle = static_cast<size_t>(best);
+        emitted[triangle] = true;
+
+        const uint32_t* corners = indices + triangle * 3;
+        uint32_t new_cache[modelled_cache_size + 3];
+        uint32_t new_count = 0;
+
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t v = corners[corner];
+            output.push_back(v);
+            new_cache[new_count++] = v;
+
+            // Drop the triangle from the live part of the vertex's adjacency.
+            uint32_t* live = adjacency.data() + offsets[v];
+            uint32_t* last = live + remaining[v] - 1;
+            std::iter_swap(std::find(live, last + 1, static_cast<uint32_t>(triangle)), last);
+            remaining[v]--;
+        }
+
+        for (uint32_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                new_cache[new_count++] = v;
+            }
+        }
+
+        // Everything that was in the cache or just entered it may have changed score, including
+        // vertices pushed out at the end.
+        for (uint32_t i = 0; i < new_count; i++) {
+            uint32_t v = new_cache[i];
+            cache_position[v] = i < modelled_cache_size ? static_cast<int32_t>(i) : -1;
+            vertex_scores[v] = vertex_score(cache_position[v], remaining[v]);
+        }
+
+        best = -1;
+        float best_score = -1.0f;
+        for (uint32_t i = 0; i < new_count; i++) {
+            uint32_t v = new_cache[i];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                uint32_t t = adjacency[offsets[v] + j];
+                float score = vertex_scores[indices[t * 3 + 0]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+                triangle_scores[t] = score;
+
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+
+        cache_count = std::min(new_count, modelled_cache_size);
+        std::copy(new_cache, new_cache + cache_count, cache);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void optimize_overdraw(uint32_t* indices, size_t index_count, const float* positions, size_t stride, size_t vertex_count) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    auto position = [&](uint32_t v) {
+        return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + v * stride);
+    };
+
+    // Cut a new cluster wherever a triangle misses the (small, FIFO) cache on all three vertices.
+    constexpr uint32_t fifo_size = 16;
+    std::vector<uint32_t> cached_at(vertex_count, 0);
+    uint32_t time = fifo_size + 1;
+
+    std::vector<size_t> cluster_starts;
+    for (size_t t = 0; t < triangle_count; t++) {
+        uint32_t misses = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t v = indices[t * 3 + corner];
+            if (time - cached_at[v] > fifo_size) {
+                cached_at[v] = time++;
+                misses++;
+            }
+        }
+
+        if (t == 0 || misses == 3) {
+            cluster_starts.push_back(t);
+        }
+    }
+    cluster_starts.push_back(triangle_count);
+
+    float mesh_center[3] = {};
+    for (size_t i = 0; i < index_count; i++) {
+        const float* p = position(indices[i]);
+        for (int axis = 0; axis < 3; axis++) {
+            mesh_center[axis] += p[axis];
+        }
+    }
+    for (auto& axis : mesh_center) {
+        axis /= static_cast<float>(index_count);
+    }
+
+    // Sort key: how far the cluster sits outwards along its own average normal.
+    size_t cluster_count = cluster_starts.size() - 1;
+    std::vector<float> sort_keys(cluster_count);
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        float center[3] = {};
+        float normal[3] = {};
+        float area = 0.0f;
+
+        for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+            const float* a = position(indices[t * 3 + 0]);
+            const float* b = position(indices[t * 3 + 1]);
+            const float* p = position(indices[t * 3 + 2]);
+
+            float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e1[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+            float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+            float triangle_area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (int axis = 0; axis < 3; axis++) {
+                center[axis] += (a[axis] + b[axis] + p[axis]) * triangle_area / 3.0f;
+                normal[axis] += n[axis];
+            }
+            area += triangle_area;
+        }
+
+        float normal_length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area == 0.0f || normal_length == 0.0f) {
+            sort_keys[c] = 0.0f;
+            continue;
+        }
+
+        float key = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            key += (center[axis] / area - mesh_center[axis]) * normal[axis] / normal_length;
+        }
+        sort_keys[c] = key;
+    }
+
+    std::vector<uint32_t> order(cluster_count);
+    for (size_t c = 0; c < cluster_count; c++) {
+        order[c] = static_cast<uint32_t>(c);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(index_count);
+    for (uint32_t c : order) {
+        output.insert(output.end(), indices + cluster_starts[c] * 3, indices + cluster_starts[c + 1] * 3);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimize_vertex_fetch(void* vertices, uint32_t* indices, size_t index_count, size_t vertex_count, size_t vertex_stride) {
+    constexpr uint32_t unused = 0xffffffffu;
+
+    std::vector<uint32_t> remap(vertex_count, unused);
+    uint32_t next = 0;
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t& target = remap[indices[i]];
+        if (target == unused) {
+            target = next++;
+        }
+        indices[i] = target;
+    }
+
+    char* bytes = static_cast<char*>(vertices);
+    std::vector<char> original(bytes, bytes + vertex_count * vertex_stride);
+
+    for (size_t v = 0; v < vertex_count; v++) {
+        if (remap[v] != unused) {
+            memcpy(bytes + remap[v] * vertex_stride, original.data() + v * vertex_stride, vertex_stride);
+        }
+    }
+
+    return next;
+}
+
+float analyze_vertex_cache(const uint32_t* indices, size_t index_count, size_t vertex_count, uint32_t cache_size) {
+    if (index_count < 3) {
+        return 0.0f;
+    }
+
+    std::vector<uint32_t> cached_at(vertex_count, 0);
+    uint32_t time = cache_size + 1;
+    size_t misses = 0;
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (time - cached_at[v] > cache_size) {
+            cached_at[v] = time++;
+            misses++;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(index_count / 3);
+}
+
+size_t simplify_clusters(uint32_t* indices, size_t index_count, const float* positions, size_t stride, size_t vertex_count, uint32_t grid_size) {
+    if (index_count < 3 || vertex_count == 0 || grid_size == 0) {
+        return index_count;
+    }
+
+    auto position = [&](size_t v) {
+        return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + v * stride);
+    };
+
+    float bounds_min[3] = { position(0)[0], position(0)[1], position(0)[2] };
+    float bounds_max[3] = { bounds_min[0], bounds_min[1], bounds_min[2] };
+    for (size_t v = 1; v < vertex_count; v++) {
+        const float* p = position(v);
+        for (int axis = 0; axis < 3; axis++) {
+            bounds_min[axis] = std::min(bounds_min[axis], p[axis]);
+            bounds_max[axis] = std::max(bounds_max[axis], p[axis]);
+        }
+    }
+
+    float longest = std::max({ bounds_max[0] - bounds_min[0], bounds_max[1] - bounds_min[1], bounds_max[2] - bounds_min[2] });
+    float cell_size = longest > 0.0f ? longest / static_cast<float>(grid_size) : 1.0f;
+
+    // Cells are numbered in lookup order, not by coordinate, so the grid never has to be allocated.
+    std::vector<uint64_t> cell_keys(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        const float* p = position(v);
+        uint64_t key = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            uint64_t cell = std::min(static_cast<uint64_t>((p[axis] - bounds_min[axis]) / cell_size), static_cast<uint64_t>(grid_size - 1));
+            key = key * grid_size + cell;
+        }
+        cell_keys[v] = key;
+    }
+
+    std::vector<uint64_t> sorted_keys(cell_keys);
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    sorted_keys.erase(std::unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+
+    std::vector<uint32_t> vertex_cells(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        vertex_cells[v] = static_cast<uint32_t>(std::lower_bound(sorted_keys.begin(), sorted_keys.end(), cell_keys[v]) - sorted_keys.begin());
+    }
+
+    size_t cell_count = sorted_keys.size();
+    std::vector<float> cell_means(cell_count * 3, 0.0f);
+    std::vector<uint32_t> cell_vertex_counts(cell_count, 0);
+    for (size_t v = 0; v < vertex_count; v++) {
+        const float* p = position(v);
+        uint32_t cell = vertex_cells[v];
+        for (int axis = 0; axis < 3; axis++) {
+            cell_means[cell * 3 + axis] += p[axis];
+        }
+        cell_vertex_counts[cell]++;
+    }
+    for (size_t cell = 0; cell < cell_count; cell++) {
+        for (int axis = 0; axis < 3; axis++) {
+            cell_means[cell * 3 + axis] /= static_cast<float>(cell_vertex_counts[cell]);
+        }
+    }
+
+    constexpr uint32_t unused = 0xffffffffu;
+    std::vector<uint32_t> representatives(cell_count, unused);
+    std::vector<float> representative_distances(cell_count, 0.0f);
+    for (size_t v = 0; v < vertex_count; v++) {
+        const float* p = position(v);
+        uint32_t cell = vertex_cells[v];
+        float distance = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            float d = p[axis] - cell_means[cell * 3 + axis];
+            distance += d * d;
+        }
+        if (representatives[cell] == unused || distance < representative_distances[cell]) {
+            representatives[cell] = static_cast<uint32_t>(v);
+            representative_distances[cell] = distance;
+        }
+    }
+
+    size_t output_count = 0;
+    for (size_t t = 0; t < index_count / 3; t++) {
+        uint32_t a = vertex_cells[indices[t * 3 + 0]];
+        uint32_t b = vertex_cells[indices[t * 3 + 1]];
+        uint32_t c = vertex_cells[indices[t * 3 + 2]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+
+        // Writing never overtakes reading, so the triangles can be compacted in place.
+        indices[output_count++] = representatives[a];
+        indices[output_count++] = representatives[b];
+        indices[output_count++] = representatives[c];
+    }
+
+    return output_count;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Load-time index and vertex reordering for indexed triangle lists. All functions work in place.
+//
+// The intended order is optimize_vertex_cache, optimize_overdraw, optimize_vertex_fetch: the first
+// two only permute triangles, the last one renumbers vertices to match the final triangle order.
+
+// Reorders triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm).
+void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count);
+
+// Reorders clusters of triangles produced by optimize_vertex_cache so that outward-facing parts of
+// the mesh are drawn first and occlude the rest. Clusters are only cut where the vertex cache is
+// cold anyway, so the cache efficiency is kept. `positions` points at the x component of the
+// first vertex, with `stride` bytes between vertices.
+void optimize_overdraw(uint32_t* indices, size_t index_count, const float* positions, size_t stride, size_t vertex_count);
+
+// Renumbers vertices in order of first use and reorders `vertices` to match, so vertex fetches
+// walk memory linearly. Unused vertices are dropped; returns the new vertex count.
+size_t optimize_vertex_fetch(void* vertices, uint32_t* indices, size_t index_count, size_t vertex_count, size_t vertex_stride);
+
+// Simplifies the mesh by vertex clustering: positions are snapped to a grid of grid_size cells
+// along the longest side of the bounds, every occupied cell keeps the vertex nearest to the mean
+// of its vertices, and triangles left with fewer than three distinct cells are dropped. Surviving
+// vertices are original ones, so attributes need no interpolation; compact them afterwards with
+// optimize_vertex_fetch. Returns the new index count.
+size_t simplify_clusters(uint32_t* indices, size_t index_count, const float* positions, size_t stride, size_t vertex_count, uint32_t grid_size);
+
+// Average cache miss ratio (transformed vertices per triangle) for a FIFO cache of the given size.
+float analyze_vertex_cache(const uint32_t* indices, size_t index_count, size_t vertex_count, uint32_t cache_size = 16);
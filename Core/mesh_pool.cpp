@@ -0,0 +1,151 @@
+#include "mesh_pool.h"
+
+#include <iterator>
+#include <stdexcept>
+
+void MeshPool::init(DeviceAllocator& allocator, uint32_t vertex_stride, uint32_t index_size, uint32_t vertex_capacity, uint32_t index_capacity) {
+    if (index_size != 2 && index_size != 4) {
+        throw std::runtime_error("mesh pool: indices must be 16 or 32 bits");
+    }
+
+    this->allocator = &allocator;
+    this->vertex_stride = vertex_stride;
+    this->index_size = index_size;
+    this->vertex_capacity = vertex_capacity;
+    this->index_capacity = index_capacity;
+    free_vertices = { { 0, vertex_capacity } };
+    free_indices = { { 0, index_capacity } };
+    mesh_ranges.clear();
+    free_slots.clear();
+
+    allocator.create_buffer(static_cast<VkDeviceSize>(vertex_capacity) * vertex_stride,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertices, vertex_allocation);
+    allocator.create_buffer(static_cast<VkDeviceSize>(index_capacity) * index_size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indices, index_allocation);
+}
+
+void MeshPool::cleanup() {
+    if (allocator == nullptr) {
+        return;
+    }
+
+    allocator->destroy_buffer(indices, index_allocation);
+    allocator->destroy_buffer(vertices, vertex_allocation);
+    indices = VK_NULL_HANDLE;
+    vertices = VK_NULL_HANDLE;
+    mesh_ranges.clear();
+    free_slots.clear();
+    allocator = nullptr;
+}
+
+uint32_t MeshPool::add(StagingRing& uploader, const MeshData& mesh) {
+    if (mesh.vertex_stride != vertex_stride) {
+        throw std::runtime_error("mesh pool: mesh has a different vertex layout");
+    }
+    if (mesh.index_size > index_size) {
+        throw std::runtime_error("mesh pool: mesh indices are wider than the pool's");
+    }
+
+    uint32_t first_vertex = 0;
+    uint32_t first_index = 0;
+    if (!find_free(free_vertices, mesh.vertex_count, first_vertex) || !find_free(free_indices, mesh.index_count, first_index)) {
+        throw std::runtime_error("mesh pool: out of space");
+    }
+    take_free(free_vertices, first_vertex, mesh.vertex_count);
+    take_free(free_indices, first_index, mesh.index_count);
+
+    MeshRange range{};
+    range.first_index = first_index;
+    range.index_count = mesh.index_count;
+    range.vertex_offset = static_cast<int32_t>(first_vertex);
+    range.vertex_count = mesh.vertex_count;
+
+    uploader.upload_buffer(vertices, static_cast<VkDeviceSize>(first_vertex) * vertex_stride, mesh.vertices, mesh.vertex_bytes());
+
+    VkDeviceSize index_offset = static_cast<VkDeviceSize>(first_index) * index_size;
+    if (mesh.index_size == index_size) {
+        uploader.upload_buffer(indices, index_offset, mesh.indices, mesh.index_bytes());
+    }
+    else {
+        // The ring copies the data right away, so the widened indices only live for the call.
+        const uint16_t* short_indices = static_cast<const uint16_t*>(mesh.indices);
+        std::vector<uint32_t> widened(short_indices, short_indices + mesh.index_count);
+        uploader.upload_buffer(indices, index_offset, widened.data(), widened.size() * sizeof(uint32_t));
+    }
+
+    if (!free_slots.empty()) {
+        uint32_t slot = free_slots.back();
+        free_slots.pop_back();
+        mesh_ranges[slot] = range;
+        return slot;
+    }
+
+    mesh_ranges.push_back(range);
+    return static_cast<uint32_t>(mesh_ranges.size() - 1);
+}
+
+bool MeshPool::fits(uint32_t vertex_count, uint32_t index_count) const {
+    uint32_t first = 0;
+    return find_free(free_vertices, vertex_count, first) && find_free(free_indices, index_count, first);
+}
+
+void MeshPool::remove(uint32_t mesh) {
+    MeshRange& range = mesh_ranges[mesh];
+    give_free(free_vertices, static_cast<uint32_t>(range.vertex_offset), range.vertex_count);
+    give_free(free_indices, range.first_index, range.index_count);
+
+    range = MeshRange{};
+    free_slots.push_back(mesh);
+}
+
+bool MeshPool::find_free(const FreeList& free_list, uint32_t count, uint32_t& first) {
+    if (count == 0) {
+        first = 0;
+        return true;
+    }
+
+    for (const auto& [start, length] : free_list) {
+        if (length >= count) {
+            first = start;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MeshPool::take_free(FreeList& free_list, uint32_t first, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    auto it = free_list.find(first);
+    uint32_t length = it->second;
+    free_list.erase(it);
+    if (length > count) {
+        free_list.emplace(first + count, length - count);
+    }
+}
+
+void MeshPool::give_free(FreeList& free_list, uint32_t first, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    auto next = free_list.lower_bound(first);
+    if (next != free_list.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == first) {
+            first = previous->first;
+            count += previous->second;
+            free_list.erase(previous);
+        }
+    }
+    if (next != free_list.end() && first + count == next->first) {
+        count += next->second;
+        free_list.erase(next);
+    }
+
+    free_list.emplace(first, count);
+}
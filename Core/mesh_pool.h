@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "device_allocator.h"
+#include "mesh_cache.h"
+#include "staging_ring.h"
+
+// Where a mesh lives in the shared buffers, in the terms of VkDrawIndexedIndirectCommand.
+struct MeshRange {
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    int32_t vertex_offset = 0;
+    uint32_t vertex_count = 0;
+};
+
+// One vertex and one index buffer holding every mesh of a vertex layout, so a scene binds them
+// once and each draw only picks its range with firstIndex and vertexOffset. That is what lets a
+// single indirect draw call cover any number of meshes.
+//
+// Capacity is fixed by init(); meshes are uploaded through the staging ring into the first free
+// ranges that fit and stay until remove() or cleanup(), which lets streamed meshes come and go.
+// Indices remain relative to their mesh, so a 16-bit pool holds any number of meshes of up to
+// 65536 vertices each.
+class MeshPool {
+public:
+    void init(DeviceAllocator& allocator, uint32_t vertex_stride, uint32_t index_size, uint32_t vertex_capacity, uint32_t index_capacity);
+    void cleanup();
+
+    // Returns the mesh's index into ranges(). 16-bit indices are widened for a 32-bit pool; a
+    // different vertex stride, wider indices or a full pool throw.
+    uint32_t add(StagingRing& uploader, const MeshData& mesh);
+
+    uint32_t max_vertices() const { return vertex_capacity; }
+    uint32_t max_indices() const { return index_capacity; }
+
+    // Whether add() would find room for the mesh right now.
+    bool fits(uint32_t vertex_count, uint32_t index_count) const;
+
+    // Frees the mesh's ranges; its entry in ranges() is cleared and reused by a later add(). The
+    // caller makes sure no submitted work still reads the mesh.
+    void remove(uint32_t mesh);
+
+    const std::vector<MeshRange>& ranges() const { return mesh_ranges; }
+
+    VkBuffer vertex_buffer() const { return vertices; }
+    VkBuffer index_buffer() const { return indices; }
+    VkIndexType index_type() const { return index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32; }
+
+    VkDeviceSize memory_bytes() const { return vertex_allocation.size + index_allocation.size; }
+
+private:
+    DeviceAllocator* allocator = nullptr;
+    uint32_t vertex_stride = 0;
+    uint32_t index_size = 0;
+    uint32_t vertex_capacity = 0;
+    uint32_t index_capacity = 0;
+
+    VkBuffer vertices = VK_NULL_HANDLE;
+    Allocation vertex_allocation{};
+    VkBuffer indices = VK_NULL_HANDLE;
+    Allocation index_allocation{};
+
+    // Free ranges as first element and count, merged with their neighbors on remove().
+    using FreeList = std::map<uint32_t, uint32_t>;
+
+    static bool find_free(const FreeList& free_list, uint32_t count, uint32_t& first);
+    static void take_free(FreeList& free_list, uint32_t first, uint32_t count);
+    static void give_free(FreeList& free_list, uint32_t first, uint32_t count);
+
+    FreeList free_vertices;
+    FreeList free_indices;
+    std::vector<MeshRange> mesh_ranges;
+    std::vector<uint32_t> free_slots;
+};
@@ -0,0 +1,250 @@
+#include "mesh_streamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void MeshStreamer::init(MeshPool& pool) {
+    this->pool = &pool;
+    meshes.clear();
+    used_bytes = 0;
+    pinned_vertices = 0;
+    pinned_indices = 0;
+    stopping = false;
+    error = nullptr;
+
+    thread = std::thread(&MeshStreamer::thread_main, this);
+}
+
+void MeshStreamer::cleanup() {
+    if (pool == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        requests.clear();
+    }
+    work_ready.notify_all();
+    thread.join();
+
+    // The pool's buffers go with the pool, which outlives this.
+    finished.clear();
+    waiting.clear();
+    meshes.clear();
+    pool = nullptr;
+}
+
+uint32_t MeshStreamer::add_mesh(StagingRing& uploader, const MeshData& coarsest, uint32_t level_count, LevelOpener opener) {
+    if (level_count == 0) {
+        throw std::runtime_error("mesh streamer: a mesh needs at least one level");
+    }
+
+    StreamedMesh mesh;
+    mesh.levels.resize(level_count);
+    mesh.opener = std::move(opener);
+    mesh.wanted_level = level_count - 1;
+
+    Level& level = mesh.levels.back();
+    level.pool_mesh = pool->add(uploader, coarsest);
+    level.bytes = pool_bytes(coarsest);
+    level.state = LevelState::resident;
+    used_bytes += level.bytes;
+    pinned_vertices += coarsest.vertex_count;
+    pinned_indices += coarsest.index_count;
+
+    meshes.push_back(std::move(mesh));
+    return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void MeshStreamer::request(uint32_t mesh, uint32_t level) {
+    meshes[mesh].wanted_level = std::clamp(level, meshes[mesh].finest_level, level_count(mesh) - 1);
+}
+
+void MeshStreamer::update(StagingRing& uploader, uint64_t submitted_frames, uint64_t completed_frames) {
+    std::vector<ReadLevel> read;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        read.swap(finished);
+    }
+
+    for (StreamedMesh& mesh : meshes) {
+        for (uint32_t i = 0; i < mesh.levels.size(); i++) {
+            Level& level = mesh.levels[i];
+            if (level.state == LevelState::retiring && level.retired_at <= completed_frames) {
+                pool->remove(level.pool_mesh);
+                used_bytes -= level.bytes;
+                level.state = LevelState::absent;
+            }
+            else if (level.state == LevelState::uploading && uploader.is_complete(level.batch_id)) {
+                level.state = LevelState::resident;
+            }
+
+            if (i >= mesh.wanted_level) {
+                level.wanted_at = submitted_frames;
+            }
+        }
+    }
+
+    // Reads that are no longer wanted are dropped; the rest wait for room.
+    for (ReadLevel& level : read) {
+        StreamedMesh& mesh = meshes[level.mesh];
+        if (level.level < mesh.wanted_level) {
+            mesh.levels[level.level].state = LevelState::absent;
+        }
+        else {
+            mesh.levels[level.level].state = LevelState::read;
+            waiting.push_back(std::move(level));
+        }
+    }
+
+    retire_unwanted(submitted_frames, unwanted_frames);
+
+    std::vector<Level*> uploaded;
+    for (size_t i = 0; i < waiting.size();) {
+        ReadLevel& level = waiting[i];
+        if (level.level < meshes[level.mesh].wanted_level) {
+            meshes[level.mesh].levels[level.level].state = LevelState::absent;
+            waiting.erase(waiting.begin() + i);
+            continue;
+        }
+        if (level.data.vertex_count > pool->max_vertices() - pinned_vertices ||
+            level.data.index_count > pool->max_indices() - pinned_indices) {
+            // Streaming everything else out would not make room either; holding on to it would keep
+            // the copy and block the mesh's reads for good.
+            StreamedMesh& mesh = meshes[level.mesh];
+            mesh.levels[level.level].state = LevelState::absent;
+            mesh.finest_level = std::max(mesh.finest_level, level.level + 1);
+            mesh.wanted_level = std::max(mesh.wanted_level, mesh.finest_level);
+            waiting.erase(waiting.begin() + i);
+            continue;
+        }
+        if (!pool->fits(level.data.vertex_count, level.data.index_count)) {
+            // Freed ranges only come back once their frames complete, so this is retried later.
+            retire_unwanted(submitted_frames, 0);
+            i++;
+            continue;
+        }
+
+        level.data.vertices = level.vertices.data();
+        level.data.indices = level.indices.data();
+
+        Level& state = meshes[level.mesh].levels[level.level];
+        state.pool_mesh = pool->add(uploader, level.data);
+        state.bytes = pool_bytes(level.data);
+        state.state = LevelState::uploading;
+        used_bytes += state.bytes;
+        uploaded.push_back(&state);
+
+        // The ring has its own copy now.
+        waiting.erase(waiting.begin() + i);
+    }
+
+    if (!uploaded.empty()) {
+        uint64_t batch_id = uploader.submit();
+        for (Level* level : uploaded) {
+            level->batch_id = batch_id;
+        }
+    }
+
+    // One read in flight per mesh, for the level wanted now.
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < meshes.size(); i++) {
+        StreamedMesh& mesh = meshes[i];
+
+        bool busy = false;
+        for (const Level& level : mesh.levels) {
+            busy = busy || level.state == LevelState::reading || level.state == LevelState::read;
+        }
+
+        Level& wanted = mesh.levels[mesh.wanted_level];
+        if (!busy && wanted.state == LevelState::absent) {
+            wanted.state = LevelState::reading;
+            requests.push_back({ i, mesh.wanted_level, mesh.opener });
+            work_ready.notify_one();
+        }
+    }
+}
+
+const MeshRange* MeshStreamer::resident_range(uint32_t mesh, uint32_t level) const {
+    const Level& state = meshes[mesh].levels[level];
+    return state.state == LevelState::resident ? &pool->ranges()[state.pool_mesh] : nullptr;
+}
+
+uint32_t MeshStreamer::resident_level(uint32_t mesh, uint32_t level) const {
+    uint32_t coarsest = level_count(mesh) - 1;
+    while (level < coarsest && meshes[mesh].levels[level].state != LevelState::resident) {
+        level++;
+    }
+    return level;
+}
+
+VkDeviceSize MeshStreamer::pool_bytes(const MeshData& mesh) const {
+    // Indices take the pool's width, whatever they had in the cache.
+    return mesh.vertex_bytes() + static_cast<VkDeviceSize>(mesh.index_count) * (pool->index_type() == VK_INDEX_TYPE_UINT16 ? 2 : 4);
+}
+
+void MeshStreamer::read_level(const ReadRequest& request, ReadLevel& result) {
+    MeshCache cache;
+    request.opener(request.level, cache);
+
+    const MeshData& data = cache.mesh();
+    result.mesh = request.mesh;
+    result.level = request.level;
+    result.data = data;
+    result.vertices.resize(data.vertex_bytes());
+    memcpy(result.vertices.data(), data.vertices, data.vertex_bytes());
+    result.indices.resize(data.index_bytes());
+    memcpy(result.indices.data(), data.indices, data.index_bytes());
+    result.data.vertices = result.vertices.data();
+    result.data.indices = result.indices.data();
+
+    cache.close();
+}
+
+void MeshStreamer::thread_main() {
+    while (true) {
+        ReadRequest request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping) {
+                return;
+            }
+            request = std::move(requests.front());
+            requests.pop_front();
+        }
+
+        ReadLevel result;
+        try {
+            read_level(request, result);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(result));
+    }
+}
+
+void MeshStreamer::retire_unwanted(uint64_t submitted_frames, uint64_t min_unwanted_frames) {
+    for (StreamedMesh& mesh : meshes) {
+        for (uint32_t i = 0; i < mesh.wanted_level; i++) {
+            Level& level = mesh.levels[i];
+            if (level.state == LevelState::resident && submitted_frames - level.wanted_at >= min_unwanted_frames) {
+                // Frames submitted so far may still draw it; the next ones will not.
+                level.state = LevelState::retiring;
+                level.retired_at = submitted_frames;
+            }
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mesh_cache.h"
+#include "mesh_pool.h"
+#include "staging_ring.h"
+
+// Streams the levels of detail of meshes in and out of a MeshPool, whose capacity is the memory
+// budget for them.
+//
+// Level 0 is the finest. The coarsest level of every mesh is uploaded by add_mesh() and stays, so
+// drawing can always fall back to it. The other levels are requested by how close the mesh is:
+// a streaming thread reads the wanted level's mesh cache into memory, update() uploads it through
+// the staging ring and frees the CPU copy, and the level becomes resident once the upload batch
+// has completed. Levels finer than wanted are streamed out when they have not been wanted for a
+// while, or right away when a wanted level does not fit. Their pool ranges are only reused once
+// every frame that may still draw them has completed. A level too large for the pool even with
+// only the coarsest levels in it is dropped, and the mesh is not given finer levels than the next
+// coarser one from then on.
+//
+// Everything but the file reads runs on the render thread.
+class MeshStreamer {
+public:
+    // Opens the level's mesh cache, throwing on failure. Runs on the streaming thread.
+    using LevelOpener = std::function<void(uint32_t level, MeshCache& cache)>;
+
+    // Frames a level may go unwanted before it is streamed out without pressure.
+    static constexpr uint64_t unwanted_frames = 120;
+
+    void init(MeshPool& pool);
+    void cleanup();
+
+    // Registers a mesh, uploading its coarsest level right away; the caller submits the ring and
+    // may free the data afterwards. Returns the mesh's id.
+    uint32_t add_mesh(StagingRing& uploader, const MeshData& coarsest, uint32_t level_count, LevelOpener opener);
+
+    uint32_t mesh_count() const { return static_cast<uint32_t>(meshes.size()); }
+
+    // Finest level wanted for the mesh from now on, within the levels the pool can hold.
+    void request(uint32_t mesh, uint32_t level);
+
+    // Once per frame after the frame's fence wait, before its draws are chosen. Frees levels
+    // retired before completed_frames, uploads what the streaming thread has read, streams out
+    // unwanted levels and queues the next read. Rethrows errors of the streaming thread.
+    void update(StagingRing& uploader, uint64_t submitted_frames, uint64_t completed_frames);
+
+    uint32_t level_count(uint32_t mesh) const { return static_cast<uint32_t>(meshes[mesh].levels.size()); }
+
+    // Where the level lives in the pool, or nullptr while it is not resident.
+    const MeshRange* resident_range(uint32_t mesh, uint32_t level) const;
+
+    // The level itself when resident, the nearest coarser resident one otherwise.
+    uint32_t resident_level(uint32_t mesh, uint32_t level) const;
+
+    // Bytes of the pool holding resident and uploading levels.
+    VkDeviceSize resident_bytes() const { return used_bytes; }
+
+private:
+    enum class LevelState {
+        absent,
+        reading,
+        read,
+        uploading,
+        resident,
+        retiring
+    };
+
+    struct Level {
+        LevelState state = LevelState::absent;
+        uint32_t pool_mesh = 0;
+        VkDeviceSize bytes = 0;
+        uint64_t batch_id = 0;
+        uint64_t retired_at = 0;
+        uint64_t wanted_at = 0;
+    };
+
+    struct StreamedMesh {
+        std::vector<Level> levels;
+        LevelOpener opener;
+        uint32_t wanted_level = 0;
+        // Finer levels are too large for the pool.
+        uint32_t finest_level = 0;
+    };
+
+    // A level's arrays copied out of its mesh cache, so the file is closed again on the streaming
+    // thread and the render thread never touches unread pages.
+    struct ReadLevel {
+        uint32_t mesh = 0;
+        uint32_t level = 0;
+        MeshData data{};
+        std::vector<uint8_t> vertices;
+        std::vector<uint8_t> indices;
+    };
+
+    struct ReadRequest {
+        uint32_t mesh = 0;
+        uint32_t level = 0;
+        LevelOpener opener;
+    };
+
+    VkDeviceSize pool_bytes(const MeshData& mesh) const;
+    static void read_level(const ReadRequest& request, ReadLevel& result);
+    void thread_main();
+
+    // Starts streaming out resident levels finer than wanted that have gone unwanted for at least
+    // min_unwanted_frames; their ranges are freed once the frames submitted so far have completed.
+    void retire_unwanted(uint64_t submitted_frames, uint64_t min_unwanted_frames);
+
+    MeshPool* pool = nullptr;
+    std::vector<StreamedMesh> meshes;
+    VkDeviceSize used_bytes = 0;
+
+    // Held by the coarsest levels, which never leave the pool.
+    uint32_t pinned_vertices = 0;
+    uint32_t pinned_indices = 0;
+
+    // Read but not uploaded yet, waiting for room in the pool.
+    std::vector<ReadLevel> waiting;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    bool stopping = false;
+    std::deque<ReadRequest> requests;
+    std::vector<ReadLevel> finished;
+
+    // First exception thrown on the streaming thread, rethrown by update().
+    std::exception_ptr error;
+};
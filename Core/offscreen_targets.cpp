@@ -0,0 +1,80 @@
+#include "offscreen_targets.h"
+
+#include <stdexcept>
+
+void OffscreenTargets::init(VkPhysicalDevice physical_device, VkDevice logical_device, VkFormat format, VkExtent2D extent, uint32_t image_count) {
+    this->logical_device = logical_device;
+    image_format = format;
+    image_extent = extent;
+    next = 0;
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    // A handful of images, so each gets its own allocation rather than needing the sample's allocator.
+    for (uint32_t i = 0; i < image_count; i++) {
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.extent = { extent.width, extent.height, 1 };
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.format = format;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkImage image;
+        if (vkCreateImage(logical_device, &image_info, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create offscreen image");
+        }
+        image_handles.push_back(image);
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(logical_device, image, &requirements);
+
+        uint32_t memory_type = UINT32_MAX;
+        for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++) {
+            if ((requirements.memoryTypeBits & (1u << type)) &&
+                (memory_properties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                memory_type = type;
+                break;
+            }
+        }
+        if (memory_type == UINT32_MAX) {
+            throw std::runtime_error("vk: failed to find device local memory for an offscreen image");
+        }
+
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = requirements.size;
+        alloc_info.memoryTypeIndex = memory_type;
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to allocate offscreen image memory");
+        }
+        memories.push_back(memory);
+        allocated_bytes += requirements.size;
+
+        vkBindImageMemory(logical_device, image, memory, 0);
+    }
+}
+
+void OffscreenTargets::cleanup() {
+    for (size_t i = 0; i < image_handles.size(); i++) {
+        vkDestroyImage(logical_device, image_handles[i], nullptr);
+        vkFreeMemory(logical_device, memories[i], nullptr);
+    }
+    image_handles.clear();
+    memories.clear();
+    allocated_bytes = 0;
+}
+
+uint32_t OffscreenTargets::next_image() {
+    uint32_t image = next;
+    next = (next + 1) % static_cast<uint32_t>(image_handles.size());
+    return image;
+}
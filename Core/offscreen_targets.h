@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Color images standing in for the swap chain when nothing is presented, as in benchmark runs.
+//
+// next_image() hands them out round-robin the way vkAcquireNextImageKHR would, so the rest of a
+// frame stays the same. There is no acquire to wait for: with one image per frame in flight, an
+// image is only reused once the fence of the frame that last rendered to it has signalled.
+class OffscreenTargets {
+public:
+    // Color attachment (and blit source) support for it is required by the spec.
+    static constexpr VkFormat default_format = VK_FORMAT_B8G8R8A8_SRGB;
+
+    void init(VkPhysicalDevice physical_device, VkDevice logical_device, VkFormat format, VkExtent2D extent, uint32_t image_count);
+    void cleanup();
+
+    const std::vector<VkImage>& images() const { return image_handles; }
+    VkFormat format() const { return image_format; }
+    VkExtent2D extent() const { return image_extent; }
+
+    uint32_t next_image();
+
+    VkDeviceSize memory_bytes() const { return allocated_bytes; }
+
+private:
+    VkDevice logical_device = VK_NULL_HANDLE;
+    VkFormat image_format = default_format;
+    VkExtent2D image_extent{};
+
+    std::vector<VkImage> image_handles;
+    std::vector<VkDeviceMemory> memories;
+    VkDeviceSize allocated_bytes = 0;
+
+    uint32_t next = 0;
+};
@@ -0,0 +1,109 @@
+#include "pipeline_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "mapped_file.h"
+
+// FNV-1a, as hash_file().
+static uint64_t hash_bytes(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void PipelineCache::init(VkPhysicalDevice physical_device, VkDevice logical_device, const std::string& path) {
+    this->logical_device = logical_device;
+    this->path = path;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    MappedFile file;
+    const void* initial_data = nullptr;
+    size_t initial_size = 0;
+
+    if (file.open(path) && file.size() >= sizeof(PipelineCacheHeader)) {
+        const PipelineCacheHeader* header = static_cast<const PipelineCacheHeader*>(file.data());
+        const void* blob = static_cast<const char*>(file.data()) + sizeof(PipelineCacheHeader);
+
+        loaded = header->magic == magic &&
+            header->version == version &&
+            header->vendor_id == properties.vendorID &&
+            header->device_id == properties.deviceID &&
+            header->driver_version == properties.driverVersion &&
+            memcmp(header->pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+            header->data_size == file.size() - sizeof(PipelineCacheHeader) &&
+            header->data_hash == hash_bytes(blob, static_cast<size_t>(header->data_size));
+
+        if (loaded) {
+            initial_data = blob;
+            initial_size = static_cast<size_t>(header->data_size);
+        }
+    }
+
+    VkPipelineCacheCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = initial_size;
+    create_info.pInitialData = initial_data;
+
+    if (vkCreatePipelineCache(logical_device, &create_info, nullptr, &cache) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create pipeline cache");
+    }
+}
+
+void PipelineCache::cleanup() {
+    if (cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    save();
+    vkDestroyPipelineCache(logical_device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::save() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(logical_device, cache, &size, nullptr) != VK_SUCCESS) {
+        return false;
+    }
+
+    std::vector<char> blob(size);
+    if (vkGetPipelineCacheData(logical_device, cache, &size, blob.data()) != VK_SUCCESS) {
+        return false;
+    }
+
+    PipelineCacheHeader header{};
+    header.magic = magic;
+    header.version = version;
+    header.vendor_id = properties.vendorID;
+    header.device_id = properties.deviceID;
+    header.driver_version = properties.driverVersion;
+    memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = size;
+    header.data_hash = hash_bytes(blob.data(), size);
+
+    // Written under a temporary name and renamed, as the mesh cache.
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(blob.data(), static_cast<std::streamsize>(size));
+
+        if (!out) {
+            return false;
+        }
+    }
+
+    std::remove(path.c_str());
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
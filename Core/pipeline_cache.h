@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+
+// VkPipelineCache persisted to disk, so pipelines compiled by one run are reused by the next one
+// instead of going through the driver's shader compiler again.
+//
+// Layout: PipelineCacheHeader followed by the blob from vkGetPipelineCacheData. The header pins
+// the vendor, device, driver version and pipelineCacheUUID the blob was produced by, plus a hash of
+// the blob; a file that does not match in every field is ignored and the cache starts empty. The
+// driver checks its own header as well, but not every driver survives being handed a corrupt blob.
+class PipelineCache {
+public:
+    static constexpr uint32_t magic = 0x43504b56; // "VKPC"
+    static constexpr uint32_t version = 1;
+
+    // Creates the cache, seeded from path when the file was written for this device and driver.
+    void init(VkPhysicalDevice physical_device, VkDevice logical_device, const std::string& path);
+
+    // Saves and destroys the cache.
+    void cleanup();
+
+    // Writes the current contents to disk. Returns false if the file could not be written.
+    bool save();
+
+    VkPipelineCache handle() const { return cache; }
+
+    // Whether init found a usable file.
+    bool was_loaded() const { return loaded; }
+
+private:
+    VkDevice logical_device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    std::string path;
+    bool loaded = false;
+};
+
+struct PipelineCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+    uint64_t data_hash;
+};
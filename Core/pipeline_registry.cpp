@@ -0,0 +1,421 @@
+#include "pipeline_registry.h"
+
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+#include "vulkan_bootstrap.h"
+
+namespace {
+
+// FNV-1a, fed field by field so struct padding never reaches the key.
+struct KeyHasher {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    void add_bytes(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+
+    template<typename T>
+    void add(const T& value) {
+        add_bytes(&value, sizeof(value));
+    }
+
+    void add_stage(const ShaderStageDesc& stage, uint64_t code_hash) {
+        add(code_hash);
+        add(stage.specialization_entries.size());
+        for (const auto& entry : stage.specialization_entries) {
+            add(entry.constantID);
+            add(entry.offset);
+            add(entry.size);
+        }
+        add(stage.specialization_data.size());
+        add_bytes(stage.specialization_data.data(), stage.specialization_data.size());
+    }
+};
+
+// Kinds of pipeline, hashed first so a graphics and a compute desc never share a key.
+enum PipelineKind : uint32_t {
+    graphics_pipeline_kind = 1,
+    compute_pipeline_kind = 2,
+};
+
+VkSpecializationInfo specialization_info(const ShaderStageDesc& stage) {
+    VkSpecializationInfo info{};
+    info.mapEntryCount = static_cast<uint32_t>(stage.specialization_entries.size());
+    info.pMapEntries = stage.specialization_entries.data();
+    info.dataSize = stage.specialization_data.size();
+    info.pData = stage.specialization_data.data();
+    return info;
+}
+
+}
+
+bool PipelineHandle::is_ready() const {
+    return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+VkPipeline PipelineHandle::get() const {
+    return future.get();
+}
+
+VkPipeline PipelineHandle::get_or(VkPipeline fallback) const {
+    return is_ready() ? future.get() : fallback;
+}
+
+void PipelineRegistry::init(VkDevice logical_device, VkPipelineCache pipeline_cache, uint32_t compile_thread_count) {
+    this->logical_device = logical_device;
+    this->pipeline_cache = pipeline_cache;
+
+    stopping = false;
+    for (uint32_t i = 0; i < compile_thread_count; i++) {
+        compile_threads.emplace_back(&PipelineRegistry::compile_main, this);
+    }
+}
+
+void PipelineRegistry::cleanup() {
+    // The compile threads drain the queue before they exit, so every future below is ready.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (auto& thread : compile_threads) {
+        thread.join();
+    }
+    compile_threads.clear();
+
+    for (auto& [key, pipeline] : pipelines) {
+        try {
+            vkDestroyPipeline(logical_device, pipeline.get(), nullptr);
+        }
+        catch (const std::exception&) {
+            // Failed to compile; there is nothing to destroy.
+        }
+    }
+    pipelines.clear();
+    shaders.clear();
+}
+
+uint32_t PipelineRegistry::default_compile_thread_count() {
+    uint32_t hardware_threads = std::thread::hardware_concurrency();
+    return hardware_threads > 3 ? hardware_threads / 2 : 1;
+}
+
+PipelineHandle PipelineRegistry::request(const GraphicsPipelineDesc& desc) {
+    std::shared_ptr<const ShaderCode> vertex_code = load_shader(desc.vertex_shader.path);
+    std::shared_ptr<const ShaderCode> fragment_code = load_shader(desc.fragment_shader.path);
+
+    KeyHasher hasher;
+    hasher.add(graphics_pipeline_kind);
+    hasher.add_stage(desc.vertex_shader, vertex_code->hash);
+    hasher.add_stage(desc.fragment_shader, fragment_code->hash);
+    hasher.add(desc.vertex_bindings.size());
+    for (const auto& binding : desc.vertex_bindings) {
+        hasher.add(binding.binding);
+        hasher.add(binding.stride);
+        hasher.add(binding.inputRate);
+    }
+    hasher.add(desc.vertex_attributes.size());
+    for (const auto& attribute : desc.vertex_attributes) {
+        hasher.add(attribute.location);
+        hasher.add(attribute.binding);
+        hasher.add(attribute.format);
+        hasher.add(attribute.offset);
+    }
+    hasher.add(desc.topology);
+    hasher.add(desc.polygon_mode);
+    hasher.add(desc.cull_mode);
+    hasher.add(desc.front_face);
+    hasher.add(desc.samples);
+    hasher.add(desc.sample_shading);
+    hasher.add(desc.min_sample_shading);
+    hasher.add(desc.depth_test);
+    hasher.add(desc.depth_write);
+    hasher.add(desc.depth_compare_op);
+    hasher.add(desc.alpha_blend);
+    hasher.add(desc.layout);
+    hasher.add(desc.render_pass);
+    hasher.add(desc.subpass);
+
+    return enqueue(hasher.hash, std::packaged_task<VkPipeline()>([this, desc, vertex_code, fragment_code] {
+        return compile_graphics(desc, *vertex_code, *fragment_code);
+    }));
+}
+
+PipelineHandle PipelineRegistry::request(const ComputePipelineDesc& desc) {
+    std::shared_ptr<const ShaderCode> code = load_shader(desc.shader.path);
+
+    KeyHasher hasher;
+    hasher.add(compute_pipeline_kind);
+    hasher.add_stage(desc.shader, code->hash);
+    hasher.add(desc.layout);
+
+    return enqueue(hasher.hash, std::packaged_task<VkPipeline()>([this, desc, code] {
+        return compile_compute(desc, *code);
+    }));
+}
+
+std::shared_ptr<const PipelineRegistry::ShaderCode> PipelineRegistry::load_shader(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = shaders.find(path);
+        if (it != shaders.end()) {
+            return it->second;
+        }
+    }
+
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("pipeline registry: failed to open " + path);
+    }
+
+    std::vector<char> code(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(code.data(), static_cast<std::streamsize>(code.size()));
+    std::shared_ptr<const ShaderCode> shader = make_shader(std::move(code));
+
+    // Another thread may have loaded the same file in the meantime; keep the first copy.
+    std::lock_guard<std::mutex> lock(mutex);
+    return shaders.emplace(path, std::move(shader)).first->second;
+}
+
+std::shared_ptr<const PipelineRegistry::ShaderCode> PipelineRegistry::make_shader(std::vector<char> code) {
+    auto shader = std::make_shared<ShaderCode>();
+    shader->code = std::move(code);
+
+    KeyHasher hasher;
+    hasher.add_bytes(shader->code.data(), shader->code.size());
+    shader->hash = hasher.hash;
+    return shader;
+}
+
+void PipelineRegistry::replace_shader(const std::string& path, std::vector<char> code) {
+    std::shared_ptr<const ShaderCode> shader = make_shader(std::move(code));
+
+    // Compiles already queued hold on to the old code.
+    std::lock_guard<std::mutex> lock(mutex);
+    shaders[path] = std::move(shader);
+}
+
+void PipelineRegistry::release(const PipelineHandle& handle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pipelines.erase(handle.hash);
+    }
+
+    try {
+        vkDestroyPipeline(logical_device, handle.get(), nullptr);
+    }
+    catch (const std::exception&) {
+        // Failed to compile; there is nothing to destroy.
+    }
+}
+
+VkShaderModule PipelineRegistry::create_shader_module(const ShaderCode& shader) const {
+    return ::create_shader_module(logical_device, shader.code);
+}
+
+PipelineHandle PipelineRegistry::enqueue(uint64_t key, std::packaged_task<VkPipeline()> compile) {
+    PipelineHandle handle;
+    handle.hash = key;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = pipelines.find(key);
+        if (it != pipelines.end()) {
+            handle.future = it->second;
+            return handle;
+        }
+
+        handle.future = compile.get_future().share();
+        pipelines.emplace(key, handle.future);
+
+        if (!compile_threads.empty()) {
+            queue.push_back(std::move(compile));
+        }
+    }
+
+    if (compile_threads.empty()) {
+        compile();
+    }
+    else {
+        work_ready.notify_one();
+    }
+
+    return handle;
+}
+
+void PipelineRegistry::compile_main() {
+    for (;;) {
+        std::packaged_task<VkPipeline()> compile;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+
+            if (queue.empty()) {
+                return;
+            }
+            compile = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        // Errors end up in the future.
+        compile();
+    }
+}
+
+VkPipeline PipelineRegistry::compile_graphics(const GraphicsPipelineDesc& desc, const ShaderCode& vertex_code, const ShaderCode& fragment_code) const {
+    VkShaderModule vert_shader_module = create_shader_module(vertex_code);
+    VkShaderModule frag_shader_module = VK_NULL_HANDLE;
+    try {
+        frag_shader_module = create_shader_module(fragment_code);
+    }
+    catch (...) {
+        vkDestroyShaderModule(logical_device, vert_shader_module, nullptr);
+        throw;
+    }
+
+    VkSpecializationInfo vert_specialization = specialization_info(desc.vertex_shader);
+    VkSpecializationInfo frag_specialization = specialization_info(desc.fragment_shader);
+
+    VkPipelineShaderStageCreateInfo shader_stages[2]{};
+    shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shader_stages[0].module = vert_shader_module;
+    shader_stages[0].pName = "main";
+    shader_stages[0].pSpecializationInfo = desc.vertex_shader.specialization_entries.empty() ? nullptr : &vert_specialization;
+
+    shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shader_stages[1].module = frag_shader_module;
+    shader_stages[1].pName = "main";
+    shader_stages[1].pSpecializationInfo = desc.fragment_shader.specialization_entries.empty() ? nullptr : &frag_specialization;
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertex_bindings.size());
+    vertex_input_info.pVertexBindingDescriptions = desc.vertex_bindings.data();
+    vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertex_attributes.size());
+    vertex_input_info.pVertexAttributeDescriptions = desc.vertex_attributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = desc.topology;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = desc.polygon_mode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = desc.cull_mode;
+    rasterizer.frontFace = desc.front_face;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = desc.samples;
+    multisampling.sampleShadingEnable = desc.sample_shading ? VK_TRUE : VK_FALSE;
+    multisampling.minSampleShading = desc.min_sample_shading;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthWriteEnable = desc.depth_write ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthCompareOp = desc.depth_compare_op;
+    depth_stencil.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = desc.alpha_blend ? VK_TRUE : VK_FALSE;
+    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blending{};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.logicOpEnable = VK_FALSE;
+    color_blending.logicOp = VK_LOGIC_OP_COPY;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+
+    VkDynamicState dynamic_states[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = shader_stages;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = desc.layout;
+    pipeline_info.renderPass = desc.render_pass;
+    pipeline_info.subpass = desc.subpass;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateGraphicsPipelines(logical_device, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+
+    vkDestroyShaderModule(logical_device, frag_shader_module, nullptr);
+    vkDestroyShaderModule(logical_device, vert_shader_module, nullptr);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create graphics pipeline");
+    }
+
+    return pipeline;
+}
+
+VkPipeline PipelineRegistry::compile_compute(const ComputePipelineDesc& desc, const ShaderCode& code) const {
+    VkShaderModule compute_shader_module = create_shader_module(code);
+    VkSpecializationInfo specialization = specialization_info(desc.shader);
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = compute_shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.stage.pSpecializationInfo = desc.shader.specialization_entries.empty() ? nullptr : &specialization;
+    pipeline_info.layout = desc.layout;
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(logical_device, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+
+    vkDestroyShaderModule(logical_device, compute_shader_module, nullptr);
+
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create compute pipeline");
+    }
+
+    return pipeline;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderStageDesc {
+    // SPIR-V file, read once and shared by every pipeline that uses it.
+    std::string path;
+    std::vector<VkSpecializationMapEntry> specialization_entries;
+    std::vector<uint8_t> specialization_data;
+};
+
+// The state the samples actually vary. Viewport and scissor are always dynamic and there is a
+// single color attachment.
+struct GraphicsPipelineDesc {
+    ShaderStageDesc vertex_shader;
+    ShaderStageDesc fragment_shader;
+
+    std::vector<VkVertexInputBindingDescription> vertex_bindings;
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    bool sample_shading = false;
+    float min_sample_shading = 0.0f;
+
+    bool depth_test = false;
+    bool depth_write = false;
+    VkCompareOp depth_compare_op = VK_COMPARE_OP_LESS;
+
+    // Straight alpha blending on the color attachment.
+    bool alpha_blend = false;
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+};
+
+struct ComputePipelineDesc {
+    ShaderStageDesc shader;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+};
+
+// A pipeline that may still be compiling. Copies share the same result.
+class PipelineHandle {
+public:
+    uint64_t key() const { return hash; }
+    bool is_ready() const;
+
+    // Blocks until the pipeline is compiled; rethrows the error if compiling it failed.
+    VkPipeline get() const;
+
+    // The pipeline if it is ready, fallback otherwise. Never blocks.
+    VkPipeline get_or(VkPipeline fallback) const;
+
+private:
+    friend class PipelineRegistry;
+
+    uint64_t hash = 0;
+    std::shared_future<VkPipeline> future;
+};
+
+// Owns every pipeline of a device, keyed by a hash of the SPIR-V and the pipeline state.
+//
+// request() returns at once: a key seen before gets the existing handle, a new one is queued for
+// the compile threads, which create shader modules and pipelines through the shared
+// VkPipelineCache. Renderers keep drawing with a fallback through get_or() until a variant is
+// ready, so adding permutations never stalls a frame. Pipelines live until cleanup(), or until
+// release() for ones that were rebuilt.
+//
+// request() may be called from any thread. Layouts and render passes referenced by a desc must
+// stay alive until its pipeline is ready.
+class PipelineRegistry {
+public:
+    void init(VkDevice logical_device, VkPipelineCache pipeline_cache, uint32_t compile_thread_count = default_compile_thread_count());
+
+    // Finishes the queued compiles and destroys all pipelines.
+    void cleanup();
+
+    PipelineHandle request(const GraphicsPipelineDesc& desc);
+    PipelineHandle request(const ComputePipelineDesc& desc);
+
+    // Reads and hashes a SPIR-V file ahead of the request() that needs it. Any thread, and
+    // before init() too, so shaders can load while the device is still being created.
+    void preload(const std::string& path) { load_shader(path); }
+
+    // Replaces the SPIR-V of a path, for shaders recompiled while running. Pipelines requested
+    // from then on use the new code and get new keys; the ones already built are left alone.
+    void replace_shader(const std::string& path, std::vector<char> code);
+
+    // Destroys a pipeline that is no longer used, waiting for it if it is still compiling. The
+    // caller makes sure no other handle of the key is in use and the GPU is done with it.
+    void release(const PipelineHandle& handle);
+
+    // Half of the hardware threads, so compiles do not starve the render and recording threads.
+    static uint32_t default_compile_thread_count();
+
+private:
+    struct ShaderCode {
+        std::vector<char> code;
+        uint64_t hash = 0;
+    };
+
+    std::shared_ptr<const ShaderCode> load_shader(const std::string& path);
+    static std::shared_ptr<const ShaderCode> make_shader(std::vector<char> code);
+    VkShaderModule create_shader_module(const ShaderCode& code) const;
+    PipelineHandle enqueue(uint64_t key, std::packaged_task<VkPipeline()> compile);
+    void compile_main();
+
+    VkPipeline compile_graphics(const GraphicsPipelineDesc& desc, const ShaderCode& vertex_code, const ShaderCode& fragment_code) const;
+    VkPipeline compile_compute(const ComputePipelineDesc& desc, const ShaderCode& code) const;
+
+    VkDevice logical_device = VK_NULL_HANDLE;
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+
+    std::vector<std::thread> compile_threads;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    bool stopping = false;
+    std::deque<std::packaged_task<VkPipeline()>> queue;
+
+    std::unordered_map<uint64_t, std::shared_future<VkPipeline>> pipelines;
+    std::unordered_map<std::string, std::shared_ptr<const ShaderCode>> shaders;
+};
@@ -0,0 +1,111 @@
+#include "pipeline_reloader.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+void PipelineReloader::init(PipelineRegistry& registry, ShaderReloader& shaders) {
+    this->registry = &registry;
+    this->shaders = &shaders;
+    tracked_pipelines.clear();
+    retired_pipelines.clear();
+}
+
+void PipelineReloader::cleanup() {
+    // Retired and pending pipelines are still in the registry and go with it.
+    tracked_pipelines.clear();
+    retired_pipelines.clear();
+    registry = nullptr;
+    shaders = nullptr;
+}
+
+void PipelineReloader::track(PipelineHandle& handle, VkPipeline& pipeline, const GraphicsPipelineDesc& desc) {
+    TrackedPipeline tracked;
+    tracked.current = &handle;
+    tracked.pipeline = &pipeline;
+    tracked.shader_paths = { desc.vertex_shader.path, desc.fragment_shader.path };
+    tracked.request = [this, desc] { return registry->request(desc); };
+    tracked_pipelines.push_back(std::move(tracked));
+}
+
+void PipelineReloader::track(PipelineHandle& handle, VkPipeline& pipeline, const ComputePipelineDesc& desc) {
+    TrackedPipeline tracked;
+    tracked.current = &handle;
+    tracked.pipeline = &pipeline;
+    tracked.shader_paths = { desc.shader.path };
+    tracked.request = [this, desc] { return registry->request(desc); };
+    tracked_pipelines.push_back(std::move(tracked));
+}
+
+std::vector<std::string> PipelineReloader::update(uint64_t submitted_frames, uint64_t completed_frames) {
+    // Pipelines still compiling wait for a later frame rather than block this one.
+    for (size_t i = 0; i < retired_pipelines.size();) {
+        if (retired_pipelines[i].submitted_frames > completed_frames || !retired_pipelines[i].handle.is_ready()) {
+            i++;
+            continue;
+        }
+
+        registry->release(retired_pipelines[i].handle);
+        retired_pipelines.erase(retired_pipelines.begin() + i);
+    }
+
+    std::vector<std::string> errors = shaders->take_errors();
+
+    std::vector<ShaderReloader::CompiledShader> compiled = shaders->take_compiled();
+    if (!compiled.empty()) {
+        std::set<std::string> changed;
+        for (ShaderReloader::CompiledShader& shader : compiled) {
+            changed.insert(shader.spirv_path);
+            registry->replace_shader(shader.spirv_path, std::move(shader.code));
+        }
+
+        for (TrackedPipeline& tracked : tracked_pipelines) {
+            bool uses_changed = std::any_of(tracked.shader_paths.begin(), tracked.shader_paths.end(),
+                [&](const std::string& path) { return changed.count(path) > 0; });
+            if (uses_changed) {
+                rebuild(tracked, tracked.request());
+            }
+        }
+    }
+
+    for (TrackedPipeline& tracked : tracked_pipelines) {
+        if (!tracked.rebuilding || !tracked.pending.is_ready()) {
+            continue;
+        }
+
+        try {
+            VkPipeline pipeline = tracked.pending.get();
+            retired_pipelines.push_back({ *tracked.current, submitted_frames });
+            *tracked.current = tracked.pending;
+            *tracked.pipeline = pipeline;
+        }
+        catch (const std::exception& e) {
+            errors.push_back(std::string("hot reload: ") + e.what());
+            registry->release(tracked.pending);
+        }
+        tracked.pending = PipelineHandle{};
+        tracked.rebuilding = false;
+    }
+
+    return errors;
+}
+
+void PipelineReloader::rebuild(TrackedPipeline& tracked, PipelineHandle rebuilt) {
+    // Saving a shader back to what is drawn already revives a pipeline that was retired.
+    retired_pipelines.erase(std::remove_if(retired_pipelines.begin(), retired_pipelines.end(),
+        [&](const RetiredPipeline& retired) { return retired.handle.key() == rebuilt.key(); }), retired_pipelines.end());
+
+    // Superseded by a newer save while still compiling; never bound, so nothing waits on it.
+    if (tracked.rebuilding && tracked.pending.key() != rebuilt.key()) {
+        retired_pipelines.push_back({ tracked.pending, 0 });
+    }
+    tracked.rebuilding = false;
+
+    // Same SPIR-V as before, e.g. only comments changed.
+    if (rebuilt.key() == tracked.current->key()) {
+        return;
+    }
+
+    tracked.pending = std::move(rebuilt);
+    tracked.rebuilding = true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "pipeline_registry.h"
+#include "shader_reloader.h"
+
+// Swaps in the pipelines rebuilt from shaders that ShaderReloader recompiled, between frames.
+//
+// A tracked pipeline is the handle it was requested as and the VkPipeline the renderer binds.
+// When one of its shaders is recompiled, update() hands the code to the registry and requests the
+// pipeline again. The old one keeps drawing until the rebuild has compiled, so the frame being
+// recorded binds one pipeline throughout and frames in flight keep theirs; it is released once
+// the frames that may have drawn with it have completed. A rebuild that fails is reported and
+// dropped, and the old pipeline stays until the shader is fixed.
+class PipelineReloader {
+public:
+    void init(PipelineRegistry& registry, ShaderReloader& shaders);
+
+    // Before the registry's cleanup(), which destroys the pipelines still retired or compiling.
+    void cleanup();
+
+    // handle and pipeline are replaced in place, so they stay where they are while tracked.
+    void track(PipelineHandle& handle, VkPipeline& pipeline, const GraphicsPipelineDesc& desc);
+    void track(PipelineHandle& handle, VkPipeline& pipeline, const ComputePipelineDesc& desc);
+
+    // Once per frame, before recording. Pipelines replaced now may still be used by the first
+    // submitted_frames frames; those replaced earlier are released once completed_frames covers
+    // them. Returns the errors of shaders and pipelines that failed to build.
+    std::vector<std::string> update(uint64_t submitted_frames, uint64_t completed_frames);
+
+private:
+    struct TrackedPipeline {
+        PipelineHandle* current = nullptr;
+        VkPipeline* pipeline = nullptr;
+        std::vector<std::string> shader_paths;
+        std::function<PipelineHandle()> request;
+
+        // The rebuild still compiling, if rebuilding.
+        PipelineHandle pending;
+        bool rebuilding = false;
+    };
+
+    struct RetiredPipeline {
+        PipelineHandle handle;
+        uint64_t submitted_frames = 0;
+    };
+
+    void rebuild(TrackedPipeline& tracked, PipelineHandle rebuilt);
+
+    PipelineRegistry* registry = nullptr;
+    ShaderReloader* shaders = nullptr;
+
+    std::vector<TrackedPipeline> tracked_pipelines;
+    std::vector<RetiredPipeline> retired_pipelines;
+};
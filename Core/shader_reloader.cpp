@@ -0,0 +1,268 @@
+#include "shader_reloader.h"
+
+#include <shaderc/shaderc.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <set>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace {
+
+// Loads shaderc ahead of the delay-loaded imports, which would fault instead of failing.
+bool load_shaderc() {
+#ifdef _WIN32
+    return LoadLibraryA("shaderc_shared.dll") != nullptr;
+#else
+    return true;
+#endif
+}
+
+// Resolves #include "name" against the including file's directory, as glslc does.
+class FileIncluder : public shaderc::CompileOptions::IncluderInterface {
+public:
+    shaderc_include_result* GetInclude(const char* requested_source, shaderc_include_type type, const char* requesting_source,
+        size_t include_depth) override {
+        Include* include = new Include;
+        include->name = (std::filesystem::path(requesting_source).parent_path() / requested_source).string();
+
+        std::ifstream file(include->name, std::ios::binary);
+        if (file.is_open()) {
+            include->content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        else {
+            // An empty name tells shaderc the include failed, with the content as the reason.
+            include->content = "failed to open " + include->name;
+            include->name.clear();
+        }
+
+        include->result = { include->name.data(), include->name.size(), include->content.data(), include->content.size(), include };
+        return &include->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result* data) override {
+        delete static_cast<Include*>(data->user_data);
+    }
+
+private:
+    struct Include {
+        std::string name;
+        std::string content;
+        shaderc_include_result result{};
+    };
+};
+
+// Stage from the extension, as glslc does.
+bool shader_kind(const std::string& path, shaderc_shader_kind& kind) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    if (extension == ".vert") {
+        kind = shaderc_glsl_vertex_shader;
+    }
+    else if (extension == ".frag") {
+        kind = shaderc_glsl_fragment_shader;
+    }
+    else if (extension == ".comp") {
+        kind = shaderc_glsl_compute_shader;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Compiles the source into code, or describes why it could not in error.
+bool compile_source(const shaderc::Compiler& compiler, const ShaderReloader::Source& source, std::vector<char>& code, std::string& error) {
+    shaderc_shader_kind kind;
+    if (!shader_kind(source.glsl_path, kind)) {
+        error = "unknown shader stage";
+        return false;
+    }
+
+    std::ifstream file(source.glsl_path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "failed to open";
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    shaderc::CompileOptions options;
+    for (const std::string& define : source.defines) {
+        options.AddMacroDefinition(define);
+    }
+    options.SetIncluder(std::make_unique<FileIncluder>());
+
+    shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(text.data(), text.size(), kind, source.glsl_path.c_str(), options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+        error = result.GetErrorMessage();
+        return false;
+    }
+
+    const char* words = reinterpret_cast<const char*>(result.cbegin());
+    code.assign(words, reinterpret_cast<const char*>(result.cend()));
+    return true;
+}
+
+}
+
+ShaderReloadSettings ShaderReloadSettings::from_command_line(int argc, char** argv) {
+    ShaderReloadSettings settings;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--hot-reload") {
+            settings.enabled = true;
+        }
+    }
+    return settings;
+}
+
+void ShaderReloader::init(std::vector<Source> sources, std::chrono::milliseconds poll_interval) {
+    this->sources.clear();
+    stopping = false;
+    compiled.clear();
+    errors.clear();
+
+    if (!load_shaderc()) {
+        errors.push_back("shader reloader: shaderc_shared.dll not found; hot reload needs the Vulkan SDK");
+        return;
+    }
+
+    for (Source& source : sources) {
+        WatchedSource watched;
+        watched.source = std::move(source);
+
+        std::error_code error;
+        watched.write_time = std::filesystem::last_write_time(watched.source.glsl_path, error);
+        this->sources.push_back(std::move(watched));
+    }
+
+    includes.clear();
+    std::set<std::filesystem::path> directories;
+    for (const WatchedSource& watched : this->sources) {
+        directories.insert(std::filesystem::path(watched.source.glsl_path).parent_path());
+    }
+    for (const std::filesystem::path& directory : directories) {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory.empty() ? "." : directory, error)) {
+            if (entry.path().extension() == ".glsl") {
+                WatchedInclude include;
+                include.path = directory / entry.path().filename();
+                include.write_time = std::filesystem::last_write_time(include.path, error);
+                includes.push_back(std::move(include));
+            }
+        }
+    }
+    this->poll_interval = poll_interval;
+
+    thread = std::thread(&ShaderReloader::thread_main, this);
+}
+
+void ShaderReloader::cleanup() {
+    if (!thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stop_requested.notify_all();
+    thread.join();
+
+    sources.clear();
+    includes.clear();
+    compiled.clear();
+    errors.clear();
+}
+
+std::vector<ShaderReloader::CompiledShader> ShaderReloader::take_compiled() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<CompiledShader> result;
+    result.swap(compiled);
+    return result;
+}
+
+std::vector<std::string> ShaderReloader::take_errors() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> result;
+    result.swap(errors);
+    return result;
+}
+
+void ShaderReloader::thread_main() {
+    shaderc::Compiler compiler;
+    if (!compiler.IsValid()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        errors.push_back("shader reloader: failed to create the shaderc compiler");
+        return;
+    }
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (stop_requested.wait_for(lock, poll_interval, [this] { return stopping; })) {
+                return;
+            }
+        }
+
+        // A file being replaced by the editor may be missing for a moment; try again later.
+        std::set<std::filesystem::path> changed_directories;
+        for (WatchedInclude& include : includes) {
+            std::error_code time_error;
+            auto write_time = std::filesystem::last_write_time(include.path, time_error);
+            if (!time_error && write_time != include.write_time) {
+                include.write_time = write_time;
+                changed_directories.insert(include.path.parent_path());
+            }
+        }
+
+        for (WatchedSource& watched : sources) {
+            std::error_code time_error;
+            auto write_time = std::filesystem::last_write_time(watched.source.glsl_path, time_error);
+            bool include_changed = changed_directories.count(std::filesystem::path(watched.source.glsl_path).parent_path()) > 0;
+            if (!include_changed && (time_error || write_time == watched.write_time)) {
+                continue;
+            }
+            if (!time_error) {
+                watched.write_time = write_time;
+            }
+
+            const Source& source = watched.source;
+            std::vector<char> code;
+            std::string error;
+            if (compile_source(compiler, source, code, error)) {
+                std::ofstream file(source.spirv_path, std::ios::binary | std::ios::trunc);
+                file.write(code.data(), static_cast<std::streamsize>(code.size()));
+                if (!file) {
+                    error = "failed to write " + source.spirv_path;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error.empty()) {
+                std::string name = source.glsl_path;
+                for (const std::string& define : source.defines) {
+                    name += " -D" + define;
+                }
+                errors.push_back("shader reloader: " + name + ": " + error);
+                continue;
+            }
+
+            // A shader saved twice before the render thread looked only hands over the last code.
+            bool replaced = false;
+            for (CompiledShader& shader : compiled) {
+                if (shader.spirv_path == source.spirv_path) {
+                    shader.code = std::move(code);
+                    replaced = true;
+                }
+            }
+            if (!replaced) {
+                compiled.push_back({ source.spirv_path, std::move(code) });
+            }
+        }
+    }
+}
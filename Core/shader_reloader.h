@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Recompiles the GLSL of a sample when it is saved and swaps the rebuilt pipelines in while
+// running. Windowed runs only; benchmarks always use the SPIR-V on disk.
+struct ShaderReloadSettings {
+    bool enabled = false;
+
+    // Reads --hot-reload.
+    static ShaderReloadSettings from_command_line(int argc, char** argv);
+};
+
+// Watches GLSL sources and recompiles them with shaderc when they change, for iterating on
+// shaders without restarting.
+//
+// A thread polls the sources' modification times. A changed source is compiled with its defines,
+// the way the build step would, the SPIR-V is written over its file, so the next start picks it up
+// too, and handed to the render thread through take_compiled(). The render thread rebuilds the
+// pipelines using it and swaps them in at a frame boundary. A source that fails to compile keeps
+// its old SPIR-V; the error is reported through take_errors().
+//
+// #include "name" is resolved against the including file's directory, as glslc does. Like the
+// build step, a change to any .glsl next to a source recompiles every source in that directory;
+// .glsl files added after init() are not watched.
+//
+// The sources' times at init() are taken as built, so nothing compiles until a file is saved.
+//
+// Samples delay-load shaderc_shared.dll, so they start without the Vulkan SDK's runtime; without
+// it init() only reports an error and nothing is watched.
+class ShaderReloader {
+public:
+    struct Source {
+        std::string glsl_path;
+        std::string spirv_path;
+        // Macros defined for the compile, like -D of glslc.
+        std::vector<std::string> defines;
+    };
+
+    struct CompiledShader {
+        std::string spirv_path;
+        std::vector<char> code;
+    };
+
+    void init(std::vector<Source> sources, std::chrono::milliseconds poll_interval = std::chrono::milliseconds(250));
+    void cleanup();
+
+    // Shaders compiled since the last call, the latest code of each.
+    std::vector<CompiledShader> take_compiled();
+
+    // Compile errors since the last call, one message per failed source.
+    std::vector<std::string> take_errors();
+
+private:
+    struct WatchedSource {
+        Source source;
+        std::filesystem::file_time_type write_time{};
+    };
+
+    struct WatchedInclude {
+        std::filesystem::path path;
+        std::filesystem::file_time_type write_time{};
+    };
+
+    void thread_main();
+
+    std::vector<WatchedSource> sources;
+    std::vector<WatchedInclude> includes;
+    std::chrono::milliseconds poll_interval{};
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable stop_requested;
+    bool stopping = false;
+    std::vector<CompiledShader> compiled;
+    std::vector<std::string> errors;
+};
@@ -0,0 +1,609 @@
+#include "staging_ring.h"
+
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// Satisfies the copy offset rules for every format the samples upload (texel size, 16-byte
+// compressed blocks).
+static constexpr VkDeviceSize copy_alignment = 16;
+
+static VkCommandPool create_command_pool(VkDevice logical_device, uint32_t queue_family) {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+
+    VkCommandPool command_pool;
+    if (vkCreateCommandPool(logical_device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create staging command pool");
+    }
+
+    return command_pool;
+}
+
+static VkCommandBuffer allocate_command_buffer(VkDevice logical_device, VkCommandPool command_pool) {
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    if (vkAllocateCommandBuffers(logical_device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to allocate staging command buffer");
+    }
+
+    return command_buffer;
+}
+
+static void begin_command_buffer(VkCommandBuffer command_buffer) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to begin staging command buffer");
+    }
+}
+
+void StagingRing::init(VkDevice logical_device, DeviceAllocator& allocator,
+    VkQueue upload_queue, uint32_t upload_family,
+    VkQueue destination_queue, uint32_t destination_family,
+    VkDeviceSize capacity) {
+    this->logical_device = logical_device;
+    this->allocator = &allocator;
+    this->upload_queue = upload_queue;
+    this->upload_family = upload_family;
+    this->destination_queue = destination_queue;
+    this->destination_family = destination_family;
+    this->capacity = capacity;
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(allocator.physical_device_handle(), &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(allocator.physical_device_handle(), &family_count, families.data());
+    image_granularity = families[upload_family].minImageTransferGranularity;
+
+    // Shared with the destination family, which copies out of it what the upload queue cannot.
+    allocator.create_buffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        { upload_family, destination_family }, buffer, allocation);
+
+    upload_command_pool = create_command_pool(logical_device, upload_family);
+    if (transfers_ownership()) {
+        destination_command_pool = create_command_pool(logical_device, destination_family);
+    }
+}
+
+void StagingRing::cleanup() {
+    submit();
+    wait_idle();
+
+    for (auto& batch : idle) {
+        vkDestroyFence(logical_device, batch.fence, nullptr);
+        if (batch.uploaded != VK_NULL_HANDLE) {
+            vkDestroySemaphore(logical_device, batch.uploaded, nullptr);
+        }
+        if (batch.timestamps != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(logical_device, batch.timestamps, nullptr);
+        }
+    }
+    idle.clear();
+    destination_images.clear();
+
+    vkDestroyCommandPool(logical_device, upload_command_pool, nullptr);
+    if (destination_command_pool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(logical_device, destination_command_pool, nullptr);
+        destination_command_pool = VK_NULL_HANDLE;
+    }
+    allocator->destroy_buffer(buffer, allocation);
+}
+
+void StagingRing::upload_buffer(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+    // Large buffers go through in ring-sized pieces rather than failing.
+    const char* src = static_cast<const char*>(data);
+    while (size > 0) {
+        VkDeviceSize chunk = std::min(size, capacity);
+        VkDeviceSize offset = reserve(chunk, copy_alignment);
+
+        memcpy(static_cast<char*>(allocation.mapped) + offset, src, static_cast<size_t>(chunk));
+
+        VkBufferCopy copy_region{};
+        copy_region.srcOffset = offset;
+        copy_region.dstOffset = dst_offset;
+        copy_region.size = chunk;
+        vkCmdCopyBuffer(command_buffer(), buffer, dst_buffer, 1, &copy_region);
+
+        src += chunk;
+        dst_offset += chunk;
+        size -= chunk;
+    }
+
+    // Only once the last piece is recorded; a flush in between must not hand the buffer over early.
+    // Once per buffer, however many ranges of it the batch writes.
+    if (transfers_ownership() && std::find(written_buffers.begin(), written_buffers.end(), dst_buffer) == written_buffers.end()) {
+        written_buffers.push_back(dst_buffer);
+    }
+}
+
+void StagingRing::upload_image(VkImage dst_image, VkBufferImageCopy region, const void* data, VkDeviceSize size, uint32_t block_height) {
+    if (size <= capacity) {
+        VkDeviceSize offset = reserve(size, copy_alignment);
+
+        memcpy(static_cast<char*>(allocation.mapped) + offset, data, static_cast<size_t>(size));
+
+        VkBufferImageCopy piece = region;
+        piece.bufferOffset = offset;
+        copy_to_image(dst_image, piece, region, block_height);
+        return;
+    }
+
+    // Large images go through in pieces of whole rows, like buffers.
+    if (region.bufferRowLength != 0 || region.bufferImageHeight != 0 || region.imageExtent.depth != 1 || region.imageSubresource.layerCount != 1) {
+        throw std::runtime_error("vk: only tightly packed 2D images can be split across the staging ring");
+    }
+
+    uint32_t height = region.imageExtent.height;
+    VkDeviceSize row_count = (height + block_height - 1) / block_height;
+    if (row_count == 0 || size % row_count != 0) {
+        throw std::runtime_error("vk: image data does not match its extent");
+    }
+
+    VkDeviceSize row_size = size / row_count;
+    VkDeviceSize rows_per_chunk = capacity / row_size;
+    if (rows_per_chunk == 0) {
+        throw std::runtime_error("vk: image row does not fit into the staging ring");
+    }
+    // Pieces that start on the transfer granularity stay on the upload queue.
+    if (transfers_ownership() && image_granularity.height > 1 && rows_per_chunk >= image_granularity.height) {
+        rows_per_chunk -= rows_per_chunk % image_granularity.height;
+    }
+
+    const char* src = static_cast<const char*>(data);
+    int32_t first_y = region.imageOffset.y;
+    for (VkDeviceSize row = 0; row < row_count; row += rows_per_chunk) {
+        VkDeviceSize rows = std::min(rows_per_chunk, row_count - row);
+        VkDeviceSize chunk = rows * row_size;
+        VkDeviceSize offset = reserve(chunk, copy_alignment);
+
+        memcpy(static_cast<char*>(allocation.mapped) + offset, src + row * row_size, static_cast<size_t>(chunk));
+
+        // The last piece of a block-compressed image ends at the image's edge, not a block's.
+        uint32_t first_texel_row = static_cast<uint32_t>(row * block_height);
+        VkBufferImageCopy piece = region;
+        piece.bufferOffset = offset;
+        piece.imageOffset.y = first_y + static_cast<int32_t>(first_texel_row);
+        piece.imageExtent.height = std::min(static_cast<uint32_t>(rows * block_height), height - first_texel_row);
+        copy_to_image(dst_image, piece, region, block_height);
+    }
+}
+
+void StagingRing::copy_to_image(VkImage dst_image, const VkBufferImageCopy& piece, const VkBufferImageCopy& level, uint32_t block_size) {
+    bool on_destination = std::find(destination_images.begin(), destination_images.end(), dst_image) != destination_images.end();
+    if (!on_destination && (!transfers_ownership() || fits_granularity(piece, level, block_size))) {
+        vkCmdCopyBufferToImage(command_buffer(), buffer, dst_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &piece);
+        return;
+    }
+
+    if (!on_destination) {
+        move_to_destination(dst_image, piece.imageSubresource.aspectMask);
+    }
+    vkCmdCopyBufferToImage(destination_command_buffer(), buffer, dst_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &piece);
+}
+
+// Every dimension starts on a multiple of the granularity and either spans a multiple of it or
+// ends at the edge of the level. A granularity of 0 only allows whole levels.
+bool StagingRing::fits_granularity(const VkBufferImageCopy& piece, const VkBufferImageCopy& level, uint32_t block_size) const {
+    const uint32_t granularity[3] = { image_granularity.width, image_granularity.height, image_granularity.depth };
+    const int32_t piece_offset[3] = { piece.imageOffset.x, piece.imageOffset.y, piece.imageOffset.z };
+    const uint32_t piece_extent[3] = { piece.imageExtent.width, piece.imageExtent.height, piece.imageExtent.depth };
+    const int32_t level_offset[3] = { level.imageOffset.x, level.imageOffset.y, level.imageOffset.z };
+    const uint32_t level_extent[3] = { level.imageExtent.width, level.imageExtent.height, level.imageExtent.depth };
+
+    for (int i = 0; i < 3; i++) {
+        // Granularity counts compressed blocks; depth is never blocked.
+        uint32_t block = i < 2 ? block_size : 1;
+        uint32_t offset = static_cast<uint32_t>(piece_offset[i]);
+        uint32_t end = offset + piece_extent[i];
+        bool starts_level = piece_offset[i] == level_offset[i];
+        bool ends_level = end == static_cast<uint32_t>(level_offset[i]) + level_extent[i];
+
+        if (granularity[i] == 0) {
+            if (!starts_level || !ends_level) {
+                return false;
+            }
+            continue;
+        }
+
+        uint32_t step = granularity[i] * block;
+        if (offset % step != 0 || (piece_extent[i] % step != 0 && !ends_level)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hands the image over in TRANSFER_DST_OPTIMAL, with whatever the upload queue has copied into it.
+void StagingRing::move_to_destination(VkImage image, VkImageAspectFlags aspect) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = upload_family;
+    barrier.dstQueueFamilyIndex = destination_family;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspect;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+
+    vkCmdPipelineBarrier(command_buffer(),
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(destination_command_buffer(),
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    destination_images.push_back(image);
+}
+
+void StagingRing::release_image(VkImage image, const VkImageSubresourceRange& range,
+    VkImageLayout old_layout, VkImageLayout new_layout,
+    VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+
+    // Already on the destination queue when the upload queue could not copy it.
+    auto moved = std::find(destination_images.begin(), destination_images.end(), image);
+    bool on_destination = moved != destination_images.end();
+    if (on_destination) {
+        destination_images.erase(moved);
+    }
+
+    if (!transfers_ownership() || on_destination) {
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dst_access;
+
+        vkCmdPipelineBarrier(on_destination ? destination_command_buffer() : command_buffer(),
+            VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+        return;
+    }
+
+    // Release half: makes the copies available and gives up ownership. Its destination access is
+    // ignored by the spec, the acquire below carries it.
+    barrier.srcQueueFamilyIndex = upload_family;
+    barrier.dstQueueFamilyIndex = destination_family;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+
+    vkCmdPipelineBarrier(command_buffer(),
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    // Acquire half, identical apart from the access masks. Recorded right away so anything the
+    // caller records on the destination command buffer afterwards sees the image.
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dst_access;
+
+    vkCmdPipelineBarrier(recording.destination_command_buffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+}
+
+VkCommandBuffer StagingRing::command_buffer() {
+    if (!is_recording) {
+        begin_batch();
+    }
+
+    return recording.command_buffer;
+}
+
+VkCommandBuffer StagingRing::destination_command_buffer() {
+    if (!transfers_ownership()) {
+        return command_buffer();
+    }
+
+    if (!is_recording) {
+        begin_batch();
+    }
+
+    // Hand over the buffers written so far before the caller gets to use them.
+    release_written_buffers();
+    return recording.destination_command_buffer;
+}
+
+uint64_t StagingRing::submit() {
+    if (!is_recording) {
+        return next_batch_id - 1;
+    }
+
+    if (transfers_ownership()) {
+        release_written_buffers();
+    }
+    else {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+        vkCmdPipelineBarrier(recording.command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            1, &barrier,
+            0, nullptr,
+            0, nullptr);
+    }
+
+    if (recording.timed) {
+        vkCmdWriteTimestamp(recording.command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            recording.timestamps, recording.timed_pair * 2 + 1);
+    }
+
+    // The pair written here is read once the fence signals, so the next use takes the other one.
+    if (recording.timestamps != VK_NULL_HANDLE) {
+        VkCommandBuffer reset_command_buffer = transfers_ownership() ? recording.destination_command_buffer : recording.command_buffer;
+        vkCmdResetQueryPool(reset_command_buffer, recording.timestamps, recording.next_pair * 2, 2);
+        recording.pair_reset = true;
+    }
+
+    if (vkEndCommandBuffer(recording.command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to record staging command buffer");
+    }
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &recording.command_buffer;
+
+    if (!transfers_ownership()) {
+        if (vkQueueSubmit(upload_queue, 1, &submit_info, recording.fence) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to submit staging command buffer");
+        }
+    }
+    else {
+        if (vkEndCommandBuffer(recording.destination_command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to record staging acquire command buffer");
+        }
+
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &recording.uploaded;
+
+        if (vkQueueSubmit(upload_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to submit staging command buffer");
+        }
+
+        // The destination side only waits for the copies of this batch, so rendering submitted
+        // before it keeps running while the transfer queue works. Its fence signals after both.
+        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkSubmitInfo acquire_info{};
+        acquire_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquire_info.waitSemaphoreCount = 1;
+        acquire_info.pWaitSemaphores = &recording.uploaded;
+        acquire_info.pWaitDstStageMask = &wait_stage;
+        acquire_info.commandBufferCount = 1;
+        acquire_info.pCommandBuffers = &recording.destination_command_buffer;
+
+        if (vkQueueSubmit(destination_queue, 1, &acquire_info, recording.fence) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to submit staging acquire command buffer");
+        }
+    }
+
+    recording.ring_end = head;
+    recording.id = next_batch_id++;
+    pending.push_back(recording);
+    is_recording = false;
+
+    return recording.id;
+}
+
+bool StagingRing::is_complete(uint64_t batch_id) {
+    retire_completed();
+    return completed_batch_id >= batch_id;
+}
+
+void StagingRing::wait(uint64_t batch_id) {
+    while (completed_batch_id < batch_id && !pending.empty()) {
+        wait_oldest();
+    }
+}
+
+void StagingRing::wait_idle() {
+    while (!pending.empty()) {
+        wait_oldest();
+    }
+}
+
+void StagingRing::begin_batch() {
+    if (!idle.empty()) {
+        recording = idle.back();
+        idle.pop_back();
+    }
+    else {
+        recording = {};
+        recording.command_buffer = allocate_command_buffer(logical_device, upload_command_pool);
+
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(logical_device, &fence_info, nullptr, &recording.fence) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create staging fence");
+        }
+
+        if (transfers_ownership()) {
+            recording.destination_command_buffer = allocate_command_buffer(logical_device, destination_command_pool);
+
+            VkSemaphoreCreateInfo semaphore_info{};
+            semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+            if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &recording.uploaded) != VK_SUCCESS) {
+                throw std::runtime_error("vk: failed to create staging semaphore");
+            }
+        }
+    }
+
+    begin_command_buffer(recording.command_buffer);
+    if (transfers_ownership()) {
+        begin_command_buffer(recording.destination_command_buffer);
+    }
+
+    recording.timed = false;
+    if (profiler != nullptr && profiler->supports_timestamps(upload_family)) {
+        if (recording.timestamps == VK_NULL_HANDLE) {
+            VkQueryPoolCreateInfo pool_info{};
+            pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            pool_info.queryCount = 4;
+
+            if (vkCreateQueryPool(logical_device, &pool_info, nullptr, &recording.timestamps) != VK_SUCCESS) {
+                throw std::runtime_error("vk: failed to create staging query pool");
+            }
+        }
+
+        // A fresh pool has nothing reset yet; the first use of the batch only resets a pair.
+        if (recording.pair_reset) {
+            recording.timed = true;
+            recording.timed_pair = recording.next_pair;
+            recording.next_pair ^= 1;
+            vkCmdWriteTimestamp(recording.command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                recording.timestamps, recording.timed_pair * 2);
+        }
+    }
+
+    is_recording = true;
+}
+
+void StagingRing::release_written_buffers() {
+    if (written_buffers.empty()) {
+        return;
+    }
+
+    std::vector<VkBufferMemoryBarrier> barriers(written_buffers.size());
+    for (size_t i = 0; i < written_buffers.size(); i++) {
+        barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barriers[i].srcQueueFamilyIndex = upload_family;
+        barriers[i].dstQueueFamilyIndex = destination_family;
+        barriers[i].buffer = written_buffers[i];
+        barriers[i].offset = 0;
+        barriers[i].size = VK_WHOLE_SIZE;
+        barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[i].dstAccessMask = 0;
+    }
+
+    vkCmdPipelineBarrier(recording.command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data(),
+        0, nullptr);
+
+    // Buffers can be read by anything afterwards: vertex input, uniforms, storage.
+    for (auto& barrier : barriers) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+
+    vkCmdPipelineBarrier(recording.destination_command_buffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data(),
+        0, nullptr);
+
+    written_buffers.clear();
+}
+
+VkDeviceSize StagingRing::reserve(VkDeviceSize size, VkDeviceSize alignment) {
+    if (size > capacity) {
+        throw std::runtime_error("vk: upload does not fit into the staging ring");
+    }
+
+    for (;;) {
+        retire_completed();
+
+        // With nothing in flight the whole ring is free; start over at its beginning.
+        if (pending.empty() && !is_recording) {
+            head = 0;
+            tail = 0;
+        }
+
+        uint64_t start = (head + alignment - 1) / alignment * alignment;
+
+        // Never split an upload across the end of the ring; skip to the next lap instead.
+        if (start % capacity + size > capacity) {
+            start = (start / capacity + 1) * capacity;
+        }
+
+        if (start + size - tail <= capacity) {
+            head = start + size;
+            return start % capacity;
+        }
+
+        // Out of space. The batch being recorded may be the one holding it, so flush it first.
+        if (pending.empty()) {
+            submit();
+        }
+        wait_oldest();
+    }
+}
+
+void StagingRing::retire_completed() {
+    while (!pending.empty() && vkGetFenceStatus(logical_device, pending.front().fence) == VK_SUCCESS) {
+        Batch batch = pending.front();
+        pending.pop_front();
+
+        vkResetFences(logical_device, 1, &batch.fence);
+        report_timing(batch);
+
+        tail = batch.ring_end;
+        completed_batch_id = batch.id;
+        idle.push_back(batch);
+    }
+}
+
+void StagingRing::wait_oldest() {
+    if (pending.empty()) {
+        return;
+    }
+
+    vkWaitForFences(logical_device, 1, &pending.front().fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    retire_completed();
+}
+
+void StagingRing::report_timing(Batch& batch) {
+    if (!batch.timed || profiler == nullptr) {
+        return;
+    }
+    batch.timed = false;
+
+    uint64_t timestamps[2] = {};
+    if (vkGetQueryPoolResults(logical_device, batch.timestamps, batch.timed_pair * 2, 2,
+            sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        profiler->add_sample("upload", profiler->ticks_to_ms(upload_family, timestamps[0], timestamps[1]));
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "device_allocator.h"
+
+class GpuProfiler;
+
+// Persistently mapped staging memory used as a ring, plus the command buffers that copy out of it.
+//
+// Uploads are recorded into the current batch and go out together with submit(), so loading any
+// number of resources is one vkQueueSubmit. Every batch carries a fence; ring space is only
+// reused once the fence of the batch that wrote it has signalled, and the CPU only blocks when
+// the ring is actually full. Nothing here ever waits for the whole queue to go idle.
+//
+// Copies run on the upload queue, which may be a dedicated transfer family. In that case every
+// resource is released to the destination (graphics) family at the end of its batch and acquired
+// there by a small second submission that waits on the transfer one with a semaphore, so uploads
+// overlap rendering instead of being serialized with it. With a single family the release and
+// acquire collapse into a plain barrier and there is only one submission.
+//
+// A transfer family may have a coarse minImageTransferGranularity. An image copy it cannot do is
+// recorded on the destination queue instead. The image is moved over in TRANSFER_DST_OPTIMAL by
+// its first such copy, and every later copy of it is recorded there too.
+//
+// With a profiler attached, every batch is timed on the upload queue and reported as an "upload"
+// sample once its fence has signalled.
+//
+// Not thread-safe; record and submit from one thread.
+class StagingRing {
+public:
+    static constexpr VkDeviceSize default_capacity = 32ull * 1024 * 1024;
+
+    void init(VkDevice logical_device, DeviceAllocator& allocator,
+        VkQueue upload_queue, uint32_t upload_family,
+        VkQueue destination_queue, uint32_t destination_family,
+        VkDeviceSize capacity = default_capacity);
+    void cleanup();
+
+    // The profiler has to outlive the ring, or be detached with nullptr.
+    void set_profiler(GpuProfiler* profiler) { this->profiler = profiler; }
+
+    // The buffer is released to the destination queue when the batch is submitted.
+    void upload_buffer(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+
+    // The image must be in TRANSFER_DST_OPTIMAL layout when the batch executes and be handed over
+    // with release_image() once all of its copies are recorded. region.bufferOffset is filled in
+    // here; everything else describes the destination, which is a whole mip level.
+    //
+    // A region larger than the ring goes through in pieces of whole rows, which needs tightly
+    // packed data of a single 2D layer. block_height is the texel rows per row of data, 4 for
+    // 4x4 block-compressed formats.
+    void upload_image(VkImage dst_image, VkBufferImageCopy region, const void* data, VkDeviceSize size, uint32_t block_height = 1);
+
+    // Transfers the image to the destination queue, moving it from old_layout to new_layout on the way.
+    void release_image(VkImage image, const VkImageSubresourceRange& range,
+        VkImageLayout old_layout, VkImageLayout new_layout,
+        VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+
+    // Upload-queue command buffer of the batch being recorded, for barriers that have to be ordered
+    // with the copies. May change after any upload call if the ring had to be flushed.
+    VkCommandBuffer command_buffer();
+
+    // Destination-queue command buffer of the batch, executed after everything released so far has
+    // been acquired. Used for work the upload queue cannot do, like blitting mip chains.
+    VkCommandBuffer destination_command_buffer();
+
+    // Submits the current batch and returns its id; returns the last id if nothing was recorded.
+    uint64_t submit();
+
+    bool is_complete(uint64_t batch_id);
+    void wait(uint64_t batch_id);
+    void wait_idle();
+
+    bool transfers_ownership() const { return upload_family != destination_family; }
+
+private:
+    struct Batch {
+        VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+        VkCommandBuffer destination_command_buffer = VK_NULL_HANDLE;
+        VkSemaphore uploaded = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        uint64_t ring_end = 0;
+        uint64_t id = 0;
+
+        // Two pairs of timestamps used in turn. Transfer queues cannot reset queries, so the
+        // destination side of each batch resets the pair the next use of the batch writes.
+        VkQueryPool timestamps = VK_NULL_HANDLE;
+        uint32_t next_pair = 0;
+        bool pair_reset = false;
+        bool timed = false;
+        uint32_t timed_pair = 0;
+    };
+
+    void begin_batch();
+    void release_written_buffers();
+    void copy_to_image(VkImage dst_image, const VkBufferImageCopy& piece, const VkBufferImageCopy& level, uint32_t block_size);
+    bool fits_granularity(const VkBufferImageCopy& piece, const VkBufferImageCopy& level, uint32_t block_size) const;
+    void move_to_destination(VkImage image, VkImageAspectFlags aspect);
+    VkDeviceSize reserve(VkDeviceSize size, VkDeviceSize alignment);
+    void retire_completed();
+    void wait_oldest();
+    void report_timing(Batch& batch);
+
+    VkDevice logical_device = VK_NULL_HANDLE;
+    DeviceAllocator* allocator = nullptr;
+    GpuProfiler* profiler = nullptr;
+
+    VkQueue upload_queue = VK_NULL_HANDLE;
+    VkQueue destination_queue = VK_NULL_HANDLE;
+    uint32_t upload_family = 0;
+    uint32_t destination_family = 0;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation allocation{};
+    VkDeviceSize capacity = 0;
+
+    // Monotonic byte positions; the ring offset is position % capacity. Everything between tail
+    // and head may still be read by the GPU.
+    uint64_t head = 0;
+    uint64_t tail = 0;
+
+    VkCommandPool upload_command_pool = VK_NULL_HANDLE;
+    VkCommandPool destination_command_pool = VK_NULL_HANDLE;
+
+    Batch recording{};
+    bool is_recording = false;
+    std::deque<Batch> pending;
+    std::vector<Batch> idle;
+
+    // Buffers fully written in the batch being recorded, released to the destination on submit.
+    std::vector<VkBuffer> written_buffers;
+
+    // minImageTransferGranularity of the upload family, in texels or compressed blocks.
+    VkExtent3D image_granularity{ 1, 1, 1 };
+
+    // Images the upload queue could not copy, owned by the destination family until release_image().
+    std::vector<VkImage> destination_images;
+
+    uint64_t next_batch_id = 1;
+    uint64_t completed_batch_id = 0;
+};
@@ -0,0 +1,320 @@
+#include "texture_baker.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "thread_pool.h"
+
+static float srgb_to_linear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+std::vector<std::vector<uint8_t>> generate_srgb_mip_chain(const uint8_t* rgba, uint32_t width, uint32_t height) {
+    std::array<float, 256> to_linear;
+    for (int i = 0; i < 256; i++) {
+        to_linear[i] = srgb_to_linear(i / 255.0f);
+    }
+
+    std::vector<std::vector<uint8_t>> levels;
+    levels.emplace_back(rgba, rgba + static_cast<size_t>(width) * height * 4);
+
+    // Linear copy of the level being filtered, so every level is only converted once.
+    std::vector<float> source(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < source.size(); i++) {
+        source[i] = i % 4 == 3 ? rgba[i] / 255.0f : to_linear[rgba[i]];
+    }
+
+    while (width > 1 || height > 1) {
+        uint32_t next_width = std::max(1u, width / 2);
+        uint32_t next_height = std::max(1u, height / 2);
+
+        std::vector<float> filtered(static_cast<size_t>(next_width) * next_height * 4);
+        std::vector<uint8_t> level(filtered.size());
+
+        for (uint32_t y = 0; y < next_height; y++) {
+            uint32_t y0 = std::min(y * 2, height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+            for (uint32_t x = 0; x < next_width; x++) {
+                uint32_t x0 = std::min(x * 2, width - 1);
+                uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+                for (uint32_t c = 0; c < 4; c++) {
+                    float sum = source[(static_cast<size_t>(y0) * width + x0) * 4 + c] +
+                        source[(static_cast<size_t>(y0) * width + x1) * 4 + c] +
+                        source[(static_cast<size_t>(y1) * width + x0) * 4 + c] +
+                        source[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                    float value = sum * 0.25f;
+
+                    size_t index = (static_cast<size_t>(y) * next_width + x) * 4 + c;
+                    filtered[index] = value;
+
+                    float encoded = c == 3 ? value : linear_to_srgb(value);
+                    level[index] = static_cast<uint8_t>(std::clamp(encoded * 255.0f + 0.5f, 0.0f, 255.0f));
+                }
+            }
+        }
+
+        levels.push_back(std::move(level));
+        source = std::move(filtered);
+        width = next_width;
+        height = next_height;
+    }
+
+    return levels;
+}
+
+namespace {
+
+constexpr int bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Mode6Endpoints {
+    int color[2][4]; // 7-bit
+    int p_bit[2];
+
+    int expanded(int endpoint, int channel) const {
+        return (color[endpoint][channel] << 1) | p_bit[endpoint];
+    }
+};
+
+// Picks the 7-bit values and shared p-bit that best represent an 8-bit endpoint.
+void quantize_endpoint(const float value[4], int color[4], int& p_bit) {
+    float best_error = 1e30f;
+
+    for (int p = 0; p < 2; p++) {
+        int candidate[4];
+        float error = 0.0f;
+
+        for (int c = 0; c < 4; c++) {
+            float v = std::clamp(value[c], 0.0f, 255.0f);
+            candidate[c] = std::clamp(static_cast<int>(std::lround((v - p) / 2.0f)), 0, 127);
+            float d = static_cast<float>((candidate[c] << 1) | p) - v;
+            error += d * d;
+        }
+
+        if (error < best_error) {
+            best_error = error;
+            p_bit = p;
+            std::copy(candidate, candidate + 4, color);
+        }
+    }
+}
+
+uint32_t select_indices(const uint8_t pixels[16][4], const Mode6Endpoints& endpoints, uint8_t indices[16]) {
+    int palette[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            int e0 = endpoints.expanded(0, c);
+            int e1 = endpoints.expanded(1, c);
+            palette[i][c] = ((64 - bc7_weights[i]) * e0 + bc7_weights[i] * e1 + 32) >> 6;
+        }
+    }
+
+    uint32_t total_error = 0;
+    for (int p = 0; p < 16; p++) {
+        uint32_t best_error = UINT32_MAX;
+
+        for (int i = 0; i < 16; i++) {
+            uint32_t error = 0;
+            for (int c = 0; c < 4; c++) {
+                int d = palette[i][c] - pixels[p][c];
+                error += d * d;
+            }
+
+            if (error < best_error) {
+                best_error = error;
+                indices[p] = static_cast<uint8_t>(i);
+            }
+        }
+
+        total_error += best_error;
+    }
+
+    return total_error;
+}
+
+// Least-squares endpoints for fixed indices.
+bool refine_endpoints(const uint8_t pixels[16][4], const uint8_t indices[16], float e0[4], float e1[4]) {
+    float a = 0.0f, b = 0.0f, d = 0.0f;
+    float r0[4] = {}, r1[4] = {};
+
+    for (int p = 0; p < 16; p++) {
+        float w = bc7_weights[indices[p]] / 64.0f;
+        a += (1.0f - w) * (1.0f - w);
+        b += (1.0f - w) * w;
+        d += w * w;
+
+        for (int c = 0; c < 4; c++) {
+            r0[c] += (1.0f - w) * pixels[p][c];
+            r1[c] += w * pixels[p][c];
+        }
+    }
+
+    float determinant = a * d - b * b;
+    if (std::fabs(determinant) < 1e-6f) {
+        return false;
+    }
+
+    for (int c = 0; c < 4; c++) {
+        e0[c] = (d * r0[c] - b * r1[c]) / determinant;
+        e1[c] = (a * r1[c] - b * r0[c]) / determinant;
+    }
+
+    return true;
+}
+
+class BitWriter {
+public:
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, position++) {
+            if (value & (1u << i)) {
+                out[position / 8] |= static_cast<uint8_t>(1u << (position % 8));
+            }
+        }
+    }
+
+    uint8_t out[16] = {};
+
+private:
+    int position = 0;
+};
+
+void encode_block_mode6(const uint8_t pixels[16][4], uint8_t block[16]) {
+    // Principal axis of the block's colors (power iteration on the covariance).
+    float mean[4] = {};
+    for (int p = 0; p < 16; p++) {
+        for (int c = 0; c < 4; c++) {
+            mean[c] += pixels[p][c] / 16.0f;
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (int p = 0; p < 16; p++) {
+        float d[4];
+        for (int c = 0; c < 4; c++) {
+            d[c] = pixels[p][c] - mean[c];
+        }
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                covariance[i][j] += d[i] * d[j];
+            }
+        }
+    }
+
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                next[i] += covariance[i][j] * axis[j];
+            }
+        }
+
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int i = 0; i < 4; i++) {
+            axis[i] = next[i] / length;
+        }
+    }
+
+    float t_min = 1e30f, t_max = -1e30f;
+    for (int p = 0; p < 16; p++) {
+        float t = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            t += (pixels[p][c] - mean[c]) * axis[c];
+        }
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+
+    float e0[4], e1[4];
+    for (int c = 0; c < 4; c++) {
+        e0[c] = mean[c] + t_min * axis[c];
+        e1[c] = mean[c] + t_max * axis[c];
+    }
+
+    Mode6Endpoints best{};
+    quantize_endpoint(e0, best.color[0], best.p_bit[0]);
+    quantize_endpoint(e1, best.color[1], best.p_bit[1]);
+
+    uint8_t best_indices[16];
+    uint32_t best_error = select_indices(pixels, best, best_indices);
+
+    // One least-squares pass usually recovers most of what the axis fit leaves on the table.
+    if (best_error > 0 && refine_endpoints(pixels, best_indices, e0, e1)) {
+        Mode6Endpoints refined{};
+        quantize_endpoint(e0, refined.color[0], refined.p_bit[0]);
+        quantize_endpoint(e1, refined.color[1], refined.p_bit[1]);
+
+        uint8_t refined_indices[16];
+        uint32_t refined_error = select_indices(pixels, refined, refined_indices);
+
+        if (refined_error < best_error) {
+            best = refined;
+            std::copy(refined_indices, refined_indices + 16, best_indices);
+        }
+    }
+
+    // The anchor (first) index is stored without its top bit; swap the endpoints if it is set.
+    if (best_indices[0] >= 8) {
+        for (int c = 0; c < 4; c++) {
+            std::swap(best.color[0][c], best.color[1][c]);
+        }
+        std::swap(best.p_bit[0], best.p_bit[1]);
+
+        for (auto& index : best_indices) {
+            index = static_cast<uint8_t>(15 - index);
+        }
+    }
+
+    BitWriter writer;
+    writer.write(1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.write(best.color[0][c], 7);
+        writer.write(best.color[1][c], 7);
+    }
+    writer.write(best.p_bit[0], 1);
+    writer.write(best.p_bit[1], 1);
+
+    writer.write(best_indices[0], 3);
+    for (int p = 1; p < 16; p++) {
+        writer.write(best_indices[p], 4);
+    }
+
+    memcpy(block, writer.out, 16);
+}
+
+}
+
+std::vector<uint8_t> compress_bc7(const uint8_t* rgba, uint32_t width, uint32_t height, ThreadPool& threads) {
+    uint32_t blocks_x = (width + 3) / 4;
+    uint32_t blocks_y = (height + 3) / 4;
+
+    std::vector<uint8_t> blocks(static_cast<size_t>(blocks_x) * blocks_y * 16);
+
+    threads.parallel_for(blocks_y, [&](uint32_t block_y, uint32_t) {
+        uint8_t pixels[16][4];
+
+        for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+            for (uint32_t y = 0; y < 4; y++) {
+                for (uint32_t x = 0; x < 4; x++) {
+                    uint32_t source_x = std::min(block_x * 4 + x, width - 1);
+                    uint32_t source_y = std::min(block_y * 4 + y, height - 1);
+                    memcpy(pixels[y * 4 + x], rgba + (static_cast<size_t>(source_y) * width + source_x) * 4, 4);
+                }
+            }
+
+            encode_block_mode6(pixels, blocks.data() + (static_cast<size_t>(block_y) * blocks_x + block_x) * 16);
+        }
+    });
+
+    return blocks;
+}
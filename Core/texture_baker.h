@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Offline-style texture processing, run once on first launch and cached in a TextureContainer.
+
+// Full mip chain of an sRGB RGBA8 image down to 1x1, largest first. Every level is filtered from
+// the previous one with a 2x2 box in linear space and stored back as sRGB; alpha is averaged as is.
+std::vector<std::vector<uint8_t>> generate_srgb_mip_chain(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+// Compresses an RGBA8 image to BC7, mode 6 only (one RGBA subset, 4-bit indices). Edges that do not
+// fill a whole block are padded by clamping. Blocks are encoded on the pool's threads.
+std::vector<uint8_t> compress_bc7(const uint8_t* rgba, uint32_t width, uint32_t height, ThreadPool& threads);
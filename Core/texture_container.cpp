@@ -0,0 +1,105 @@
+#include "texture_container.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+static constexpr uint64_t level_alignment = 16;
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool TextureContainer::open(const std::string& path, uint64_t source_hash) {
+    close();
+
+    if (!file.open(path) || file.size() < sizeof(TextureContainerHeader)) {
+        file.close();
+        return false;
+    }
+
+    const char* bytes = static_cast<const char*>(file.data());
+    const TextureContainerHeader* header = reinterpret_cast<const TextureContainerHeader*>(bytes);
+
+    bool valid = header->magic == magic &&
+        header->version == version &&
+        header->source_hash == source_hash &&
+        header->level_count > 0 &&
+        sizeof(TextureContainerHeader) + header->level_count * sizeof(TextureContainerLevel) <= file.size();
+
+    if (!valid) {
+        file.close();
+        return false;
+    }
+
+    const TextureContainerLevel* entries = reinterpret_cast<const TextureContainerLevel*>(bytes + sizeof(TextureContainerHeader));
+
+    levels.resize(header->level_count);
+    for (uint32_t i = 0; i < header->level_count; i++) {
+        if (entries[i].offset + entries[i].size > file.size()) {
+            close();
+            return false;
+        }
+
+        levels[i].data = bytes + entries[i].offset;
+        levels[i].size = static_cast<size_t>(entries[i].size);
+        levels[i].width = std::max(1u, header->width >> i);
+        levels[i].height = std::max(1u, header->height >> i);
+    }
+
+    texture_format = static_cast<VkFormat>(header->format);
+    return true;
+}
+
+void TextureContainer::close() {
+    file.close();
+    texture_format = VK_FORMAT_UNDEFINED;
+    levels.clear();
+}
+
+void TextureContainer::write(const std::string& path, uint64_t source_hash, VkFormat format,
+    uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& level_data) {
+    TextureContainerHeader header{};
+    header.magic = magic;
+    header.version = version;
+    header.source_hash = source_hash;
+    header.format = static_cast<uint32_t>(format);
+    header.width = width;
+    header.height = height;
+    header.level_count = static_cast<uint32_t>(level_data.size());
+
+    std::vector<TextureContainerLevel> entries(level_data.size());
+    uint64_t offset = align_up(sizeof(header) + entries.size() * sizeof(TextureContainerLevel), level_alignment);
+    for (size_t i = 0; i < level_data.size(); i++) {
+        entries[i].offset = offset;
+        entries[i].size = level_data[i].size();
+        offset = align_up(offset + entries[i].size, level_alignment);
+    }
+
+    // Same write-then-rename as the mesh cache, so a half-written file is never picked up.
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("texture container: failed to write " + path);
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(TextureContainerLevel)));
+
+        for (size_t i = 0; i < level_data.size(); i++) {
+            out.seekp(static_cast<std::streamoff>(entries[i].offset));
+            out.write(reinterpret_cast<const char*>(level_data[i].data()), static_cast<std::streamsize>(level_data[i].size()));
+        }
+
+        if (!out) {
+            throw std::runtime_error("texture container: failed to write " + path);
+        }
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("texture container: failed to write " + path);
+    }
+}
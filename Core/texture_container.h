@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+struct TextureLevel {
+    const void* data = nullptr;
+    size_t size = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Baked texture file in the spirit of KTX2: a header naming the Vulkan format and the source it was
+// built from, a level index, and the payload of every mip level ready to be copied into the image
+// as is. Levels are stored largest first, each starting 16-byte aligned.
+//
+// Files are memory-mapped, so uploading a level is a single memcpy into staging memory.
+class TextureContainer {
+public:
+    static constexpr uint32_t magic = 0x58455456; // "VTEX"
+    static constexpr uint32_t version = 1;
+
+    // Maps the file and checks it was baked from the source with the given hash.
+    bool open(const std::string& path, uint64_t source_hash);
+    void close();
+
+    VkFormat format() const { return texture_format; }
+    uint32_t width() const { return levels.empty() ? 0 : levels[0].width; }
+    uint32_t height() const { return levels.empty() ? 0 : levels[0].height; }
+    uint32_t level_count() const { return static_cast<uint32_t>(levels.size()); }
+    const TextureLevel& level(uint32_t index) const { return levels[index]; }
+
+    // `level_data` holds the payload of every level, largest first.
+    static void write(const std::string& path, uint64_t source_hash, VkFormat format,
+        uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& level_data);
+
+private:
+    MappedFile file;
+    VkFormat texture_format = VK_FORMAT_UNDEFINED;
+    std::vector<TextureLevel> levels;
+};
+
+struct TextureContainerHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+};
+
+struct TextureContainerLevel {
+    uint64_t offset;
+    uint64_t size;
+};
@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+
+void ThreadPool::init(uint32_t worker_count) {
+    stopping = false;
+    for (uint32_t i = 0; i < worker_count; i++) {
+        workers.emplace_back(&ThreadPool::worker_main, this, i);
+    }
+}
+
+void ThreadPool::cleanup() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+uint32_t ThreadPool::default_worker_count() {
+    uint32_t hardware_threads = std::thread::hardware_concurrency();
+    return hardware_threads > 1 ? hardware_threads - 1 : 0;
+}
+
+void ThreadPool::parallel_for(uint32_t task_count, const std::function<void(uint32_t task, uint32_t thread)>& task) {
+    if (task_count == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> dispatch_lock(dispatch_mutex);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_task = &task;
+        this->task_count = task_count;
+        next_task = 0;
+        busy_workers = static_cast<uint32_t>(workers.size());
+        error = nullptr;
+        generation++;
+    }
+    work_ready.notify_all();
+
+    run_tasks(thread_count() - 1);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this] { return busy_workers == 0; });
+    current_task = nullptr;
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::worker_main(uint32_t thread) {
+    uint64_t seen_generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&] { return stopping || generation != seen_generation; });
+
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        run_tasks(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy_workers--;
+        }
+        work_done.notify_one();
+    }
+}
+
+void ThreadPool::run_tasks(uint32_t thread) {
+    for (;;) {
+        uint32_t index = next_task.fetch_add(1);
+        if (index >= task_count) {
+            return;
+        }
+
+        try {
+            (*current_task)(index, thread);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for fork-join work on the render thread.
+//
+// parallel_for() hands out task indices to the workers and to the calling thread, and returns once
+// every task has run. Each task also gets the index of the thread running it, in
+// [0, thread_count()), so callers can keep per-thread state such as command pools without locks.
+// The calling thread is always the last index.
+//
+// Several threads may call parallel_for() at once, like loaders running side by side during
+// startup; the calls take turns. A task must not call parallel_for() itself.
+class ThreadPool {
+public:
+    // Starts worker_count background threads; zero runs everything on the calling thread.
+    void init(uint32_t worker_count);
+    void cleanup();
+
+    uint32_t thread_count() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+    void parallel_for(uint32_t task_count, const std::function<void(uint32_t task, uint32_t thread)>& task);
+
+    // One worker per hardware thread, leaving one for the caller.
+    static uint32_t default_worker_count();
+
+private:
+    void worker_main(uint32_t thread);
+    void run_tasks(uint32_t thread);
+
+    std::vector<std::thread> workers;
+
+    // Held for a whole parallel_for(), so only one caller hands out tasks at a time.
+    std::mutex dispatch_mutex;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    bool stopping = false;
+
+    // Bumped for every parallel_for so sleeping workers can tell new work from a spurious wake-up.
+    uint64_t generation = 0;
+    const std::function<void(uint32_t, uint32_t)>* current_task = nullptr;
+    uint32_t task_count = 0;
+    std::atomic<uint32_t> next_task{ 0 };
+    uint32_t busy_workers = 0;
+
+    // First exception thrown by a task, rethrown on the calling thread.
+    std::exception_ptr error;
+};
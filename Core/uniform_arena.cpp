@@ -0,0 +1,56 @@
+#include "uniform_arena.h"
+
+#include <stdexcept>
+
+namespace {
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+void UniformArena::init(DeviceAllocator& allocator, VkDeviceSize min_alignment, uint32_t frame_count, VkDeviceSize frame_capacity) {
+    this->allocator = &allocator;
+    alignment = min_alignment > 0 ? min_alignment : 1;
+    // Regions start aligned too, so offsets within a region stay aligned in the buffer.
+    this->frame_capacity = align_up(frame_capacity, alignment);
+
+    VkDeviceSize size = this->frame_capacity * frame_count;
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("uniform arena: too large for dynamic offsets");
+    }
+
+    allocator.create_buffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, arena_buffer, allocation);
+
+    frame_begin = 0;
+    head = 0;
+}
+
+void UniformArena::cleanup() {
+    if (allocator == nullptr) {
+        return;
+    }
+
+    allocator->destroy_buffer(arena_buffer, allocation);
+    arena_buffer = VK_NULL_HANDLE;
+    allocator = nullptr;
+}
+
+void UniformArena::begin_frame(uint32_t frame) {
+    frame_begin = frame_capacity * frame;
+    head = frame_begin;
+}
+
+UniformArena::Slice UniformArena::allocate(VkDeviceSize size) {
+    if (head + size > frame_begin + frame_capacity) {
+        throw std::runtime_error("uniform arena: frame region full");
+    }
+
+    Slice slice;
+    slice.offset = static_cast<uint32_t>(head);
+    slice.data = static_cast<uint8_t*>(allocation.mapped) + head;
+    head = align_up(head + size, alignment);
+    return slice;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "device_allocator.h"
+
+// Uniform data of every frame in flight in one persistently mapped, host-coherent buffer, split
+// into a region per frame slot. Each region is a linear allocator: begin_frame() starts it over
+// and every allocation is aligned to minUniformBufferOffsetAlignment, so the result can be bound
+// with UNIFORM_BUFFER_DYNAMIC descriptors. One descriptor then serves every frame and every
+// draw, only the dynamic offset changes.
+//
+// The caller makes sure the GPU is done with a slot before starting it over, which the frame
+// fence already does.
+class UniformArena {
+public:
+    struct Slice {
+        // Dynamic offset into buffer().
+        uint32_t offset = 0;
+        void* data = nullptr;
+    };
+
+    void init(DeviceAllocator& allocator, VkDeviceSize min_alignment, uint32_t frame_count, VkDeviceSize frame_capacity);
+    void cleanup();
+
+    void begin_frame(uint32_t frame);
+
+    // Throws when the frame's region is full.
+    Slice allocate(VkDeviceSize size);
+
+    template <typename T>
+    uint32_t push(const T& value) {
+        Slice slice = allocate(sizeof(T));
+        memcpy(slice.data, &value, sizeof(T));
+        return slice.offset;
+    }
+
+    VkBuffer buffer() const { return arena_buffer; }
+    VkDeviceSize memory_bytes() const { return allocation.size; }
+
+private:
+    DeviceAllocator* allocator = nullptr;
+    VkDeviceSize alignment = 1;
+    VkDeviceSize frame_capacity = 0;
+
+    VkBuffer arena_buffer = VK_NULL_HANDLE;
+    Allocation allocation{};
+
+    VkDeviceSize frame_begin = 0;
+    VkDeviceSize head = 0;
+};
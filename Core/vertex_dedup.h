@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Flat open-addressing table for welding identical vertices.
+//
+// Vertices are plain float structs and are compared word by word with -0.0f folded into 0.0f,
+// which is exactly what operator== on their float members does. The table only stores indices
+// into the caller's vertex array, so one lookup per index either finds the existing vertex or
+// appends the new one, and nothing is allocated once reserve() covered the input.
+template<typename T>
+class VertexHashTable {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) % sizeof(uint32_t) == 0,
+        "vertices must be plain structs of 32-bit scalars");
+
+public:
+    void reserve(size_t vertex_count) {
+        size_t capacity = 16;
+        while (capacity < vertex_count * 2) {
+            capacity *= 2;
+        }
+
+        if (capacity > slots.size()) {
+            slots.assign(capacity, empty_slot);
+            count = 0;
+        }
+    }
+
+    // Returns the index of a vertex equal to `vertex` in `vertices`, appending it first if there is none.
+    uint32_t insert(const T& vertex, std::vector<T>& vertices) {
+        if ((count + 1) * 2 > slots.size()) {
+            grow(vertices);
+        }
+
+        Key key = make_key(vertex);
+        size_t mask = slots.size() - 1;
+
+        for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+            uint32_t index = slots[slot];
+
+            if (index == empty_slot) {
+                index = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(vertex);
+                slots[slot] = index;
+                count++;
+                return index;
+            }
+
+            if (make_key(vertices[index]) == key) {
+                return index;
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t empty_slot = 0xffffffffu;
+    static constexpr size_t word_count = sizeof(T) / sizeof(uint32_t);
+
+    struct Key {
+        uint32_t words[word_count];
+
+        bool operator==(const Key& other) const {
+            return memcmp(words, other.words, sizeof(words)) == 0;
+        }
+    };
+
+    static Key make_key(const T& vertex) {
+        Key key;
+        memcpy(key.words, &vertex, sizeof(T));
+
+        for (auto& word : key.words) {
+            if (word == 0x80000000u) {
+                word = 0;
+            }
+        }
+
+        return key;
+    }
+
+    static size_t hash(const Key& key) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (uint32_t word : key.words) {
+            h = (h ^ word) * 0x100000001b3ull;
+        }
+
+        // FNV mixes the low bits poorly for word-sized input; fold the high half in.
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    void grow(const std::vector<T>& vertices) {
+        slots.assign(slots.empty() ? 16 : slots.size() * 2, empty_slot);
+
+        size_t mask = slots.size() - 1;
+        for (uint32_t index = 0; index < vertices.size(); index++) {
+            size_t slot = hash(make_key(vertices[index])) & mask;
+            while (slots[slot] != empty_slot) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = index;
+        }
+    }
+
+    std::vector<uint32_t> slots;
+    size_t count = 0;
+};
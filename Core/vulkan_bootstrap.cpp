@@ -0,0 +1,285 @@
+#include "vulkan_bootstrap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+namespace {
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
+    VkDebugUtilsMessageTypeFlagsEXT message_type, const VkDebugUtilsMessengerCallbackDataEXT* callback_data, void* user_data) {
+    std::cerr << "validation layer: " << callback_data->pMessage << std::endl;
+    return VK_FALSE;
+}
+
+VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info() {
+    VkDebugUtilsMessengerCreateInfoEXT create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    create_info.pfnUserCallback = debug_callback;
+    return create_info;
+}
+
+}
+
+const std::vector<const char*>& VulkanInstance::validation_layers() {
+    static const std::vector<const char*> layers = {
+        "VK_LAYER_KHRONOS_validation"
+    };
+    return layers;
+}
+
+void VulkanInstance::init(const char* application_name, uint32_t api_version, std::vector<const char*> extensions, bool validation) {
+    this->validation = validation;
+
+    if (validation && !supports_validation_layers()) {
+        throw std::runtime_error("vk: validation layers requested, but not available");
+    }
+
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = application_name;
+    app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.pEngineName = "";
+    app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.apiVersion = api_version;
+
+    if (validation) {
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    }
+
+    VkInstanceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pApplicationInfo = &app_info;
+    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    create_info.ppEnabledExtensionNames = extensions.data();
+
+    // Chained into the create info as well, so instance creation and destruction are covered.
+    VkDebugUtilsMessengerCreateInfoEXT debug_create_info = debug_messenger_create_info();
+    if (validation) {
+        create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers().size());
+        create_info.ppEnabledLayerNames = validation_layers().data();
+        create_info.pNext = &debug_create_info;
+    }
+
+    if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create instance");
+    }
+
+    if (!validation) {
+        return;
+    }
+
+    auto create_messenger = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+    if (create_messenger == nullptr || create_messenger(instance, &debug_create_info, nullptr, &debug_messenger) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to set up debug messenger");
+    }
+}
+
+void VulkanInstance::cleanup() {
+    if (debug_messenger != VK_NULL_HANDLE) {
+        auto destroy_messenger = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT"));
+        if (destroy_messenger != nullptr) {
+            destroy_messenger(instance, debug_messenger, nullptr);
+        }
+        debug_messenger = VK_NULL_HANDLE;
+    }
+
+    vkDestroyInstance(instance, nullptr);
+    instance = VK_NULL_HANDLE;
+}
+
+bool VulkanInstance::supports_validation_layers() {
+    uint32_t layer_count;
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+    std::vector<VkLayerProperties> available_layers(layer_count);
+    vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+
+    for (const char* layer_name : validation_layers()) {
+        bool layer_found = std::any_of(available_layers.begin(), available_layers.end(), [&](const VkLayerProperties& layer) {
+            return strcmp(layer_name, layer.layerName) == 0;
+        });
+
+        if (!layer_found) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+VkSurfaceKHR create_surface(VkInstance instance, GLFWwindow* window,
+    VkResult (*create_window_surface)(VkInstance, GLFWwindow*, const VkAllocationCallbacks*, VkSurfaceKHR*)) {
+    VkSurfaceKHR surface;
+    if (create_window_surface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create window surface");
+    }
+
+    return surface;
+}
+
+VkPhysicalDevice pick_physical_device(VkInstance instance, const std::function<bool(VkPhysicalDevice)>& is_suitable) {
+    uint32_t device_count = 0;
+    vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
+
+    if (device_count == 0) {
+        throw std::runtime_error("vk: failed to find GPUs with Vulkan support");
+    }
+
+    std::vector<VkPhysicalDevice> devices(device_count);
+    vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
+
+    for (const auto& device : devices) {
+        if (is_suitable(device)) {
+            return device;
+        }
+    }
+
+    throw std::runtime_error("vk: failed to find a suitable GPU");
+}
+
+bool supports_device_extensions(VkPhysicalDevice physical_device, const std::vector<const char*>& extensions) {
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, available_extensions.data());
+
+    std::set<std::string> required_extensions(extensions.begin(), extensions.end());
+    for (const auto& extension : available_extensions) {
+        required_extensions.erase(extension.extensionName);
+    }
+
+    return required_extensions.empty();
+}
+
+SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice physical_device, VkSurfaceKHR surface) {
+    SwapChainSupportDetails details;
+
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &details.capabilities);
+
+    uint32_t format_count;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &format_count, nullptr);
+
+    if (format_count != 0) {
+        details.formats.resize(format_count);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &format_count, details.formats.data());
+    }
+
+    uint32_t present_mode_count;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, nullptr);
+
+    if (present_mode_count != 0) {
+        details.present_modes.resize(present_mode_count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, details.present_modes.data());
+    }
+
+    return details;
+}
+
+VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats) {
+    for (const auto& available_format : available_formats) {
+        if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            return available_format;
+        }
+    }
+
+    return available_formats[0];
+}
+
+VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D framebuffer_extent) {
+    if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+        return capabilities.currentExtent;
+    }
+
+    VkExtent2D actual_extent = framebuffer_extent;
+    actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+
+    return actual_extent;
+}
+
+uint32_t choose_swap_image_count(const VkSurfaceCapabilitiesKHR& capabilities) {
+    uint32_t image_count = capabilities.minImageCount + 1;
+    if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount) {
+        image_count = capabilities.maxImageCount;
+    }
+    return image_count;
+}
+
+VkShaderModule create_shader_module(VkDevice logical_device, const std::vector<char>& code) {
+    VkShaderModuleCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = code.size();
+    create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(logical_device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create shader module");
+    }
+
+    return shader_module;
+}
+
+uint32_t find_memory_type(VkPhysicalDevice physical_device, uint32_t type_filter, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties mem_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+
+    for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("vk: failed to find suitable memory type");
+}
+
+VkDeviceSize create_buffer(VkPhysicalDevice physical_device, VkDevice logical_device, VkDeviceSize size,
+    VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to create buffer");
+    }
+
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
+
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_requirements.size;
+    alloc_info.memoryTypeIndex = find_memory_type(physical_device, mem_requirements.memoryTypeBits, properties);
+
+    if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
+        throw std::runtime_error("vk: failed to allocate buffer memory");
+    }
+
+    vkBindBufferMemory(logical_device, buffer, buffer_memory, 0);
+    return alloc_info.allocationSize;
+}
+
+std::vector<char> read_binary_file(const std::string& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + path);
+    }
+
+    size_t file_size = static_cast<size_t>(file.tellg());
+    std::vector<char> buffer(file_size);
+
+    file.seekg(0);
+    file.read(buffer.data(), file_size);
+
+    return buffer;
+}
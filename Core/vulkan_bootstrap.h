@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The setup every sample used to repeat: the instance with its validation layer, the surface, the
+// device pick and extension check, the swap chain queries and shader modules. Queue selection and
+// device features differ too much between samples to share and stay with them; the swap chain and
+// frame loop of the samples drawing with one command buffer per frame are FrameLoop's.
+//
+// Nothing here needs GLFW; samples pass in the instance extensions it asks for, its surface
+// function and the size of their framebuffer.
+
+struct GLFWwindow;
+
+// Instance with the Khronos validation layer and a debug messenger printing to stderr when
+// validation is on, which it is by default in debug builds.
+class VulkanInstance {
+public:
+#ifdef NDEBUG
+    static constexpr bool validation_by_default = false;
+#else
+    static constexpr bool validation_by_default = true;
+#endif
+
+    // Also to enable on the device, for implementations that still look at device layers.
+    static const std::vector<const char*>& validation_layers();
+
+    // extensions are those the window system needs, none when headless; VK_EXT_debug_utils is
+    // added for validation. Throws when validation is requested but the layer is missing.
+    void init(const char* application_name, uint32_t api_version, std::vector<const char*> extensions,
+        bool validation = validation_by_default);
+    void cleanup();
+
+    VkInstance handle() const { return instance; }
+    bool is_validation_enabled() const { return validation; }
+
+private:
+    static bool supports_validation_layers();
+
+    VkInstance instance = VK_NULL_HANDLE;
+    VkDebugUtilsMessengerEXT debug_messenger = VK_NULL_HANDLE;
+    bool validation = false;
+};
+
+// window's surface, made by create_window_surface, which is glfwCreateWindowSurface.
+VkSurfaceKHR create_surface(VkInstance instance, GLFWwindow* window,
+    VkResult (*create_window_surface)(VkInstance, GLFWwindow*, const VkAllocationCallbacks*, VkSurfaceKHR*));
+
+// The first device is_suitable accepts. Throws when there is none.
+VkPhysicalDevice pick_physical_device(VkInstance instance, const std::function<bool(VkPhysicalDevice)>& is_suitable);
+
+bool supports_device_extensions(VkPhysicalDevice physical_device, const std::vector<const char*>& extensions);
+
+struct SwapChainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities{};
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> present_modes;
+
+    bool is_adequate() const { return !formats.empty() && !present_modes.empty(); }
+};
+
+SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice physical_device, VkSurfaceKHR surface);
+
+// B8G8R8A8_SRGB with the sRGB color space when offered, the first format otherwise.
+VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats);
+
+// The surface's extent, or the framebuffer size clamped to its limits when the surface leaves
+// the choice to the swap chain.
+VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D framebuffer_extent);
+
+// One more than the minimum, so the CPU is not held up by the presentation engine.
+uint32_t choose_swap_image_count(const VkSurfaceCapabilitiesKHR& capabilities);
+
+VkShaderModule create_shader_module(VkDevice logical_device, const std::vector<char>& code);
+
+// A memory type in type_filter with all of properties. Throws when there is none.
+uint32_t find_memory_type(VkPhysicalDevice physical_device, uint32_t type_filter, VkMemoryPropertyFlags properties);
+
+// Buffer with a dedicated allocation bound to it, for samples that do not use DeviceAllocator.
+// Returns the size of the allocation.
+VkDeviceSize create_buffer(VkPhysicalDevice physical_device, VkDevice logical_device, VkDeviceSize size,
+    VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory);
+
+// Whole file, e.g. SPIR-V. Throws when it cannot be opened.
+std::vector<char> read_binary_file(const std::string& path);
@@ -7,10 +7,9 @@
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/hash.hpp>
+#include <glm/gtc/packing.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -19,7 +18,6 @@
 #include <tiny_obj_loader.h>
 
 #include <iostream>
-#include <fstream>
 #include <stdexcept>
 #include <cstdlib>
 #include <vector>
@@ -29,65 +27,134 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
-#include <unordered_map>
+#include <functional>
+#include <future>
+
+#include "benchmark.h"
+#include "device_allocator.h"
+#include "frame_pacing.h"
+#include "gpu_profiler.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_pool.h"
+#include "mesh_streamer.h"
+#include "offscreen_targets.h"
+#include "pipeline_cache.h"
+#include "pipeline_registry.h"
+#include "pipeline_reloader.h"
+#include "shader_reloader.h"
+#include "staging_ring.h"
+#include "texture_baker.h"
+#include "texture_container.h"
+#include "thread_pool.h"
+#include "uniform_arena.h"
+#include "vertex_dedup.h"
+#include "vulkan_bootstrap.h"
 
 constexpr int width = 800;
 constexpr int height = 600;
 
 const std::string model_path = "models/viking_room.obj";
 const std::string texture_path = "textures/viking_room.png";
+const std::string mesh_cache_path = model_path + ".mesh";
 
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-const std::vector<const char*> device_extensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
-};
+// Level 0 is the imported model itself and lives in mesh_cache_path.
+std::string lod_cache_path(uint32_t level) {
+    return level == 0 ? mesh_cache_path : model_path + ".lod" + std::to_string(level) + ".mesh";
+}
 
-const std::vector<const char*> validation_layers = {
-    "VK_LAYER_KHRONOS_validation"
-};
+// Written on exit and validated against the device and driver on the next launch.
+const std::string pipeline_cache_path = "pipeline.cache";
+
+// Records the scene into secondary command buffers on all cores instead of inline on the main thread.
+constexpr bool PARALLEL_RECORDING = true;
+
+// Stores the model in the 12-byte PackedVertex layout when its vertex color is constant.
+constexpr bool PACKED_VERTICES = true;
+
+// Loads the texture from a baked container with precomputed mips (BC7 where supported) instead of
+// decoding the PNG and blitting the mip chain every launch.
+constexpr bool BAKED_TEXTURES = true;
+
+// Without baked textures, builds the mip chain with one compute dispatch (shaders/downsample.comp)
+// instead of a blit per level. Compute is also used whenever the format cannot be blitted linearly.
+constexpr bool COMPUTE_MIPMAPS = true;
+
+// Levels downsample.comp can bind, enough for a 4096x4096 texture.
+constexpr uint32_t MAX_COMPUTE_MIP_LEVELS = 13;
+
+// Upper bound of the scene's bindless texture array, further limited by the device.
+constexpr uint32_t MAX_SCENE_TEXTURES = 4096;
+
+// Scene mode draws object_count copies of the loaded meshes from shared vertex and index buffers,
+// with per-object transforms in a storage buffer, textures in one bindless array and every draw
+// written by a compute pass into an indirect buffer. The CPU records the same few commands
+// however many objects there are. Needs Vulkan 1.2 with descriptor indexing.
+struct SceneSettings {
+    // 0 draws the single model directly.
+    uint32_t object_count = 0;
+    // Frustum and occlusion culling of the objects on the GPU.
+    bool culling = true;
+    // Copies of the model drawn by the classic path with one instanced draw; 0 draws one.
+    uint32_t instance_count = 0;
+
+    bool enabled() const { return object_count > 0; }
+    bool culls() const { return enabled() && culling; }
+    bool instanced() const { return instance_count > 0; }
+
+    // --scene=N [--no-culling] or --instances=N
+    static SceneSettings from_command_line(int argc, char** argv) {
+        SceneSettings settings;
+
+        for (int i = 1; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument == "--no-culling") {
+                settings.culling = false;
+            }
+            else if (argument.rfind("--scene=", 0) == 0) {
+                settings.object_count = parse_count(argument, "--scene=");
+            }
+            else if (argument.rfind("--instances=", 0) == 0) {
+                settings.instance_count = parse_count(argument, "--instances=");
+            }
+        }
 
-#ifdef NDEBUG
-const bool enable_validation_layers = false;
-#else
-const bool enable_validation_layers = true;
-#endif
+        if (settings.enabled() && settings.instanced()) {
+            throw std::runtime_error("scene: --scene and --instances cannot be combined");
+        }
 
-VkResult create_debug_utils_messenger_ext(
-    VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* create_info,
-    const VkAllocationCallbacks* allocator, VkDebugUtilsMessengerEXT* debug_messenger) {
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        return func(instance, create_info, allocator, debug_messenger);
-    }
-    else {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
+        return settings;
     }
-}
 
-void DestroyDebugUtilsMessengerEXT(
-    VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        func(instance, debugMessenger, pAllocator);
+private:
+    static uint32_t parse_count(const std::string& argument, const std::string& prefix) {
+        unsigned long count = 0;
+        try {
+            count = std::stoul(argument.substr(prefix.size()));
+        }
+        catch (const std::exception&) {
+            count = 0;
+        }
+
+        if (count < 1 || count > (1u << 20)) {
+            throw std::runtime_error("scene: " + prefix.substr(0, prefix.size() - 1) + " must be between 1 and " + std::to_string(1u << 20));
+        }
+        return static_cast<uint32_t>(count);
     }
-}
+};
 
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphics_family;
     std::optional<uint32_t> present_family;
 
+    // A transfer-only family if the device has one, the graphics family otherwise.
+    std::optional<uint32_t> transfer_family;
+
     bool is_complete() {
         return graphics_family.has_value() && present_family.has_value();
     }
 };
 
-struct SwapChainSupportDetails {
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> present_modes;
-};
-
 struct Vertex {
     glm::vec3 pos;
     glm::vec3 color;
@@ -129,40 +196,275 @@ struct Vertex {
     }
 };
 
-namespace std {
-    template<> struct hash<Vertex> {
-        size_t operator()(Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (hash<glm::vec2>()(vertex.tex_coord) << 1);
-        }
-    };
-}
+// Compact layout: positions as unorm16 relative to the mesh bounds (the fourth component only pads
+// to a format every device supports), texture coordinates as half floats, and no color; the
+// constant color goes to shader_packed.vert as specialization constants. Dequantization is
+// folded into the model matrix.
+struct PackedVertex {
+    uint16_t pos[4];
+    uint16_t tex_coord[2];
+
+    static VkVertexInputBindingDescription get_binding_description() {
+        VkVertexInputBindingDescription binding_description{};
+        binding_description.binding = 0;
+        binding_description.stride = sizeof(PackedVertex);
+        binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return binding_description;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions() {
+        std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+
+        attribute_descriptions[0].binding = 0;
+        attribute_descriptions[0].location = 0;
+        attribute_descriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attribute_descriptions[0].offset = offsetof(PackedVertex, pos);
+
+        attribute_descriptions[1].binding = 0;
+        attribute_descriptions[1].location = 1;
+        attribute_descriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+        attribute_descriptions[1].offset = offsetof(PackedVertex, tex_coord);
+
+        return attribute_descriptions;
+    }
+};
 
 uint32_t current_frame = 0;
 
+// The camera, shared by every draw of a frame. Per-draw matrices are push constants.
 struct UniformBufferObject {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
 };
 
+struct DrawConstants {
+    glm::mat4 model;
+};
+
+// Size of the per-level arrays in scene_draws.comp.
+constexpr uint32_t MAX_MESH_LODS = 4;
+
+// Levels of detail of the model, simplified at import into mesh caches of their own and streamed
+// in and out by distance. With one level the whole model is loaded up front as before.
+struct StreamingSettings {
+    uint32_t lod_count = 1;
+    // Capacity of the mesh pool; 0 takes half of what the device-local heap has left.
+    VkDeviceSize budget_bytes = 0;
+
+    // --lods=N [--mesh-budget=MiB]
+    static StreamingSettings from_command_line(int argc, char** argv) {
+        StreamingSettings settings;
+
+        for (int i = 1; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument.rfind("--lods=", 0) == 0) {
+                settings.lod_count = parse_value(argument, "--lods=", MAX_MESH_LODS);
+            }
+            else if (argument.rfind("--mesh-budget=", 0) == 0) {
+                settings.budget_bytes = static_cast<VkDeviceSize>(parse_value(argument, "--mesh-budget=", 1u << 20)) * 1024 * 1024;
+            }
+        }
+
+        return settings;
+    }
+
+private:
+    static uint32_t parse_value(const std::string& argument, const std::string& prefix, uint32_t max_value) {
+        unsigned long value = 0;
+        try {
+            value = std::stoul(argument.substr(prefix.size()));
+        }
+        catch (const std::exception&) {
+            value = 0;
+        }
+
+        if (value < 1 || value > max_value) {
+            throw std::runtime_error("streaming: " + prefix.substr(0, prefix.size() - 1) + " must be between 1 and " + std::to_string(max_value));
+        }
+        return static_cast<uint32_t>(value);
+    }
+};
+
+// The multisampled color and depth targets only live within the render pass: color is resolved
+// and depth discarded at its end. Marked transient and backed by lazily allocated memory where the
+// device has it, tiled GPUs keep them in on-chip memory and never commit real memory for them.
+// Depth stays a stored, sampled image while scene culling builds the depth pyramid from it.
+struct AttachmentSettings {
+    bool transient = true;
+
+    // --no-transient-attachments
+    static AttachmentSettings from_command_line(int argc, char** argv) {
+        AttachmentSettings settings;
+        for (int i = 1; i < argc; i++) {
+            if (std::string(argv[i]) == "--no-transient-attachments") {
+                settings.transient = false;
+            }
+        }
+        return settings;
+    }
+};
+
+// The GlslShader items of ModelLoading.vcxproj; keep the two in step.
+std::vector<ShaderReloader::Source> shader_sources() {
+    return {
+        { "shaders/shader.vert", "shaders/vert.spv", {} },
+        { "shaders/shader.frag", "shaders/frag.spv", {} },
+        { "shaders/shader_packed.vert", "shaders/vert_packed.spv", {} },
+        { "shaders/shader.vert", "shaders/vert_instanced.spv", { "INSTANCED" } },
+        { "shaders/shader_packed.vert", "shaders/vert_packed_instanced.spv", { "INSTANCED" } },
+        { "shaders/downsample.comp", "shaders/downsample.spv", {} },
+        { "shaders/scene.vert", "shaders/scene_vert.spv", {} },
+        { "shaders/scene.frag", "shaders/scene_frag.spv", {} },
+        { "shaders/scene_draws.comp", "shaders/scene_draws.spv", {} },
+        { "shaders/depth_pyramid.comp", "shaders/depth_pyramid.spv", {} },
+        { "shaders/depth_pyramid.comp", "shaders/depth_pyramid_ms.spv", { "MULTISAMPLED" } },
+    };
+}
+
+// Every level halves the simplification grid of the one before, starting here for level 1.
+constexpr uint32_t LOD_GRID_SIZE = 128;
+
+// A level is drawn while its error covers at most this many pixels.
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+const float FIELD_OF_VIEW = glm::radians(45.0f);
+
+// Room for a frame's uniform data in the arena, alignment included.
+constexpr VkDeviceSize UNIFORM_ARENA_FRAME_BYTES = 16 * 1024;
+
+// std430 layouts of scene.vert and scene_draws.comp.
+struct SceneObject {
+    glm::mat4 model;
+    // Bounding sphere in scene space.
+    glm::vec4 bounds;
+    uint32_t mesh;
+    uint32_t texture;
+    uint32_t padding[2];
+};
+
+struct SceneMesh {
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+};
+
+// Where the commands start in a draw buffer; the draw count comes first.
+constexpr VkDeviceSize DRAW_COMMANDS_OFFSET = 16;
+
+// std140 layout of the CullData block of scene_draws.comp.
+struct CullData {
+    glm::vec4 frustum_planes[6];
+    glm::mat4 previous_view;
+    glm::mat4 previous_projection;
+    glm::vec2 pyramid_size;
+    uint32_t pyramid_levels;
+    uint32_t occlusion_ready;
+    float near_plane;
+    // Pixels per unit of error at unit distance, over LOD_PIXEL_ERROR.
+    float lod_scale;
+    uint32_t lod_count;
+    uint32_t padding;
+    // Scene space, w unused.
+    glm::vec4 camera_position;
+    // Scene-space error of every level.
+    glm::vec4 lod_errors;
+};
+
+// Size of the level array in depth_pyramid.comp, enough for a 32768 texel attachment.
+constexpr uint32_t MAX_PYRAMID_LEVELS = 16;
+
+constexpr float NEAR_PLANE = 0.1f;
+
 class TriangleApplication {
 public:
-    void run() {
+    void run(const FramePacing& pacing, const SceneSettings& scene, const StreamingSettings& streaming, const AttachmentSettings& attachments,
+        const ShaderReloadSettings& shader_reload, const GpuProfilerOptions& profiling) {
+        this->pacing = pacing;
+        frames_in_flight = pacing.frames_in_flight;
+        this->scene = scene;
+        this->streaming = streaming;
+        this->attachments = attachments;
+        this->profiling = profiling;
+
+        startup.begin("window");
         init_window();
         init_vulkan();
+        if (shader_reload.enabled) {
+            shader_reloader.init(shader_sources());
+        }
         main_loop();
         cleanup();
     }
 
-private:
-    GLFWwindow* window;
+    // Offscreen, without a window; see BenchmarkSettings. msaa_samples caps the sample count,
+    // 0 keeps the highest the device supports.
+    BenchmarkRun run_benchmark(const FramePacing& pacing, const SceneSettings& scene, const StreamingSettings& streaming,
+        const AttachmentSettings& attachments, const GpuProfilerOptions& profiling, const BenchmarkSettings& settings, uint32_t msaa_samples) {
+        this->pacing = pacing;
+        frames_in_flight = pacing.frames_in_flight;
+        this->scene = scene;
+        this->streaming = streaming;
+        this->attachments = attachments;
+        this->profiling = profiling;
+        max_msaa_samples = msaa_samples;
+        headless = true;
+        current_frame = 0;
+
+        init_vulkan();
+
+        BenchmarkRun run;
+        run.config = { { "frames_in_flight", frames_in_flight }, { "msaa", static_cast<uint32_t>(this->msaa_samples) },
+            { "scene_objects", scene.object_count }, { "scene_culling", scene.culls() ? 1u : 0u },
+            { "instances", scene.instance_count }, { "lods", streaming.lod_count },
+            { "transient_attachments", attachments.transient ? 1u : 0u }, { "width", width }, { "height", height } };
+        run_benchmark_frames(settings, logical_device, gpu_profiler, startup, run, [this](float) { draw_frame(); });
+        run.startup_ms = startup.phases();
+        const auto& background = startup.background_phases();
+        run.startup_ms.insert(run.startup_ms.end(), background.begin(), background.end());
+        run.add_gpu_scopes(gpu_profiler);
+        run.add_allocator_stats(allocator.stats());
+        run.memory_bytes.emplace_back("offscreen", offscreen_targets.memory_bytes());
+        run.memory_bytes.emplace_back("attachments", allocator.committed_bytes(color_image_allocation) + allocator.committed_bytes(depth_image_allocation));
+        run.memory_bytes.emplace_back("meshes", mesh_pool.memory_bytes());
+        run.memory_bytes.emplace_back("instances", instance_buffer_bytes());
+        run.memory_bytes.emplace_back("uniforms", uniform_arena.memory_bytes());
+
+        cleanup();
+        return run;
+    }
 
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debug_messenger;
+private:
+    GLFWwindow* window = nullptr;
+
+    // No window, surface or swap chain; frames go to offscreen_targets and are never presented.
+    bool headless = false;
+    OffscreenTargets offscreen_targets;
+    PhaseTimer startup;
+
+    FramePacing pacing;
+    uint32_t frames_in_flight = 2;
+    SceneSettings scene;
+    StreamingSettings streaming;
+    AttachmentSettings attachments;
+    GpuProfilerOptions profiling;
+    PresentWaiter present_waiter;
+
+    VulkanInstance instance;
     VkPhysicalDevice physical_device = VK_NULL_HANDLE;
     VkSampleCountFlagBits msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+    uint32_t max_msaa_samples = 0;
     VkDevice logical_device;
+    DeviceAllocator allocator;
+    StagingRing uploader;
+    PipelineCache pipeline_cache;
+    PipelineRegistry pipelines;
+    ShaderReloader shader_reloader;
+    PipelineReloader pipeline_reloader;
+    GpuProfiler gpu_profiler;
+    uint32_t graphics_family = 0;
     VkQueue graphics_queue;
+    VkQueue transfer_queue;
     VkSurfaceKHR surface;
     VkQueue present_queue;
     VkSwapchainKHR swap_chain;
@@ -173,45 +475,194 @@ private:
     VkDescriptorSetLayout descriptor_set_layout;
     VkRenderPass render_pass;
     VkPipelineLayout pipeline_layout;
-    VkPipeline graphics_pipeline;
+    // Ready scene pipeline; variants requested from the registry draw with this one until they are compiled.
+    PipelineHandle scene_pipeline;
+    VkPipeline graphics_pipeline = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> swap_chain_framebuffers;
     VkCommandPool command_pool;
     std::vector<VkCommandBuffer> command_buffers;
 
+    // Secondary command buffers for parallel recording come from one pool per thread and frame in
+    // flight. A pool is only touched by its own thread and is reset as a whole once the frame's
+    // fence has signalled; its buffers are kept and reused.
+    struct RecordingPool {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> secondary_buffers;
+        size_t used = 0;
+    };
+
+    std::vector<std::vector<RecordingPool>> recording_pools;
+
+    // Shared by model import and command buffer recording.
+    ThreadPool worker_threads;
+
     VkImage color_image;
-    VkDeviceMemory color_image_memory;
+    Allocation color_image_allocation;
     VkImageView color_image_view;
 
     VkImage depth_image;
-    VkDeviceMemory depth_image_memory;
+    Allocation depth_image_allocation;
     VkImageView depth_image_view;
 
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+    // Size the color and depth attachments were created with. They are kept while the swap chain
+    // stays within it, and only reallocated when the window grows.
+    VkExtent2D attachment_extent{};
+
+    // Swap chain objects replaced by recreate_swap_chain(). Frames in flight may still use them, so
+    // they are destroyed once the fence of the last frame submitted before the swap has signalled.
+    struct RetiredSwapChain {
+        VkSwapchainKHR swap_chain = VK_NULL_HANDLE;
+        std::vector<VkImageView> image_views;
+        std::vector<VkFramebuffer> framebuffers;
+
+        // Only set when the attachments were reallocated.
+        VkImage color_image = VK_NULL_HANDLE;
+        Allocation color_image_allocation{};
+        VkImageView color_image_view = VK_NULL_HANDLE;
+        VkImage depth_image = VK_NULL_HANDLE;
+        Allocation depth_image_allocation{};
+        VkImageView depth_image_view = VK_NULL_HANDLE;
+
+        // Always replaced along with the swap chain while culling.
+        VkImage depth_pyramid = VK_NULL_HANDLE;
+        Allocation depth_pyramid_allocation{};
+        VkImageView depth_pyramid_view = VK_NULL_HANDLE;
+        std::vector<VkImageView> depth_pyramid_levels;
+
+        // Frames submitted before the swap, any of which may reference these objects.
+        uint64_t submitted_frames = 0;
+    };
+
+    std::vector<RetiredSwapChain> retired_swap_chains;
+    uint64_t submitted_frames = 0;
 
-    VkBuffer vertex_buffer;
-    VkDeviceMemory vertex_buffer_memory;
-    VkBuffer index_buffer;
-    VkDeviceMemory index_buffer_memory;
+    // Mapped from the mesh cache until the vertex and index data have been copied into staging memory.
+    // The coarsest level is uploaded at startup as well; finer ones are read by the streamer.
+    MeshCache mesh_cache;
+    MeshCache coarsest_cache;
+    uint64_t mesh_source_hash = 0;
+    uint32_t mesh_import_flags = 0;
 
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
-    std::vector<void*> uniform_buffers_mapped;
+    struct LodSize {
+        uint32_t vertex_count = 0;
+        uint32_t index_count = 0;
+    };
+    std::vector<LodSize> lod_sizes;
+
+    // Layout of the loaded model, taken from the mesh cache.
+    bool packed_vertices = false;
+    glm::mat4 position_dequantization{ 1.0f };
+    glm::vec3 constant_color{ 1.0f };
+
+    // Model-space bounding sphere, center and radius.
+    glm::vec4 model_bounds{ 0.0f, 0.0f, 0.0f, 1.0f };
+
+    MeshPool mesh_pool;
+    MeshStreamer mesh_streamer;
+    // Streamer id of the model, and the range of its level the classic path draws this frame.
+    uint32_t model_mesh = 0;
+    MeshRange model_range{};
+
+    // Scene mode. Objects are static; the mesh table is rewritten from the streamer's resident
+    // levels and the draws are rebuilt on the GPU every frame, each into buffers of the frame
+    // slot, so frames in flight never share one.
+    bool draw_indirect_count = false;
+    uint32_t scene_texture_capacity = 0;
+    std::vector<VkImageView> scene_textures;
+    VkBuffer scene_object_buffer = VK_NULL_HANDLE;
+    Allocation scene_object_allocation{};
+    std::vector<VkBuffer> scene_mesh_buffers;
+    std::vector<Allocation> scene_mesh_allocations;
+    std::vector<SceneMesh*> scene_mesh_tables;
+    std::vector<VkBuffer> draw_buffers;
+    std::vector<Allocation> draw_buffer_allocations;
+    VkDescriptorSetLayout draw_descriptor_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout draw_pipeline_layout = VK_NULL_HANDLE;
+    PipelineHandle draw_pipeline_handle;
+    VkPipeline draw_pipeline = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> draw_descriptor_sets;
+
+    // Culling. The pyramid holds the farthest depth of the previous frame and is rebuilt after
+    // every render pass; it is sized from the swap chain, so it is recreated along with it.
+    VkImage depth_pyramid = VK_NULL_HANDLE;
+    Allocation depth_pyramid_allocation{};
+    VkImageView depth_pyramid_view = VK_NULL_HANDLE;
+    std::vector<VkImageView> depth_pyramid_levels;
+    VkExtent2D depth_pyramid_extent{};
+    uint32_t depth_pyramid_level_count = 0;
+    VkSampler depth_pyramid_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout pyramid_descriptor_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout pyramid_pipeline_layout = VK_NULL_HANDLE;
+    PipelineHandle pyramid_pipeline_handle;
+    VkPipeline pyramid_pipeline = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> pyramid_descriptor_sets;
+
+    // Bumped whenever the pyramid is recreated. Sets of a frame slot are rewritten when it next
+    // records, its previous command buffer being finished by then.
+    uint64_t pyramid_generation = 0;
+    std::vector<uint64_t> pyramid_set_generations;
+    bool depth_pyramid_ready = false;
+
+    // View and projection of the last recorded frame, whose depth the pyramid holds.
+    glm::mat4 previous_view{ 1.0f };
+    glm::mat4 previous_projection{ 1.0f };
+    glm::mat4 current_view{ 1.0f };
+    glm::mat4 current_projection{ 1.0f };
+
+    // Instanced path. A model matrix per instance, rewritten every frame into the frame slot's
+    // buffer, which stays mapped.
+    std::vector<VkBuffer> instance_buffers;
+    std::vector<Allocation> instance_buffer_allocations;
+    std::vector<glm::mat4*> instance_buffers_mapped;
+
+    // Camera distance relative to the single model, so the whole scene stays in view.
+    float view_scale = 1.0f;
+
+    // Camera and cull data of every frame slot, bound with dynamic offsets into one buffer. The
+    // camera is only recomputed when the extent or the view scale changes.
+    UniformArena uniform_arena;
+    uint32_t camera_offset = 0;
+    uint32_t cull_offset = 0;
+    UniformBufferObject camera{};
+    VkExtent2D camera_extent{};
+    float camera_view_scale = 0.0f;
+
+    // Pushed by every draw of the model.
+    DrawConstants draw_constants{ glm::mat4(1.0f) };
 
     std::vector<VkSemaphore> image_available_semaphores;
     std::vector<VkSemaphore> render_finished_semaphores;
     std::vector<VkFence> in_flight_fences;
 
     VkDescriptorPool descriptor_pool;
-    std::vector<VkDescriptorSet> descriptor_sets;
+    // The camera's offset is dynamic, so one set serves every frame.
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+
+    // Filled by load_texture() on a loader thread, and released once create_texture_image() has
+    // copied it into staging memory: the baked container, or the decoded PNG without baking.
+    TextureContainer texture_container;
+    stbi_uc* texture_pixels = nullptr;
+    int texture_width = 0;
+    int texture_height = 0;
 
     uint32_t mip_levels;
+    VkFormat texture_format = VK_FORMAT_R8G8B8A8_SRGB;
     VkImage texture_image;
-    VkDeviceMemory texture_image_memory;
+    Allocation texture_image_allocation;
     VkImageView texture_image_view;
     VkSampler texture_sampler;
 
+    // Compute mip generation. Kept until cleanup since the dispatch runs with the upload batch.
+    bool storage_image_array_indexing = false;
+    VkDescriptorSetLayout mipmap_descriptor_set_layout = VK_NULL_HANDLE;
+    VkDescriptorPool mipmap_descriptor_pool = VK_NULL_HANDLE;
+    VkPipelineLayout mipmap_pipeline_layout = VK_NULL_HANDLE;
+    std::vector<VkImageView> mipmap_level_views;
+    VkBuffer mipmap_counter_buffer = VK_NULL_HANDLE;
+    Allocation mipmap_counter_allocation{};
+
     bool framebuffer_resized = false;
+    double last_title_time = 0.0;
 
     void init_window() {
         glfwInit();
@@ -229,124 +680,146 @@ private:
     }
 
     void init_vulkan() {
+        worker_threads.init(ThreadPool::default_worker_count());
+
+        // The model, texture and shaders are read and decoded on loader threads while the
+        // instance, device and swap chain are created. Their uploads are recorded once the loaders
+        // are done and still go out in one submission.
+        std::future<double> model_loader = start_loader([this] { load_model(); });
+        std::future<double> shader_loader = start_loader([this] { preload_shaders(); });
+
+        startup.begin("instance");
         create_instance();
-        setup_debug_messenger();
-        create_surface();
-        pick_physical_device();
+        if (!headless) {
+            surface = create_surface(instance.handle(), window, glfwCreateWindowSurface);
+        }
+        startup.begin("device");
+        physical_device = pick_physical_device(instance.handle(), [this](VkPhysicalDevice device) { return is_device_suitable(device); });
+        msaa_samples = get_max_usable_sample_count();
+        // Needs the physical device: the baked texture is picked by what it can sample.
+        std::future<double> texture_loader = start_loader([this] { load_texture(); });
         create_logical_device();
+        startup.begin("swap_chain");
         create_swap_chain();
         create_image_views();
         create_render_pass();
         create_descriptor_set_layout();
-        create_graphics_pipeline();
         create_command_pool();
         create_color_resources();
         create_depth_resources();
+        create_depth_pyramid();
         create_framebuffers();
+        // The pipeline's vertex input follows the layout stored in the mesh cache, and it compiles
+        // on the registry threads while the texture is still loading.
+        startup.begin("wait_for_loaders");
+        finish_loader(model_loader, "load_model");
+        finish_loader(shader_loader, "load_shaders");
+        create_graphics_pipeline();
+        finish_loader(texture_loader, "load_texture");
+        startup.begin("resources");
         create_texture_image();
         create_texture_image_view();
         create_texture_sampler();
-        load_model();
-        create_vertex_buffer();
-        create_index_buffer();
+        create_mesh_pool();
+        create_scene_buffers();
+        mesh_cache.close();
+        coarsest_cache.close();
+        // Everything recorded by the uploader above goes out in one submission.
+        uploader.submit();
+        graphics_pipeline = scene_pipeline.get();
+        if (scene.enabled()) {
+            draw_pipeline = draw_pipeline_handle.get();
+        }
+        if (scene.culls()) {
+            pyramid_pipeline = pyramid_pipeline_handle.get();
+        }
         create_uniform_buffers();
+        create_instance_buffers();
+        create_draw_buffers();
         create_descriptor_pool();
         create_descriptor_sets();
         create_command_buffers();
+        create_recording_pools();
         create_sync_objects();
-    }
-
-    void create_instance() {
-        if (enable_validation_layers && !check_validation_layer_support()) {
-            throw std::runtime_error("vk: validation layers requested, but not available");
-        }
+        startup.end();
 
-        VkApplicationInfo app_info{};
-        app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        app_info.pApplicationName = "Triangle";
-        app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.pEngineName = "";
-        app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.apiVersion = VK_API_VERSION_1_0;
+        allocator.print_stats(log());
+    }
 
-        VkInstanceCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        create_info.pApplicationInfo = &app_info;
+    // Headless runs keep stdout for the benchmark report.
+    std::ostream& log() {
+        return headless ? std::cerr : std::cout;
+    }
 
-        std::vector<const char*> extensions = get_required_extensions();
-        create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        create_info.ppEnabledExtensionNames = extensions.data();
+    // Runs a loader on a thread of its own and returns how long it took.
+    std::future<double> start_loader(std::function<void()> loader) {
+        return std::async(std::launch::async, [loader = std::move(loader)] {
+            auto started = PhaseTimer::Clock::now();
+            loader();
+            return std::chrono::duration<double, std::milli>(PhaseTimer::Clock::now() - started).count();
+        });
+    }
 
-        VkDebugUtilsMessengerCreateInfoEXT debug_create_info{};
-        if (enable_validation_layers) {
-            create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-            create_info.ppEnabledLayerNames = validation_layers.data();
+    // Waits for the loader, rethrowing its error, and records its time as a background phase.
+    void finish_loader(std::future<double>& loader, const std::string& name) {
+        startup.add_background(name, loader.get());
+    }
 
-            populate_debug_messenger_create_info(debug_create_info);
-            create_info.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debug_create_info;
+    // Every SPIR-V file startup may need, so the requests find them loaded. Both vertex shaders,
+    // since which one is used depends on the mesh.
+    void preload_shaders() {
+        if (scene.enabled()) {
+            pipelines.preload("shaders/scene_vert.spv");
+            pipelines.preload("shaders/scene_frag.spv");
+            pipelines.preload("shaders/scene_draws.spv");
+            if (scene.culls()) {
+                // Which one depends on the sample count, not known yet.
+                pipelines.preload("shaders/depth_pyramid.spv");
+                pipelines.preload("shaders/depth_pyramid_ms.spv");
+            }
+        }
+        else if (scene.instanced()) {
+            pipelines.preload("shaders/vert_instanced.spv");
+            if (PACKED_VERTICES) {
+                pipelines.preload("shaders/vert_packed_instanced.spv");
+            }
+            pipelines.preload("shaders/frag.spv");
         }
         else {
-            create_info.enabledLayerCount = 0;
-            create_info.pNext = nullptr;
+            pipelines.preload("shaders/vert.spv");
+            if (PACKED_VERTICES) {
+                pipelines.preload("shaders/vert_packed.spv");
+            }
+            pipelines.preload("shaders/frag.spv");
         }
-
-        if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create instance");
+        if (!BAKED_TEXTURES) {
+            pipelines.preload("shaders/downsample.spv");
         }
     }
 
-    void setup_debug_messenger() {
-        if (!enable_validation_layers) return;
-
-        VkDebugUtilsMessengerCreateInfoEXT create_info;
-        populate_debug_messenger_create_info(create_info);
-
-        if (create_debug_utils_messenger_ext(instance, &create_info, nullptr, &debug_messenger) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to set up debug messenger");
-        }
+    void create_instance() {
+        instance.init("ModelLoading", VK_API_VERSION_1_2, required_instance_extensions(headless, glfwGetRequiredInstanceExtensions));
     }
 
     VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes) {
-        for (const auto& available_present_mode : available_present_modes) {
-            if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return available_present_mode;
-            }
-        }
-
-        return VK_PRESENT_MODE_FIFO_KHR;
+        return pacing.choose_present_mode(available_present_modes);
     }
 
-    VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities) {
-        if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-            return capabilities.currentExtent;
-        }
-        else {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
-
-            VkExtent2D actual_extent = {
-                static_cast<uint32_t>(width),
-                static_cast<uint32_t>(height)
-            };
-
-            actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-            actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
-
-            return actual_extent;
+    void create_swap_chain(VkSwapchainKHR old_swap_chain = VK_NULL_HANDLE) {
+        if (headless) {
+            VkExtent2D extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+            create_offscreen_swap_chain(offscreen_targets, physical_device, logical_device, extent, frames_in_flight,
+                swap_chain_images, swap_chain_image_format, swap_chain_extent);
+            return;
         }
-    }
 
-    void create_swap_chain() {
-        SwapChainSupportDetails swap_chain_support = query_swap_chain_support(physical_device);
+        SwapChainSupportDetails swap_chain_support = query_swap_chain_support(physical_device, surface);
 
         VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
         VkPresentModeKHR present_mode = choose_swap_present_mode(swap_chain_support.present_modes);
-        VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities);
+        VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities, framebuffer_extent());
 
-        uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
-        if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount) {
-            image_count = swap_chain_support.capabilities.maxImageCount;
-        }
+        uint32_t image_count = choose_swap_image_count(swap_chain_support.capabilities);
 
         VkSwapchainCreateInfoKHR create_info{};
         create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -376,7 +849,8 @@ private:
         create_info.presentMode = present_mode;
         create_info.clipped = VK_TRUE;
 
-        create_info.oldSwapchain = VK_NULL_HANDLE;
+        // Lets the presentation engine hand resources over from the swap chain being replaced.
+        create_info.oldSwapchain = old_swap_chain;
 
         if (vkCreateSwapchainKHR(logical_device, &create_info, nullptr, &swap_chain) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to create swap chain");
@@ -403,7 +877,8 @@ private:
         color_attachment.format = swap_chain_image_format;
         color_attachment.samples = msaa_samples;
         color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        // Only the resolved image is kept.
+        color_attachment.storeOp = attachments.transient ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
         color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -413,7 +888,8 @@ private:
         depth_attachment.format = find_depth_format();
         depth_attachment.samples = msaa_samples;
         depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // Stored while the depth pyramid is built from it after the pass.
+        depth_attachment.storeOp = transient_depth() ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
         depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -427,7 +903,7 @@ private:
         color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment_resolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment_resolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment_resolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        color_attachment_resolve.finalLayout = presentable_layout(headless);
 
         VkAttachmentReference color_attachment_ref{};
         color_attachment_ref.attachment = 0;
@@ -474,10 +950,15 @@ private:
     }
 
     void create_descriptor_set_layout() {
+        if (scene.enabled()) {
+            create_scene_descriptor_set_layouts();
+            return;
+        }
+
         VkDescriptorSetLayoutBinding ubo_layout_binding{};
         ubo_layout_binding.binding = 0;
         ubo_layout_binding.descriptorCount = 1;
-        ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         ubo_layout_binding.pImmutableSamplers = nullptr;
         ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -499,129 +980,284 @@ private:
         }
     }
 
-    void create_graphics_pipeline() {
-        std::vector<char> vert_shader_code = read_file("shaders/vert.spv");
-        std::vector<char> frag_shader_code = read_file("shaders/frag.spv");
-
-        VkShaderModule vert_shader_module = create_shader_module(vert_shader_code);
-        VkShaderModule frag_shader_module = create_shader_module(frag_shader_code);
-
-        VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
-        vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vert_shader_stage_info.module = vert_shader_module;
-        vert_shader_stage_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
-        frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        frag_shader_stage_info.module = frag_shader_module;
-        frag_shader_stage_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_stage_info, frag_shader_stage_info };
-
-        VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-        vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-        auto binding_description = Vertex::get_binding_description();
-        auto attribute_descriptions = Vertex::get_attribute_descriptions();
-
-        vertex_input_info.vertexBindingDescriptionCount = 1;
-        vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
-        vertex_input_info.pVertexBindingDescriptions = &binding_description;
-        vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
-
-        VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-        input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        input_assembly.primitiveRestartEnable = VK_FALSE;
-
-        VkPipelineViewportStateCreateInfo viewport_state{};
-        viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewport_state.viewportCount = 1;
-        viewport_state.scissorCount = 1;
-
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.rasterizationSamples = msaa_samples;
-
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.minSampleShading = 0.5f;
-
-        VkPipelineDepthStencilStateCreateInfo depth_stencil{};
-        depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depth_stencil.depthTestEnable = VK_TRUE;
-        depth_stencil.depthWriteEnable = VK_TRUE;
-        depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
-        depth_stencil.depthBoundsTestEnable = VK_FALSE;
-        depth_stencil.stencilTestEnable = VK_FALSE;
-
-        VkPipelineColorBlendAttachmentState color_blend_attachment{};
-        color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        color_blend_attachment.blendEnable = VK_FALSE;
-
-        VkPipelineColorBlendStateCreateInfo color_blending{};
-        color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        color_blending.logicOpEnable = VK_FALSE;
-        color_blending.logicOp = VK_LOGIC_OP_COPY;
-        color_blending.attachmentCount = 1;
-        color_blending.pAttachments = &color_blend_attachment;
-        color_blending.blendConstants[0] = 0.0f;
-        color_blending.blendConstants[1] = 0.0f;
-        color_blending.blendConstants[2] = 0.0f;
-        color_blending.blendConstants[3] = 0.0f;
-
-        std::vector<VkDynamicState> dynamic_states = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
+    // The graphics set adds the objects and the bindless texture array, whose size is picked when
+    // the sets are allocated. The draw set is what scene_draws.comp reads and writes.
+    void create_scene_descriptor_set_layouts() {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        scene_texture_capacity = std::min({ MAX_SCENE_TEXTURES, properties.limits.maxPerStageDescriptorSamplers,
+            properties.limits.maxPerStageDescriptorSampledImages });
+
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        bindings[2].binding = 2;
+        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[2].descriptorCount = scene_texture_capacity;
+        bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        // Only the scene's textures are written; the rest of the array is never accessed.
+        std::array<VkDescriptorBindingFlags, 3> binding_flags = {
+            0, 0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
         };
-        VkPipelineDynamicStateCreateInfo dynamic_state{};
-        dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
-        dynamic_state.pDynamicStates = dynamic_states.data();
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{};
+        binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        binding_flags_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+        binding_flags_info.pBindingFlags = binding_flags.data();
+
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.pNext = &binding_flags_info;
+        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.pBindings = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(logical_device, &layout_info, nullptr, &descriptor_set_layout) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create scene descriptor set layout");
+        }
+
+        // Objects, meshes and the frame's draw buffer, then the depth pyramid and the cull data.
+        std::array<VkDescriptorSetLayoutBinding, 5> draw_bindings{};
+        for (uint32_t i = 0; i < draw_bindings.size(); i++) {
+            draw_bindings[i].binding = i;
+            draw_bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            draw_bindings[i].descriptorCount = 1;
+            draw_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        draw_bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        draw_bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+
+        // There is no pyramid without culling, and the shader then never reads it.
+        std::array<VkDescriptorBindingFlags, 5> draw_binding_flags = { 0, 0, 0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT, 0 };
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo draw_binding_flags_info{};
+        draw_binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        draw_binding_flags_info.bindingCount = static_cast<uint32_t>(draw_binding_flags.size());
+        draw_binding_flags_info.pBindingFlags = draw_binding_flags.data();
+
+        VkDescriptorSetLayoutCreateInfo draw_layout_info{};
+        draw_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        draw_layout_info.pNext = &draw_binding_flags_info;
+        draw_layout_info.bindingCount = static_cast<uint32_t>(draw_bindings.size());
+        draw_layout_info.pBindings = draw_bindings.data();
+
+        if (vkCreateDescriptorSetLayout(logical_device, &draw_layout_info, nullptr, &draw_descriptor_set_layout) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create draw descriptor set layout");
+        }
+
+        if (!scene.culls()) {
+            return;
+        }
+
+        // The depth attachment and every level of the pyramid, as in generate_mipmaps_compute().
+        std::array<VkDescriptorSetLayoutBinding, 2> pyramid_bindings{};
+        pyramid_bindings[0].binding = 0;
+        pyramid_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pyramid_bindings[0].descriptorCount = 1;
+        pyramid_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        pyramid_bindings[1].binding = 1;
+        pyramid_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pyramid_bindings[1].descriptorCount = MAX_PYRAMID_LEVELS;
+        pyramid_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo pyramid_layout_info{};
+        pyramid_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        pyramid_layout_info.bindingCount = static_cast<uint32_t>(pyramid_bindings.size());
+        pyramid_layout_info.pBindings = pyramid_bindings.data();
+
+        if (vkCreateDescriptorSetLayout(logical_device, &pyramid_layout_info, nullptr, &pyramid_descriptor_set_layout) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create depth pyramid descriptor set layout");
+        }
+    }
+
+    void create_graphics_pipeline() {
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(DrawConstants);
 
         VkPipelineLayoutCreateInfo pipeline_layout_info{};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipeline_layout_info.setLayoutCount = 1;
         pipeline_layout_info.pSetLayouts = &descriptor_set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
         if (vkCreatePipelineLayout(logical_device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to create pipeline layout");
         }
 
-        VkGraphicsPipelineCreateInfo pipeline_info{};
-        pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipeline_info.stageCount = 2;
-        pipeline_info.pStages = shader_stages;
-        pipeline_info.pVertexInputState = &vertex_input_info;
-        pipeline_info.pInputAssemblyState = &input_assembly;
-        pipeline_info.pViewportState = &viewport_state;
-        pipeline_info.pRasterizationState = &rasterizer;
-        pipeline_info.pMultisampleState = &multisampling;
-        pipeline_info.pColorBlendState = &color_blending;
-        pipeline_info.pDynamicState = &dynamic_state;
-        pipeline_info.layout = pipeline_layout;
-        pipeline_info.renderPass = render_pass;
-        pipeline_info.subpass = 0;
-        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-        pipeline_info.pDepthStencilState = &depth_stencil;
+        GraphicsPipelineDesc desc{};
+        desc.vertex_shader.path = packed_vertices ? "shaders/vert_packed.spv" : "shaders/vert.spv";
+        desc.fragment_shader.path = "shaders/frag.spv";
+
+        if (scene.enabled()) {
+            desc.vertex_shader.path = "shaders/scene_vert.spv";
+            desc.fragment_shader.path = "shaders/scene_frag.spv";
+
+            // Only position and texture coordinates, at locations 0 and 1 for either layout.
+            std::array<VkVertexInputAttributeDescription, 2> attribute_descriptions{};
+            if (packed_vertices) {
+                attribute_descriptions = PackedVertex::get_attribute_descriptions();
+                desc.vertex_bindings = { PackedVertex::get_binding_description() };
+            }
+            else {
+                auto vertex_attributes = Vertex::get_attribute_descriptions();
+                attribute_descriptions = { vertex_attributes[0], vertex_attributes[2] };
+                attribute_descriptions[1].location = 1;
+                desc.vertex_bindings = { Vertex::get_binding_description() };
+            }
+            desc.vertex_attributes.assign(attribute_descriptions.begin(), attribute_descriptions.end());
+        }
+        else if (packed_vertices) {
+            for (uint32_t i = 0; i < 3; i++) {
+                VkSpecializationMapEntry color_entry{};
+                color_entry.constantID = i;
+                color_entry.offset = i * sizeof(float);
+                color_entry.size = sizeof(float);
+                desc.vertex_shader.specialization_entries.push_back(color_entry);
+            }
+
+            const uint8_t* color_bytes = reinterpret_cast<const uint8_t*>(&constant_color);
+            desc.vertex_shader.specialization_data.assign(color_bytes, color_bytes + sizeof(constant_color));
+
+            auto attribute_descriptions = PackedVertex::get_attribute_descriptions();
+            desc.vertex_bindings = { PackedVertex::get_binding_description() };
+            desc.vertex_attributes.assign(attribute_descriptions.begin(), attribute_descriptions.end());
+        }
+        else {
+            auto attribute_descriptions = Vertex::get_attribute_descriptions();
+            desc.vertex_bindings = { Vertex::get_binding_description() };
+            desc.vertex_attributes.assign(attribute_descriptions.begin(), attribute_descriptions.end());
+        }
+
+        // The instance's model matrix as four columns, after the vertex attributes.
+        if (scene.instanced()) {
+            desc.vertex_shader.path = packed_vertices ? "shaders/vert_packed_instanced.spv" : "shaders/vert_instanced.spv";
+
+            VkVertexInputBindingDescription instance_binding{};
+            instance_binding.binding = 1;
+            instance_binding.stride = sizeof(glm::mat4);
+            instance_binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+            desc.vertex_bindings.push_back(instance_binding);
+
+            for (uint32_t i = 0; i < 4; i++) {
+                VkVertexInputAttributeDescription column{};
+                column.binding = 1;
+                column.location = 4 + i;
+                column.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+                column.offset = i * sizeof(glm::vec4);
+                desc.vertex_attributes.push_back(column);
+            }
+        }
+
+        desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        desc.cull_mode = VK_CULL_MODE_BACK_BIT;
+        desc.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        desc.samples = msaa_samples;
+        desc.sample_shading = false;
+        desc.min_sample_shading = 0.5f;
+        desc.depth_test = true;
+        desc.depth_write = true;
+        desc.depth_compare_op = VK_COMPARE_OP_LESS;
+        desc.layout = pipeline_layout;
+        desc.render_pass = render_pass;
+        desc.subpass = 0;
+
+        // Compiles on the registry threads while the texture finishes loading and is uploaded;
+        // init_vulkan only waits for it after the uploads are submitted.
+        scene_pipeline = pipelines.request(desc);
+        pipeline_reloader.track(scene_pipeline, graphics_pipeline, desc);
+
+        if (scene.enabled()) {
+            create_draw_pipeline();
+        }
+    }
+
+    // scene_draws.comp, packing the draws for vkCmdDrawIndexedIndirectCount where the device has it.
+    void create_draw_pipeline() {
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(uint32_t);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &draw_descriptor_set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(logical_device, &pipeline_layout_info, nullptr, &draw_pipeline_layout) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create draw pipeline layout");
+        }
+
+        ComputePipelineDesc pipeline_desc{};
+        pipeline_desc.shader.path = "shaders/scene_draws.spv";
+        pipeline_desc.layout = draw_pipeline_layout;
+
+        VkSpecializationMapEntry compact_entry{};
+        compact_entry.constantID = 0;
+        compact_entry.offset = 0;
+        compact_entry.size = sizeof(VkBool32);
+        pipeline_desc.shader.specialization_entries.push_back(compact_entry);
+
+        // Compacting, then frustum and occlusion culling.
+        std::array<VkBool32, 3> constants = {
+            draw_indirect_count ? VK_TRUE : VK_FALSE, scene.culls() ? VK_TRUE : VK_FALSE, scene.culls() ? VK_TRUE : VK_FALSE
+        };
+        for (uint32_t i = 0; i < constants.size(); i++) {
+            VkSpecializationMapEntry entry{};
+            entry.constantID = i;
+            entry.offset = i * sizeof(VkBool32);
+            entry.size = sizeof(VkBool32);
+            pipeline_desc.shader.specialization_entries.push_back(entry);
+        }
+
+        const uint8_t* constant_bytes = reinterpret_cast<const uint8_t*>(constants.data());
+        pipeline_desc.shader.specialization_data.assign(constant_bytes, constant_bytes + sizeof(constants));
+
+        draw_pipeline_handle = pipelines.request(pipeline_desc);
+        pipeline_reloader.track(draw_pipeline_handle, draw_pipeline, pipeline_desc);
+
+        if (scene.culls()) {
+            create_pyramid_pipeline();
+        }
+    }
+
+    void create_pyramid_pipeline() {
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = 3 * sizeof(uint32_t);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &pyramid_descriptor_set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
-        if (vkCreateGraphicsPipelines(logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create graphics pipeline");
+        if (vkCreatePipelineLayout(logical_device, &pipeline_layout_info, nullptr, &pyramid_pipeline_layout) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create depth pyramid pipeline layout");
         }
 
-        vkDestroyShaderModule(logical_device, frag_shader_module, nullptr);
-        vkDestroyShaderModule(logical_device, vert_shader_module, nullptr);
+        // A multisampled attachment needs sampler2DMS to read every sample.
+        ComputePipelineDesc pipeline_desc{};
+        pipeline_desc.shader.path = msaa_samples == VK_SAMPLE_COUNT_1_BIT ? "shaders/depth_pyramid.spv" : "shaders/depth_pyramid_ms.spv";
+        pipeline_desc.layout = pyramid_pipeline_layout;
+
+        pyramid_pipeline_handle = pipelines.request(pipeline_desc);
+        pipeline_reloader.track(pyramid_pipeline_handle, pyramid_pipeline, pipeline_desc);
     }
 
     void create_framebuffers() {
@@ -657,25 +1293,93 @@ private:
             glfwWaitEvents();
         }
 
-        vkDeviceWaitIdle(logical_device);
-
-        cleanup_swap_chain();
+        // No device drain: the old objects are retired and destroyed by draw_frame() once the
+        // frames that use them have finished.
+        present_waiter.reset();
+        RetiredSwapChain retired{};
+        retired.swap_chain = swap_chain;
+        retired.image_views.swap(swap_chain_image_views);
+        retired.framebuffers.swap(swap_chain_framebuffers);
+        retired.submitted_frames = submitted_frames;
 
-        create_swap_chain();
+        create_swap_chain(retired.swap_chain);
         create_image_views();
-        create_color_resources();
-        create_depth_resources();
+
+        // Framebuffers may be smaller than their attachments, so shrinking keeps the old ones.
+        if (scene.culls()) {
+            retired.depth_pyramid = depth_pyramid;
+            retired.depth_pyramid_allocation = depth_pyramid_allocation;
+            retired.depth_pyramid_view = depth_pyramid_view;
+            retired.depth_pyramid_levels.swap(depth_pyramid_levels);
+        }
+
+        if (swap_chain_extent.width > attachment_extent.width || swap_chain_extent.height > attachment_extent.height) {
+            retired.color_image = color_image;
+            retired.color_image_allocation = color_image_allocation;
+            retired.color_image_view = color_image_view;
+            retired.depth_image = depth_image;
+            retired.depth_image_allocation = depth_image_allocation;
+            retired.depth_image_view = depth_image_view;
+
+            create_color_resources();
+            create_depth_resources();
+        }
+
+        create_depth_pyramid();
         create_framebuffers();
+
+        retired_swap_chains.push_back(std::move(retired));
+    }
+
+    // completed_frames is the number of submitted frames known to have finished on the GPU.
+    void destroy_retired_swap_chains(uint64_t completed_frames) {
+        for (size_t i = 0; i < retired_swap_chains.size();) {
+            if (retired_swap_chains[i].submitted_frames > completed_frames) {
+                i++;
+                continue;
+            }
+
+            destroy_retired_swap_chain(retired_swap_chains[i]);
+            retired_swap_chains.erase(retired_swap_chains.begin() + i);
+        }
+    }
+
+    void destroy_retired_swap_chain(RetiredSwapChain& retired) {
+        if (retired.depth_pyramid_view != VK_NULL_HANDLE) {
+            destroy_depth_pyramid(retired.depth_pyramid, retired.depth_pyramid_allocation, retired.depth_pyramid_view, retired.depth_pyramid_levels);
+        }
+
+        if (retired.depth_image_view != VK_NULL_HANDLE) {
+            vkDestroyImageView(logical_device, retired.depth_image_view, nullptr);
+            allocator.destroy_image(retired.depth_image, retired.depth_image_allocation);
+        }
+
+        if (retired.color_image_view != VK_NULL_HANDLE) {
+            vkDestroyImageView(logical_device, retired.color_image_view, nullptr);
+            allocator.destroy_image(retired.color_image, retired.color_image_allocation);
+        }
+
+        for (auto framebuffer : retired.framebuffers) {
+            vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
+        }
+
+        for (auto image_view : retired.image_views) {
+            vkDestroyImageView(logical_device, image_view, nullptr);
+        }
+
+        vkDestroySwapchainKHR(logical_device, retired.swap_chain, nullptr);
     }
 
     void cleanup_swap_chain() {
+        if (depth_pyramid_view != VK_NULL_HANDLE) {
+            destroy_depth_pyramid(depth_pyramid, depth_pyramid_allocation, depth_pyramid_view, depth_pyramid_levels);
+        }
+
         vkDestroyImageView(logical_device, depth_image_view, nullptr);
-        vkDestroyImage(logical_device, depth_image, nullptr);
-        vkFreeMemory(logical_device, depth_image_memory, nullptr);
+        allocator.destroy_image(depth_image, depth_image_allocation);
 
         vkDestroyImageView(logical_device, color_image_view, nullptr);
-        vkDestroyImage(logical_device, color_image, nullptr);
-        vkFreeMemory(logical_device, color_image_memory, nullptr);
+        allocator.destroy_image(color_image, color_image_allocation);
 
         for (auto framebuffer : swap_chain_framebuffers) {
             vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
@@ -685,23 +1389,143 @@ private:
             vkDestroyImageView(logical_device, image_view, nullptr);
         }
 
+        if (headless) {
+            offscreen_targets.cleanup();
+            return;
+        }
+
         vkDestroySwapchainKHR(logical_device, swap_chain, nullptr);
+
+        for (auto& retired : retired_swap_chains) {
+            destroy_retired_swap_chain(retired);
+        }
+        retired_swap_chains.clear();
     }
 
     void load_model() {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string err;
-
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, model_path.c_str())) {
-            throw std::runtime_error(err);
+        uint64_t source_hash = hash_file_cached(model_path);
+        uint32_t import_flags = PACKED_VERTICES ? 1 : 0;
+        mesh_source_hash = source_hash;
+        mesh_import_flags = import_flags;
+
+        // Every level has to be there and share the full model's layout. Levels in between are
+        // only checked; the streamer maps them again when they are wanted.
+        auto open_caches = [&] {
+            if (!mesh_cache.open(mesh_cache_path, source_hash, import_flags)) {
+                return false;
+            }
+            uint32_t stride = mesh_cache.mesh().vertex_stride;
+            if (stride != sizeof(Vertex) && stride != sizeof(PackedVertex)) {
+                return false;
+            }
+
+            lod_sizes.assign(1, { mesh_cache.mesh().vertex_count, mesh_cache.mesh().index_count });
+            for (uint32_t level = 1; level < streaming.lod_count; level++) {
+                MeshCache probe;
+                MeshCache& lod = level + 1 == streaming.lod_count ? coarsest_cache : probe;
+                if (!lod.open(lod_cache_path(level), source_hash, import_flags) || lod.mesh().vertex_stride != stride) {
+                    return false;
+                }
+                lod_sizes.push_back({ lod.mesh().vertex_count, lod.mesh().index_count });
+            }
+            return true;
+        };
+
+        if (!open_caches()) {
+            // Files that are still mapped cannot be written over on Windows.
+            mesh_cache.close();
+            coarsest_cache.close();
+            import_model(source_hash, import_flags);
+
+            if (!open_caches()) {
+                throw std::runtime_error("mesh cache: failed to read back " + mesh_cache_path);
+            }
+        }
+
+        const MeshData& mesh = mesh_cache.mesh();
+
+        packed_vertices = mesh.vertex_stride == sizeof(PackedVertex);
+        position_dequantization = glm::translate(glm::mat4(1.0f), glm::vec3(mesh.position_offset[0], mesh.position_offset[1], mesh.position_offset[2])) *
+            glm::scale(glm::mat4(1.0f), glm::vec3(mesh.position_scale[0], mesh.position_scale[1], mesh.position_scale[2]));
+        constant_color = glm::vec3(mesh.constant_color[0], mesh.constant_color[1], mesh.constant_color[2]);
+        model_bounds = bounding_sphere(mesh);
+    }
+
+    // Around the bounding box of the dequantized positions, as center and radius.
+    static glm::vec4 bounding_sphere(const MeshData& mesh) {
+        if (mesh.vertex_count == 0) {
+            return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+
+        glm::vec3 bounds_min;
+        glm::vec3 bounds_max;
+        if (mesh.vertex_stride == sizeof(PackedVertex)) {
+            // Quantized relative to the bounds, which are the dequantization itself.
+            bounds_min = glm::vec3(mesh.position_offset[0], mesh.position_offset[1], mesh.position_offset[2]);
+            bounds_max = bounds_min + glm::vec3(mesh.position_scale[0], mesh.position_scale[1], mesh.position_scale[2]);
+        }
+        else {
+            const Vertex* vertices = static_cast<const Vertex*>(mesh.vertices);
+            bounds_min = vertices[0].pos;
+            bounds_max = vertices[0].pos;
+            for (uint32_t i = 1; i < mesh.vertex_count; i++) {
+                bounds_min = glm::min(bounds_min, vertices[i].pos);
+                bounds_max = glm::max(bounds_max, vertices[i].pos);
+            }
         }
 
-        std::unordered_map<Vertex, uint32_t> unique_vertices{};
+        return glm::vec4((bounds_min + bounds_max) * 0.5f, std::max(glm::length(bounds_max - bounds_min) * 0.5f, 1e-3f));
+    }
+
+    // Parses the OBJ, deduplicates its vertices and stores the result in the mesh cache.
+    void import_model(uint64_t source_hash, uint32_t import_flags) {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+
+        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, model_path.c_str())) {
+            throw std::runtime_error(err);
+        }
+
+        // Where each shape starts in the concatenated index stream.
+        std::vector<size_t> shape_offsets(shapes.size() + 1, 0);
+        for (size_t i = 0; i < shapes.size(); i++) {
+            shape_offsets[i + 1] = shape_offsets[i] + shapes[i].mesh.indices.size();
+        }
+        size_t total_indices = shape_offsets.back();
+
+        // Every thread welds a contiguous range of the stream on its own...
+        struct WeldedChunk {
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+        };
+
+        uint32_t chunk_count = static_cast<uint32_t>(std::min<size_t>(worker_threads.thread_count(), std::max<size_t>(1, total_indices / 4096)));
+        std::vector<WeldedChunk> chunks(chunk_count);
+
+        worker_threads.parallel_for(chunk_count, [&](uint32_t chunk, uint32_t) {
+            size_t begin = total_indices * chunk / chunk_count;
+            size_t end = total_indices * (chunk + 1) / chunk_count;
+
+            WeldedChunk& welded = chunks[chunk];
+            welded.vertices.reserve(end - begin);
+            welded.indices.reserve(end - begin);
+
+            VertexHashTable<Vertex> unique_vertices;
+            unique_vertices.reserve(end - begin);
+
+            size_t shape = std::upper_bound(shape_offsets.begin(), shape_offsets.end(), begin) - shape_offsets.begin() - 1;
+            for (size_t i = begin; i < end; i++) {
+                while (i >= shape_offsets[shape + 1]) {
+                    shape++;
+                }
+
+                const tinyobj::index_t& index = shapes[shape].mesh.indices[i - shape_offsets[shape]];
 
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
                 Vertex vertex{};
 
                 vertex.pos = {
@@ -717,82 +1541,343 @@ private:
 
                 vertex.color = { 1.0f, 1.0f, 1.0f };
 
-                if (unique_vertices.count(vertex) == 0) {
-                    unique_vertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
+                welded.indices.push_back(unique_vertices.insert(vertex, welded.vertices));
+            }
+        });
+
+        // ...and the chunks are merged in stream order. Each chunk lists its vertices in order of
+        // first use, so the final numbering is the one a single sequential pass would produce.
+        size_t chunk_vertex_total = 0;
+        for (const auto& welded : chunks) {
+            chunk_vertex_total += welded.vertices.size();
+        }
+
+        vertices.reserve(chunk_vertex_total);
+        indices.reserve(total_indices);
+
+        VertexHashTable<Vertex> unique_vertices;
+        unique_vertices.reserve(chunk_vertex_total);
+
+        std::vector<uint32_t> remap;
+        for (const auto& welded : chunks) {
+            remap.resize(welded.vertices.size());
+            for (size_t i = 0; i < welded.vertices.size(); i++) {
+                remap[i] = unique_vertices.insert(welded.vertices[i], vertices);
+            }
+
+            for (uint32_t index : welded.indices) {
+                indices.push_back(remap[index]);
+            }
+        }
+
+        float acmr_before = analyze_vertex_cache(indices.data(), indices.size(), vertices.size());
+
+        optimize_vertex_cache(indices.data(), indices.size(), vertices.size());
+        optimize_overdraw(indices.data(), indices.size(), &vertices[0].pos.x, sizeof(Vertex), vertices.size());
+        vertices.resize(optimize_vertex_fetch(vertices.data(), indices.data(), indices.size(), vertices.size(), sizeof(Vertex)));
+
+        log() << "mesh: " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, ACMR "
+            << acmr_before << " -> " << analyze_vertex_cache(indices.data(), indices.size(), vertices.size()) << std::endl;
+
+        bool constant_color = std::all_of(vertices.begin(), vertices.end(), [&](const Vertex& vertex) {
+            return vertex.color == vertices[0].color;
+        });
+        bool pack = PACKED_VERTICES && constant_color && !vertices.empty();
+
+        // Every level is quantized against the full model's bounds, so one dequantization serves
+        // all of them.
+        glm::vec3 bounds_min(0.0f);
+        glm::vec3 extent(1.0f);
+        if (pack) {
+            bounds_min = vertices[0].pos;
+            glm::vec3 bounds_max = vertices[0].pos;
+            for (const auto& vertex : vertices) {
+                bounds_min = glm::min(bounds_min, vertex.pos);
+                bounds_max = glm::max(bounds_max, vertex.pos);
+            }
+
+            // A flat axis would divide by zero; any scale decodes it correctly.
+            extent = bounds_max - bounds_min;
+            for (int axis = 0; axis < 3; axis++) {
+                if (extent[axis] == 0.0f) {
+                    extent[axis] = 1.0f;
                 }
+            }
+        }
+
+        write_mesh_cache(mesh_cache_path, source_hash, import_flags, vertices, indices, pack, bounds_min, extent);
+
+        // Coarser levels are simplified from the full model, not from each other, so errors do not add up.
+        for (uint32_t level = 1; level < streaming.lod_count; level++) {
+            std::vector<uint32_t> lod_indices(indices);
+            lod_indices.resize(simplify_clusters(lod_indices.data(), lod_indices.size(), vertices.empty() ? nullptr : &vertices[0].pos.x,
+                sizeof(Vertex), vertices.size(), lod_grid_size(level)));
+            optimize_vertex_cache(lod_indices.data(), lod_indices.size(), vertices.size());
+
+            std::vector<Vertex> lod_vertices(vertices);
+            lod_vertices.resize(optimize_vertex_fetch(lod_vertices.data(), lod_indices.data(), lod_indices.size(), lod_vertices.size(), sizeof(Vertex)));
+
+            log() << "mesh: level " << level << ": " << lod_vertices.size() << " vertices, " << lod_indices.size() / 3 << " triangles" << std::endl;
+
+            write_mesh_cache(lod_cache_path(level), source_hash, import_flags, lod_vertices, lod_indices, pack, bounds_min, extent);
+        }
+    }
+
+    // Packs the vertices relative to bounds_min and extent when asked to, narrows the indices where
+    // they fit and writes the result.
+    void write_mesh_cache(const std::string& path, uint64_t source_hash, uint32_t import_flags,
+        const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, bool pack, const glm::vec3& bounds_min, const glm::vec3& extent) {
+        MeshData mesh{};
+        mesh.vertices = vertices.data();
+        mesh.vertex_count = static_cast<uint32_t>(vertices.size());
+        mesh.vertex_stride = sizeof(Vertex);
+        mesh.index_count = static_cast<uint32_t>(indices.size());
+
+        std::vector<PackedVertex> packed;
+        if (pack && !vertices.empty()) {
+            packed.resize(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++) {
+                glm::vec3 normalized = (vertices[i].pos - bounds_min) / extent;
+                for (int axis = 0; axis < 3; axis++) {
+                    packed[i].pos[axis] = glm::packUnorm1x16(normalized[axis]);
+                }
+                packed[i].pos[3] = 0;
+
+                packed[i].tex_coord[0] = glm::packHalf1x16(vertices[i].tex_coord.x);
+                packed[i].tex_coord[1] = glm::packHalf1x16(vertices[i].tex_coord.y);
+            }
+
+            mesh.vertices = packed.data();
+            mesh.vertex_stride = sizeof(PackedVertex);
+
+            for (int axis = 0; axis < 3; axis++) {
+                mesh.position_offset[axis] = bounds_min[axis];
+                mesh.position_scale[axis] = extent[axis];
+                mesh.constant_color[axis] = vertices[0].color[axis];
+            }
+        }
+
+        // 16-bit indices whenever every vertex is addressable with them; primitive restart is off,
+        // so 0xffff is an ordinary index.
+        std::vector<uint16_t> short_indices;
+        if (vertices.size() <= 0x10000) {
+            short_indices.assign(indices.begin(), indices.end());
+            mesh.indices = short_indices.data();
+            mesh.index_size = sizeof(uint16_t);
+        }
+        else {
+            mesh.indices = indices.data();
+            mesh.index_size = sizeof(uint32_t);
+        }
+
+        MeshCache::write(path, source_hash, import_flags, mesh);
+    }
+
+    // The pool holds every level when the budget allows, and otherwise as much of them as it does,
+    // but always the coarsest level. Only the coarsest is uploaded now.
+    void create_mesh_pool() {
+        const MeshData& mesh = mesh_cache.mesh();
+        const MeshData& coarsest = streaming.lod_count > 1 ? coarsest_cache.mesh() : mesh;
+
+        uint64_t total_vertices = 0;
+        uint64_t total_indices = 0;
+        for (const LodSize& size : lod_sizes) {
+            total_vertices += size.vertex_count;
+            total_indices += size.index_count;
+        }
+        VkDeviceSize total_bytes = total_vertices * mesh.vertex_stride + total_indices * mesh.index_size;
+
+        VkDeviceSize budget = streaming.budget_bytes > 0 ? streaming.budget_bytes : allocator.heap_headroom(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) / 2;
+        double share = total_bytes > budget ? static_cast<double>(budget) / static_cast<double>(total_bytes) : 1.0;
 
-                indices.push_back(unique_vertices[vertex]);
+        uint32_t vertex_capacity = std::max(coarsest.vertex_count, static_cast<uint32_t>(total_vertices * share));
+        uint32_t index_capacity = std::max(coarsest.index_count, static_cast<uint32_t>(total_indices * share));
+        mesh_pool.init(allocator, mesh.vertex_stride, mesh.index_size, vertex_capacity, index_capacity);
+
+        mesh_streamer.init(mesh_pool);
+        model_mesh = mesh_streamer.add_mesh(uploader, coarsest, streaming.lod_count, [this](uint32_t level, MeshCache& cache) {
+            if (!cache.open(lod_cache_path(level), mesh_source_hash, mesh_import_flags)) {
+                throw std::runtime_error("mesh cache: failed to read back " + lod_cache_path(level));
             }
+        });
+        model_range = *mesh_streamer.resident_range(model_mesh, streaming.lod_count - 1);
+
+        if (streaming.lod_count > 1) {
+            log() << "streaming: " << streaming.lod_count << " levels, " << (mesh_pool.memory_bytes() >> 10) << " KiB pool for "
+                << (total_bytes >> 10) << " KiB of levels" << std::endl;
         }
     }
 
-    void create_vertex_buffer() {
-        VkDeviceSize buffer_size = sizeof(vertices[0]) * vertices.size();
+    static uint32_t lod_grid_size(uint32_t level) {
+        return LOD_GRID_SIZE >> (level - 1);
+    }
+
+    // A simplified level moves vertices by up to a grid cell, whose side is at most the model's
+    // diameter over the grid size.
+    float lod_error(uint32_t level) const {
+        return level == 0 ? 0.0f : 2.0f * model_bounds.w / static_cast<float>(lod_grid_size(level));
+    }
 
-        VkBuffer staging_buffer;
-        VkDeviceMemory staging_buffer_memory;
-        create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+    // Pixels per unit of error at unit distance, over the error allowed.
+    float lod_scale() const {
+        return static_cast<float>(swap_chain_extent.height) / (2.0f * std::tan(FIELD_OF_VIEW * 0.5f)) / LOD_PIXEL_ERROR;
+    }
 
-        void* data;
-        vkMapMemory(logical_device, staging_buffer_memory, 0, buffer_size, 0, &data);
-        memcpy(data, vertices.data(), (size_t)buffer_size);
-        vkUnmapMemory(logical_device, staging_buffer_memory);
+    // The coarsest level whose error stays within LOD_PIXEL_ERROR at the given distance.
+    uint32_t lod_for_distance(float distance) const {
+        uint32_t level = streaming.lod_count - 1;
+        while (level > 0 && lod_error(level) * lod_scale() > distance) {
+            level--;
+        }
+        return level;
+    }
 
-        create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory);
+    // Lays the objects out on a square grid spaced by the model's bounds, each turned a little so
+    // the copies can be told apart, and uploads them. Objects cycle through the streamed meshes
+    // and the textures.
+    void create_scene_buffers() {
+        if (!scene.enabled()) {
+            return;
+        }
+
+        scene_textures = { texture_image_view };
+        if (scene_textures.size() > scene_texture_capacity) {
+            throw std::runtime_error("scene: more textures than the device can bind");
+        }
+
+        std::vector<SceneObject> objects(scene.object_count);
+        for (uint32_t i = 0; i < scene.object_count; i++) {
+            glm::vec3 position = grid_position(i, scene.object_count);
+
+            objects[i].model = grid_cell_transform(position, grid_turn(i));
+            // The turn is about the sphere's center.
+            objects[i].bounds = glm::vec4(position, model_bounds.w);
+            objects[i].mesh = i % mesh_streamer.mesh_count();
+            objects[i].texture = i % static_cast<uint32_t>(scene_textures.size());
+        }
 
-        copy_buffer(staging_buffer, vertex_buffer, buffer_size);
+        fit_view_to_grid(scene.object_count);
 
-        vkDestroyBuffer(logical_device, staging_buffer, nullptr);
-        vkFreeMemory(logical_device, staging_buffer_memory, nullptr);
+        VkDeviceSize object_bytes = objects.size() * sizeof(SceneObject);
+        allocator.create_buffer(object_bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scene_object_buffer, scene_object_allocation);
+        uploader.upload_buffer(scene_object_buffer, 0, objects.data(), object_bytes);
+
+        // The mesh table follows what the streamer has resident, so every frame slot has its own.
+        VkDeviceSize mesh_bytes = static_cast<VkDeviceSize>(mesh_streamer.mesh_count()) * MAX_MESH_LODS * sizeof(SceneMesh);
+        scene_mesh_buffers.resize(frames_in_flight);
+        scene_mesh_allocations.resize(frames_in_flight);
+        scene_mesh_tables.resize(frames_in_flight);
+        for (size_t i = 0; i < frames_in_flight; i++) {
+            allocator.create_buffer(mesh_bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, scene_mesh_buffers[i], scene_mesh_allocations[i]);
+            scene_mesh_tables[i] = static_cast<SceneMesh*>(scene_mesh_allocations[i].mapped);
+        }
+
+        log() << "scene: " << objects.size() << " objects, " << mesh_streamer.mesh_count() << " meshes, " << scene_textures.size() << " textures, "
+            << (draw_indirect_count ? "draw indirect count" : "draw indirect") << std::endl;
+    }
+
+    // Scene objects and instances are laid out on a square grid spaced by the model's bounds.
+    glm::vec3 grid_position(uint32_t index, uint32_t count) const {
+        uint32_t side = grid_side(count);
+        float spacing = 2.2f * model_bounds.w;
+        return glm::vec3(
+            (static_cast<float>(index % side) - (side - 1) * 0.5f) * spacing,
+            (static_cast<float>(index / side) - (side - 1) * 0.5f) * spacing,
+            0.0f);
+    }
+
+    static uint32_t grid_side(uint32_t count) {
+        return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
     }
 
-    void create_index_buffer() {
-        VkDeviceSize buffer_size = sizeof(indices[0]) * indices.size();
+    // Steps of the golden angle never line two neighbors up.
+    static float grid_turn(uint32_t index) {
+        return static_cast<float>(index % 1024) * 2.3999632f;
+    }
 
-        VkBuffer staging_buffer;
-        VkDeviceMemory staging_buffer_memory;
-        create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+    // The model centered on position, turned about its center.
+    glm::mat4 grid_cell_transform(const glm::vec3& position, float turn) const {
+        glm::mat4 centered = glm::translate(glm::mat4(1.0f), -glm::vec3(model_bounds)) * position_dequantization;
+        return glm::translate(glm::mat4(1.0f), position) * glm::rotate(glm::mat4(1.0f), turn, glm::vec3(0.0f, 0.0f, 1.0f)) * centered;
+    }
 
-        void* data;
-        vkMapMemory(logical_device, staging_buffer_memory, 0, buffer_size, 0, &data);
-        memcpy(data, indices.data(), (size_t)buffer_size);
-        vkUnmapMemory(logical_device, staging_buffer_memory);
+    void fit_view_to_grid(uint32_t count) {
+        float grid_radius = (grid_side(count) - 1) * 2.2f * model_bounds.w * 0.70710678f + model_bounds.w;
+        view_scale = grid_radius / model_bounds.w;
+    }
 
-        create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, index_buffer_memory);
+    // Host visible: the CPU writes every instance each frame, and the GPU reads each matrix once.
+    void create_instance_buffers() {
+        if (!scene.instanced()) {
+            return;
+        }
+
+        VkDeviceSize buffer_size = static_cast<VkDeviceSize>(scene.instance_count) * sizeof(glm::mat4);
 
-        copy_buffer(staging_buffer, index_buffer, buffer_size);
+        instance_buffers.resize(frames_in_flight);
+        instance_buffer_allocations.resize(frames_in_flight);
+        instance_buffers_mapped.resize(frames_in_flight);
+        for (size_t i = 0; i < frames_in_flight; i++) {
+            allocator.create_buffer(buffer_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instance_buffers[i], instance_buffer_allocations[i]);
+            instance_buffers_mapped[i] = static_cast<glm::mat4*>(instance_buffer_allocations[i].mapped);
+        }
 
-        vkDestroyBuffer(logical_device, staging_buffer, nullptr);
-        vkFreeMemory(logical_device, staging_buffer_memory, nullptr);
+        fit_view_to_grid(scene.instance_count);
+    }
+
+    VkDeviceSize instance_buffer_bytes() const {
+        VkDeviceSize bytes = 0;
+        for (const Allocation& allocation : instance_buffer_allocations) {
+            bytes += allocation.size;
+        }
+        return bytes;
     }
 
     void create_uniform_buffers() {
-        VkDeviceSize buffer_size = sizeof(UniformBufferObject);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
 
-        uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        uniform_buffers_mapped.resize(MAX_FRAMES_IN_FLIGHT);
+        uniform_arena.init(allocator, properties.limits.minUniformBufferOffsetAlignment, static_cast<uint32_t>(frames_in_flight), UNIFORM_ARENA_FRAME_BYTES);
+    }
+
+    // Draw buffer of every frame slot: the draw count, then a command per object.
+    void create_draw_buffers() {
+        if (!scene.enabled()) {
+            return;
+        }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+        VkDeviceSize buffer_size = DRAW_COMMANDS_OFFSET + static_cast<VkDeviceSize>(scene.object_count) * sizeof(VkDrawIndexedIndirectCommand);
 
-            vkMapMemory(logical_device, uniformBuffersMemory[i], 0, buffer_size, 0, &uniform_buffers_mapped[i]);
+        draw_buffers.resize(frames_in_flight);
+        draw_buffer_allocations.resize(frames_in_flight);
+        for (size_t i = 0; i < frames_in_flight; i++) {
+            allocator.create_buffer(buffer_size,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, draw_buffers[i], draw_buffer_allocations[i]);
         }
     }
 
+    // One graphics set. Scene mode adds the objects, the scene's textures and a draw set per
+    // frame, and culling a depth pyramid set per frame.
     void create_descriptor_pool() {
-        std::array<VkDescriptorPoolSize, 2> pool_sizes{};
-        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        pool_sizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        uint32_t frames = static_cast<uint32_t>(frames_in_flight);
+        uint32_t texture_count = scene.enabled() ? static_cast<uint32_t>(scene_textures.size()) : 1;
+
+        std::array<VkDescriptorPoolSize, 4> pool_sizes{};
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        pool_sizes[0].descriptorCount = 1 + (scene.enabled() ? frames : 0);
         pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        pool_sizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        pool_sizes[1].descriptorCount = texture_count + (scene.culls() ? 2 * frames : 0);
+        pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_sizes[2].descriptorCount = 1 + 3 * frames;
+        pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pool_sizes[3].descriptorCount = frames * MAX_PYRAMID_LEVELS;
 
         VkDescriptorPoolCreateInfo pool_info{};
         pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.poolSizeCount = scene.culls() ? 4 : (scene.enabled() ? 3 : 2);
         pool_info.pPoolSizes = pool_sizes.data();
-        pool_info.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        pool_info.maxSets = 1 + (scene.enabled() ? frames : 0) + (scene.culls() ? frames : 0);
 
         if (vkCreateDescriptorPool(logical_device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to create descriptor pool");
@@ -800,102 +1885,208 @@ private:
     }
 
     void create_descriptor_sets() {
-        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptor_set_layout);
+        if (scene.enabled()) {
+            create_scene_descriptor_sets();
+            return;
+        }
+
         VkDescriptorSetAllocateInfo alloc_info{};
         alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         alloc_info.descriptorPool = descriptor_pool;
-        alloc_info.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        alloc_info.pSetLayouts = layouts.data();
-
-        descriptor_sets.resize(MAX_FRAMES_IN_FLIGHT);
-        if (vkAllocateDescriptorSets(logical_device, &alloc_info, descriptor_sets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to allocate descriptor sets");
-        }
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VkDescriptorBufferInfo buffer_info{};
-            buffer_info.buffer = uniformBuffers[i];
-            buffer_info.offset = 0;
-            buffer_info.range = sizeof(UniformBufferObject);
-
-            VkDescriptorImageInfo image_info{};
-            image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            image_info.imageView = texture_image_view;
-            image_info.sampler = texture_sampler;
-
-            std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
-
-            descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_writes[0].dstSet = descriptor_sets[i];
-            descriptor_writes[0].dstBinding = 0;
-            descriptor_writes[0].dstArrayElement = 0;
-            descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptor_writes[0].descriptorCount = 1;
-            descriptor_writes[0].pBufferInfo = &buffer_info;
-
-            descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_writes[1].dstSet = descriptor_sets[i];
-            descriptor_writes[1].dstBinding = 1;
-            descriptor_writes[1].dstArrayElement = 0;
-            descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptor_writes[1].descriptorCount = 1;
-            descriptor_writes[1].pImageInfo = &image_info;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &descriptor_set_layout;
 
-            vkUpdateDescriptorSets(logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+        if (vkAllocateDescriptorSets(logical_device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to allocate descriptor set");
         }
+
+        VkDescriptorBufferInfo buffer_info{};
+        buffer_info.buffer = uniform_arena.buffer();
+        buffer_info.offset = 0;
+        buffer_info.range = sizeof(UniformBufferObject);
+
+        VkDescriptorImageInfo image_info{};
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_info.imageView = texture_image_view;
+        image_info.sampler = texture_sampler;
+
+        std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
+
+        descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[0].dstSet = descriptor_set;
+        descriptor_writes[0].dstBinding = 0;
+        descriptor_writes[0].dstArrayElement = 0;
+        descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptor_writes[0].descriptorCount = 1;
+        descriptor_writes[0].pBufferInfo = &buffer_info;
+
+        descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[1].dstSet = descriptor_set;
+        descriptor_writes[1].dstBinding = 1;
+        descriptor_writes[1].dstArrayElement = 0;
+        descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor_writes[1].descriptorCount = 1;
+        descriptor_writes[1].pImageInfo = &image_info;
+
+        vkUpdateDescriptorSets(logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
     }
 
-    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory) {
-        VkBufferCreateInfo buffer_info{};
-        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        buffer_info.size = size;
-        buffer_info.usage = usage;
-        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    void create_scene_descriptor_sets() {
+        uint32_t texture_count = static_cast<uint32_t>(scene_textures.size());
+
+        VkDescriptorSetVariableDescriptorCountAllocateInfo variable_count_info{};
+        variable_count_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+        variable_count_info.descriptorSetCount = 1;
+        variable_count_info.pDescriptorCounts = &texture_count;
 
-        if (vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create buffer");
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.pNext = &variable_count_info;
+        alloc_info.descriptorPool = descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &descriptor_set_layout;
+
+        if (vkAllocateDescriptorSets(logical_device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to allocate scene descriptor set");
         }
 
-        VkMemoryRequirements mem_requirements;
-        vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
+        std::vector<VkDescriptorSetLayout> draw_layouts(frames_in_flight, draw_descriptor_set_layout);
+        VkDescriptorSetAllocateInfo draw_alloc_info{};
+        draw_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        draw_alloc_info.descriptorPool = descriptor_pool;
+        draw_alloc_info.descriptorSetCount = static_cast<uint32_t>(frames_in_flight);
+        draw_alloc_info.pSetLayouts = draw_layouts.data();
 
-        VkMemoryAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = mem_requirements.size;
-        alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
+        draw_descriptor_sets.resize(frames_in_flight);
+        if (vkAllocateDescriptorSets(logical_device, &draw_alloc_info, draw_descriptor_sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to allocate draw descriptor sets");
+        }
 
-        if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to allocate buffer memory");
+        std::vector<VkDescriptorImageInfo> image_infos(texture_count);
+        for (uint32_t i = 0; i < texture_count; i++) {
+            image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            image_infos[i].imageView = scene_textures[i];
+            image_infos[i].sampler = texture_sampler;
         }
 
-        vkBindBufferMemory(logical_device, buffer, buffer_memory, 0);
-    }
+        VkDescriptorBufferInfo object_info{ scene_object_buffer, 0, VK_WHOLE_SIZE };
+
+        auto buffer_write = [](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo* info) {
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = binding;
+            write.dstArrayElement = 0;
+            write.descriptorType = type;
+            write.descriptorCount = 1;
+            write.pBufferInfo = info;
+            return write;
+        };
+
+        VkDescriptorBufferInfo uniform_info{ uniform_arena.buffer(), 0, sizeof(UniformBufferObject) };
+        VkDescriptorBufferInfo cull_info{ uniform_arena.buffer(), 0, sizeof(CullData) };
+
+        VkWriteDescriptorSet texture_write{};
+        texture_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        texture_write.dstSet = descriptor_set;
+        texture_write.dstBinding = 2;
+        texture_write.dstArrayElement = 0;
+        texture_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        texture_write.descriptorCount = texture_count;
+        texture_write.pImageInfo = image_infos.data();
+
+        std::array<VkWriteDescriptorSet, 3> set_writes = {
+            buffer_write(descriptor_set, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &uniform_info),
+            buffer_write(descriptor_set, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &object_info),
+            texture_write,
+        };
+
+        vkUpdateDescriptorSets(logical_device, static_cast<uint32_t>(set_writes.size()), set_writes.data(), 0, nullptr);
 
-    void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
-        VkCommandBuffer command_buffer = begin_single_time_commands();
+        for (size_t i = 0; i < frames_in_flight; i++) {
+            VkDescriptorBufferInfo mesh_info{ scene_mesh_buffers[i], 0, VK_WHOLE_SIZE };
+            VkDescriptorBufferInfo draw_info{ draw_buffers[i], 0, VK_WHOLE_SIZE };
 
-        VkBufferCopy copy_region{};
-        copy_region.size = size;
-        vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+            std::array<VkWriteDescriptorSet, 4> descriptor_writes = {
+                buffer_write(draw_descriptor_sets[i], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &object_info),
+                buffer_write(draw_descriptor_sets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &mesh_info),
+                buffer_write(draw_descriptor_sets[i], 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &draw_info),
+                buffer_write(draw_descriptor_sets[i], 4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, &cull_info),
+            };
+
+            vkUpdateDescriptorSets(logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+        }
 
-        end_single_time_commands(command_buffer);
+        if (!scene.culls()) {
+            return;
+        }
+
+        std::vector<VkDescriptorSetLayout> pyramid_layouts(frames_in_flight, pyramid_descriptor_set_layout);
+        VkDescriptorSetAllocateInfo pyramid_alloc_info{};
+        pyramid_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        pyramid_alloc_info.descriptorPool = descriptor_pool;
+        pyramid_alloc_info.descriptorSetCount = static_cast<uint32_t>(frames_in_flight);
+        pyramid_alloc_info.pSetLayouts = pyramid_layouts.data();
+
+        pyramid_descriptor_sets.resize(frames_in_flight);
+        if (vkAllocateDescriptorSets(logical_device, &pyramid_alloc_info, pyramid_descriptor_sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to allocate depth pyramid descriptor sets");
+        }
+
+        pyramid_set_generations.assign(frames_in_flight, pyramid_generation);
+        for (uint32_t i = 0; i < frames_in_flight; i++) {
+            write_pyramid_descriptors(i);
+        }
     }
 
-    uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties mem_properties;
-        vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+    // The attachment and levels the pyramid is built from and into, and the pyramid the culling
+    // reads, for one frame slot.
+    void write_pyramid_descriptors(uint32_t frame) {
+        VkDescriptorImageInfo depth_info{};
+        depth_info.sampler = depth_pyramid_sampler;
+        depth_info.imageView = depth_image_view;
+        depth_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-        for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-            if ((type_filter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
+        // The unused tail of the binding repeats the last level.
+        std::array<VkDescriptorImageInfo, MAX_PYRAMID_LEVELS> level_infos{};
+        for (uint32_t i = 0; i < MAX_PYRAMID_LEVELS; i++) {
+            level_infos[i].imageView = depth_pyramid_levels[std::min(i, depth_pyramid_level_count - 1)];
+            level_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
         }
 
-        throw std::runtime_error("vk: failed to find suitable memory type");
+        VkDescriptorImageInfo pyramid_info{};
+        pyramid_info.sampler = depth_pyramid_sampler;
+        pyramid_info.imageView = depth_pyramid_view;
+        pyramid_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 3> descriptor_writes{};
+        descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[0].dstSet = pyramid_descriptor_sets[frame];
+        descriptor_writes[0].dstBinding = 0;
+        descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor_writes[0].descriptorCount = 1;
+        descriptor_writes[0].pImageInfo = &depth_info;
+
+        descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[1].dstSet = pyramid_descriptor_sets[frame];
+        descriptor_writes[1].dstBinding = 1;
+        descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptor_writes[1].descriptorCount = MAX_PYRAMID_LEVELS;
+        descriptor_writes[1].pImageInfo = level_infos.data();
+
+        descriptor_writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[2].dstSet = draw_descriptor_sets[frame];
+        descriptor_writes[2].dstBinding = 3;
+        descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor_writes[2].descriptorCount = 1;
+        descriptor_writes[2].pImageInfo = &pyramid_info;
+
+        vkUpdateDescriptorSets(logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+        pyramid_set_generations[frame] = pyramid_generation;
     }
 
     void create_command_buffers() {
-        command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+        command_buffers.resize(frames_in_flight);
 
         VkCommandBufferAllocateInfo alloc_info{};
         alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -908,10 +2099,34 @@ private:
         }
     }
 
+    void create_recording_pools() {
+        if (!PARALLEL_RECORDING) {
+            return;
+        }
+
+        QueueFamilyIndices queue_family_indices = find_queue_families(physical_device);
+
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
+
+        recording_pools.resize(frames_in_flight);
+        for (auto& frame_pools : recording_pools) {
+            frame_pools.resize(worker_threads.thread_count());
+
+            for (auto& recording_pool : frame_pools) {
+                if (vkCreateCommandPool(logical_device, &pool_info, nullptr, &recording_pool.pool) != VK_SUCCESS) {
+                    throw std::runtime_error("vk: failed to create recording command pool");
+                }
+            }
+        }
+    }
+
     void create_sync_objects() {
-        image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
+        image_available_semaphores.resize(frames_in_flight);
+        render_finished_semaphores.resize(frames_in_flight);
+        in_flight_fences.resize(frames_in_flight);
 
         VkSemaphoreCreateInfo semaphore_info{};
         semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -920,7 +2135,7 @@ private:
         fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        for (size_t i = 0; i < frames_in_flight; i++) {
             if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
                 vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
                 vkCreateFence(logical_device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
@@ -951,7 +2166,241 @@ private:
         render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());;
         render_pass_info.pClearValues = clear_values.data();
 
-        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        if (scene.enabled()) {
+            record_draw_build(command_buffer);
+        }
+
+        GpuProfiler::Scope render_scope = gpu_profiler.begin(command_buffer, "render", graphics_family);
+
+        // One indirect draw covers the whole scene, so there is nothing to split across threads.
+        if (scene.enabled()) {
+            vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+            record_scene_draws(command_buffer);
+        }
+        else if (PARALLEL_RECORDING) {
+            vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+            std::vector<VkCommandBuffer> secondary_buffers = record_secondary_command_buffers(image_index);
+            vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(secondary_buffers.size()), secondary_buffers.data());
+        }
+        else {
+            vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+            record_draws(command_buffer, 0, model_range.index_count);
+        }
+
+        vkCmdEndRenderPass(command_buffer);
+
+        gpu_profiler.end(command_buffer, render_scope);
+
+        if (scene.culls()) {
+            record_depth_pyramid(command_buffer);
+        }
+
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to record command buffer");
+        }
+    }
+
+    // Splits the index buffer into one triangle range per recording thread and records each range
+    // into its own secondary command buffer. The result is in draw order.
+    std::vector<VkCommandBuffer> record_secondary_command_buffers(uint32_t image_index) {
+        uint32_t triangle_count = model_range.index_count / 3;
+        uint32_t triangles_per_chunk = std::max(1u, (triangle_count + worker_threads.thread_count() - 1) / worker_threads.thread_count());
+        uint32_t chunk_count = (triangle_count + triangles_per_chunk - 1) / triangles_per_chunk;
+
+        std::vector<VkCommandBuffer> secondary_buffers(chunk_count);
+
+        worker_threads.parallel_for(chunk_count, [&](uint32_t chunk, uint32_t thread) {
+            RecordingPool& recording_pool = recording_pools[current_frame][thread];
+
+            if (recording_pool.used == recording_pool.secondary_buffers.size()) {
+                VkCommandBufferAllocateInfo alloc_info{};
+                alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                alloc_info.commandPool = recording_pool.pool;
+                alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                alloc_info.commandBufferCount = 1;
+
+                VkCommandBuffer allocated;
+                if (vkAllocateCommandBuffers(logical_device, &alloc_info, &allocated) != VK_SUCCESS) {
+                    throw std::runtime_error("vk: failed to allocate secondary command buffer");
+                }
+                recording_pool.secondary_buffers.push_back(allocated);
+            }
+
+            VkCommandBuffer secondary_buffer = recording_pool.secondary_buffers[recording_pool.used++];
+
+            VkCommandBufferInheritanceInfo inheritance_info{};
+            inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance_info.renderPass = render_pass;
+            inheritance_info.subpass = 0;
+            inheritance_info.framebuffer = swap_chain_framebuffers[image_index];
+
+            VkCommandBufferBeginInfo begin_info{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            begin_info.pInheritanceInfo = &inheritance_info;
+
+            if (vkBeginCommandBuffer(secondary_buffer, &begin_info) != VK_SUCCESS) {
+                throw std::runtime_error("vk: failed to begin recording secondary command buffer");
+            }
+
+            uint32_t first_triangle = chunk * triangles_per_chunk;
+            uint32_t chunk_triangles = std::min(triangles_per_chunk, triangle_count - first_triangle);
+            record_draws(secondary_buffer, first_triangle * 3, chunk_triangles * 3);
+
+            if (vkEndCommandBuffer(secondary_buffer) != VK_SUCCESS) {
+                throw std::runtime_error("vk: failed to record secondary command buffer");
+            }
+
+            secondary_buffers[chunk] = secondary_buffer;
+        });
+
+        return secondary_buffers;
+    }
+
+    // Draws a range of the indices of the model's level picked for this frame. Secondary command
+    // buffers inherit no state from the primary, so each one binds all of it.
+    void record_draws(VkCommandBuffer command_buffer, uint32_t first_index, uint32_t index_count) {
+        bind_draw_state(command_buffer);
+
+        uint32_t instance_count = 1;
+        if (scene.instanced()) {
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(command_buffer, 1, 1, &instance_buffers[current_frame], &offset);
+            instance_count = scene.instance_count;
+        }
+
+        vkCmdDrawIndexed(command_buffer, index_count, instance_count, model_range.first_index + first_index, model_range.vertex_offset, 0);
+    }
+
+    // Every object with the commands scene_draws.comp wrote for this frame.
+    void record_scene_draws(VkCommandBuffer command_buffer) {
+        bind_draw_state(command_buffer);
+
+        VkBuffer draw_buffer = draw_buffers[current_frame];
+        if (draw_indirect_count) {
+            vkCmdDrawIndexedIndirectCount(command_buffer, draw_buffer, DRAW_COMMANDS_OFFSET, draw_buffer, 0,
+                scene.object_count, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else {
+            vkCmdDrawIndexedIndirect(command_buffer, draw_buffer, DRAW_COMMANDS_OFFSET, scene.object_count, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+
+    // Clears the draw count of the frame slot and runs scene_draws.comp over every object, ahead
+    // of the render pass that draws with the result.
+    void record_draw_build(VkCommandBuffer command_buffer) {
+        VkBuffer draw_buffer = draw_buffers[current_frame];
+
+        if (scene.culls() && pyramid_set_generations[current_frame] != pyramid_generation) {
+            write_pyramid_descriptors(current_frame);
+        }
+
+        GpuProfiler::Scope build_scope = gpu_profiler.begin(command_buffer, "build_draws", graphics_family);
+
+        vkCmdFillBuffer(command_buffer, draw_buffer, 0, sizeof(uint32_t), 0);
+
+        VkMemoryBarrier fill_barrier{};
+        fill_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        fill_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        fill_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &fill_barrier,
+            0, nullptr,
+            0, nullptr);
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, draw_pipeline);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, draw_pipeline_layout, 0, 1, &draw_descriptor_sets[current_frame], 1, &cull_offset);
+        vkCmdPushConstants(command_buffer, draw_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &scene.object_count);
+        vkCmdDispatch(command_buffer, (scene.object_count + 63) / 64, 1, 1);
+
+        VkMemoryBarrier draw_barrier{};
+        draw_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        draw_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        draw_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+        vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+            1, &draw_barrier,
+            0, nullptr,
+            0, nullptr);
+
+        gpu_profiler.end(command_buffer, build_scope);
+    }
+
+    // Reduces this frame's depth into the pyramid the next frame culls against, one level per
+    // dispatch. The pyramid stays in GENERAL for both; the barrier ahead of the first level waits
+    // for the previous frame's culling to be done reading it.
+    void record_depth_pyramid(VkCommandBuffer command_buffer) {
+        GpuProfiler::Scope pyramid_scope = gpu_profiler.begin(command_buffer, "depth_pyramid", graphics_family);
+
+        std::array<VkImageMemoryBarrier, 2> barriers{};
+        barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[0].image = depth_image;
+        barriers[0].subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+        barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        // The previous contents are not needed.
+        barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[1].image = depth_pyramid;
+        barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, depth_pyramid_level_count, 0, 1 };
+        barriers[1].srcAccessMask = 0;
+        barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+        if (hasStencilComponent(find_depth_format())) {
+            barriers[0].subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+
+        vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramid_pipeline);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramid_pipeline_layout, 0, 1, &pyramid_descriptor_sets[current_frame], 0, nullptr);
+
+        for (uint32_t level = 0; level < depth_pyramid_level_count; level++) {
+            uint32_t width = std::max(1u, depth_pyramid_extent.width >> level);
+            uint32_t height = std::max(1u, depth_pyramid_extent.height >> level);
+            uint32_t push_constants[3] = { swap_chain_extent.width, swap_chain_extent.height, level };
+
+            vkCmdPushConstants(command_buffer, pyramid_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), push_constants);
+            vkCmdDispatch(command_buffer, (width + 7) / 8, (height + 7) / 8, 1);
+
+            // Each level is read by the next, the last one by the next frame's culling. The barrier
+            // ahead of that frame's draws then also keeps its depth clear after these reads.
+            VkMemoryBarrier level_barrier{};
+            level_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            level_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            level_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(command_buffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &level_barrier,
+                0, nullptr,
+                0, nullptr);
+        }
+
+        gpu_profiler.end(command_buffer, pyramid_scope);
+
+        depth_pyramid_ready = true;
+        previous_view = current_view;
+        previous_projection = current_projection;
+    }
+
+    void bind_draw_state(VkCommandBuffer command_buffer) {
         vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
 
         VkViewport viewport{};
@@ -968,20 +2417,14 @@ private:
         scissor.extent = swap_chain_extent;
         vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-        VkBuffer vertex_buffers[] = { vertex_buffer };
+        VkBuffer vertex_buffers[] = { mesh_pool.vertex_buffer() };
         VkDeviceSize offsets[] = { 0 };
         vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
 
-        vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
-
-        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets[current_frame], 0, nullptr);
-
-        vkCmdDrawIndexed(command_buffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-        vkCmdEndRenderPass(command_buffer);
+        vkCmdBindIndexBuffer(command_buffer, mesh_pool.index_buffer(), 0, mesh_pool.index_type());
 
-        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to record command buffer");
-        }
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 1, &camera_offset);
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &draw_constants);
     }
 
     void create_command_pool() {
@@ -1002,10 +2445,12 @@ private:
 
         create_image(swap_chain_extent.width, swap_chain_extent.height, 1, msaa_samples, color_format,
             VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            color_image, color_image_memory);
+            (attachments.transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0) | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+            attachment_memory_properties(attachments.transient),
+            color_image, color_image_allocation);
         color_image_view = create_image_view(color_image, color_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+        attachment_extent = swap_chain_extent;
     }
 
     void create_depth_resources() {
@@ -1013,12 +2458,93 @@ private:
 
         create_image(swap_chain_extent.width, swap_chain_extent.height, 1, msaa_samples, depth_format,
             VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            depth_image, depth_image_memory);
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (scene.culls() ? VK_IMAGE_USAGE_SAMPLED_BIT : 0) |
+            (transient_depth() ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0),
+            attachment_memory_properties(transient_depth()),
+            depth_image, depth_image_allocation);
         depth_image_view = create_image_view(depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
     }
 
+    // Transient images cannot be sampled, so depth is only transient without culling.
+    bool transient_depth() const {
+        return attachments.transient && !scene.culls();
+    }
+
+    // The allocator falls back to plain device-local memory where no lazily allocated type fits.
+    static VkMemoryPropertyFlags attachment_memory_properties(bool transient) {
+        return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | (transient ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0);
+    }
+
+    // The swap chain's extent rounded down to powers of two, with every level down to 1x1.
+    void create_depth_pyramid() {
+        if (!scene.culls()) {
+            return;
+        }
+
+        auto round_down = [](uint32_t size) {
+            uint32_t power = 1;
+            while (power * 2 <= size) {
+                power *= 2;
+            }
+            return power;
+        };
+
+        depth_pyramid_extent = { round_down(swap_chain_extent.width), round_down(swap_chain_extent.height) };
+        depth_pyramid_level_count = static_cast<uint32_t>(std::floor(std::log2(std::max(depth_pyramid_extent.width, depth_pyramid_extent.height)))) + 1;
+        if (depth_pyramid_level_count > MAX_PYRAMID_LEVELS) {
+            throw std::runtime_error("vk: swap chain too large for the depth pyramid");
+        }
+
+        create_image(depth_pyramid_extent.width, depth_pyramid_extent.height, depth_pyramid_level_count, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            depth_pyramid, depth_pyramid_allocation);
+        depth_pyramid_view = create_image_view(depth_pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, depth_pyramid_level_count);
+
+        depth_pyramid_levels.resize(depth_pyramid_level_count);
+        for (uint32_t i = 0; i < depth_pyramid_level_count; i++) {
+            VkImageViewCreateInfo view_info{};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.image = depth_pyramid;
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = VK_FORMAT_R32_SFLOAT;
+            view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+
+            if (vkCreateImageView(logical_device, &view_info, nullptr, &depth_pyramid_levels[i]) != VK_SUCCESS) {
+                throw std::runtime_error("vk: failed to create depth pyramid level view");
+            }
+        }
+
+        // Only read with texelFetch, the filter does not matter.
+        if (depth_pyramid_sampler == VK_NULL_HANDLE) {
+            VkSamplerCreateInfo sampler_info{};
+            sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+            sampler_info.magFilter = VK_FILTER_NEAREST;
+            sampler_info.minFilter = VK_FILTER_NEAREST;
+            sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+            sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+            sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+            sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+            sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+            if (vkCreateSampler(logical_device, &sampler_info, nullptr, &depth_pyramid_sampler) != VK_SUCCESS) {
+                throw std::runtime_error("vk: failed to create depth pyramid sampler");
+            }
+        }
+
+        pyramid_generation++;
+        depth_pyramid_ready = false;
+    }
+
+    void destroy_depth_pyramid(VkImage image, Allocation& allocation, VkImageView view, const std::vector<VkImageView>& levels) {
+        for (VkImageView level : levels) {
+            vkDestroyImageView(logical_device, level, nullptr);
+        }
+        vkDestroyImageView(logical_device, view, nullptr);
+        allocator.destroy_image(image, allocation);
+    }
+
     bool hasStencilComponent(VkFormat format) {
         return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
     }
@@ -1027,7 +2553,7 @@ private:
         return find_supported_format(
             { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
             VK_IMAGE_TILING_OPTIMAL,
-            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | (scene.culls() ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0)
         );
     }
 
@@ -1047,50 +2573,214 @@ private:
         throw std::runtime_error("vk: failed to find supported format");
     }
 
-    void create_texture_image() {
-        int tex_width, tex_height, tex_channels;
-        stbi_uc* pixels = stbi_load(texture_path.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
-        VkDeviceSize image_size = tex_width * tex_height * 4;
-        mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(tex_width, tex_height)))) + 1;
+    bool is_format_supported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        try {
+            find_supported_format({ format }, tiling, features);
+            return true;
+        }
+        catch (const std::runtime_error&) {
+            return false;
+        }
+    }
 
-        if (!pixels) {
+    // CPU side only, so it can run on a loader thread; no device or uploader calls.
+    void load_texture() {
+        if (BAKED_TEXTURES) {
+            load_baked_texture();
+            return;
+        }
+
+        int tex_channels;
+        texture_pixels = stbi_load(texture_path.c_str(), &texture_width, &texture_height, &tex_channels, STBI_rgb_alpha);
+
+        if (!texture_pixels) {
             throw std::runtime_error("stb: failed to load texture image");
         }
+    }
 
-        VkBuffer staging_buffer;
-        VkDeviceMemory staging_buffer_memory;
-        create_buffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+    void create_texture_image() {
+        if (BAKED_TEXTURES) {
+            create_baked_texture_image();
+            return;
+        }
 
-        void* data;
-        vkMapMemory(logical_device, staging_buffer_memory, 0, image_size, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(image_size));
-        vkUnmapMemory(logical_device, staging_buffer_memory);
+        int tex_width = texture_width;
+        int tex_height = texture_height;
+        VkDeviceSize image_size = tex_width * tex_height * 4;
+        mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(tex_width, tex_height)))) + 1;
 
-        stbi_image_free(pixels);
+        bool use_compute = can_generate_mipmaps_with_compute(mip_levels) &&
+            (COMPUTE_MIPMAPS || !is_format_supported(VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT));
 
+        // sRGB formats usually cannot be storage images, so the compute path creates the image as
+        // UNORM and samples it through an sRGB view.
         create_image(tex_width, tex_height, mip_levels,
             VK_SAMPLE_COUNT_1_BIT,
-            VK_FORMAT_R8G8B8A8_SRGB,
+            use_compute ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB,
             VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                (use_compute ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT),
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             texture_image,
-            texture_image_memory);
+            texture_image_allocation,
+            use_compute ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT : 0);
 
-        transition_image_layout(texture_image,
+        transition_image_layout(uploader.command_buffer(), texture_image,
             VK_FORMAT_R8G8B8A8_SRGB,
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
-        copy_buffer_to_image(staging_buffer, texture_image, static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height), 1 };
+        uploader.upload_image(texture_image, region, texture_pixels, image_size);
+
+        stbi_image_free(texture_pixels);
+        texture_pixels = nullptr;
+
+        VkImageSubresourceRange range{};
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = mip_levels;
+        range.baseArrayLayer = 0;
+        range.layerCount = 1;
+
+        if (use_compute) {
+            // The dispatch reads and writes every level through storage views.
+            uploader.release_image(texture_image, range,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+            // NOTE: Transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps.
+            VkCommandBuffer mip_command_buffer = uploader.destination_command_buffer();
+            GpuProfiler::Scope mip_scope = gpu_profiler.begin(mip_command_buffer, "mipmaps", graphics_family);
+            generate_mipmaps_compute(mip_command_buffer, texture_image, tex_width, tex_height, mip_levels);
+            gpu_profiler.end(mip_command_buffer, mip_scope);
+            return;
+        }
+
+        // Blits need a graphics queue, so the whole chain moves over in TRANSFER_DST_OPTIMAL first.
+        uploader.release_image(texture_image, range,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
         // NOTE: Transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps.
+        VkCommandBuffer mip_command_buffer = uploader.destination_command_buffer();
+        GpuProfiler::Scope mip_scope = gpu_profiler.begin(mip_command_buffer, "mipmaps", graphics_family);
+        generate_mipmaps(mip_command_buffer, texture_image, VK_FORMAT_R8G8B8A8_SRGB, tex_width, tex_height, mip_levels);
+        gpu_profiler.end(mip_command_buffer, mip_scope);
+    }
+
+    // Opens texture_container, baking it first when it is missing or stale. Format queries only
+    // need the physical device.
+    void load_baked_texture() {
+        const VkFormatFeatureFlags sampled_features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+        uint64_t source_hash = hash_file_cached(texture_path);
+        TextureContainer& container = texture_container;
+
+        // There is no ASTC encoder here; an .astc.vtex baked by an external tool is used when the
+        // device can sample it. Otherwise BC7 or plain RGBA8, baked on first use.
+        std::string astc_path = texture_path + ".astc.vtex";
+        bool use_astc = is_format_supported(VK_FORMAT_ASTC_4x4_SRGB_BLOCK, VK_IMAGE_TILING_OPTIMAL, sampled_features) &&
+            container.open(astc_path, source_hash) && container.format() == VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
+
+        if (!use_astc) {
+            VkFormat format = find_supported_format({ VK_FORMAT_BC7_SRGB_BLOCK, VK_FORMAT_R8G8B8A8_SRGB }, VK_IMAGE_TILING_OPTIMAL, sampled_features);
+            std::string path = texture_path + (format == VK_FORMAT_BC7_SRGB_BLOCK ? ".bc7.vtex" : ".rgba8.vtex");
+
+            if (!container.open(path, source_hash) || container.format() != format) {
+                bake_texture(path, source_hash, format);
+
+                if (!container.open(path, source_hash)) {
+                    throw std::runtime_error("texture container: failed to read back " + path);
+                }
+            }
+        }
+    }
+
+    void create_baked_texture_image() {
+        const TextureContainer& container = texture_container;
+
+        texture_format = container.format();
+        mip_levels = container.level_count();
+
+        create_image(container.width(), container.height(), mip_levels,
+            VK_SAMPLE_COUNT_1_BIT,
+            texture_format,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            texture_image,
+            texture_image_allocation);
+
+        transition_image_layout(uploader.command_buffer(), texture_image,
+            texture_format,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
+
+        for (uint32_t i = 0; i < mip_levels; i++) {
+            const TextureLevel& level = container.level(i);
+
+            VkBufferImageCopy region{};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { level.width, level.height, 1 };
+            // BC7 and ASTC 4x4 both store rows of 4x4 blocks.
+            uploader.upload_image(texture_image, region, level.data, level.size, texture_format == VK_FORMAT_R8G8B8A8_SRGB ? 1 : 4);
+        }
+
+        VkImageSubresourceRange range{};
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = mip_levels;
+        range.baseArrayLayer = 0;
+        range.layerCount = 1;
+        uploader.release_image(texture_image, range,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT);
+
+        texture_container.close();
+    }
+
+    // Decodes the PNG, builds the mip chain in linear space and stores it in `format`.
+    void bake_texture(const std::string& path, uint64_t source_hash, VkFormat format) {
+        int tex_width, tex_height, tex_channels;
+        stbi_uc* pixels = stbi_load(texture_path.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
 
-        vkDestroyBuffer(logical_device, staging_buffer, nullptr);
-        vkFreeMemory(logical_device, staging_buffer_memory, nullptr);
+        if (!pixels) {
+            throw std::runtime_error("stb: failed to load texture image");
+        }
+
+        uint32_t width = static_cast<uint32_t>(tex_width);
+        uint32_t height = static_cast<uint32_t>(tex_height);
 
-        generate_mipmaps(texture_image, VK_FORMAT_R8G8B8A8_SRGB, tex_width, tex_height, mip_levels);
+        std::vector<std::vector<uint8_t>> levels = generate_srgb_mip_chain(pixels, width, height);
+        stbi_image_free(pixels);
+
+        if (format == VK_FORMAT_BC7_SRGB_BLOCK) {
+            for (size_t i = 0; i < levels.size(); i++) {
+                levels[i] = compress_bc7(levels[i].data(), std::max(1u, width >> i), std::max(1u, height >> i), worker_threads);
+            }
+        }
+
+        TextureContainer::write(path, source_hash, format, width, height, levels);
     }
 
-    void generate_mipmaps(VkImage image, VkFormat image_format, int32_t tex_width, int32_t tex_height, uint32_t mip_levels) {
+    void generate_mipmaps(VkCommandBuffer command_buffer, VkImage image, VkFormat image_format, int32_t tex_width, int32_t tex_height, uint32_t mip_levels) {
         // Check if image format supports linear blitting.
         VkFormatProperties format_properties;
         vkGetPhysicalDeviceFormatProperties(physical_device, image_format, &format_properties);
@@ -1099,8 +2789,6 @@ private:
             throw std::runtime_error("vk: texture image format does not support linear blitting");
         }
 
-        VkCommandBuffer command_buffer = begin_single_time_commands();
-
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         barrier.image = image;
@@ -1114,68 +2802,294 @@ private:
         int32_t mip_width = tex_width;
         int32_t mip_height = tex_height;
 
-        for (uint32_t i = 1; i < mip_levels; i++) {
-            barrier.subresourceRange.baseMipLevel = i - 1;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        for (uint32_t i = 1; i < mip_levels; i++) {
+            barrier.subresourceRange.baseMipLevel = i - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            vkCmdPipelineBarrier(command_buffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = { 0, 0, 0 };
+            blit.srcOffsets[1] = { mip_width, mip_height, 1 };
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = i - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = { 0, 0, 0 };
+            blit.dstOffsets[1] = { mip_width > 1 ? mip_width / 2 : 1, mip_height > 1 ? mip_height / 2 : 1, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = i;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = 1;
+
+            vkCmdBlitImage(command_buffer,
+                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit,
+                VK_FILTER_LINEAR);
+            //VK_FILTER_NEAREST);
+
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(command_buffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            if (mip_width > 1) mip_width /= 2;
+            if (mip_height > 1) mip_height /= 2;
+        }
+
+        barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+    }
+
+    bool can_generate_mipmaps_with_compute(uint32_t mip_levels) {
+        if (!storage_image_array_indexing || mip_levels > MAX_COMPUTE_MIP_LEVELS ||
+            !is_format_supported(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+            return false;
+        }
+
+        // The dispatch is recorded on the graphics queue.
+        uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+        QueueFamilyIndices indices = find_queue_families(physical_device);
+        return queue_families[indices.graphics_family.value()].queueFlags & VK_QUEUE_COMPUTE_BIT;
+    }
+
+    // One dispatch of downsample.comp writes every level, so there is no barrier per level as with
+    // blits and the format does not need linear blit support. Expects the image in GENERAL layout.
+    void generate_mipmaps_compute(VkCommandBuffer command_buffer, VkImage image, int32_t tex_width, int32_t tex_height, uint32_t mip_levels) {
+        VkDescriptorSetLayoutBinding level_binding{};
+        level_binding.binding = 0;
+        level_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        level_binding.descriptorCount = MAX_COMPUTE_MIP_LEVELS;
+        level_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutBinding counter_binding{};
+        counter_binding.binding = 1;
+        counter_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        counter_binding.descriptorCount = 1;
+        counter_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings = { level_binding, counter_binding };
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.pBindings = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(logical_device, &layout_info, nullptr, &mipmap_descriptor_set_layout) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create mipmap descriptor set layout");
+        }
+
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = 2 * sizeof(uint32_t);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &mipmap_descriptor_set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(logical_device, &pipeline_layout_info, nullptr, &mipmap_pipeline_layout) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create mipmap pipeline layout");
+        }
+
+        // Needed right away to record the dispatch; owned by the registry.
+        ComputePipelineDesc pipeline_desc{};
+        pipeline_desc.shader.path = "shaders/downsample.spv";
+        pipeline_desc.layout = mipmap_pipeline_layout;
+        VkPipeline mipmap_pipeline = pipelines.request(pipeline_desc).get();
+
+        // One UNORM view per level; the unused tail of the binding repeats the last one.
+        mipmap_level_views.resize(mip_levels);
+        for (uint32_t i = 0; i < mip_levels; i++) {
+            VkImageViewCreateInfo view_info{};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.image = image;
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+            view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            view_info.subresourceRange.baseMipLevel = i;
+            view_info.subresourceRange.levelCount = 1;
+            view_info.subresourceRange.baseArrayLayer = 0;
+            view_info.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(logical_device, &view_info, nullptr, &mipmap_level_views[i]) != VK_SUCCESS) {
+                throw std::runtime_error("vk: failed to create mip level view");
+            }
+        }
+
+        allocator.create_buffer(sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            mipmap_counter_buffer,
+            mipmap_counter_allocation);
+
+        std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+        pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pool_sizes[0].descriptorCount = MAX_COMPUTE_MIP_LEVELS;
+        pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_sizes[1].descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.pPoolSizes = pool_sizes.data();
+        pool_info.maxSets = 1;
+
+        if (vkCreateDescriptorPool(logical_device, &pool_info, nullptr, &mipmap_descriptor_pool) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to create mipmap descriptor pool");
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = mipmap_descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &mipmap_descriptor_set_layout;
+
+        VkDescriptorSet descriptor_set;
+        if (vkAllocateDescriptorSets(logical_device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
+            throw std::runtime_error("vk: failed to allocate mipmap descriptor set");
+        }
+
+        std::array<VkDescriptorImageInfo, MAX_COMPUTE_MIP_LEVELS> image_infos{};
+        for (uint32_t i = 0; i < MAX_COMPUTE_MIP_LEVELS; i++) {
+            image_infos[i].imageView = mipmap_level_views[std::min(i, mip_levels - 1)];
+            image_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        VkDescriptorBufferInfo counter_info{};
+        counter_info.buffer = mipmap_counter_buffer;
+        counter_info.offset = 0;
+        counter_info.range = sizeof(uint32_t);
+
+        std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
+        descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[0].dstSet = descriptor_set;
+        descriptor_writes[0].dstBinding = 0;
+        descriptor_writes[0].dstArrayElement = 0;
+        descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptor_writes[0].descriptorCount = MAX_COMPUTE_MIP_LEVELS;
+        descriptor_writes[0].pImageInfo = image_infos.data();
+
+        descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[1].dstSet = descriptor_set;
+        descriptor_writes[1].dstBinding = 1;
+        descriptor_writes[1].dstArrayElement = 0;
+        descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptor_writes[1].descriptorCount = 1;
+        descriptor_writes[1].pBufferInfo = &counter_info;
 
-            vkCmdPipelineBarrier(command_buffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
+        vkUpdateDescriptorSets(logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
 
-            VkImageBlit blit{};
-            blit.srcOffsets[0] = { 0, 0, 0 };
-            blit.srcOffsets[1] = { mip_width, mip_height, 1 };
-            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.srcSubresource.mipLevel = i - 1;
-            blit.srcSubresource.baseArrayLayer = 0;
-            blit.srcSubresource.layerCount = 1;
-            blit.dstOffsets[0] = { 0, 0, 0 };
-            blit.dstOffsets[1] = { mip_width > 1 ? mip_width / 2 : 1, mip_height > 1 ? mip_height / 2 : 1, 1 };
-            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.dstSubresource.mipLevel = i;
-            blit.dstSubresource.baseArrayLayer = 0;
-            blit.dstSubresource.layerCount = 1;
+        // The shader leaves the counter at zero after every dispatch, but fresh memory is undefined.
+        vkCmdFillBuffer(command_buffer, mipmap_counter_buffer, 0, sizeof(uint32_t), 0);
 
-            vkCmdBlitImage(command_buffer,
-                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1, &blit,
-                VK_FILTER_LINEAR);
-            //VK_FILTER_NEAREST);
+        VkMemoryBarrier fill_barrier{};
+        fill_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        fill_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        fill_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &fill_barrier,
+            0, nullptr,
+            0, nullptr);
 
-            vkCmdPipelineBarrier(command_buffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
+        // Each workgroup covers a 64x64 tile of mip 0.
+        uint32_t workgroups_x = (static_cast<uint32_t>(tex_width) + 63) / 64;
+        uint32_t workgroups_y = (static_cast<uint32_t>(tex_height) + 63) / 64;
+        uint32_t push_constants[2] = { mip_levels, workgroups_x * workgroups_y };
 
-            if (mip_width > 1) mip_width /= 2;
-            if (mip_height > 1) mip_height /= 2;
-        }
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmap_pipeline);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmap_pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+        vkCmdPushConstants(command_buffer, mipmap_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), push_constants);
+        vkCmdDispatch(command_buffer, workgroups_x, workgroups_y, 1);
 
-        barrier.subresourceRange.baseMipLevel = mip_levels - 1;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
         barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mip_levels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
         vkCmdPipelineBarrier(command_buffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
             0, nullptr,
             0, nullptr,
             1, &barrier);
+    }
+
+    void destroy_scene_resources() {
+        if (draw_descriptor_set_layout == VK_NULL_HANDLE) {
+            return;
+        }
+
+        for (size_t i = 0; i < draw_buffers.size(); i++) {
+            allocator.destroy_buffer(draw_buffers[i], draw_buffer_allocations[i]);
+        }
+        for (size_t i = 0; i < scene_mesh_buffers.size(); i++) {
+            allocator.destroy_buffer(scene_mesh_buffers[i], scene_mesh_allocations[i]);
+        }
+        allocator.destroy_buffer(scene_object_buffer, scene_object_allocation);
+
+        vkDestroyPipelineLayout(logical_device, draw_pipeline_layout, nullptr);
+        vkDestroyDescriptorSetLayout(logical_device, draw_descriptor_set_layout, nullptr);
+
+        if (pyramid_pipeline_layout != VK_NULL_HANDLE) {
+            vkDestroyPipelineLayout(logical_device, pyramid_pipeline_layout, nullptr);
+            vkDestroyDescriptorSetLayout(logical_device, pyramid_descriptor_set_layout, nullptr);
+            vkDestroySampler(logical_device, depth_pyramid_sampler, nullptr);
+        }
+    }
+
+    void destroy_mipmap_resources() {
+        if (mipmap_pipeline_layout == VK_NULL_HANDLE) {
+            return;
+        }
 
-        end_single_time_commands(command_buffer);
+        vkDestroyPipelineLayout(logical_device, mipmap_pipeline_layout, nullptr);
+        vkDestroyDescriptorPool(logical_device, mipmap_descriptor_pool, nullptr);
+        vkDestroyDescriptorSetLayout(logical_device, mipmap_descriptor_set_layout, nullptr);
+        for (VkImageView view : mipmap_level_views) {
+            vkDestroyImageView(logical_device, view, nullptr);
+        }
+        allocator.destroy_buffer(mipmap_counter_buffer, mipmap_counter_allocation);
     }
 
     VkSampleCountFlagBits get_max_usable_sample_count() {
@@ -1185,6 +3099,10 @@ private:
         VkSampleCountFlags counts =
             physical_device_properties.limits.framebufferColorSampleCounts &
             physical_device_properties.limits.framebufferDepthSampleCounts;
+        // Sample counts are their own flag bits, so this drops every count above the cap.
+        if (max_msaa_samples != 0) {
+            counts &= (max_msaa_samples << 1) - 1;
+        }
         if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
         if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
         if (counts & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
@@ -1195,13 +3113,22 @@ private:
         return VK_SAMPLE_COUNT_1_BIT;
     }
 
+    // The compute mip path creates the image as UNORM with STORAGE usage, which the sRGB format
+    // does not support, so the view sampling it asks for SAMPLED only. The storage views of the
+    // mip levels stay UNORM.
     void create_texture_image_view() {
-        texture_image_view = create_image_view(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels);
+        texture_image_view = create_image_view(texture_image, texture_format, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels, VK_IMAGE_USAGE_SAMPLED_BIT);
     }
 
-    VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels) {
+    // usage narrows what the view is used for when the image's usage does not all apply to its format.
+    VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels, VkImageUsageFlags usage = 0) {
+        VkImageViewUsageCreateInfo usage_info{};
+        usage_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+        usage_info.usage = usage;
+
         VkImageViewCreateInfo view_info{};
         view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.pNext = usage != 0 ? &usage_info : nullptr;
         view_info.image = image;
         view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
         view_info.format = format;
@@ -1252,9 +3179,10 @@ private:
     void create_image(
         uint32_t width, uint32_t height, uint32_t mip_levels, VkSampleCountFlagBits num_samples,
         VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-        VkImage& image, VkDeviceMemory& imageMemory) {
+        VkImage& image, Allocation& allocation, VkImageCreateFlags flags = 0) {
         VkImageCreateInfo image_info{};
         image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.flags = flags;
         image_info.imageType = VK_IMAGE_TYPE_2D;
         image_info.extent.width = width;
         image_info.extent.height = height;
@@ -1268,28 +3196,10 @@ private:
         image_info.samples = num_samples;
         image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        if (vkCreateImage(logical_device, &image_info, nullptr, &image) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create image");
-        }
-
-        VkMemoryRequirements mem_requirements;
-        vkGetImageMemoryRequirements(logical_device, image, &mem_requirements);
-
-        VkMemoryAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = mem_requirements.size;
-        alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to allocate image memory");
-        }
-
-        vkBindImageMemory(logical_device, image, imageMemory, 0);
+        allocator.create_image(image_info, properties, image, allocation);
     }
 
-    void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels) {
-        VkCommandBuffer command_buffer = begin_single_time_commands();
-
+    void transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels) {
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         barrier.oldLayout = old_layout;
@@ -1332,198 +3242,62 @@ private:
             0, nullptr,
             1, &barrier
         );
-
-        end_single_time_commands(command_buffer);
-    }
-
-    void copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-        VkCommandBuffer command_buffer = begin_single_time_commands();
-
-        VkBufferImageCopy region{};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-        region.imageOffset = { 0, 0, 0 };
-        region.imageExtent = {
-            width,
-            height,
-            1
-        };
-
-        vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-        end_single_time_commands(command_buffer);
-    }
-
-    VkCommandBuffer begin_single_time_commands() {
-        VkCommandBufferAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        alloc_info.commandPool = command_pool;
-        alloc_info.commandBufferCount = 1;
-
-        VkCommandBuffer command_buffer;
-        vkAllocateCommandBuffers(logical_device, &alloc_info, &command_buffer);
-
-        VkCommandBufferBeginInfo begin_info{};
-        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-        vkBeginCommandBuffer(command_buffer, &begin_info);
-
-        return command_buffer;
-    }
-
-    void end_single_time_commands(VkCommandBuffer command_buffer) {
-        vkEndCommandBuffer(command_buffer);
-
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffer;
-
-        vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphics_queue);
-
-        vkFreeCommandBuffers(logical_device, command_pool, 1, &command_buffer);
-    }
-
-    VkShaderModule create_shader_module(const std::vector<char>& code) {
-        VkShaderModuleCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        create_info.codeSize = code.size();
-        create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-        VkShaderModule shader_module;
-        if (vkCreateShaderModule(logical_device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create shader module");
-        }
-
-        return shader_module;
-    }
-
-    void create_surface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create window surface");
-        }
-    }
-
-    void populate_debug_messenger_create_info(VkDebugUtilsMessengerCreateInfoEXT& create_info) {
-        create_info = {};
-        create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        create_info.pfnUserCallback = debug_callback;
-    }
-
-    bool check_validation_layer_support() {
-        uint32_t layer_count;
-        vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-
-        std::vector<VkLayerProperties> available_layers(layer_count);
-        vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
-
-        for (const char* layer_name : validation_layers) {
-            bool layer_found = false;
-
-            for (const auto& layer_properties : available_layers) {
-                if (strcmp(layer_name, layer_properties.layerName) == 0) {
-                    layer_found = true;
-                    break;
-                }
-            }
-
-            if (!layer_found) {
-                return false;
-            }
-        }
-
-        return true;
-    }
-
-    std::vector<const char*> get_required_extensions() {
-        uint32_t glfw_extension_count = 0;
-        const char** glfw_extensions;
-        glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-
-        std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
-
-        if (enable_validation_layers) {
-            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-        }
-
-        return extensions;
     }
 
-    void pick_physical_device() {
-        uint32_t device_count = 0;
-        vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
-
-        if (device_count == 0) {
-            throw std::runtime_error("vk: failed to find GPUs with Vulkan support");
-        }
-
-        std::vector<VkPhysicalDevice> devices(device_count);
-        vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
-
-        for (const auto& device : devices) {
-            if (is_device_suitable(device)) {
-                physical_device = device;
-                msaa_samples = get_max_usable_sample_count();
-                break;
-            }
-        }
-
-        if (physical_device == VK_NULL_HANDLE) {
-            throw std::runtime_error("vk: failed to find a suitable GPU");
-        }
+    VkExtent2D framebuffer_extent() {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
     }
 
     bool is_device_suitable(VkPhysicalDevice device) {
         QueueFamilyIndices indices = find_queue_families(device);
 
-        bool extensions_supported = check_device_extension_support(device);
+        bool extensions_supported = supports_device_extensions(device, required_device_extensions(headless));
 
-        bool swap_chain_adequate = false;
-        if (extensions_supported) {
-            SwapChainSupportDetails swap_chain_support = query_swap_chain_support(device);
-            swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+        bool swap_chain_adequate = headless;
+        if (extensions_supported && !headless) {
+            swap_chain_adequate = query_swap_chain_support(device, surface).is_adequate();
         }
 
         VkPhysicalDeviceFeatures supported_features;
         vkGetPhysicalDeviceFeatures(device, &supported_features);
 
-        return indices.is_complete() && extensions_supported && swap_chain_adequate /* && supported_features.samplerAnisotropy */;
+        return indices.is_complete() && extensions_supported && swap_chain_adequate /* && supported_features.samplerAnisotropy */ &&
+            (!scene.enabled() || supports_scene_rendering(device));
     }
 
-    VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats) {
-        for (const auto& available_format : available_formats) {
-            if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-                return available_format;
-            }
+    // Vulkan 1.2 for descriptor indexing, multi-draw indirect with firstInstance, and compute on the
+    // graphics queue to build the draws. vkCmdDrawIndexedIndirectCount is used where available.
+    bool supports_scene_rendering(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2 || properties.limits.maxDrawIndirectCount < scene.object_count) {
+            return false;
         }
 
-        return available_formats[0];
-    }
-
-    bool check_device_extension_support(VkPhysicalDevice device) {
-        uint32_t extension_count;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+        VkPhysicalDeviceVulkan12Features vulkan12_features{};
+        vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 
-        std::vector<VkExtensionProperties> available_extensions(extension_count);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &vulkan12_features;
+        vkGetPhysicalDeviceFeatures2(device, &features);
 
-        std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
-
-        for (const auto& extension : available_extensions) {
-            required_extensions.erase(extension.extensionName);
+        QueueFamilyIndices indices = find_queue_families(device);
+        if (!indices.graphics_family.has_value()) {
+            return false;
         }
 
-        return required_extensions.empty();
+        uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
+
+        return features.features.multiDrawIndirect && features.features.drawIndirectFirstInstance &&
+            vulkan12_features.runtimeDescriptorArray && vulkan12_features.shaderSampledImageArrayNonUniformIndexing &&
+            vulkan12_features.descriptorBindingPartiallyBound && vulkan12_features.descriptorBindingVariableDescriptorCount &&
+            (queue_families[indices.graphics_family.value()].queueFlags & VK_QUEUE_COMPUTE_BIT);
     }
 
     QueueFamilyIndices find_queue_families(VkPhysicalDevice device) {
@@ -1541,10 +3315,7 @@ private:
                 indices.graphics_family = i;
             }
 
-            VkBool32 present_support = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
-
-            if (present_support) {
+            if (supports_present(headless, device, i, queue_family, surface)) {
                 indices.present_family = i;
             }
 
@@ -1555,6 +3326,19 @@ private:
             i++;
         }
 
+        // Dedicated transfer families map to the copy engines, which run alongside graphics work.
+        for (uint32_t j = 0; j < queue_family_count; j++) {
+            VkQueueFlags flags = queue_families[j].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                indices.transfer_family = j;
+                break;
+            }
+        }
+
+        if (!indices.transfer_family.has_value()) {
+            indices.transfer_family = indices.graphics_family;
+        }
+
         return indices;
     }
 
@@ -1564,7 +3348,8 @@ private:
         std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
         std::set<uint32_t> unique_queue_families = {
             indices.graphics_family.value(),
-            indices.present_family.value()
+            indices.present_family.value(),
+            indices.transfer_family.value()
         };
 
         float queue_priority = 1.0f;
@@ -1577,9 +3362,19 @@ private:
             queue_create_infos.push_back(queue_create_info);
         }
 
+        VkPhysicalDeviceFeatures supported_features;
+        vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+
         VkPhysicalDeviceFeatures device_features{};
         device_features.samplerAnisotropy = VK_TRUE;
         device_features.sampleRateShading = VK_TRUE;
+        device_features.textureCompressionBC = supported_features.textureCompressionBC;
+        device_features.textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR;
+        device_features.shaderStorageImageArrayDynamicIndexing = supported_features.shaderStorageImageArrayDynamicIndexing;
+        storage_image_array_indexing = supported_features.shaderStorageImageArrayDynamicIndexing;
+
+        bool use_pipeline_statistics = profiling.pipeline_statistics && supported_features.pipelineStatisticsQuery;
+        device_features.pipelineStatisticsQuery = use_pipeline_statistics ? VK_TRUE : VK_FALSE;
 
         VkDeviceCreateInfo create_info{};
         create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -1589,12 +3384,53 @@ private:
 
         create_info.pEnabledFeatures = &device_features;
 
-        create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-        create_info.ppEnabledExtensionNames = device_extensions.data();
+        // Checked by supports_scene_rendering(), except drawIndirectCount.
+        VkPhysicalDeviceVulkan12Features vulkan12_features{};
+        vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        if (scene.enabled()) {
+            VkPhysicalDeviceVulkan12Features supported_vulkan12_features{};
+            supported_vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+            VkPhysicalDeviceFeatures2 supported_features2{};
+            supported_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            supported_features2.pNext = &supported_vulkan12_features;
+            vkGetPhysicalDeviceFeatures2(physical_device, &supported_features2);
+
+            device_features.multiDrawIndirect = VK_TRUE;
+            device_features.drawIndirectFirstInstance = VK_TRUE;
+            vulkan12_features.runtimeDescriptorArray = VK_TRUE;
+            vulkan12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            vulkan12_features.descriptorBindingPartiallyBound = VK_TRUE;
+            vulkan12_features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+            vulkan12_features.drawIndirectCount = supported_vulkan12_features.drawIndirectCount;
+            draw_indirect_count = supported_vulkan12_features.drawIndirectCount;
+
+            create_info.pNext = &vulkan12_features;
+        }
+
+        std::vector<const char*> enabled_extensions = required_device_extensions(headless);
+        bool use_present_wait = !headless && pacing.low_latency && PresentWaiter::is_supported(physical_device);
+        if (use_present_wait) {
+            const auto& present_wait_extensions = PresentWaiter::device_extensions();
+            enabled_extensions.insert(enabled_extensions.end(), present_wait_extensions.begin(), present_wait_extensions.end());
+            create_info.pNext = present_waiter.device_create_next(create_info.pNext);
+        }
+
+        // Sizes the mesh pool by what the heap has left, other processes included.
+        VkPhysicalDeviceProperties device_properties;
+        vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+        bool use_memory_budget = device_properties.apiVersion >= VK_API_VERSION_1_1 &&
+            supports_device_extensions(physical_device, { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME });
+        if (use_memory_budget) {
+            enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions.size());
+        create_info.ppEnabledExtensionNames = enabled_extensions.data();
 
-        if (enable_validation_layers) {
-            create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-            create_info.ppEnabledLayerNames = validation_layers.data();
+        if (instance.is_validation_enabled()) {
+            create_info.enabledLayerCount = static_cast<uint32_t>(VulkanInstance::validation_layers().size());
+            create_info.ppEnabledLayerNames = VulkanInstance::validation_layers().data();
         }
         else {
             create_info.enabledLayerCount = 0;
@@ -1606,39 +3442,51 @@ private:
 
         vkGetDeviceQueue(logical_device, indices.graphics_family.value(), 0, &graphics_queue);
         vkGetDeviceQueue(logical_device, indices.present_family.value(), 0, &present_queue);
-    }
-
-    SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device) {
-        SwapChainSupportDetails details;
+        vkGetDeviceQueue(logical_device, indices.transfer_family.value(), 0, &transfer_queue);
+        graphics_family = indices.graphics_family.value();
 
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-
-        uint32_t format_count;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, nullptr);
-
-        if (format_count != 0) {
-            details.formats.resize(format_count);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, details.formats.data());
-        }
-
-        uint32_t present_mode_count;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, nullptr);
-
-        if (present_mode_count != 0) {
-            details.present_modes.resize(present_mode_count);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, details.present_modes.data());
+        present_waiter.init(logical_device, use_present_wait);
+        allocator.init(physical_device, logical_device);
+        if (use_memory_budget) {
+            allocator.enable_memory_budget();
         }
-
-        return details;
+        pipeline_cache.init(physical_device, logical_device, pipeline_cache_path);
+        pipelines.init(logical_device, pipeline_cache.handle());
+        pipeline_reloader.init(pipelines, shader_reloader);
+        gpu_profiler.init(physical_device, logical_device, frames_in_flight, profiling.csv_path, use_pipeline_statistics);
+        uploader.init(logical_device, allocator,
+            transfer_queue, indices.transfer_family.value(),
+            graphics_queue, indices.graphics_family.value());
+        uploader.set_profiler(&gpu_profiler);
     }
 
     void main_loop() {
+        bool first_frame = true;
         while (!glfwWindowShouldClose(window)) {
+            // In low-latency mode input is only sampled once the previous frame is on screen.
+            present_waiter.wait_for_last_present();
             glfwPollEvents();
+
+            // Time to first frame is the startup cost users actually see.
+            if (first_frame) {
+                startup.begin("first_frame");
+            }
             draw_frame();
+            if (first_frame) {
+                startup.end();
+                std::cout << "startup: " << startup.summary() << std::endl;
+                first_frame = false;
+            }
+
+            double current_time = glfwGetTime();
+            if (current_time - last_title_time >= 1.0) {
+                glfwSetWindowTitle(window, ("Vulkan | " + gpu_profiler.summary()).c_str());
+                last_title_time = current_time;
+            }
         }
 
         vkDeviceWaitIdle(logical_device);
+        std::cout << gpu_profiler.report();
     }
 
     void update_uniform_buffer(uint32_t current_image) {
@@ -1647,21 +3495,135 @@ private:
         auto current_time = std::chrono::high_resolution_clock::now();
         float elapsed_time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
 
-        UniformBufferObject ubo{};
-        ubo.model = glm::rotate(glm::mat4(1.0f), elapsed_time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.proj = glm::perspective(glm::radians(45.0f), swap_chain_extent.width / (float)swap_chain_extent.height, 0.1f, 10.0f);
-        ubo.proj[1][1] *= -1;
+        // The frame's fence has signalled, so its region of the arena is free again.
+        uniform_arena.begin_frame(current_image);
+
+        update_camera();
+        camera_offset = uniform_arena.push(camera);
+
+        // Scene objects carry the dequantization in their own matrices.
+        glm::mat4 spin = glm::rotate(glm::mat4(1.0f), elapsed_time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        draw_constants.model = scene.enabled() ? spin : spin * position_dequantization;
+
+        select_model_level(spin);
+
+        if (scene.enabled()) {
+            write_scene_mesh_table(current_image);
+            update_cull_data();
+        }
+
+        // Each instance spins about its own center. Written straight into the mapped buffer.
+        if (scene.instanced()) {
+            glm::mat4* instances = instance_buffers_mapped[current_image];
+            float spin_angle = elapsed_time * glm::radians(90.0f);
+            for (uint32_t i = 0; i < scene.instance_count; i++) {
+                instances[i] = grid_cell_transform(grid_position(i, scene.instance_count), grid_turn(i) + spin_angle);
+            }
+        }
+    }
+
+    // Requests the level the nearest part of the model, or of the grid of copies, needs and picks
+    // what the classic path draws: that level, or the nearest coarser one until it is resident.
+    // Scene objects pick their own levels on the GPU.
+    void select_model_level(const glm::mat4& spin) {
+        glm::vec3 eye = glm::vec3(glm::inverse(camera.view)[3]);
+        // Grids are centered on the origin and fit_view_to_grid() scaled the view to their radius.
+        glm::vec3 center = scene.enabled() || scene.instanced() ? glm::vec3(0.0f) : glm::vec3(spin * glm::vec4(glm::vec3(model_bounds), 1.0f));
+        float distance = std::max(glm::length(eye - center) - view_scale * model_bounds.w, NEAR_PLANE);
+
+        uint32_t level = lod_for_distance(distance);
+        mesh_streamer.request(model_mesh, level);
+        model_range = *mesh_streamer.resident_range(model_mesh, mesh_streamer.resident_level(model_mesh, level));
+    }
+
+    // MAX_MESH_LODS entries per streamed mesh; levels that are not resident have no indices.
+    void write_scene_mesh_table(uint32_t frame) {
+        SceneMesh* table = scene_mesh_tables[frame];
+        for (uint32_t mesh = 0; mesh < mesh_streamer.mesh_count(); mesh++) {
+            for (uint32_t level = 0; level < MAX_MESH_LODS; level++) {
+                const MeshRange* range = level < mesh_streamer.level_count(mesh) ? mesh_streamer.resident_range(mesh, level) : nullptr;
+                table[mesh * MAX_MESH_LODS + level] = range != nullptr ? SceneMesh{ range->index_count, range->first_index, range->vertex_offset } : SceneMesh{};
+            }
+        }
+    }
+
+    void update_camera() {
+        if (camera_extent.width == swap_chain_extent.width && camera_extent.height == swap_chain_extent.height && camera_view_scale == view_scale) {
+            return;
+        }
+
+        camera.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f) * view_scale, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        camera.proj = glm::perspective(FIELD_OF_VIEW, swap_chain_extent.width / (float)swap_chain_extent.height, NEAR_PLANE, 10.0f * view_scale);
+        camera.proj[1][1] *= -1;
+
+        camera_extent = swap_chain_extent;
+        camera_view_scale = view_scale;
+    }
+
+    // Frustum planes of this frame in scene space, for a depth range of [0, 1], and the matrices
+    // of the frame the pyramid was built from.
+    void update_cull_data() {
+        current_view = camera.view * draw_constants.model;
+        current_projection = camera.proj;
+
+        glm::mat4 clip = camera.proj * current_view;
+        auto row = [&](int i) { return glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]); };
+
+        CullData cull{};
+        cull.frustum_planes[0] = row(3) + row(0);
+        cull.frustum_planes[1] = row(3) - row(0);
+        cull.frustum_planes[2] = row(3) + row(1);
+        cull.frustum_planes[3] = row(3) - row(1);
+        cull.frustum_planes[4] = row(2);
+        cull.frustum_planes[5] = row(3) - row(2);
+        for (glm::vec4& plane : cull.frustum_planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+
+        cull.previous_view = previous_view;
+        cull.previous_projection = previous_projection;
+        cull.pyramid_size = glm::vec2(depth_pyramid_extent.width, depth_pyramid_extent.height);
+        cull.pyramid_levels = depth_pyramid_level_count;
+        cull.occlusion_ready = depth_pyramid_ready ? 1 : 0;
+        cull.near_plane = NEAR_PLANE;
+        cull.lod_scale = lod_scale();
+        cull.lod_count = streaming.lod_count;
+        cull.camera_position = glm::inverse(current_view)[3];
+        for (uint32_t level = 0; level < streaming.lod_count; level++) {
+            cull.lod_errors[level] = lod_error(level);
+        }
+
+        cull_offset = uniform_arena.push(cull);
+    }
 
-        memcpy(uniform_buffers_mapped[current_image], &ubo, sizeof(ubo));
+    void reset_recording_pools(uint32_t frame) {
+        for (auto& recording_pool : recording_pools[frame]) {
+            vkResetCommandPool(logical_device, recording_pool.pool, 0);
+            recording_pool.used = 0;
+        }
     }
 
     void draw_frame() {
         vkWaitForFences(logical_device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+        gpu_profiler.begin_frame(current_frame);
+
+        // The fence belongs to the frame submitted frames_in_flight frames ago, and a fence also
+        // covers everything submitted to the queue before it.
+        uint64_t completed_frames = submitted_frames >= frames_in_flight ? submitted_frames - frames_in_flight + 1 : 0;
+        if (completed_frames > 0) {
+            destroy_retired_swap_chains(completed_frames);
+        }
+        mesh_streamer.update(uploader, submitted_frames, completed_frames);
+        for (const std::string& error : pipeline_reloader.update(submitted_frames, completed_frames)) {
+            log() << error << std::endl;
+        }
 
         uint32_t image_index;
-        VkResult result = vkAcquireNextImageKHR(logical_device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        VkResult result = headless ? VK_SUCCESS : vkAcquireNextImageKHR(logical_device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+        if (headless) {
+            image_index = offscreen_targets.next_image();
+        }
+        else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
             recreate_swap_chain();
             return;
         }
@@ -1674,6 +3636,9 @@ private:
         vkResetFences(logical_device, 1, &in_flight_fences[current_frame]);
 
         vkResetCommandBuffer(command_buffers[current_frame], 0);
+        if (PARALLEL_RECORDING) {
+            reset_recording_pools(current_frame);
+        }
         record_command_buffer(command_buffers[current_frame], image_index);
 
         VkSubmitInfo submit_info{};
@@ -1681,7 +3646,7 @@ private:
 
         VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame] };
         VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        submit_info.waitSemaphoreCount = 1;
+        submit_info.waitSemaphoreCount = headless ? 0 : 1;
         submit_info.pWaitSemaphores = wait_semaphores;
         submit_info.pWaitDstStageMask = wait_stages;
 
@@ -1689,12 +3654,18 @@ private:
         submit_info.pCommandBuffers = &command_buffers[current_frame];
 
         VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame] };
-        submit_info.signalSemaphoreCount = 1;
+        submit_info.signalSemaphoreCount = headless ? 0 : 1;
         submit_info.pSignalSemaphores = signal_semaphores;
 
         if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to submit draw command buffer");
         }
+        submitted_frames++;
+
+        if (headless) {
+            current_frame = (current_frame + 1) % frames_in_flight;
+            return;
+        }
 
         VkPresentInfoKHR present_info{};
         present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1706,6 +3677,7 @@ private:
         present_info.swapchainCount = 1;
         present_info.pSwapchains = swap_chains;
         present_info.pImageIndices = &image_index;
+        present_info.pNext = present_waiter.next_present(swap_chain, present_info.pNext);
 
         result = vkQueuePresentKHR(present_queue, &present_info);
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized) {
@@ -1716,89 +3688,99 @@ private:
             throw std::runtime_error("vk: failed to present swap chain image");
         }
 
-        current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+        current_frame = (current_frame + 1) % frames_in_flight;
     }
 
     void cleanup() {
         cleanup_swap_chain();
 
-        vkDestroyPipeline(logical_device, graphics_pipeline, nullptr);
+        shader_reloader.cleanup();
+        pipeline_reloader.cleanup();
+        pipelines.cleanup();
         vkDestroyPipelineLayout(logical_device, pipeline_layout, nullptr);
         vkDestroyRenderPass(logical_device, render_pass, nullptr);
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroyBuffer(logical_device, uniformBuffers[i], nullptr);
-            vkFreeMemory(logical_device, uniformBuffersMemory[i], nullptr);
+        uniform_arena.cleanup();
+        for (size_t i = 0; i < instance_buffers.size(); i++) {
+            allocator.destroy_buffer(instance_buffers[i], instance_buffer_allocations[i]);
         }
 
         vkDestroyDescriptorPool(logical_device, descriptor_pool, nullptr);
+        destroy_scene_resources();
 
         vkDestroySampler(logical_device, texture_sampler, nullptr);
         vkDestroyImageView(logical_device, texture_image_view, nullptr);
 
-        vkDestroyImage(logical_device, texture_image, nullptr);
-        vkFreeMemory(logical_device, texture_image_memory, nullptr);
+        destroy_mipmap_resources();
 
-        vkDestroyDescriptorSetLayout(logical_device, descriptor_set_layout, nullptr);
+        allocator.destroy_image(texture_image, texture_image_allocation);
 
-        vkDestroyBuffer(logical_device, index_buffer, nullptr);
-        vkFreeMemory(logical_device, index_buffer_memory, nullptr);
+        vkDestroyDescriptorSetLayout(logical_device, descriptor_set_layout, nullptr);
 
-        vkDestroyBuffer(logical_device, vertex_buffer, nullptr);
-        vkFreeMemory(logical_device, vertex_buffer_memory, nullptr);
+        mesh_streamer.cleanup();
+        mesh_pool.cleanup();
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        for (size_t i = 0; i < frames_in_flight; i++) {
             vkDestroySemaphore(logical_device, render_finished_semaphores[i], nullptr);
             vkDestroySemaphore(logical_device, image_available_semaphores[i], nullptr);
             vkDestroyFence(logical_device, in_flight_fences[i], nullptr);
         }
 
         vkDestroyCommandPool(logical_device, command_pool, nullptr);
-        vkDestroyDevice(logical_device, nullptr);
 
-        if (enable_validation_layers) {
-            DestroyDebugUtilsMessengerEXT(instance, debug_messenger, nullptr);
+        for (auto& frame_pools : recording_pools) {
+            for (auto& recording_pool : frame_pools) {
+                vkDestroyCommandPool(logical_device, recording_pool.pool, nullptr);
+            }
         }
+        worker_threads.cleanup();
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
-
-        glfwDestroyWindow(window);
-        glfwTerminate();
-    }
-
-    static std::vector<char> read_file(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        uploader.cleanup();
+        gpu_profiler.cleanup();
+        allocator.cleanup();
+        pipeline_cache.cleanup();
+        vkDestroyDevice(logical_device, nullptr);
 
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to open file.");
+        if (!headless) {
+            vkDestroySurfaceKHR(instance.handle(), surface, nullptr);
         }
+        instance.cleanup();
 
-        size_t file_size = (size_t)file.tellg();
-        std::vector<char> buffer(file_size);
-
-        file.seekg(0);
-        file.read(buffer.data(), file_size);
-
-        file.close();
-
-        return buffer;
-    }
-
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
-        VkDebugUtilsMessageSeverityFlagBitsEXT message_severity, VkDebugUtilsMessageTypeFlagsEXT message_type,
-        const VkDebugUtilsMessengerCallbackDataEXT* callback_data, void* user_data) {
-        std::cerr << "validation layer: " << callback_data->pMessage << std::endl;
-
-        return VK_FALSE;
+        if (!headless) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
     }
 };
 
-int main() {
-    TriangleApplication app;
-
+int main(int argc, char** argv) {
     try {
-        app.run();
+        FramePacing pacing = FramePacing::from_command_line(argc, argv);
+        SceneSettings scene = SceneSettings::from_command_line(argc, argv);
+        StreamingSettings streaming = StreamingSettings::from_command_line(argc, argv);
+        AttachmentSettings attachments = AttachmentSettings::from_command_line(argc, argv);
+        ShaderReloadSettings shader_reload = ShaderReloadSettings::from_command_line(argc, argv);
+        GpuProfilerOptions profiling = GpuProfilerOptions::from_command_line(argc, argv);
+        BenchmarkSettings benchmark = BenchmarkSettings::from_command_line(argc, argv);
+
+        if (benchmark.enabled) {
+            // A fresh instance and device per sample count, so every run starts up the same way.
+            std::vector<uint32_t> msaa_levels = benchmark.msaa_levels;
+            if (msaa_levels.empty()) {
+                msaa_levels.push_back(0);
+            }
+
+            BenchmarkReport report("ModelLoading");
+            for (uint32_t msaa : msaa_levels) {
+                TriangleApplication app;
+                report.add_run(app.run_benchmark(pacing, scene, streaming, attachments, profiling, benchmark, msaa));
+            }
+            report.write(benchmark.output_path);
+        }
+        else {
+            TriangleApplication app;
+            app.run(pacing, scene, streaming, attachments, shader_reload, profiling);
+        }
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
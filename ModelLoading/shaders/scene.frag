@@ -0,0 +1,14 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Every texture of the scene, bound once; objects pick theirs by index.
+layout(binding = 2) uniform sampler2D textures[];
+
+layout(location = 0) in vec2 frag_tex_coord;
+layout(location = 1) flat in uint frag_texture;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    out_color = texture(textures[nonuniformEXT(frag_texture)], frag_tex_coord);
+}
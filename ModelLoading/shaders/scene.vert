@@ -0,0 +1,38 @@
+#version 450
+
+// Scene mode: every object is one instance of an indirect draw, and firstInstance is its index
+// into the object buffer.
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+} draw;
+
+struct SceneObject {
+    mat4 model;
+    vec4 bounds;
+    uint mesh;
+    uint texture;
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    SceneObject objects[];
+};
+
+// Either vertex layout; the pipeline binds position and texture coordinates to these.
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 tex_coord;
+
+layout(location = 0) out vec2 frag_tex_coord;
+layout(location = 1) flat out uint frag_texture;
+
+void main() {
+    SceneObject object = objects[gl_InstanceIndex];
+    gl_Position = ubo.proj * ubo.view * draw.model * object.model * vec4(position, 1.0);
+    frag_tex_coord = tex_coord;
+    frag_texture = object.texture;
+}
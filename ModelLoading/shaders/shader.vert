@@ -1,20 +1,33 @@
 #version 450
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+} draw;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec2 tex_coord;
 
+#ifdef INSTANCED
+// Per instance, in place of draw.model.
+layout(location = 4) in mat4 instance_model;
+#endif
+
 layout(location = 0) out vec3 frag_color;
 layout(location = 1) out vec2 frag_tex_coord;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
+#ifdef INSTANCED
+    mat4 model = instance_model;
+#else
+    mat4 model = draw.model;
+#endif
+    gl_Position = ubo.proj * ubo.view * model * vec4(position, 1.0);
     frag_color = color;
     frag_tex_coord = tex_coord;
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#version 450
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+} draw;
+
+// Vertex color shared by the whole mesh.
+layout(constant_id = 0) const float color_r = 1.0;
+layout(constant_id = 1) const float color_g = 1.0;
+layout(constant_id = 2) const float color_b = 1.0;
+
+// Unorm16 relative to the mesh bounds; draw.model maps it back to model space.
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 tex_coord;
+
+#ifdef INSTANCED
+// Per instance, in place of draw.model.
+layout(location = 4) in mat4 instance_model;
+#endif
+
+layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec2 frag_tex_coord;
+
+void main() {
+#ifdef INSTANCED
+    mat4 model = instance_model;
+#else
+    mat4 model = draw.model;
+#endif
+    gl_Position = ubo.proj * ubo.view * model * vec4(position, 1.0);
+    frag_color = vec3(color_r, color_g, color_b);
+    frag_tex_coord = tex_coord;
+}
\ No newline at end of file
@@ -11,32 +11,24 @@
 #include <fstream>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <optional>
 #include <set>
 #include <limits>
 #include <algorithm>
 #include <array>
+#include <string>
+
+#include "benchmark.h"
+#include "frame_loop.h"
+#include "frame_pacing.h"
+#include "gpu_profiler.h"
+#include "vulkan_bootstrap.h"
 
 constexpr int width = 800;
 constexpr int height = 600;
 
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-const std::vector<const char*> device_extensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
-};
-
-const std::vector<const char*> validation_layers = {
-    "VK_LAYER_KHRONOS_validation"
-};
-
-#ifdef NDEBUG
-const bool enable_validation_layers = false;
-#else
-const bool enable_validation_layers = true;
-#endif
-
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphics_family;
     std::optional<uint32_t> present_family;
@@ -46,12 +38,6 @@ struct QueueFamilyIndices {
     }
 };
 
-struct SwapChainSupportDetails {
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> present_modes;
-};
-
 struct Vertex {
     glm::vec2 pos;
     glm::vec3 color;
@@ -88,47 +74,67 @@ const std::vector<Vertex> vertices = {
     {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
 };
 
-uint32_t current_frame = 0;
-
 class TriangleApplication {
 public:
-    void run() {
+    void run(const FramePacing& pacing) {
+        this->pacing = pacing;
+        frames_in_flight = pacing.frames_in_flight;
+
         init_window();
         init_vulkan();
         main_loop();
         cleanup();
     }
 
+    // Offscreen, without a window; see BenchmarkSettings.
+    BenchmarkRun run_benchmark(const FramePacing& pacing, const BenchmarkSettings& settings) {
+        this->pacing = pacing;
+        frames_in_flight = pacing.frames_in_flight;
+        headless = true;
+
+        init_vulkan();
+
+        BenchmarkRun run;
+        run.config = { { "frames_in_flight", frames_in_flight }, { "width", width }, { "height", height } };
+        run_benchmark_frames(settings, logical_device, gpu_profiler, startup, run, [this](float) { draw_frame(); });
+        run.startup_ms = startup.phases();
+        run.add_gpu_scopes(gpu_profiler);
+        run.memory_bytes = { { "buffers", buffer_memory_bytes }, { "offscreen", frame_loop.offscreen_memory_bytes() } };
+
+        cleanup();
+        return run;
+    }
+
 private:
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;
 
-    VkInstance instance;
+    // No window, surface or swap chain; frames go to offscreen targets and are never presented.
+    bool headless = false;
+    GpuProfiler gpu_profiler;
+    PhaseTimer startup;
+    uint32_t graphics_family = 0;
+    VkDeviceSize buffer_memory_bytes = 0;
+
+    FramePacing pacing;
+    uint32_t frames_in_flight = 2;
+    PresentWaiter present_waiter;
+
+    VulkanInstance instance;
     VkPhysicalDevice physical_device = VK_NULL_HANDLE;
     VkDevice logical_device;
     VkQueue graphics_queue;
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkQueue present_queue;
-    VkSwapchainKHR swap_chain;
-    std::vector<VkImage> swap_chain_images;
-    VkFormat swap_chain_image_format;
-    VkExtent2D swap_chain_extent;
-    std::vector<VkImageView> swap_chain_image_views;
+    FrameLoop frame_loop;
     VkRenderPass render_pass;
     VkPipelineLayout pipeline_layout;
     VkPipeline graphics_pipeline;
     std::vector<VkFramebuffer> swap_chain_framebuffers;
     VkCommandPool command_pool;
-    std::vector<VkCommandBuffer> command_buffers;
 
     VkBuffer vertex_buffer;
     VkDeviceMemory vertex_buffer_memory;
 
-    std::vector<VkSemaphore> image_available_semaphores;
-    std::vector<VkSemaphore> render_finished_semaphores;
-    std::vector<VkFence> in_flight_fences;
-
-    bool framebuffer_resized = false;
-
     void init_window() {
         glfwInit();
 
@@ -141,183 +147,67 @@ private:
 
     static void framebuffer_resize_callback(GLFWwindow* window, int width, int height) {
         auto app = reinterpret_cast<TriangleApplication*>(glfwGetWindowUserPointer(window));
-        app->framebuffer_resized = true;
+        app->frame_loop.mark_resized();
     }
 
     void init_vulkan() {
+        startup.begin("instance");
         create_instance();
-        create_surface();
-        pick_physical_device();
+        if (!headless) {
+            surface = create_surface(instance.handle(), window, glfwCreateWindowSurface);
+        }
+        startup.begin("device");
+        physical_device = pick_physical_device(instance.handle(), [this](VkPhysicalDevice device) { return is_device_suitable(device); });
         create_logical_device();
-        create_swap_chain();
-        create_image_views();
+        startup.begin("swap_chain");
+        create_command_pool();
+        create_frame_loop();
         create_render_pass();
+        startup.begin("pipelines");
         create_graphics_pipeline();
-        create_framebuffers();
-        create_command_pool();
+        startup.begin("resources");
+        create_swap_chain_resources();
         create_vertex_buffer();
-        create_command_buffers();
-        create_sync_objects();
+        startup.end();
     }
 
     void create_instance() {
-        if (enable_validation_layers && !check_validation_layer_support()) {
-            throw std::runtime_error("vk: validation layers requested, but not available");
-        }
-
-        VkApplicationInfo app_info{};
-        app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        app_info.pApplicationName = "Triangle";
-        app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.pEngineName = "";
-        app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.apiVersion = VK_API_VERSION_1_0;
-
-        VkInstanceCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        create_info.pApplicationInfo = &app_info;
-
-        std::vector<const char*> extensions = get_required_extensions();
-        create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        create_info.ppEnabledExtensionNames = extensions.data();
-
-        VkDebugUtilsMessengerCreateInfoEXT debug_create_info{};
-        if (enable_validation_layers) {
-            create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-            create_info.ppEnabledLayerNames = validation_layers.data();
-
-            populate_debug_messenger_create_info(debug_create_info);
-            create_info.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debug_create_info;
-        }
-        else {
-            create_info.enabledLayerCount = 0;
-            create_info.pNext = nullptr;
-        }
-
-        if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create instance");
-        }
+        // 1.1 for the present wait feature query.
+        instance.init("Triangle", VK_API_VERSION_1_1, required_instance_extensions(headless, glfwGetRequiredInstanceExtensions));
     }
 
-    VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes) {
-        for (const auto& available_present_mode : available_present_modes) {
-            if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return available_present_mode;
-            }
-        }
-
-        return VK_PRESENT_MODE_FIFO_KHR;
-    }
-
-    VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities) {
-        if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-            return capabilities.currentExtent;
-        }
-        else {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
-
-            VkExtent2D actual_extent = {
-                static_cast<uint32_t>(width),
-                static_cast<uint32_t>(height)
-            };
-
-            actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-            actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
-
-            return actual_extent;
-        }
-    }
-
-    void create_swap_chain() {
-        SwapChainSupportDetails swap_chain_support = query_swap_chain_support(physical_device);
-
-        VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
-        VkPresentModeKHR present_mode = choose_swap_present_mode(swap_chain_support.present_modes);
-        VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities);
-
-        uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
-        if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount) {
-            image_count = swap_chain_support.capabilities.maxImageCount;
-        }
-
-        VkSwapchainCreateInfoKHR create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        create_info.surface = surface;
-
-        create_info.minImageCount = image_count;
-        create_info.imageFormat = surface_format.format;
-        create_info.imageColorSpace = surface_format.colorSpace;
-        create_info.imageExtent = extent;
-        create_info.imageArrayLayers = 1;
-        create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
+    void create_frame_loop() {
         QueueFamilyIndices indices = find_queue_families(physical_device);
-        uint32_t queue_family_indices[] = { indices.graphics_family.value(), indices.present_family.value() };
-
-        if (indices.graphics_family != indices.present_family) {
-            create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            create_info.queueFamilyIndexCount = 2;
-            create_info.pQueueFamilyIndices = queue_family_indices;
-        }
-        else {
-            create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        }
-
-        create_info.preTransform = swap_chain_support.capabilities.currentTransform;
-        create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        create_info.presentMode = present_mode;
-        create_info.clipped = VK_TRUE;
-
-        create_info.oldSwapchain = VK_NULL_HANDLE;
 
-        if (vkCreateSwapchainKHR(logical_device, &create_info, nullptr, &swap_chain) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create swap chain");
-        }
-
-        vkGetSwapchainImagesKHR(logical_device, swap_chain, &image_count, nullptr);
-        swap_chain_images.resize(image_count);
-        vkGetSwapchainImagesKHR(logical_device, swap_chain, &image_count, swap_chain_images.data());
-
-        swap_chain_image_format = surface_format.format;
-        swap_chain_extent = extent;
-    }
-
-    void create_image_views() {
-        swap_chain_image_views.resize(swap_chain_images.size());
-
-        for (size_t i = 0; i < swap_chain_images.size(); i++) {
-            VkImageViewCreateInfo create_info{};
-            create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            create_info.image = swap_chain_images[i];
-            create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            create_info.format = swap_chain_image_format;
-            create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-            create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            create_info.subresourceRange.baseMipLevel = 0;
-            create_info.subresourceRange.levelCount = 1;
-            create_info.subresourceRange.baseArrayLayer = 0;
-            create_info.subresourceRange.layerCount = 1;
-
-            if (vkCreateImageView(logical_device, &create_info, nullptr, &swap_chain_image_views[i]) != VK_SUCCESS) {
-                throw std::runtime_error("vk: failed to create image views");
-            }
-        }
+        FrameLoop::Config config{};
+        config.physical_device = physical_device;
+        config.logical_device = logical_device;
+        config.surface = surface;
+        config.graphics_family = indices.graphics_family.value();
+        config.present_family = indices.present_family.value();
+        config.graphics_queue = graphics_queue;
+        config.present_queue = present_queue;
+        config.command_pool = command_pool;
+        config.pacing = pacing;
+        config.present_waiter = &present_waiter;
+        config.profiler = &gpu_profiler;
+        config.headless_extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+        config.wait_for_framebuffer_extent = [this] { return wait_for_framebuffer_extent(); };
+        config.destroy_swap_chain_resources = [this] { cleanup_swap_chain_resources(); };
+        config.create_swap_chain_resources = [this] { create_swap_chain_resources(); };
+        frame_loop.init(config);
     }
 
     void create_render_pass() {
         VkAttachmentDescription color_attachment{};
-        color_attachment.format = swap_chain_image_format;
+        color_attachment.format = frame_loop.image_format();
         color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
         color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        color_attachment.finalLayout = presentable_layout(headless);
 
         VkAttachmentReference color_attachment_ref{};
         color_attachment_ref.attachment = 0;
@@ -351,11 +241,11 @@ private:
     }
 
     void create_graphics_pipeline() {
-        std::vector<char> vert_shader_code = read_file("shaders/vert.spv");
-        std::vector<char> frag_shader_code = read_file("shaders/frag.spv");
+        std::vector<char> vert_shader_code = read_binary_file("shaders/vert.spv");
+        std::vector<char> frag_shader_code = read_binary_file("shaders/frag.spv");
 
-        VkShaderModule vert_shader_module = create_shader_module(vert_shader_code);
-        VkShaderModule frag_shader_module = create_shader_module(frag_shader_code);
+        VkShaderModule vert_shader_module = create_shader_module(logical_device, vert_shader_code);
+        VkShaderModule frag_shader_module = create_shader_module(logical_device, frag_shader_code);
 
         VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
         vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -465,6 +355,7 @@ private:
     }
 
     void create_framebuffers() {
+        const std::vector<VkImageView>& swap_chain_image_views = frame_loop.image_views();
         swap_chain_framebuffers.resize(swap_chain_image_views.size());
 
         for (size_t i = 0; i < swap_chain_image_views.size(); i++) {
@@ -477,8 +368,8 @@ private:
             framebuffer_info.renderPass = render_pass;
             framebuffer_info.attachmentCount = 1;
             framebuffer_info.pAttachments = attachments;
-            framebuffer_info.width = swap_chain_extent.width;
-            framebuffer_info.height = swap_chain_extent.height;
+            framebuffer_info.width = frame_loop.extent().width;
+            framebuffer_info.height = frame_loop.extent().height;
             framebuffer_info.layers = 1;
 
             if (vkCreateFramebuffer(logical_device, &framebuffer_info, nullptr, &swap_chain_framebuffers[i]) != VK_SUCCESS) {
@@ -487,33 +378,14 @@ private:
         }
     }
 
-    void recreate_swap_chain() {
-        int width = 0, height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
-        while (width == 0 || height == 0) {
-            glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
-        }
-
-        vkDeviceWaitIdle(logical_device);
-
-        cleanup_swap_chain();
-
-        create_swap_chain();
-        create_image_views();
+    void create_swap_chain_resources() {
         create_framebuffers();
     }
 
-    void cleanup_swap_chain() {
+    void cleanup_swap_chain_resources() {
         for (auto framebuffer : swap_chain_framebuffers) {
             vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
         }
-
-        for (auto image_view : swap_chain_image_views) {
-            vkDestroyImageView(logical_device, image_view, nullptr);
-        }
-
-        vkDestroySwapchainKHR(logical_device, swap_chain, nullptr);
     }
 
     void create_vertex_buffer() {
@@ -521,14 +393,14 @@ private:
 
         VkBuffer staging_buffer;
         VkDeviceMemory staging_buffer_memory;
-        create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+        buffer_memory_bytes += create_buffer(physical_device, logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
 
         void* data;
         vkMapMemory(logical_device, staging_buffer_memory, 0, buffer_size, 0, &data);
         memcpy(data, vertices.data(), (size_t)buffer_size);
         vkUnmapMemory(logical_device, staging_buffer_memory);
 
-        create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory);
+        buffer_memory_bytes += create_buffer(physical_device, logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory);
 
         copy_buffer(staging_buffer, vertex_buffer, buffer_size);
 
@@ -536,32 +408,6 @@ private:
         vkFreeMemory(logical_device, staging_buffer_memory, nullptr);
     }
 
-    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory) {
-        VkBufferCreateInfo buffer_info{};
-        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        buffer_info.size = size;
-        buffer_info.usage = usage;
-        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        if (vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create buffer");
-        }
-
-        VkMemoryRequirements mem_requirements;
-        vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
-
-        VkMemoryAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        alloc_info.allocationSize = mem_requirements.size;
-        alloc_info.memoryTypeIndex = find_memory_type(mem_requirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to allocate buffer memory");
-        }
-
-        vkBindBufferMemory(logical_device, buffer, buffer_memory, 0);
-    }
-
     void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
         VkCommandBufferAllocateInfo alloc_info{};
         alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -593,54 +439,6 @@ private:
         vkFreeCommandBuffers(logical_device, command_pool, 1, &command_buffer);
     }
 
-    uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties mem_properties;
-        vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
-
-        for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-            if ((type_filter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-
-        throw std::runtime_error("vk: failed to find suitable memory type");
-    }
-
-    void create_command_buffers() {
-        command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
-
-        VkCommandBufferAllocateInfo alloc_info{};
-        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        alloc_info.commandPool = command_pool;
-        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        alloc_info.commandBufferCount = (uint32_t)command_buffers.size();
-
-        if (vkAllocateCommandBuffers(logical_device, &alloc_info, command_buffers.data()) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to allocate command buffers");
-        }
-    }
-
-    void create_sync_objects() {
-        image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-
-        VkSemaphoreCreateInfo semaphore_info{};
-        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-        VkFenceCreateInfo fence_info{};
-        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(logical_device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
-                throw std::runtime_error("vk: failed to create synchronization objects for a frame");
-            }
-        }
-    }
-
     void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index) {
         VkCommandBufferBeginInfo begin_info{};
         begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -654,27 +452,29 @@ private:
         render_pass_info.renderPass = render_pass;
         render_pass_info.framebuffer = swap_chain_framebuffers[image_index];
         render_pass_info.renderArea.offset = { 0, 0 };
-        render_pass_info.renderArea.extent = swap_chain_extent;
+        render_pass_info.renderArea.extent = frame_loop.extent();
 
         VkClearValue clear_color = { {{1.0f, 1.0f, 1.0f, 1.0f}} };
         render_pass_info.clearValueCount = 1;
         render_pass_info.pClearValues = &clear_color;
 
+        GpuProfiler::Scope render_scope = gpu_profiler.begin(command_buffer, "render", graphics_family);
+
         vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
         vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
 
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
-        viewport.width = (float)swap_chain_extent.width;
-        viewport.height = (float)swap_chain_extent.height;
+        viewport.width = (float)frame_loop.extent().width;
+        viewport.height = (float)frame_loop.extent().height;
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
         vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
         VkRect2D scissor{};
         scissor.offset = { 0, 0 };
-        scissor.extent = swap_chain_extent;
+        scissor.extent = frame_loop.extent();
         vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
         VkBuffer vertex_buffers[] = { vertex_buffer };
@@ -684,6 +484,8 @@ private:
         vkCmdDraw(command_buffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
         vkCmdEndRenderPass(command_buffer);
 
+        gpu_profiler.end(command_buffer, render_scope);
+
         if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
             throw std::runtime_error("vk: failed to record command buffer");
         }
@@ -702,141 +504,30 @@ private:
         }
     }
 
-    VkShaderModule create_shader_module(const std::vector<char>& code) {
-        VkShaderModuleCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        create_info.codeSize = code.size();
-        create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-        VkShaderModule shader_module;
-        if (vkCreateShaderModule(logical_device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create shader module");
-        }
-
-        return shader_module;
-    }
-
-    void create_surface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to create window surface");
-        }
-    }
-
-    void populate_debug_messenger_create_info(VkDebugUtilsMessengerCreateInfoEXT& create_info) {
-        create_info = {};
-        create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        create_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        create_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        create_info.pfnUserCallback = debug_callback;
-    }
-
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity, VkDebugUtilsMessageTypeFlagsEXT message_type, const VkDebugUtilsMessengerCallbackDataEXT* callback_data, void* user_data) {
-        std::cerr << "vk: validation layer " << callback_data->pMessage << std::endl;
-        return VK_FALSE;
-    }
-
-    bool check_validation_layer_support() {
-        uint32_t layer_count;
-        vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-
-        std::vector<VkLayerProperties> available_layers(layer_count);
-        vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
-
-        for (const char* layer_name : validation_layers) {
-            bool layer_found = false;
-
-            for (const auto& layer_properties : available_layers) {
-                if (strcmp(layer_name, layer_properties.layerName) == 0) {
-                    layer_found = true;
-                    break;
-                }
-            }
-
-            if (!layer_found) {
-                return false;
-            }
-        }
-
-        return true;
-    }
-
-    std::vector<const char*> get_required_extensions() {
-        uint32_t glfw_extension_count = 0;
-        const char** glfw_extensions;
-        glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-
-        std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
-
-        if (enable_validation_layers) {
-            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-        }
-
-        return extensions;
-    }
-
-    void pick_physical_device() {
-        uint32_t device_count = 0;
-        vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
-
-        if (device_count == 0) {
-            throw std::runtime_error("vk: failed to find GPUs with Vulkan support");
-        }
-
-        std::vector<VkPhysicalDevice> devices(device_count);
-        vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
-
-        for (const auto& device : devices) {
-            if (is_device_suitable(device)) {
-                physical_device = device;
-                break;
-            }
-        }
-
-        if (physical_device == VK_NULL_HANDLE) {
-            throw std::runtime_error("vk: failed to find a suitable GPU");
+    // Waits for events while the window is minimized.
+    VkExtent2D wait_for_framebuffer_extent() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        while (width == 0 || height == 0) {
+            glfwGetFramebufferSize(window, &width, &height);
+            glfwWaitEvents();
         }
+        return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
     }
 
     bool is_device_suitable(VkPhysicalDevice device) {
         QueueFamilyIndices indices = find_queue_families(device);
 
-        bool extensions_supported = check_device_extension_support(device);
+        bool extensions_supported = supports_device_extensions(device, required_device_extensions(headless));
 
-        bool swap_chain_adequate = false;
-        if (extensions_supported) {
-            SwapChainSupportDetails swap_chain_support = query_swap_chain_support(device);
-            swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+        bool swap_chain_adequate = headless;
+        if (extensions_supported && !headless) {
+            swap_chain_adequate = query_swap_chain_support(device, surface).is_adequate();
         }
 
         return indices.is_complete() && extensions_supported && swap_chain_adequate;
     }
 
-    VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats) {
-        for (const auto& available_format : available_formats) {
-            if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-                return available_format;
-            }
-        }
-
-        return available_formats[0];
-    }
-
-    bool check_device_extension_support(VkPhysicalDevice device) {
-        uint32_t extension_count;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
-
-        std::vector<VkExtensionProperties> available_extensions(extension_count);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
-
-        std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
-
-        for (const auto& extension : available_extensions) {
-            required_extensions.erase(extension.extensionName);
-        }
-
-        return required_extensions.empty();
-    }
-
     QueueFamilyIndices find_queue_families(VkPhysicalDevice device) {
         QueueFamilyIndices indices;
 
@@ -852,10 +543,7 @@ private:
                 indices.graphics_family = i;
             }
 
-            VkBool32 present_support = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
-
-            if (present_support) {
+            if (supports_present(headless, device, i, queue_family, surface)) {
                 indices.present_family = i;
             }
 
@@ -898,12 +586,20 @@ private:
 
         create_info.pEnabledFeatures = &device_features;
 
-        create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-        create_info.ppEnabledExtensionNames = device_extensions.data();
+        std::vector<const char*> enabled_extensions = required_device_extensions(headless);
+        bool use_present_wait = !headless && pacing.low_latency && PresentWaiter::is_supported(physical_device);
+        if (use_present_wait) {
+            const auto& present_wait_extensions = PresentWaiter::device_extensions();
+            enabled_extensions.insert(enabled_extensions.end(), present_wait_extensions.begin(), present_wait_extensions.end());
+            create_info.pNext = present_waiter.device_create_next(create_info.pNext);
+        }
+
+        create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions.size());
+        create_info.ppEnabledExtensionNames = enabled_extensions.data();
 
-        if (enable_validation_layers) {
-            create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
-            create_info.ppEnabledLayerNames = validation_layers.data();
+        if (instance.is_validation_enabled()) {
+            create_info.enabledLayerCount = static_cast<uint32_t>(VulkanInstance::validation_layers().size());
+            create_info.ppEnabledLayerNames = VulkanInstance::validation_layers().data();
         }
         else {
             create_info.enabledLayerCount = 0;
@@ -915,34 +611,16 @@ private:
 
         vkGetDeviceQueue(logical_device, indices.graphics_family.value(), 0, &graphics_queue);
         vkGetDeviceQueue(logical_device, indices.present_family.value(), 0, &present_queue);
-    }
-
-    SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device) {
-        SwapChainSupportDetails details;
+        graphics_family = indices.graphics_family.value();
 
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-
-        uint32_t format_count;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, nullptr);
-
-        if (format_count != 0) {
-            details.formats.resize(format_count);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, details.formats.data());
-        }
-
-        uint32_t present_mode_count;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, nullptr);
-
-        if (present_mode_count != 0) {
-            details.present_modes.resize(present_mode_count);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, details.present_modes.data());
-        }
-
-        return details;
+        present_waiter.init(logical_device, use_present_wait);
+        gpu_profiler.init(physical_device, logical_device, frames_in_flight, "", false);
     }
 
     void main_loop() {
         while (!glfwWindowShouldClose(window)) {
+            // In low-latency mode input is only sampled once the previous frame is on screen.
+            present_waiter.wait_for_last_present();
             glfwPollEvents();
             draw_frame();
         }
@@ -951,68 +629,14 @@ private:
     }
 
     void draw_frame() {
-        vkWaitForFences(logical_device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
-
-        uint32_t image_index;
-        VkResult result = vkAcquireNextImageKHR(logical_device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            recreate_swap_chain();
-            return;
-        }
-        else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-            throw std::runtime_error("vk: failed to acquire swap chain image");
-        }
-
-        vkResetFences(logical_device, 1, &in_flight_fences[current_frame]);
-
-        vkResetCommandBuffer(command_buffers[current_frame], 0);
-        record_command_buffer(command_buffers[current_frame], image_index);
-
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-        VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame] };
-        VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        submit_info.waitSemaphoreCount = 1;
-        submit_info.pWaitSemaphores = wait_semaphores;
-        submit_info.pWaitDstStageMask = wait_stages;
-
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &command_buffers[current_frame];
-
-        VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame] };
-        submit_info.signalSemaphoreCount = 1;
-        submit_info.pSignalSemaphores = signal_semaphores;
-
-        if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to submit draw command buffer");
-        }
-
-        VkPresentInfoKHR present_info{};
-        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-
-        present_info.waitSemaphoreCount = 1;
-        present_info.pWaitSemaphores = signal_semaphores;
-
-        VkSwapchainKHR swap_chains[] = { swap_chain };
-        present_info.swapchainCount = 1;
-        present_info.pSwapchains = swap_chains;
-        present_info.pImageIndices = &image_index;
-
-        result = vkQueuePresentKHR(present_queue, &present_info);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized) {
-            framebuffer_resized = false;
-            recreate_swap_chain();
-        }
-        else if (result != VK_SUCCESS) {
-            throw std::runtime_error("vk: failed to present swap chain image");
-        }
-
-        current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+        frame_loop.draw_frame([this](VkCommandBuffer command_buffer, uint32_t, uint32_t image_index) {
+            record_command_buffer(command_buffer, image_index);
+        });
     }
 
     void cleanup() {
-        cleanup_swap_chain();
+        cleanup_swap_chain_resources();
+        frame_loop.cleanup();
 
         vkDestroyPipeline(logical_device, graphics_pipeline, nullptr);
         vkDestroyPipelineLayout(logical_device, pipeline_layout, nullptr);
@@ -1021,45 +645,35 @@ private:
         vkDestroyBuffer(logical_device, vertex_buffer, nullptr);
         vkFreeMemory(logical_device, vertex_buffer_memory, nullptr);
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(logical_device, render_finished_semaphores[i], nullptr);
-            vkDestroySemaphore(logical_device, image_available_semaphores[i], nullptr);
-            vkDestroyFence(logical_device, in_flight_fences[i], nullptr);
-        }
-
         vkDestroyCommandPool(logical_device, command_pool, nullptr);
+        gpu_profiler.cleanup();
         vkDestroyDevice(logical_device, nullptr);
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
-
-        glfwDestroyWindow(window);
-        glfwTerminate();
-    }
-
-    static std::vector<char> read_file(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary | std::ios::ate);
-
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to open file.");
+        if (!headless) {
+            vkDestroySurfaceKHR(instance.handle(), surface, nullptr);
         }
+        instance.cleanup();
 
-        size_t file_size = (size_t)file.tellg();
-        std::vector<char> buffer(file_size);
-
-        file.seekg(0);
-        file.read(buffer.data(), file_size);
-
-        file.close();
-
-        return buffer;
+        if (!headless) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
     }
 };
 
-int main() {
-    TriangleApplication app;
-
+int main(int argc, char** argv) {
     try {
-        app.run();
+        FramePacing pacing = FramePacing::from_command_line(argc, argv);
+        BenchmarkSettings benchmark = BenchmarkSettings::from_command_line(argc, argv);
+        if (benchmark.enabled) {
+            BenchmarkReport report("Triangle");
+            TriangleApplication app;
+            report.add_run(app.run_benchmark(pacing, benchmark));
+            report.write(benchmark.output_path);
+        }
+        else {
+            TriangleApplication app;
+            app.run(pacing);
+        }
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;